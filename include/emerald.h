@@ -15,6 +15,7 @@
 #include <emerald/hash.h>
 #include <emerald/path.h>
 #include <emerald/log.h>
+#include <emerald/source.h>
 #include <emerald/refobj.h>
 #include <emerald/main.h>
 #include <emerald/file.h>
@@ -25,6 +26,7 @@
 #include <emerald/value.h>
 #include <emerald/object.h>
 #include <emerald/context.h>
+#include <emerald/script.h>
 #include <emerald/string.h>
 #include <emerald/map.h>
 #include <emerald/list.h>
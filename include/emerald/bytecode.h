@@ -20,10 +20,18 @@ struct em_context;
 typedef enum em_code_type {
 	EM_CODE_TYPE_TREE = 0,
 	EM_CODE_TYPE_BINARY,
+	EM_CODE_TYPE_REGISTER,
 
 	EM_CODE_TYPE_COUNT,
 } em_code_type_t;
 
+/* bytecode format version (bump when encoding changes) */
+#define EM_CODE_VERSION 8
+
+#ifndef EM_CODE_TIER_THRESHOLD
+ #define EM_CODE_TIER_THRESHOLD 1000 /* calls and loop iterations before tree code is compiled */
+#endif
+
 /* bytecode operations */
 typedef enum em_code_op {
 	EM_CODE_OP_PCINT = 1, /* push int constant */
@@ -71,13 +79,10 @@ typedef enum em_code_op {
 	EM_CODE_OP_JNTR, /* jump if not true */
 	EM_CODE_OP_JPNTR, /* jump and push none if not true */
 	EM_CODE_OP_CALL, /* call value */
-	EM_CODE_OP_SAVE1, /* save level-1 context (error) */
-	EM_CODE_OP_SAVE3, /* save level-3 context (loop) */
-	EM_CODE_OP_RSTR1, /* restore level-1 context (error) */
-	EM_CODE_OP_RSTR2, /* restore level-2 context (call) */
-	EM_CODE_OP_RSTR3, /* restore level-3 context (loop) */
-	EM_CODE_OP_DSCD1, /* discard level-1 context (error) */
-	EM_CODE_OP_DSCD3, /* discard level-3 context (loop) */
+	EM_CODE_OP_HTAB, /* handler table (skipped when run) */
+	EM_CODE_OP_RSTR1, /* unwind to level-1 handler (error) */
+	EM_CODE_OP_RSTR2, /* unwind out of slice (return) */
+	EM_CODE_OP_RSTR3, /* unwind to level-3 handler (loop) */
 
 	EM_CODE_OP_DCLS, /* define class */
 	EM_CODE_OP_DFUNC, /* define function */
@@ -89,17 +94,72 @@ typedef enum em_code_op {
 	EM_CODE_OP_INCLUDE, /* include file */
 	EM_CODE_OP_BLTJXPIPI, /* kind of hard to explain */
 	EM_CODE_OP_LEN, /* get length of value (doesn't pop value) */
-	EM_CODE_OP_R1EISNTP, /* restore level-1 context if error is not type, or push error */
+	EM_CODE_OP_R1EISNTP, /* unwind to level-1 handler if error is not type, or push error */
+
+	/* superinstructions (emitted by peephole optimizer) */
+	EM_CODE_OP_ESETLC, /* set line and column */
+	EM_CODE_OP_STORP, /* store variable and pop value */
+	EM_CODE_OP_LADDI, /* load variable and add int constant */
+	EM_CODE_OP_JNLT, /* compare ordering (less) and jump if not true */
+	EM_CODE_OP_JNGT, /* compare ordering (greater) and jump if not true */
+	EM_CODE_OP_JNEQ, /* compare equality and jump if not true */
+	EM_CODE_OP_JNNEQ, /* compare notted equality and jump if not true */
+
+	/* int-specialized operations (rewritten in place by the interpreter) */
+	EM_CODE_OP_BADDII, /* add ints */
+	EM_CODE_OP_BSUBII, /* subtract ints */
+	EM_CODE_OP_BMULII, /* multiply ints */
+	EM_CODE_OP_BEQII, /* compare equality of ints */
+	EM_CODE_OP_BNEQII, /* compare notted equality of ints */
+	EM_CODE_OP_BLTII, /* compare ordering of ints (less) */
+	EM_CODE_OP_BGTII, /* compare ordering of ints (greater) */
+	EM_CODE_OP_LADDII, /* load int variable and add int constant */
+	EM_CODE_OP_JNLTII, /* compare ordering of ints (less) and jump if not true */
+	EM_CODE_OP_JNGTII, /* compare ordering of ints (greater) and jump if not true */
+	EM_CODE_OP_JNEQII, /* compare equality of ints and jump if not true */
+	EM_CODE_OP_JNNEQII, /* compare notted equality of ints and jump if not true */
+
+	/* counted loops */
+	EM_CODE_OP_FORPREP, /* check bounds of counted loop and set iterator */
+	EM_CODE_OP_FORLOOP, /* step counted loop and jump if not done */
+
+	EM_CODE_OP_TCALL, /* call value in place of function and return */
 
 	EM_CODE_OP_COUNT,
 } em_code_op_t;
 
+/*
+ * Slices with loops or try statements start with a table of handlers
+ * instead of saving and restoring them as they run. An instruction that
+ * unwinds continues at the first handler of its level whose range covers
+ * it, with the stack cut back to the depth the range started at and the
+ * unwinding value pushed. Inner statements come before the statements that
+ * contain them. Entries are encoded as start, end and handler (uint32),
+ * depth (uint16) and level (uint8).
+ */
+typedef struct em_code_handler {
+	uint32_t start; /* position of first instruction covered */
+	uint32_t end; /* position after last instruction covered */
+	uint32_t handler; /* position to continue at */
+	uint16_t depth; /* stack depth at start of range (set by verifier) */
+	uint8_t level; /* 1 = error, 3 = loop */
+} em_code_handler_t;
+
+#define EM_CODE_HANDLER_SIZE 15 /* encoded size of handler */
+
 /* portion of bytecode */
 typedef struct em_code_slice {
 	void *data; /* start of bytecode data */
 	size_t position; /* position in bytecode data */
 	size_t length; /* length of bytecode data */
+	size_t capacity; /* allocated size while compiling, or 0 */
+	size_t max_stack; /* deepest value stack use (set by verifier, 0 if not verified) */
 	em_code_op_t mode; /* CALL, RSTR1, RSTR2 or RSTR3 */
+	uint32_t hotness; /* loop back-edges taken by interpreter */
+	void *jit; /* native code (see jit.h) */
+#ifdef EM_PROFILE
+	void *profile; /* execution counts (see profile.h) */
+#endif
 } em_code_slice_t;
 
 /* code object */
@@ -110,12 +170,14 @@ typedef struct em_code {
 		em_node_t *tree; /* tree-walker node */
 		em_code_slice_t binary; /* bytecode slice */
 	};
+	uint32_t hotness; /* calls and loop iterations while tree-walked */
+	em_tree_t *source_tree; /* tree of tree code (kept once promoted, for names and error lines) */
 	char path[]; /* file path */
 } em_code_t;
 
 #define EM_CODE(p) ((em_code_t *)(p))
 
-EM_API em_reflist_t em_reflist_code;
+EM_API EM_THREAD_LOCAL em_reflist_t em_reflist_code;
 
 #define EM_CODE_INCREF(p) EM_CODE(em_refobj_incref(EM_REFOBJ(p)))
 #define EM_CODE_DECREF(p) em_refobj_decref(EM_REFOBJ(p))
@@ -124,6 +186,8 @@ EM_API em_reflist_t em_reflist_code;
 typedef struct em_code_compiler {
 	em_pos_t pos;
 	em_code_slice_t *slice;
+	size_t nhandlers; /* handlers written to table */
+	size_t maxhandlers; /* size of handler table */
 } em_code_compiler_t;
 
 #define EM_CODE_COMPILER_INIT ((em_code_compiler_t){0})
@@ -132,6 +196,9 @@ typedef struct em_code_compiler {
 EM_API em_code_t *em_code_new_node(em_node_t *node, const char *path); /* create code object with node */
 EM_API em_code_t *em_code_new_binary(em_code_slice_t binary, const char *path); /* create code object with bytecode slice */
 EM_API em_value_t em_code_run(em_code_t *code, struct em_context *context); /* run code */
+EM_API em_bool_t em_code_is_compilable(em_node_t *node); /* check if node only uses operations supported by the vm */
+EM_API em_result_t em_code_compile(em_code_slice_t *slice, em_node_t *node); /* compile and optimize node */
+EM_API em_value_t em_code_run_node(struct em_context *context, em_node_t *node); /* compile node and run it in the vm */
 
 EM_API void em_code_write_uint8(em_code_slice_t *slice, uint8_t value); /* write uint8 value */
 EM_API void em_code_write_uint16(em_code_slice_t *slice, uint16_t value); /* write uint16 value */
@@ -163,9 +230,14 @@ EM_API em_floattype_t em_code_read_floattype(em_code_slice_t *slice); /* read em
 EM_API const char *em_code_read_string(em_code_slice_t *slice); /* read string */
 EM_API const char *em_code_read_hashed_string(em_code_slice_t *slice, em_hash_t *hash); /* read string with hash */
 
-EM_API size_t em_code_get_size(em_code_compiler_t *compiler, em_node_t *node); /* predict final size of node (useful for branches) */
 EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node); /* write node */
 EM_API void em_code_disassemble(em_code_slice_t *slice, FILE *fp); /* disassemble generated code */
+EM_API em_bool_t em_code_disassemble_inst(em_code_slice_t *slice, FILE *fp); /* disassemble instruction at current position */
+EM_API const char *em_code_get_op_name(em_code_op_t op); /* get name of operation */
+EM_API size_t em_code_get_inst_size(em_code_slice_t *slice, size_t pos); /* get size of instruction at position (0 if invalid) */
+EM_API size_t em_code_get_handler_count(em_code_slice_t *slice); /* get number of handlers in table */
+EM_API void em_code_get_handler(em_code_slice_t *slice, size_t index, em_code_handler_t *handler); /* decode handler from table */
+EM_API void em_code_set_handler(em_code_slice_t *slice, size_t index, const em_code_handler_t *handler); /* encode handler into table */
 
 EM_API em_value_t em_code_run_slice(struct em_context *context, em_code_slice_t *slice); /* run code slice */
 EM_API void em_code_run_inst(struct em_context *context, em_code_slice_t *slice); /* run single instruction */
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * On-disk bytecode cache
+ */
+#ifndef EMERALD_CACHE_H
+#define EMERALD_CACHE_H
+
+#include <emerald/core.h>
+#include <emerald/bytecode.h>
+
+#define EM_CODE_CACHE_MAGIC "EMC\x1b"
+#define EM_CODE_CACHE_EXT ".emc"
+
+/* cache file header */
+typedef struct em_code_cache_header {
+	char magic[4]; /* EM_CODE_CACHE_MAGIC */
+	uint32_t version; /* EM_CODE_VERSION of compiler */
+	uint32_t abi; /* sizes of int/float types and byte order */
+	uint32_t reserved; /* always zero */
+	uint64_t hash; /* hash of source file contents */
+	uint64_t size; /* size of source file */
+	uint64_t length; /* length of bytecode following header */
+} em_code_cache_header_t;
+
+/* loaded cache file */
+typedef struct em_code_cache {
+	void *map; /* mapped or allocated file data */
+	size_t size; /* size of file data */
+	em_bool_t mapped; /* data is memory mapped */
+} em_code_cache_t;
+
+#define EM_CODE_CACHE_INIT ((em_code_cache_t){NULL})
+
+/* functions */
+EM_API em_result_t em_code_cache_get_path(char *buf, size_t cnt, const char *path); /* get cache file path for source file */
+EM_API em_result_t em_code_cache_load(em_code_cache_t *cache, em_code_slice_t *slice, const char *path, const char *text, size_t len); /* load cached bytecode for source file */
+EM_API em_result_t em_code_cache_store(em_code_slice_t *slice, const char *path, const char *text, size_t len); /* write bytecode cache for source file */
+EM_API void em_code_cache_release(em_code_cache_t *cache); /* release loaded cache file */
+
+#endif /* EMERALD_CACHE_H */
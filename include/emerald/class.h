@@ -23,7 +23,7 @@ typedef struct em_method {
 /* class */
 typedef struct em_class {
 	em_object_t base;
-	em_node_t *node; /* class node */
+	em_node_t *node; /* class node (its tree is held for the name) */
 	const char *name; /* class name */
 	em_value_t clsbase; /* base class */
 	em_value_t map; /* value map */
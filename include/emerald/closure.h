@@ -0,0 +1,17 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Handlers bound to tree nodes for the tree-walker
+ */
+#ifndef EMERALD_CLOSURE_H
+#define EMERALD_CLOSURE_H
+
+#include <emerald/core.h>
+#include <emerald/node.h>
+
+/* functions */
+EM_API void em_closure_compile(em_node_t *node); /* bind handlers and operands of nodes in tree */
+
+#endif /* EMERALD_CLOSURE_H */
@@ -11,15 +11,46 @@
 #include <emerald/parser.h>
 #include <emerald/value.h>
 #include <emerald/bytecode.h>
+#include <emerald/cache.h>
+#include <emerald/function.h>
 
-/* context */
+/*
+ * The scope and value stacks start small and grow geometrically
+ * up to their maximums. They shrink again once they are less than a quarter
+ * full, so deep recursion doesn't keep its memory around. Calls nest on the
+ * native stack as well, so pushing a scope also fails once most of the
+ * native stack of the current thread is used (see em_context_push_scope).
+ */
 #define EM_CONTEXT_MAX_DIRS 32
-#define EM_CONTEXT_MAX_SCOPE 128
-#define EM_CONTEXT_MAX_STACK 1024
+#define EM_CONTEXT_MIN_SCOPE 16 /* initial size of scope stack */
+#ifndef EM_CONTEXT_MAX_SCOPE
+ #define EM_CONTEXT_MAX_SCOPE 65536
+#endif
+#ifndef EM_CONTEXT_NATIVE_STACK
+ #define EM_CONTEXT_NATIVE_STACK 1048576 /* size of native stack if the system doesn't give one */
+#endif
+#define EM_CONTEXT_MIN_STACK 64 /* initial size of value stack */
+#ifndef EM_CONTEXT_MAX_STACK
+ #define EM_CONTEXT_MAX_STACK 1048576
+#endif
+
+/*
+ * Break, continue and return statements leave the statements they are in
+ * by failing with a signal set in the context, rather than by raising an
+ * error. The loop or call that they end clears the signal. A signal that
+ * gets past all of them becomes an error (see em_context_raise_signal).
+ */
+typedef enum em_signal {
+	EM_SIGNAL_NONE = 0,
+	EM_SIGNAL_BREAK,
+	EM_SIGNAL_CONTINUE,
+	EM_SIGNAL_RETURN,
+} em_signal_t;
 
 typedef struct em_recfile {
 	struct em_recfile *next; /* next entry */
 	em_code_slice_t slice; /* bytecode slice */
+	em_code_cache_t cache; /* cache file backing slice, if any */
 	char rpath[]; /* real file path */
 } em_recfile_t;
 
@@ -30,23 +61,33 @@ typedef struct em_context {
 	em_parser_t parser; /* local parser */
 	const char *dirstack[EM_CONTEXT_MAX_DIRS]; /* directory stack */
 	size_t ndirstack; /* number of directories in stack */
-	em_value_t scopestack[EM_CONTEXT_MAX_SCOPE]; /* scope stack */
+	char *path_env; /* copy of EM_PATH split into directories */
+	em_value_t *scopestack; /* scope stack (maps above the top are kept for reuse, or fail) */
 	size_t nscopestack; /* number of scopes in stack */
+	size_t scopestack_size; /* allocated size of scope stack */
 	em_recfile_t *rec_first; /* first run file */
 	em_recfile_t *rec_last; /* last run file */
 	em_value_t pass; /* value to pass down for return statement */
+	em_signal_t signal; /* pending break, continue or return */
+	em_pos_t signal_pos; /* position of statement that sent signal */
+	em_value_t tail_call; /* function to run in place of returning, or fail (see function.c) */
+	em_value_t tail_args[EM_FUNCTION_MAX_ARGUMENTS]; /* arguments of tail call (referenced) */
+	size_t tail_nargs; /* number of arguments of tail call */
+	em_pos_t tail_pos; /* position of tail call */
 	em_code_type_t mode; /* tree-walker or bytecode vm */
-	em_value_t stack[EM_CONTEXT_MAX_STACK]; /* value stack */
+	em_value_t *stack; /* value stack */
 	size_t sp; /* stack position */
-	struct {
-		uint32_t level; /* 1 = error, 2 = call, 3 = loop */
-		size_t pos; /* position in respective slice */
-		size_t sp; /* stack position */
-	} cstack[EM_CONTEXT_MAX_STACK]; /* saved context stack */
-	size_t csp; /* context stack position */
+	size_t stack_size; /* allocated size of value stack */
+	size_t stack_reserved; /* stack position that running code may push up to */
 	em_code_op_t op_mode; /* operation mode */
 	em_pos_t op_pos; /* current position */
 	size_t file_level; /* depth in files */
+	em_bool_t use_cache; /* load and store bytecode cache files */
+	em_bool_t fold; /* fold constants and prune dead branches before running */
+	em_bool_t use_jit; /* compile hot bytecode to native code (if built with EM_JIT) */
+	em_bool_t tier; /* compile hot tree-walked functions and loops to bytecode */
+	em_bool_t profile; /* count and time bytecode instructions (if built with EM_PROFILE) */
+	em_code_t *code; /* code object being tree-walked */
 } em_context_t;
 
 #define EM_CONTEXT_INIT ((em_context_t){EM_FALSE})
@@ -55,16 +96,25 @@ typedef struct em_context {
 EM_API em_context_t *em_context_new(const char **argv); /* create context */
 EM_API em_result_t em_context_init(em_context_t *context, const char **argv); /* initialize context */
 EM_API em_value_t em_context_run_text(em_context_t *context, const char *path, const char *text, em_ssize_t len); /* run code */
+EM_API em_value_t em_context_run_slice(em_context_t *context, const char *path, em_code_slice_t *slice); /* run compiled bytecode of file */
+EM_API void em_context_leave_file(em_context_t *context); /* leave file, raising signals that leave the outermost one */
 EM_API const char *em_context_pushdir(em_context_t *context, const char *path); /* push directory to stack */
 EM_API const char *em_context_resolve(em_context_t *context, const char *path); /* resolve file path */
 EM_API const char *em_context_popdir(em_context_t *context); /* pop directory from stack */
+EM_API size_t em_context_get_stack_size(void); /* get size of native stack that threads are given by default */
 EM_API em_result_t em_context_push_scope(em_context_t *context); /* push scope to stack */
 EM_API void em_context_pop_scope(em_context_t *context); /* pop scope from stack */
+EM_API void em_context_set_tail_call(em_context_t *context, em_value_t call, em_value_t *args, size_t nargs, em_pos_t *pos); /* save call to run in place of function and return */
+EM_API void em_context_drop_tail_call(em_context_t *context); /* drop pending tail call */
+EM_API em_value_t em_context_signal(em_context_t *context, em_signal_t signal, const em_pos_t *pos); /* send signal to enclosing loop or call */
+EM_API em_bool_t em_context_catch_signal(em_context_t *context, em_signal_t signal); /* clear signal if it is pending */
+EM_API void em_context_raise_signal(em_context_t *context); /* raise pending signal as error */
 EM_API void em_context_set_value(em_context_t *context, em_hash_t key, em_value_t value); /* set value in current scope */
 EM_API em_value_t em_context_get_value(em_context_t *context, em_hash_t key); /* get value from current scope */
-EM_API void em_context_push_value(em_context_t *context, em_value_t value); /* push value to stack */
+EM_API em_result_t em_context_reserve_stack(em_context_t *context, size_t count); /* make room for values above top of stack */
+EM_API void em_context_trim_stack(em_context_t *context, size_t reserved); /* restore previous reservation and shrink value stack */
+EM_API em_result_t em_context_push_value(em_context_t *context, em_value_t value); /* push value to stack */
 EM_API em_value_t em_context_pop_value(em_context_t *context); /* pop value from stack */
-EM_API void em_context_push_context(em_context_t *context, uint32_t level, size_t pos, size_t sp); /* save context to context stack */
 EM_API em_value_t em_context_run_file(em_context_t *context, em_pos_t *pos, const char *path); /* run code from file */
 
 EM_API em_value_t em_context_visit(em_context_t *context, em_node_t *node); /* visit node */
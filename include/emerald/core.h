@@ -39,6 +39,19 @@
 
 #define EM_INLINE static inline
 
+/*
+ * Each thread that runs contexts has its own objects, error state and
+ * scratch buffers (see em_thread_init). The default model is used so the
+ * library can still be loaded with dlopen.
+ */
+#if defined __GNUC__
+ #define EM_THREAD_LOCAL __thread
+#elif defined _MSC_VER
+ #define EM_THREAD_LOCAL __declspec(thread)
+#else
+ #define EM_THREAD_LOCAL _Thread_local
+#endif
+
 /* result */
 typedef enum em_result {
 	EM_RESULT_SUCCESS = 0,
@@ -77,6 +90,13 @@ typedef long em_inttype_t;
 
 #define EM_INTTYPE_FORMAT "%ld"
 
+/* int arithmetic that wraps around on overflow (signed overflow is undefined) */
+typedef unsigned long em_uinttype_t;
+
+#define EM_INTTYPE_ADD(a, b) ((em_inttype_t)((em_uinttype_t)(a) + (em_uinttype_t)(b)))
+#define EM_INTTYPE_SUB(a, b) ((em_inttype_t)((em_uinttype_t)(a) - (em_uinttype_t)(b)))
+#define EM_INTTYPE_MUL(a, b) ((em_inttype_t)((em_uinttype_t)(a) * (em_uinttype_t)(b)))
+
 typedef double em_floattype_t;
 
 #define EM_FLOATTYPE_FORMAT "%lg"
@@ -0,0 +1,17 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Constant folding
+ */
+#ifndef EMERALD_FOLD_H
+#define EMERALD_FOLD_H
+
+#include <emerald/core.h>
+#include <emerald/node.h>
+
+/* functions */
+EM_API void em_node_fold(em_node_t *node); /* fold constant expressions and prune dead branches in tree */
+
+#endif /* EMERALD_FOLD_H */
@@ -23,13 +23,19 @@ typedef struct em_builtin_function {
 
 #define EM_BUILTIN_FUNCTION(p) ((em_builtin_function_t *)(p))
 
+/* function parameter */
+typedef struct em_function_param {
+	const char *name; /* parameter name */
+	em_hash_t hash; /* hash of name */
+} em_function_param_t;
+
 /* function */
 typedef struct em_function {
 	em_object_t base;
 	em_code_t *body; /* code of function body */
 	const char *name; /* function name */
-	size_t nargnames; /* number of argument names */
-	const char *argnames[]; /* argument names */
+	size_t nparams; /* number of parameters */
+	em_function_param_t params[]; /* parameters (hashed when function is created) */
 } em_function_t;
 
 #define EM_FUNCTION(p) ((em_function_t *)(p))
@@ -37,6 +43,7 @@ typedef struct em_function {
 /* functions */
 EM_API em_value_t em_builtin_function_new(const char *name, em_builtin_function_handler_t handler); /* create builtin function */
 EM_API em_value_t em_function_new(em_code_t *body, const char *name, size_t nargnames, const char **argnames); /* create function */
+EM_API em_value_t em_function_call_bound(struct em_context *context, em_value_t v, em_value_t binding, em_value_t *args, size_t nargs, em_pos_t *pos); /* call function with value bound to first parameter */
 
 EM_API em_bool_t em_is_builtin_function(em_value_t v); /* check if value is builtin function */
 EM_API em_bool_t em_is_function(em_value_t v); /* check if value is function */
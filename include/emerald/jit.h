@@ -0,0 +1,30 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Baseline JIT compiler for bytecode
+ */
+#ifndef EMERALD_JIT_H
+#define EMERALD_JIT_H
+
+#include <emerald/core.h>
+#include <emerald/bytecode.h>
+
+struct em_context;
+
+/* native code is only generated for x86-64 unix systems */
+#if defined EM_JIT && defined EM_UNIX && (defined __x86_64__ || defined _M_X64)
+ #define EM_JIT_ENABLED
+#endif
+
+#ifndef EM_JIT_THRESHOLD
+ #define EM_JIT_THRESHOLD 1000 /* loop back-edges taken before a slice is compiled */
+#endif
+
+/* functions */
+EM_API em_bool_t em_jit_compile(em_code_slice_t *slice); /* compile slice to native code */
+EM_API em_bool_t em_jit_run(struct em_context *context, em_code_slice_t *slice); /* run native code from current position */
+EM_API void em_jit_free(em_code_slice_t *slice); /* free native code of slice */
+
+#endif /* EMERALD_JIT_H */
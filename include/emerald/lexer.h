@@ -7,25 +7,41 @@
 #define EMERALD_LEXER_H
 
 #include <emerald/core.h>
+#include <emerald/source.h>
 #include <emerald/token.h>
 
+/* position of lexer in text */
+typedef struct em_cursor {
+	em_pos_t pos; /* line and column of current character */
+	const char *text; /* file contents */
+	em_ssize_t len; /* length of text */
+	em_ssize_t index; /* index into file contents */
+	em_ssize_t lastchsz; /* size of last character in bytes */
+	int cc; /* current character */
+} em_cursor_t;
+
+#define EM_CURSOR_INIT ((em_cursor_t){EM_POS_INIT, NULL, 0, -1, 1, 0})
+
 /* lexer */
 typedef struct em_lexer {
 	em_bool_t init; /* initialized */
-	em_pos_t pos; /* position in file/text */
-	em_pos_t initial_pos; /* initial position */
-	em_token_t *first; /* first token */
-	em_token_t *last; /* last token */
+	em_cursor_t cur; /* position in file/text */
+	em_source_t *source; /* source of current text */
+	em_token_t *token; /* token being made */
+	em_token_t *eof; /* end of file given out after an error */
+	em_token_type_t last_type; /* type of last token given out */
+	em_bool_t error; /* error raised while making a token */
 } em_lexer_t;
 
 #define EM_LEXER_INIT ((em_lexer_t){EM_FALSE})
 
 /* functions */
 EM_API em_result_t em_lexer_init(em_lexer_t *lexer); /* initialize lexer */
-EM_API void em_lexer_reset(em_lexer_t *lexer, const char *path, const char *text, em_ssize_t len); /* reset lexer */
+EM_API em_result_t em_lexer_reset(em_lexer_t *lexer, const char *path, const char *text, em_ssize_t len); /* reset lexer */
 EM_API em_token_t *em_lexer_add_token_full(em_lexer_t *lexer, em_token_type_t type, em_pos_t *pos, const char *value, size_t len); /* add token with length specified */
 EM_API em_token_t *em_lexer_add_token(em_lexer_t *lexer, em_token_type_t type, em_pos_t *pos, const char *value); /* add token */
-EM_API em_result_t em_lexer_make_tokens(em_lexer_t *lexer); /* generate tokens from input text */
+EM_API em_token_t *em_lexer_next(em_lexer_t *lexer); /* get next token from input text */
+EM_API em_result_t em_lexer_make_token(em_lexer_t *lexer); /* make next token from input text */
 EM_API em_result_t em_lexer_make_number(em_lexer_t *lexer); /* make numeric token */
 EM_API em_result_t em_lexer_make_identifier(em_lexer_t *lexer); /* make identifier or keyword token */
 EM_API em_result_t em_lexer_make_string(em_lexer_t *lexer); /* make string token */
@@ -26,30 +26,23 @@ EM_API em_log_level_t em_log_hide_level;
 /* error position */
 typedef struct em_pos {
 	const char *path; /* file path */
-	const char *text; /* file contents */
-	em_ssize_t len; /* length of text */
-	em_ssize_t index; /* index into file contents */
-	em_ssize_t lastchsz; /* size of last character in bytes */
-	em_ssize_t line, column; /* line and column numbers */
-	em_ssize_t lstart, lend; /* start and end indices of line */
-	int cc; /* current character */
-	struct em_context *context; /* context */
+	struct em_source *source; /* source text (NULL for compiled code) */
+	uint32_t line, column; /* line and column numbers (found from offset when shown if line is 0) */
+	uint32_t offset; /* offset into source text */
 } em_pos_t;
 
-#define EM_POS_INIT ((em_pos_t){NULL, NULL, 0, -1, 1, 0, 0, -1, -1, 0, NULL})
+#define EM_POS_INIT ((em_pos_t){NULL, NULL, 0, 0, 0})
 
-/* builtin error classes */
-EM_API struct em_value em_class_error;
-EM_API struct em_value em_class_syntax_error;
-EM_API struct em_value em_class_runtime_error;
-EM_API struct em_value em_class_system_break;
-EM_API struct em_value em_class_system_continue;
-EM_API struct em_value em_class_system_return;
-EM_API struct em_value em_class_system_exit;
+/* builtin error classes (one set per thread) */
+EM_API EM_THREAD_LOCAL struct em_value em_class_error;
+EM_API EM_THREAD_LOCAL struct em_value em_class_syntax_error;
+EM_API EM_THREAD_LOCAL struct em_value em_class_runtime_error;
+EM_API EM_THREAD_LOCAL struct em_value em_class_system_break;
+EM_API EM_THREAD_LOCAL struct em_value em_class_system_continue;
+EM_API EM_THREAD_LOCAL struct em_value em_class_system_return;
+EM_API EM_THREAD_LOCAL struct em_value em_class_system_exit;
 
 /* functions */
-EM_API void em_pos_advance(em_pos_t *pos); /* advance position */
-
 EM_API void em_log(em_log_level_t level, const char *file, long line, const char *fmt, ...); /* log a basic message */
 EM_API void em_log_error(const em_pos_t *pos, const char *fmt, ...); /* log an error */
 EM_API void em_log_verror(const em_pos_t *pos, const char *fmt, va_list args); /* log an error with va_list */
@@ -15,8 +15,18 @@ typedef enum em_init_flag {
 	EM_INIT_FLAG_PRINT_ALLOC_TRAFFIC = 0x4,
 } em_init_flag_t;
 
+/*
+ * em_init sets up what is shared by the whole process and the calling
+ * thread. Every other thread that runs contexts calls em_thread_init
+ * first and em_thread_quit when it is done. Objects belong to the thread
+ * that made them, and a context is only used by the thread that
+ * initialized it, so contexts on different threads run without locks.
+ */
+
 /* functions */
 EM_API em_result_t em_init(em_init_flag_t flags); /* initialize emerald */
+EM_API em_result_t em_thread_init(void); /* initialize emerald for calling thread */
+EM_API void em_thread_quit(void); /* quit emerald for calling thread */
 EM_API void em_quit(void); /* quit emerald */
 
 #endif /* EMERALD_MAIN_H */
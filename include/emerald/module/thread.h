@@ -0,0 +1,24 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Thread module
+ */
+#ifndef EMERALD_MODULE_THREAD_H
+#define EMERALD_MODULE_THREAD_H
+
+#include <emerald/core.h>
+#include <emerald/module.h>
+
+/*
+ * Each spawned thread runs a file in a context of its own, then calls the
+ * file's main function (if any) with the arguments given to spawn. Nothing
+ * is shared between threads except channels: arguments, results and values
+ * sent on a channel are copied into the thread that receives them. Only
+ * none, numbers, strings, lists, maps and channels can be copied.
+ */
+
+EM_API em_module_t em_module_thread;
+
+#endif /* EMERALD_MODULE_THREAD_H */
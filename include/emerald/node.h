@@ -10,6 +10,8 @@
 #include <emerald/refobj.h>
 #include <emerald/array.h>
 #include <emerald/token.h>
+#include <emerald/value.h>
+#include <emerald/source.h>
 
 /* node types */
 typedef enum em_node_type {
@@ -50,38 +52,133 @@ typedef enum em_node_type {
 	EM_NODE_TYPE_COUNT,
 } em_node_type_t;
 
+/* operators of operation nodes (resolved from the operator token by the parser) */
+typedef enum em_node_op {
+	EM_NODE_OP_NONE = 0,
+
+	/* unary operators */
+	EM_NODE_OP_POSITIVE, /* +a */
+	EM_NODE_OP_NEGATIVE, /* -a */
+	EM_NODE_OP_BITWISE_NOT, /* ~a */
+	EM_NODE_OP_NOT, /* not a */
+
+	/* binary operators */
+	EM_NODE_OP_ADD, /* a + b */
+	EM_NODE_OP_SUBTRACT, /* a - b */
+	EM_NODE_OP_MULTIPLY, /* a * b */
+	EM_NODE_OP_DIVIDE, /* a / b */
+	EM_NODE_OP_MODULO, /* a % b */
+	EM_NODE_OP_BITWISE_OR, /* a | b */
+	EM_NODE_OP_BITWISE_XOR, /* a ^ b */
+	EM_NODE_OP_BITWISE_AND, /* a & b */
+	EM_NODE_OP_SHIFT_LEFT, /* a << b */
+	EM_NODE_OP_SHIFT_RIGHT, /* a >> b */
+	EM_NODE_OP_EQUAL, /* a == b */
+	EM_NODE_OP_NOT_EQUAL, /* a != b */
+	EM_NODE_OP_LESS_THAN, /* a < b */
+	EM_NODE_OP_LESS_THAN_EQUAL, /* a <= b */
+	EM_NODE_OP_GREATER_THAN, /* a > b */
+	EM_NODE_OP_GREATER_THAN_EQUAL, /* a >= b */
+	EM_NODE_OP_AND, /* a and b (short-circuited) */
+	EM_NODE_OP_OR, /* a or b (short-circuited) */
+
+	EM_NODE_OP_COUNT,
+} em_node_op_t;
+
+struct em_context;
+struct em_node;
+
+/* handler bound to node by em_closure_compile */
+typedef em_value_t (*em_node_handler_t)(struct em_context *, struct em_node *);
+
+/*
+ * Nodes and the tokens and values they save are allocated in blocks owned
+ * by their tree and are freed along with it. The children of a node are a
+ * range of one array kept by the tree, which is laid out once the tree is
+ * parsed (until then each range grows on its own). A node only keeps an
+ * offset into the source text, from which EM_NODE_POS makes a position.
+ */
+
+/* block of tree memory */
+typedef struct em_tree_block {
+	struct em_tree_block *prev; /* previous block */
+	size_t size; /* size of data */
+	size_t used; /* bytes of data given out */
+	char data[]; /* data */
+} em_tree_block_t;
+
+/* syntax tree */
+typedef struct em_tree {
+	em_refobj_t base;
+	em_source_t *source; /* source text */
+	em_tree_block_t *blocks; /* nodes, tokens and values */
+	em_tree_block_t *scratch; /* child ranges while parsing */
+	struct em_node **children; /* children of all nodes */
+	em_bool_t parsed; /* children have been laid out */
+} em_tree_t;
+
+#define EM_TREE(p) ((em_tree_t *)(p))
+
+/* token saved by node */
+typedef struct em_node_token {
+	const char *value; /* token value */
+	uint32_t length; /* value length */
+	uint32_t offset; /* offset into source text */
+} em_node_token_t;
+
 /* node */
 typedef struct em_node {
-	em_refobj_t base;
-	em_node_type_t type; /* type of node */
-	em_pos_t pos; /* position */
-	uint32_t flags; /* flag values */
-	struct em_node *parent; /* parent */
-	struct em_node *first; /* first child */
-	struct em_node *last; /* last child */
-	struct em_node *prev; /* previous sibling */
-	struct em_node *next; /* next sibling */
-	em_array_t tokens; /* saved tokens */
-	em_array_t values; /* saved values */
-	size_t code_size; /* size of bytecode including children */
+	uint8_t type; /* type of node */
+	uint8_t op; /* operator of operation nodes */
+	uint16_t flags; /* flag values */
+	uint32_t offset; /* offset into source text */
+	em_tree_t *tree; /* tree that owns node */
+	struct em_node **children; /* range of children */
+	uint32_t nchildren; /* number of children */
+	uint16_t ntokens; /* number of saved tokens */
+	uint16_t nvalues; /* number of saved values */
+	em_node_token_t *tokens; /* saved tokens */
+	em_generic_t value; /* first saved value */
+	em_generic_t *values; /* saved values after the first */
+
+	/* bound by em_closure_compile */
+	em_node_handler_t handler; /* evaluates node */
+	em_value_t constant; /* value of literal */
 } em_node_t;
 
 #define EM_NODE(p) ((em_node_t *)(p))
 
-EM_API em_reflist_t em_reflist_node;
+/* name usage flags (also stored in flags of for nodes) */
+#define EM_NODE_NAME_READ 0x1 /* name may be read, including by code outside of the tree */
+#define EM_NODE_NAME_WRITTEN 0x2 /* name may be redefined */
+
+/* flags of return nodes */
+#define EM_NODE_RETURN_TAIL 0x1 /* value is a call that can reuse the frame of the function */
+
+/* position of offset into source text of tree */
+#define EM_TREE_POS(tree, off) (&(em_pos_t){(tree)->source->path, (tree)->source, 0, 0, (off)})
+#define EM_NODE_POS(node) EM_TREE_POS((node)->tree, (node)->offset)
 
-#define EM_NODE_INCREF(p) EM_NODE(em_refobj_incref(EM_REFOBJ(p)))
-#define EM_NODE_DECREF(p) em_refobj_decref(EM_REFOBJ(p))
+EM_API EM_THREAD_LOCAL em_reflist_t em_reflist_tree;
+
+#define EM_TREE_INCREF(p) EM_TREE(em_refobj_incref(EM_REFOBJ(p)))
+#define EM_TREE_DECREF(p) em_refobj_decref(EM_REFOBJ(p))
 
 /* functions */
 EM_API const char *em_get_node_type_name(em_node_type_t type); /* get name from type */
 
-EM_API em_node_t *em_node_new(em_node_type_t type, em_pos_t *pos); /* create node */
+EM_API em_tree_t *em_tree_new(em_source_t *source); /* create tree */
+EM_API void em_tree_layout(em_tree_t *tree, em_node_t *root); /* move children of nodes under root into one array */
+
+EM_API em_node_t *em_node_new(em_tree_t *tree, em_node_type_t type, uint32_t offset); /* create node */
 EM_API void em_node_add_child(em_node_t *node, em_node_t *child); /* add child node */
-EM_API void em_node_add_token(em_node_t *node, em_token_t *token); /* add token */
+EM_API void em_node_add_token(em_node_t *node, em_token_t *token); /* add copy of token */
+EM_API void em_node_add_text(em_node_t *node, const char *value, size_t length, uint32_t offset); /* add text as token */
+EM_API void em_node_set_operator(em_node_t *node, em_token_t *token); /* add operator token and resolve operator */
 EM_API void em_node_add_value(em_node_t *node, em_generic_t value); /* add generic value */
-EM_API em_token_t *em_node_get_token(em_node_t *node, size_t index); /* get token */
+EM_API em_node_token_t *em_node_get_token(em_node_t *node, size_t index); /* get token */
 EM_API em_generic_result_t em_node_get_value(em_node_t *node, size_t index); /* get value */
+EM_API uint32_t em_node_get_name_usage(em_node_t *node, em_hash_t hash); /* check how a variable name is used in tree */
 EM_API void em_node_print(em_node_t *node); /* print node information */
 
 #endif /* EMERALD_NODE_H */
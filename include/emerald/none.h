@@ -9,9 +9,9 @@
 #include <emerald/core.h>
 #include <emerald/object.h>
 
-EM_API em_value_t em_none;
+EM_API em_value_t em_none; /* shared by all threads */
 
 /* functions */
-EM_API em_value_t em_none_new(void); /* create none */
+EM_API em_value_t em_none_new(void); /* get none */
 
 #endif /* EMERALD_NONE_H */
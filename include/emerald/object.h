@@ -46,7 +46,7 @@ typedef struct em_object {
 
 #define EM_OBJECT(p) ((em_object_t *)(p))
 
-EM_API em_reflist_t em_reflist_object;
+EM_API EM_THREAD_LOCAL em_reflist_t em_reflist_object;
 
 #define EM_OBJECT_INCREF(p) EM_OBJECT(em_refobj_incref(EM_REFOBJ(p)))
 #define EM_OBJECT_DECREF(p) em_refobj_decref(EM_REFOBJ(p))
@@ -8,13 +8,22 @@
 
 #include <emerald/core.h>
 #include <emerald/token.h>
+#include <emerald/lexer.h>
 #include <emerald/node.h>
 
+/*
+ * The parser pulls tokens from the lexer one at a time. Only the current
+ * token is held by the parser; nodes keep copies of the tokens they save in
+ * their tree, which the parser holds until it's reset.
+ */
+
 /* parser */
 typedef struct em_parser {
 	em_bool_t init; /* initialized */
+	em_lexer_t *lexer; /* lexer to take tokens from */
 	em_token_t *token; /* current token */
 	em_node_t *node; /* result node */
+	em_tree_t *tree; /* tree of result node */
 } em_parser_t;
 
 #define EM_PARSER_INIT ((em_parser_t){EM_FALSE})
@@ -28,7 +37,7 @@ typedef struct em_token_pair {
 
 /* functions */
 EM_API em_result_t em_parser_init(em_parser_t *parser); /* initialize parser */
-EM_API void em_parser_reset(em_parser_t *parser, em_token_t *token); /* reset parser */
+EM_API void em_parser_reset(em_parser_t *parser, em_lexer_t *lexer); /* reset parser */
 EM_API void em_parser_advance(em_parser_t *parser); /* advance parser */
 EM_API em_result_t em_parser_parse(em_parser_t *parser); /* parse tokens */
 EM_API em_node_t *em_parser_statement(em_parser_t *parser); /* generic statement */
@@ -0,0 +1,17 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Bytecode peephole optimizer
+ */
+#ifndef EMERALD_PEEPHOLE_H
+#define EMERALD_PEEPHOLE_H
+
+#include <emerald/core.h>
+#include <emerald/bytecode.h>
+
+/* functions */
+EM_API em_result_t em_code_optimize(em_code_slice_t *slice); /* fuse common sequences and thread jumps in slice */
+
+#endif /* EMERALD_PEEPHOLE_H */
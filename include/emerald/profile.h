@@ -0,0 +1,26 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Bytecode execution profiler
+ */
+#ifndef EMERALD_PROFILE_H
+#define EMERALD_PROFILE_H
+
+#include <stdio.h>
+#include <emerald/core.h>
+#include <emerald/bytecode.h>
+
+/*
+ * Only built with EM_PROFILE; otherwise the interpreter doesn't call into
+ * the profiler at all and these functions do nothing.
+ */
+
+/* functions */
+EM_API uint64_t em_profile_clock(void); /* get timestamp in profiler units */
+EM_API void em_profile_record(em_code_slice_t *slice, size_t pos, em_code_op_t prev, em_code_op_t op, uint64_t time); /* record execution of instruction */
+EM_API void em_profile_report(FILE *fp); /* print hot operations, instructions and pairs */
+EM_API void em_profile_reset(void); /* discard recorded data */
+
+#endif /* EMERALD_PROFILE_H */
@@ -16,6 +16,7 @@ struct em_refobj;
 typedef enum em_cleanup_mode {
 	EM_CLEANUP_MODE_IMMEDIATE = 0,
 	EM_CLEANUP_MODE_WAITLIST,
+	EM_CLEANUP_MODE_IMMORTAL, /* never counted or freed, so it may be shared between threads */
 
 	EM_CLEANUP_MODE_COUNT,
 } em_cleanup_mode_t;
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Register-based bytecode
+ */
+#ifndef EMERALD_REGVM_H
+#define EMERALD_REGVM_H
+
+#include <stdio.h>
+#include <emerald/core.h>
+#include <emerald/node.h>
+#include <emerald/value.h>
+
+struct em_context;
+
+/* register operations */
+typedef enum em_reg_op {
+	EM_REG_OP_LOADK = 1, /* load constant */
+	EM_REG_OP_KSTR, /* load new string from constant */
+	EM_REG_OP_MOVE, /* move value to other register */
+	EM_REG_OP_DEL, /* delete value */
+
+	EM_REG_OP_LOAD, /* load variable */
+	EM_REG_OP_STOR, /* store variable */
+	EM_REG_OP_GETNM, /* load named member */
+	EM_REG_OP_SETNM, /* store named member */
+	EM_REG_OP_GETIDX, /* load indexed member */
+	EM_REG_OP_SETIDX, /* store indexed member */
+
+	EM_REG_OP_LIST, /* construct list */
+	EM_REG_OP_MAP, /* construct map */
+
+	EM_REG_OP_NEG, /* negate value */
+	EM_REG_OP_NOT, /* logical not value */
+	EM_REG_OP_BNOT, /* bitwise not value */
+	EM_REG_OP_BOOL, /* get truthiness of value */
+
+	EM_REG_OP_ADD, /* add values */
+	EM_REG_OP_SUB, /* subtract values */
+	EM_REG_OP_MUL, /* multiply values */
+	EM_REG_OP_DIV, /* divide values */
+	EM_REG_OP_MOD, /* modulo values */
+	EM_REG_OP_BOR, /* bitwise or values */
+	EM_REG_OP_BXOR, /* bitwise xor values */
+	EM_REG_OP_BAND, /* bitwise and values */
+	EM_REG_OP_BLSH, /* bitwise left shift values */
+	EM_REG_OP_BRSH, /* bitwise right shift values */
+	EM_REG_OP_EQ, /* compare equality of values */
+	EM_REG_OP_NEQ, /* compare notted equality of values */
+	EM_REG_OP_LT, /* compare ordering of values (less) */
+	EM_REG_OP_GT, /* compare ordering of values (greater) */
+	EM_REG_OP_LE, /* compare ordering of values (less or equal) */
+	EM_REG_OP_GE, /* compare ordering of values (greater or equal) */
+
+	EM_REG_OP_JMP, /* jump */
+	EM_REG_OP_JT, /* jump if true */
+	EM_REG_OP_JF, /* jump if not true */
+	EM_REG_OP_JNEQ, /* compare equality and jump if not true */
+	EM_REG_OP_JNNEQ, /* compare notted equality and jump if not true */
+	EM_REG_OP_JNLT, /* compare ordering (less) and jump if not true */
+	EM_REG_OP_JNGT, /* compare ordering (greater) and jump if not true */
+	EM_REG_OP_JNLE, /* compare ordering (less or equal) and jump if not true */
+	EM_REG_OP_JNGE, /* compare ordering (greater or equal) and jump if not true */
+	EM_REG_OP_FORPREP, /* check bounds of counted loop and set iterator */
+	EM_REG_OP_FORLOOP, /* step counted loop and jump if not done */
+
+	EM_REG_OP_CALL, /* call value */
+	EM_REG_OP_PUTS, /* print to output */
+	EM_REG_OP_INCLUDE, /* include file */
+	EM_REG_OP_RAISE, /* raise return, break or continue */
+	EM_REG_OP_VISIT, /* run node on tree-walker */
+
+	EM_REG_OP_COUNT,
+} em_reg_op_t;
+
+/* operands at or above this are constants instead of registers */
+#define EM_REG_CONST 0x8000
+#define EM_REG_MAX (EM_REG_CONST-1)
+
+/* instruction */
+typedef struct em_reg_inst {
+	uint8_t op; /* operation */
+	uint8_t flags; /* operation flags */
+	uint16_t a, b, c; /* operands */
+	uint32_t x; /* jump target, constant or name */
+} em_reg_inst_t;
+
+/* name or string constant */
+typedef struct em_reg_name {
+	em_hash_t hash; /* hash of name */
+	const char *string; /* text (owned by tree of node) */
+	size_t length; /* length of text */
+} em_reg_name_t;
+
+/* compiled code */
+typedef struct em_reg_code {
+	em_reg_inst_t *insts; /* instructions */
+	em_node_t **nodes; /* source node of each instruction */
+	size_t ninsts, capinsts; /* number of instructions */
+	em_value_t *consts; /* constants (ints, floats, none) */
+	size_t nconsts, capconsts; /* number of constants */
+	em_reg_name_t *names; /* names and string constants */
+	size_t nnames, capnames; /* number of names */
+	size_t nregs; /* size of register window */
+} em_reg_code_t;
+
+/* functions */
+EM_API em_result_t em_reg_compile(em_reg_code_t *code, em_node_t *node); /* compile node to register code */
+EM_API em_value_t em_reg_run(struct em_context *context, em_reg_code_t *code); /* run register code */
+EM_API void em_reg_disassemble(em_reg_code_t *code, FILE *fp); /* disassemble register code */
+EM_API void em_reg_free(em_reg_code_t *code); /* free register code */
+
+#endif /* EMERALD_REGVM_H */
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Scripts compiled once and run many times
+ */
+#ifndef EMERALD_SCRIPT_H
+#define EMERALD_SCRIPT_H
+
+#include <emerald/core.h>
+#include <emerald/node.h>
+#include <emerald/value.h>
+#include <emerald/bytecode.h>
+#include <emerald/regvm.h>
+#include <emerald/context.h>
+
+/*
+ * A script is lexed, parsed, folded and compiled for the mode of the
+ * context it is made in, so running it again does none of that. Scripts
+ * run in a scope of their own, either a map supplied by the caller (which
+ * is how inputs are passed and outputs read back) or an empty one that is
+ * thrown away afterwards. Tree-walked scripts are compiled to bytecode once
+ * they have run often enough, like functions are.
+ *
+ * Functions made by a bytecode script refer to its code, so a script is
+ * only freed once they are gone.
+ */
+
+/* compiled script */
+typedef struct em_script {
+	em_code_type_t mode; /* tree-walker, bytecode or register code */
+	em_node_t *node; /* syntax tree (its tree is held) */
+	em_code_t *code; /* tree code object (tree-walker) */
+	em_code_slice_t slice; /* bytecode */
+	em_reg_code_t reg; /* register code */
+	char path[]; /* file path */
+} em_script_t;
+
+/* functions */
+EM_API em_script_t *em_script_new(em_context_t *context, const char *path, const char *text, em_ssize_t len); /* compile text for mode of context */
+EM_API em_value_t em_script_run(em_script_t *script, em_context_t *context, em_value_t scope); /* run script in scope map, or in empty scope if scope is fail */
+EM_API void em_script_free(em_script_t *script); /* free script */
+
+#endif /* EMERALD_SCRIPT_H */
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Source text and line table that positions refer to
+ */
+#ifndef EMERALD_SOURCE_H
+#define EMERALD_SOURCE_H
+
+#include <emerald/core.h>
+
+/*
+ * The lexer records where each line starts as it passes it, so an error
+ * only has to look its line up to print it. Sources keep a copy of the
+ * text and are counted by the tokens and nodes made from them, so the line
+ * of a function that fails long after its file has run can still be
+ * printed. Positions copied out of tokens and nodes (such as the one that
+ * sent a signal) don't count, as they don't outlive them. Nodes only keep
+ * an offset into the text, which is turned into a line and column when an
+ * error is shown.
+ */
+
+/* source text */
+typedef struct em_source {
+	size_t refcnt; /* reference count */
+	const char *path; /* file path */
+	char *text; /* copy of file contents */
+	em_ssize_t len; /* length of text */
+	uint32_t *lines; /* index of the start of each line */
+	uint32_t nlines; /* number of lines */
+	uint32_t maxlines; /* number of lines allocated */
+	struct em_context *context; /* context */
+} em_source_t;
+
+/* functions */
+EM_API em_source_t *em_source_new(const char *path, const char *text, em_ssize_t len); /* create source with copy of text */
+EM_API em_source_t *em_source_incref(em_source_t *source); /* increase reference count */
+EM_API void em_source_decref(em_source_t *source); /* decrease reference count */
+EM_API em_result_t em_source_add_line(em_source_t *source, em_ssize_t index); /* add start of next line */
+EM_API em_ssize_t em_source_get_line(em_source_t *source, uint32_t line, const char **start); /* get text of line */
+EM_API void em_source_find(em_source_t *source, uint32_t offset, uint32_t *line, uint32_t *column); /* find line and column of offset into text */
+
+#endif /* EMERALD_SOURCE_H */
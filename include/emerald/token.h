@@ -60,7 +60,6 @@ typedef enum em_token_type {
 /* token */
 typedef struct em_token {
 	em_refobj_t base;
-	struct em_token *next; /* next token */
 	em_token_type_t type; /* token type */
 	em_pos_t pos; /* token position */
 	size_t length; /* value length */
@@ -69,7 +68,7 @@ typedef struct em_token {
 
 #define EM_TOKEN(p) ((em_token_t *)(p))
 
-EM_API em_reflist_t em_reflist_token;
+EM_API EM_THREAD_LOCAL em_reflist_t em_reflist_token;
 
 #define EM_TOKEN_INCREF(p) EM_TOKEN(em_refobj_incref(EM_REFOBJ(p)))
 #define EM_TOKEN_DECREF(p) em_refobj_decref(EM_REFOBJ(p))
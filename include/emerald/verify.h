@@ -0,0 +1,18 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Bytecode verifier
+ */
+#ifndef EMERALD_VERIFY_H
+#define EMERALD_VERIFY_H
+
+#include <emerald/core.h>
+#include <emerald/bytecode.h>
+
+/* functions */
+EM_API em_result_t em_code_verify(em_code_slice_t *slice); /* check that slice is safe to interpret and set its max stack depth */
+EM_API em_result_t em_code_verify_compiled(em_code_slice_t *slice); /* fill in depths of handlers of newly compiled slice, then verify it */
+
+#endif /* EMERALD_VERIFY_H */
@@ -49,6 +49,16 @@ newoption {
 	description = 'Enable debugging for bytecode compiler',
 }
 
+newoption {
+	trigger = 'enable-jit',
+	description = 'Enable native code compiler for bytecode (x86-64 unix only)',
+}
+
+newoption {
+	trigger = 'enable-profile',
+	description = 'Enable bytecode execution profiler (--profile)',
+}
+
 -- Determine module list --
 em_modules = {
 	'array',
@@ -64,6 +74,7 @@ if _TARGET_OS == 'windows' then
 elseif _TARGET_OS == 'eclair' then
 else
 	table.insert(em_modules, 'posix')
+	table.insert(em_modules, 'thread')
 end
 
 if _OPTIONS['enable-modules'] then
@@ -101,6 +112,12 @@ filter 'options:enable-asan'
 filter 'options:enable-bytecode-debug'
 	defines {'EM_BYTECODE_DEBUG'}
 
+filter 'options:enable-jit'
+	defines {'EM_JIT'}
+
+filter 'options:enable-profile'
+	defines {'EM_PROFILE'}
+
 -- Core emerald interpreter --
 project 'emerald'
 	kind 'SharedLib'
@@ -124,6 +141,11 @@ project 'emerald'
 	end
 	em_module_table = string.format('%s};\n', em_module_table)
 
+	-- Native stack bounds and spawned threads use pthreads --
+	if _TARGET_OS ~= 'windows' and _TARGET_OS ~= 'eclair' then
+		links {'pthread'}
+	end
+
 	io.writefile('obj/modules.h', string.format('%s\n%s', em_module_proto, em_module_table))
 
 	-- Configuration filters --
@@ -7,7 +7,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <emerald/core.h>
+#include <emerald/memory.h>
 #include <emerald/context.h>
+#include <emerald/source.h>
 #include <emerald/none.h>
 #include <emerald/utf8.h>
 #include <emerald/wchar.h>
@@ -19,6 +21,13 @@
 #include <emerald/function.h>
 #include <emerald/class.h>
 #include <emerald/bytecode.h>
+#include <emerald/peephole.h>
+#include <emerald/verify.h>
+#include <emerald/jit.h>
+#include <emerald/profile.h>
+
+#define PATHBUFSZ 4096
+static EM_THREAD_LOCAL char pathbuf[PATHBUFSZ];
 
 /* operation names */
 static const char *op_names[EM_CODE_OP_COUNT] = {
@@ -36,15 +45,35 @@ static const char *op_names[EM_CODE_OP_COUNT] = {
 	"LOAD", "LDNM", "LDIDX",
 	"STOR", "STNM", "STIDX",
 	"JMP", "JTR", "JNTR", "JPNTR",
-	"CALL", "SAVE1", "SAVE3",
+	"CALL", "HTAB",
 	"RSTR1", "RSTR2", "RSTR3",
-	"DSCD1", "DSCD3",
 	"DCLS", "DFUNC", "DBGN",
 	"ESETL", "ESETC", "PUTS",
 	"INCLUDE", "BLTJXPIPI",
 	"LEN", "R1EISNTP",
+	"ESETLC", "STORP", "LADDI",
+	"JNLT", "JNGT", "JNEQ", "JNNEQ",
+	"BADDII", "BSUBII", "BMULII",
+	"BEQII", "BNEQII", "BLTII", "BGTII",
+	"LADDII", "JNLTII", "JNGTII",
+	"JNEQII", "JNNEQII",
+	"FORPREP", "FORLOOP",
+	"TCALL",
 };
 
+/* free code object */
+static void code_free(void *p) {
+
+	em_code_t *code = EM_CODE(p);
+
+	if (code->type == EM_CODE_TYPE_BINARY) {
+
+		em_jit_free(&code->binary);
+		em_free(code->binary.data);
+	}
+	if (code->source_tree) EM_TREE_DECREF(code->source_tree);
+}
+
 /* create code object with node */
 EM_API em_code_t *em_code_new_node(em_node_t *node, const char *path) {
 
@@ -56,8 +85,11 @@ EM_API em_code_t *em_code_new_node(em_node_t *node, const char *path) {
 
 EM_CODE_INCREF(code);
 
+	EM_REFOBJ(code)->free = code_free;
+
 	code->type = EM_CODE_TYPE_TREE;
 	code->tree = node;
+	code->source_tree = EM_TREE_INCREF(node->tree);
 
 	memcpy(code->path, path, len);
 	code->path[len] = 0;
@@ -85,22 +117,195 @@ EM_API em_code_t *em_code_new_binary(em_code_slice_t binary, const char *path) {
 	return code;
 }
 
+
+/* compile tree code to bytecode in place */
+static void promote(em_code_t *code) {
+
+	em_code_slice_t slice = {0};
+
+	if (!em_code_is_compilable(code->tree) ||
+	    em_code_compile(&slice, code->tree) != EM_RESULT_SUCCESS) {
+
+		code->hotness = 0; /* don't check again for a while */
+		return;
+	}
+	/* the tree is replaced, but stays held for names and error lines */
+	code->type = EM_CODE_TYPE_BINARY;
+	code->binary = slice;
+}
+
+/*
+ * Run bytecode compiled from tree code. Errors are left raised and returns
+ * and loop exits are left as signals, as the tree-walker would have left
+ * them itself.
+ */
+static em_value_t run_compiled(em_context_t *context, em_code_slice_t *slice, const char *path, em_source_t *source) {
+
+	em_pos_t old_pos = context->op_pos;
+	size_t position = slice->position; /* slice may be running further down (recursion) */
+	em_code_op_t slice_mode = slice->mode;
+
+	context->op_pos = (em_pos_t){
+		.path = path,
+		.source = source,
+		.line = 0,
+		.column = 0,
+	};
+
+	em_value_t result = em_code_run_slice(context, slice);
+
+	context->op_pos = old_pos;
+	slice->position = position;
+	slice->mode = slice_mode;
+	return result;
+}
+
 /* run code */
 EM_API em_value_t em_code_run(em_code_t *code, em_context_t *context) {
 
-	em_pos_t pos = {0};
+	em_value_t result;
+
+	/* hot functions are compiled at their next call */
+	if (code->type == EM_CODE_TYPE_TREE && context->tier &&
+	    ++code->hotness >= EM_CODE_TIER_THRESHOLD)
+		promote(code);
 
 	switch (code->type) {
-		case EM_CODE_TYPE_TREE:
-			return em_context_visit(context, code->tree);
+		case EM_CODE_TYPE_TREE: {
+			em_code_t *old_code = context->code;
+			context->code = code;
+
+			result = em_context_visit(context, code->tree);
+
+			context->code = old_code;
+			return result;
+		}
+		case EM_CODE_TYPE_BINARY:
+			return run_compiled(context, &code->binary, code->path, code->source_tree? code->source_tree->source: NULL);
 	}
 	return EM_VALUE_FAIL;
 }
 
+/* check if node only uses operations supported by the vm */
+EM_API em_bool_t em_code_is_compilable(em_node_t *node) {
+
+	switch (node->type) {
+
+		/* function, class and exception machinery is tree-walker only */
+		case EM_NODE_TYPE_RAISE:
+		case EM_NODE_TYPE_FOREACH:
+		case EM_NODE_TYPE_FUNC:
+		case EM_NODE_TYPE_CLASS:
+		case EM_NODE_TYPE_TRY:
+			return EM_FALSE;
+
+		/* list of values in a puts statement must not be empty */
+		case EM_NODE_TYPE_PUTS:
+			if (!node->nchildren) return EM_FALSE;
+			break;
+	}
+	for (uint32_t i = 0; i < node->nchildren; i++) {
+
+		if (!em_code_is_compilable(node->children[i]))
+			return EM_FALSE;
+	}
+	return EM_TRUE;
+}
+
+/* count statements that need a handler */
+static size_t count_handlers(em_node_t *node) {
+
+	size_t count = 0;
+	switch (node->type) {
+		case EM_NODE_TYPE_FOR:
+		case EM_NODE_TYPE_FOREACH:
+		case EM_NODE_TYPE_WHILE:
+		case EM_NODE_TYPE_TRY:
+			count++;
+			break;
+	}
+	for (uint32_t i = 0; i < node->nchildren; i++)
+		count += count_handlers(node->children[i]);
+	return count;
+}
+
+/* compile and optimize node */
+EM_API em_result_t em_code_compile(em_code_slice_t *slice, em_node_t *node) {
+
+	em_code_compiler_t compiler = {0};
+	compiler.slice = slice;
+
+	*slice = (em_code_slice_t){0};
+
+	/* room for the handler table, which statements fill in as they are written */
+	compiler.maxhandlers = count_handlers(node);
+	if (compiler.maxhandlers > UINT16_MAX)
+		return EM_RESULT_FAILURE;
+
+	if (compiler.maxhandlers) {
+
+		em_code_write_uint8(slice, EM_CODE_OP_HTAB);
+		em_code_write_uint16(slice, (uint16_t)compiler.maxhandlers);
+		for (size_t i = 0; i < compiler.maxhandlers * EM_CODE_HANDLER_SIZE; i++)
+			em_code_write_uint8(slice, 0);
+	}
+
+	em_code_write(&compiler, node);
+	if (!slice->data) return EM_RESULT_FAILURE;
+	slice->position = 0;
+
+	(void)em_code_optimize(slice);
+	if (em_code_verify_compiled(slice) != EM_RESULT_SUCCESS) {
+
+		em_free(slice->data);
+		*slice = (em_code_slice_t){0};
+		return EM_RESULT_FAILURE;
+	}
+	return EM_RESULT_SUCCESS;
+}
+
+/* compile node and run it in the vm */
+EM_API em_value_t em_code_run_node(em_context_t *context, em_node_t *node) {
+
+	em_code_slice_t slice;
+	if (em_code_compile(&slice, node) != EM_RESULT_SUCCESS)
+		return EM_VALUE_FAIL;
+
+	em_value_t result = run_compiled(context, &slice, node->tree->source->path, node->tree->source);
+
+	em_jit_free(&slice);
+	em_free(slice.data);
+	return result;
+}
+
+/* make room for size bytes at current position */
+static em_bool_t reserve(em_code_slice_t *slice, size_t size) {
+
+	size_t end = slice->position + size;
+	if (end <= slice->length) return EM_TRUE; /* overwriting */
+
+	/* grow buffer; slices not built by the compiler have a fixed size */
+	if (end > slice->capacity) {
+
+		if (slice->data && !slice->capacity) return EM_FALSE;
+
+		size_t capacity = slice->capacity? slice->capacity: 256;
+		while (capacity < end) capacity *= 2;
+
+		void *data = slice->data? em_realloc(slice->data, capacity): em_malloc(capacity);
+		if (!data) return EM_FALSE;
+
+		slice->data = data;
+		slice->capacity = capacity;
+	}
+	slice->length = end;
+	return EM_TRUE;
+}
+
 /* write uint8 value */
 EM_API void em_code_write_uint8(em_code_slice_t *slice, uint8_t value) {
 
-	if (slice->position+1 > slice->length)
+	if (!reserve(slice, 1))
 		return;
 	*((uint8_t *)(slice->data + slice->position++)) = value;
 }
@@ -108,7 +313,7 @@ EM_API void em_code_write_uint8(em_code_slice_t *slice, uint8_t value) {
 /* write uint16 value */
 EM_API void em_code_write_uint16(em_code_slice_t *slice, uint16_t value) {
 
-	if (slice->position+2 > slice->length)
+	if (!reserve(slice, 2))
 		return;
 	*((uint16_t *)(slice->data + slice->position)) = value;
 	slice->position += 2;
@@ -117,7 +322,7 @@ EM_API void em_code_write_uint16(em_code_slice_t *slice, uint16_t value) {
 /* write uint32 value */
 EM_API void em_code_write_uint32(em_code_slice_t *slice, uint32_t value) {
 
-	if (slice->position+4 > slice->length)
+	if (!reserve(slice, 4))
 		return;
 	*((uint32_t *)(slice->data + slice->position)) = value;
 	slice->position += 4;
@@ -126,7 +331,7 @@ EM_API void em_code_write_uint32(em_code_slice_t *slice, uint32_t value) {
 /* write uint64 value */
 EM_API void em_code_write_uint64(em_code_slice_t *slice, uint64_t value) {
 
-	if (slice->position+8 > slice->length)
+	if (!reserve(slice, 8))
 		return;
 	*((uint64_t *)(slice->data + slice->position)) = value;
 	slice->position += 8;
@@ -168,7 +373,7 @@ EM_API void em_code_write_inttype(em_code_slice_t *slice, em_inttype_t value) {
 /* write float value */
 EM_API void em_code_write_float(em_code_slice_t *slice, float value) {
 
-	if (slice->position+4 > slice->length)
+	if (!reserve(slice, 4))
 		return;
 	*((float *)(slice->data + slice->position)) = value;
 	slice->position += 4;
@@ -177,7 +382,7 @@ EM_API void em_code_write_float(em_code_slice_t *slice, float value) {
 /* write double value */
 EM_API void em_code_write_double(em_code_slice_t *slice, double value) {
 
-	if (slice->position+8 > slice->length)
+	if (!reserve(slice, 8))
 		return;
 	*((double *)(slice->data + slice->position)) = value;
 	slice->position += 8;
@@ -340,399 +545,108 @@ EM_API const char *em_code_read_hashed_string(em_code_slice_t *slice, em_hash_t
 }
 
 /* synchronize position information */
-static void set_position_size(em_code_compiler_t *compiler, em_node_t *node, size_t *p_size) {
-
-	if (compiler->pos.line != node->pos.line) {
-
-		compiler->pos.line = node->pos.line;
-		*p_size += 3; /* ESETL, uint16 */
-	}
-	if (compiler->pos.column != node->pos.column) {
-
-		compiler->pos.column = node->pos.column;
-		*p_size += 2; /* ESETC, uint8 */
-	}
-}
-
 static void set_position(em_code_compiler_t *compiler, em_node_t *node) {
 
 	em_code_slice_t *slice = compiler->slice;
-	if (compiler->pos.line != node->pos.line) {
+	if (compiler->pos.line && compiler->pos.offset == node->offset)
+		return;
+
+	uint32_t line, column;
+	em_source_find(node->tree->source, node->offset, &line, &column);
+	compiler->pos.offset = node->offset;
 
-		compiler->pos.line = node->pos.line;
+	if (compiler->pos.line != line) {
+
+		compiler->pos.line = line;
 		em_code_write_uint8(slice, EM_CODE_OP_ESETL);
-		em_code_write_uint16(slice, (uint16_t)node->pos.line);
+		em_code_write_uint16(slice, (uint16_t)line);
 	}
-	if (compiler->pos.column != node->pos.column) {
+	if (compiler->pos.column != column) {
 
-		compiler->pos.column = node->pos.column;
+		compiler->pos.column = column;
 		em_code_write_uint8(slice, EM_CODE_OP_ESETC);
-		em_code_write_uint8(slice, (uint8_t)node->pos.column);
+		em_code_write_uint8(slice, (uint8_t)column);
 	}
 }
 
-/* predict final size of node (useful for branches) */
-#define STR_SIZE(len) ((len)+3)
-#define HASH_STR_SIZE(len) (STR_SIZE(len)+4)
+/* jump offsets */
 #define PC_REL(p_slice, p_pos) ((int32_t)(p_pos) - (int32_t)((p_slice)->position) - 4)
 
-EM_API size_t em_code_get_size(em_code_compiler_t *compiler, em_node_t *node) {
-
-	em_token_t *token;
-
-	size_t size = 0;
-	em_node_t *orig = node;
-	size_t count = 0;
-
-	switch (node->type) {
-
-		/* block */
-		case EM_NODE_TYPE_BLOCK:
-			for (node = node->first; node; node = node->next) {
-
-				size += em_code_get_size(compiler, node);
-				if (node->next) size += 1; /* POP */
-			}
-			node = orig;
-			if (!node->first) size += 1; /* PNONE */
-			break;
-
-		/* constants */
-		case EM_NODE_TYPE_INT:
-			set_position_size(compiler, node, &size);
-			size += 1; /* PCINT */
-			size += sizeof(em_inttype_t);
-			break;
-		case EM_NODE_TYPE_FLOAT:
-			set_position_size(compiler, node, &size);
-			size += 1; /* PCFLT */
-			size += sizeof(em_floattype_t);
-			break;
-		case EM_NODE_TYPE_STRING:
-			set_position_size(compiler, node, &size);
-			size += 1; /* PCSTR */
-			size += STR_SIZE(em_node_get_token(node, 0)->length);
-			break;
-
-		/* load variable */
-		case EM_NODE_TYPE_IDENTIFIER:
-			set_position_size(compiler, node, &size);
-			size += 1; /* LOAD */
-			size += HASH_STR_SIZE(em_node_get_token(node, 0)->length);
-			break;
-
-		/* construct list or map, function call or puts */
-		case EM_NODE_TYPE_LIST:
-		case EM_NODE_TYPE_MAP:
-		case EM_NODE_TYPE_CALL:
-		case EM_NODE_TYPE_PUTS:
-			for (node = node->first; node; node = node->next)
-				size += em_code_get_size(compiler, node);
-			node = orig;
-			set_position_size(compiler, node, &size);
-			size += 3; /* op, uint16 */
-			break;
-
-		/* unary and binary operations */
-		case EM_NODE_TYPE_UNARY_OPERATION:
-			size += em_code_get_size(compiler, node->first);
-			set_position_size(compiler, node, &size);
-			if (em_node_get_token(node, 0)->type != EM_TOKEN_TYPE_PLUS)
-				size += 1; /* op */
-			break;
-		case EM_NODE_TYPE_BINARY_OPERATION:
-			token = em_node_get_token(node, 0);
-
-			if (strchr("ao", *token->value)) {
-
-				size += em_code_get_size(compiler, node->first);
-				size += 5; /* JTR / JNTR */
-				size += 1; /* POP */
-				size += em_code_get_size(compiler, node->first->next);
-				break;
-			}
-			size += em_code_get_size(compiler, node->first);
-			size += em_code_get_size(compiler, node->first->next);
-			set_position_size(compiler, node, &size);
-			size += 1; /* op */
-			if (token->type == EM_TOKEN_TYPE_LESS_THAN_EQUALS ||
-			    token->type == EM_TOKEN_TYPE_GREATER_THAN_EQUALS)
-				size += 1; /* UNOT */
-			break;
-
-		/* member access */
-		case EM_NODE_TYPE_ACCESS:
-			if (node->first->next) { /* indexed */
-
-				size += em_code_get_size(compiler, node->first);
-				size += em_code_get_size(compiler, node->first->next);
-				set_position_size(compiler, node, &size);
-				size += 1; /* LDIDX */
-			}
-			else { /* named */
-				size += em_code_get_size(compiler, node->first);
-				set_position_size(compiler, node, &size);
-				size += 1; /* LDNM */
-				size += HASH_STR_SIZE(em_node_get_token(node, 0)->length);
-			}
-			break;
-
-		/* continue and break */
-		case EM_NODE_TYPE_CONTINUE:
-		case EM_NODE_TYPE_BREAK:
-			set_position_size(compiler, node, &size);
-			size += 1; /* PTRUE / PFLSE */
-			size += 1; /* RSTR3 */
-			break;
-
-		/* return, raise and include */
-		case EM_NODE_TYPE_RETURN:
-		case EM_NODE_TYPE_RAISE:
-		case EM_NODE_TYPE_INCLUDE:
-			size += em_code_get_size(compiler, node->first);
-			set_position_size(compiler, node, &size);
-			size += 1; /* RSTR2 / RSTR1 / INCLUDE */
-			break;
-
-		/* let statement */
-		case EM_NODE_TYPE_LET:
-			if (node->first->next) { /* indexed */
-
-				set_position_size(compiler, node, &size);
-				for (size_t i = 0; i < node->tokens.nitems; i++) {
-
-					size += 1; /* LOAD / LDNM */
-					size += HASH_STR_SIZE(
-						em_node_get_token(node, i)->length
-					);
-				}
-				size += em_code_get_size(compiler, node->first);
-				size += em_code_get_size(compiler, node->first->next);
-				set_position_size(compiler, node, &size);
-				size += 1; /* STIDX */
-			}
-			else { /* named */
-				set_position_size(compiler, node, &size);
-				for (size_t i = 0; i < node->tokens.nitems-1; i++) {
-
-					size += 1; /* LOAD / LDNM */
-					size += HASH_STR_SIZE(
-						em_node_get_token(node, i)->length
-					);
-				}
-				size += em_code_get_size(compiler, node->first);
-				set_position_size(compiler, node, &size);
-				size += 1; /* STNM / STOR */
-				size += HASH_STR_SIZE(
-					em_node_get_token(node, node->tokens.nitems-1)->length
-				);
-			}
-			break;
-
-		/* if statement */
-		case EM_NODE_TYPE_IF:
-			node = node->first;
-			while (node) {
-
-				em_node_t *condition_node = node;
-				em_node_t *body_node = condition_node->next;
-
-				if (!body_node) {
+/* write placeholder for offset to a position that isn't known yet */
+static size_t write_fixup(em_code_slice_t *slice) {
 
-					body_node = condition_node;
-					condition_node = NULL;
-				}
-				if (condition_node) {
-
-					size += em_code_get_size(compiler, condition_node);
-					size += 5; /* JMP / JNTR, uint32 */
-				}
-
-				size += em_code_get_size(compiler, body_node);
-				if (body_node->next) size += 5; /* JMP, uint32 */
-
-				node = body_node->next;
-			}
-			break;
+	size_t at = slice->position;
+	em_code_write_int32(slice, 0);
+	return at;
+}
 
-		/* for statement */
-		case EM_NODE_TYPE_FOR:
-			token = em_node_get_token(node, 0);
-			/* @init */
-			size += 5; /* SAVE3, @break */
-			size += 1; /* PNONE (value produced by @body) */
-			size += em_code_get_size(compiler, node->first);
-			size += 1; /* STOR */
-			size += HASH_STR_SIZE(token->length);
-			size += 5; /* JMP, @cond */
-			/* @break */
-			size += 5; /* JPNTR, @end+1 */
-			size += 5; /* SAVE3, @break */
-			size += 1; /* PNONE */
-			/* @start */
-			size += 1; /* LOAD */
-			size += HASH_STR_SIZE(token->length);
-			size += 1; /* UINC */
-			size += 1; /* STOR */
-			size += HASH_STR_SIZE(token->length);
-			/* @cond */
-			size += em_code_get_size(compiler, node->first->next);
-			size += 1; /* BLT */
-			size += 5; /* JNTR, @end */
-			size += 1; /* POP (value produced by @body) */
-			/* @body */
-			size += em_code_get_size(compiler, node->first->next->next);
-			size += 5; /* JMP, @start */
-			/* @end */
-			size += 1; /* DSCD3 */
-			break;
+/* resolve placeholder to position */
+static void resolve_fixup(em_code_slice_t *slice, size_t at, size_t pos) {
 
-		/* foreach statement */
-		case EM_NODE_TYPE_FOREACH:
-			token = em_node_get_token(node, 0);
-			/* @init */
-			size += em_code_get_size(compiler, node->first);
-			size += 1; /* LEN */
-			size += 1; /* PFLSE */
-			size += 1; /* PNONE */
-			size += 5; /* SAVE3, @break */
-			size += 5; /* JMP, @start */
-			/* @break */
-			size += 5; /* JNTR, @breakend */
-			size += 5; /* SAVE3, @break */
-			size += 1; /* PNONE */
-			/* @start */
-			size += 5; /* BLTJXPIPI, @end */
-			size += 1; /* STOR */
-			size += HASH_STR_SIZE(token->length);
-			size += 1; /* POP */
-			/* @body */
-			size += em_code_get_size(compiler, node->first->next);
-			size += 5; /* JMP, @start */
-			/* @breakend */
-			size += 4; /* POP, POP, POP, PNONE */
-			size += 5; /* JMP, 1 */
-			/* @end */
-			size += 1; /* DSCD3 */
-			break;
+	int32_t offset = (int32_t)pos - (int32_t)at - 4;
+	memcpy((uint8_t *)slice->data + at, &offset, 4);
+}
 
-		/* while statement */
-		case EM_NODE_TYPE_WHILE:
-			/* @init */
-			size += 1; /* PNONE */
-			size += 5; /* SAVE3, @break */
-			size += 5; /* JMP, @start */
-			/* @break */
-			size += 5; /* JPNTR, @end+1 */
-			size += 5; /* SAVE3, @break */
-			size += 1; /* PNONE */
-			/* @start */
-			size += em_code_get_size(compiler, node->first);
-			size += 5; /* JNTR, @end */
-			size += 1; /* POP */
-			/* @body */
-			size += em_code_get_size(compiler, node->first->next);
-			size += 5; /* JMP, @start */
-			/* @end */
-			size += 1; /* DSCD3 */
-			break;
+/*
+ * Any number of placeholders can share a target by chaining them: each
+ * one holds the position of the previous one plus one until resolved.
+ */
+static size_t chain_fixup(em_code_slice_t *slice, size_t chain) {
 
-		/* func statement */
-		case EM_NODE_TYPE_FUNC:
-			size += 2; /* DFUNC, uint8 */
-			if (node->flags) {
+	size_t at = slice->position;
+	em_code_write_int32(slice, (int32_t)chain);
+	return at + 1;
+}
 
-				token = em_node_get_token(node, 0);
-				size += HASH_STR_SIZE(token->length);
-			}
-			else size += HASH_STR_SIZE(11); /* '<anonymous>' */
-			for (size_t i = 0; i < node->tokens.nitems; i++) {
+static void resolve_chain(em_code_slice_t *slice, size_t chain, size_t pos) {
 
-				if (!i && node->flags)
-					continue;
-				token = em_node_get_token(node, i);
-				size += HASH_STR_SIZE(token->length);
-			}
-			size += 4; /* uint32 */
-			size += em_code_get_size(compiler, node->first);
+	while (chain) {
 
-			if (node->flags) {
+		size_t at = chain - 1;
 
-				token = em_node_get_token(node, 0);
-				size += 1; /* STOR */
-				size += HASH_STR_SIZE(token->length);
-			}
-			break;
+		int32_t next;
+		memcpy(&next, (uint8_t *)slice->data + at, 4);
 
-		/* class statement */
-		case EM_NODE_TYPE_CLASS:
-			token = em_node_get_token(node, 0);
-			if (node->first->next) { /* with base class */
+		resolve_fixup(slice, at, pos);
+		chain = (size_t)next;
+	}
+}
 
-				size += em_code_get_size(compiler, node->first);
-				size += 1; /* DBGN */
-				size += em_code_get_size(compiler, node->first->next);
-			}
-			else { /* without base class */
-				size += 1; /* PNONE */
-				size += 1; /* DBGN */
-				size += em_code_get_size(compiler, node->first);
-			}
-			size += 1; /* DCLS */
-			size += HASH_STR_SIZE(token->length);
-			break;
+/*
+ * Add handler to table. Statements add theirs once they have been written,
+ * so the ones inside of them come first.
+ */
+static void add_handler(em_code_compiler_t *compiler, uint8_t level, size_t start, size_t end, size_t handler) {
 
-		/* try statement */
-		case EM_NODE_TYPE_TRY:
-			token = em_node_get_token(node, 0);
+	if (compiler->nhandlers >= compiler->maxhandlers) return;
 
-			/* @init */
-			size += 5; /* SAVE1, @catch */
-			/* @try */
-			size += em_code_get_size(compiler, node->first);
-			size += 5; /* JMP, @end */
-			/* @catch */
-			size += em_code_get_size(compiler, node->first->next);
-			size += 1; /* R1EISNTP */
-			size += 1; /* STOR */
-			size += HASH_STR_SIZE(token->length);
-			size += 1; /* POP */
-			size += em_code_get_size(compiler, node->first->next->next);
-			size += 5; /* JMP, @end+1 */
-			/* @end */
-			size += 1; /* DSCD1 */
-			break;
-	}
-	orig->code_size = size;
-	return size;
+	em_code_handler_t entry = {(uint32_t)start, (uint32_t)end, (uint32_t)handler, 0, level};
+	em_code_set_handler(compiler->slice, compiler->nhandlers++, &entry);
 }
 
 /* write node */
 EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 
 	em_code_slice_t *slice = compiler->slice;
-	em_token_t *token;
+	em_node_token_t *token;
 	em_hash_t hash;
 	em_inttype_t it_value;
 	em_floattype_t ft_value;
 	const char *string;
 	em_code_op_t op = 0;
 	size_t count = 0;
-	size_t pos_a, pos_b, pos_c, pos_d, pos_e, pos_f;
-
-	em_node_t *orig = node;
+	size_t pos_a, pos_b, pos_c, pos_d, pos_e;
 
 	switch (node->type) {
 
 		/* block */
 		case EM_NODE_TYPE_BLOCK:
-			for (node = node->first; node; node = node->next) {
+			for (uint32_t i = 0; i < node->nchildren; i++) {
 
-				em_code_write(compiler, node);
-				if (node->next) em_code_write_uint8(slice, EM_CODE_OP_POP);
+				em_code_write(compiler, node->children[i]);
+				if (i+1 < node->nchildren) em_code_write_uint8(slice, EM_CODE_OP_POP);
 			}
-			node = orig;
-			if (!node->first) em_code_write_uint8(slice, EM_CODE_OP_PNONE);
+			if (!node->nchildren) em_code_write_uint8(slice, EM_CODE_OP_PNONE);
 			break;
 
 		/* constants */
@@ -783,12 +697,11 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 		/* construct list or puts statement */
 		case EM_NODE_TYPE_LIST:
 		case EM_NODE_TYPE_PUTS:
-			for (node = node->first; node; node = node->next) {
+			for (uint32_t i = 0; i < node->nchildren; i++) {
 
-				em_code_write(compiler, node);
+				em_code_write(compiler, node->children[i]);
 				count++;
 			}
-			node = orig;
 			set_position(compiler, node);
 
 			op = EM_CODE_OP_CLIST;
@@ -801,12 +714,11 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 
 		/* construct map */
 		case EM_NODE_TYPE_MAP:
-			for (node = node->first; node; node = node->next) {
+			for (uint32_t i = 0; i < node->nchildren; i++) {
 
-				em_code_write(compiler, node);
+				em_code_write(compiler, node->children[i]);
 				count++;
 			}
-			node = orig;
 			set_position(compiler, node);
 
 			em_code_write_uint8(slice, EM_CODE_OP_CMAP);
@@ -815,88 +727,90 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 
 		/* unary operation */
 		case EM_NODE_TYPE_UNARY_OPERATION:
-			em_code_write(compiler, node->first);
+			em_code_write(compiler, node->children[0]);
 			set_position(compiler, node);
 
-			token = em_node_get_token(node, 0);
-			if (token->type == EM_TOKEN_TYPE_MINUS)
+			if (node->op == EM_NODE_OP_NEGATIVE)
 				em_code_write_uint8(slice, EM_CODE_OP_UNEG);
-			else if (token->type == EM_TOKEN_TYPE_BITWISE_NOT)
+			else if (node->op == EM_NODE_OP_BITWISE_NOT)
 				em_code_write_uint8(slice, EM_CODE_OP_UBNOT);
-			else if (!strcmp(token->value, "not"))
+			else if (node->op == EM_NODE_OP_NOT)
 				em_code_write_uint8(slice, EM_CODE_OP_UNOT);
 			break;
 
 		/* binary operation */
 		case EM_NODE_TYPE_BINARY_OPERATION:
-			token = em_node_get_token(node, 0);
-
 			/* short-circuited operations */
-			if (strchr("ao", *token->value)) {
+			if (node->op == EM_NODE_OP_AND || node->op == EM_NODE_OP_OR) {
 
-				switch (*token->value) {
-					case 'a': op = EM_CODE_OP_JNTR; break;
-					case 'o': op = EM_CODE_OP_JTR; break;
-				}
+				em_code_op_t done_op = 0;
+				if (node->op == EM_NODE_OP_AND) { op = EM_CODE_OP_JNTR; done_op = EM_CODE_OP_PFLSE; }
+				else { op = EM_CODE_OP_JTR; done_op = EM_CODE_OP_PTRUE; }
 
-				em_code_write(compiler, node->first);
+				/* both operations result in a boolean, like in the tree-walker */
+				em_code_write(compiler, node->children[0]);
 				em_code_write_uint8(slice, (uint8_t)op);
-				em_code_write_int32(
-					slice, (int32_t)node->first->next->code_size+1
-				);
-				em_code_write_uint8(slice, EM_CODE_OP_POP);
-				em_code_write(compiler, node->first->next);
+				pos_a = write_fixup(slice); /* @done */
+				em_code_write(compiler, node->children[1]);
+				em_code_write_uint8(slice, EM_CODE_OP_UNOT);
+				em_code_write_uint8(slice, EM_CODE_OP_UNOT);
+				em_code_write_uint8(slice, EM_CODE_OP_JMP);
+				em_code_write_int32(slice, 1);
+				/* @done */
+				resolve_fixup(slice, pos_a, slice->position);
+				em_code_write_uint8(slice, (uint8_t)done_op);
 				break;
 			}
 
 			/* normal operations */
-			em_code_write(compiler, node->first);
-			em_code_write(compiler, node->first->next);
+			em_code_write(compiler, node->children[0]);
+			em_code_write(compiler, node->children[1]);
 			set_position(compiler, node);
 
-			if (token->type == EM_TOKEN_TYPE_LESS_THAN_EQUALS) {
+			if (node->op == EM_NODE_OP_LESS_THAN_EQUAL) {
 
 				em_code_write_uint8(slice, EM_CODE_OP_BGT);
 				em_code_write_uint8(slice, EM_CODE_OP_UNOT);
 				break;
 			}
-			else if (token->type == EM_TOKEN_TYPE_GREATER_THAN_EQUALS) {
+			else if (node->op == EM_NODE_OP_GREATER_THAN_EQUAL) {
 
 				em_code_write_uint8(slice, EM_CODE_OP_BLT);
 				em_code_write_uint8(slice, EM_CODE_OP_UNOT);
 				break;
 			}
 
-			switch (token->type) {
-				case EM_TOKEN_TYPE_PLUS: op = EM_CODE_OP_BADD; break;
-				case EM_TOKEN_TYPE_MINUS: op = EM_CODE_OP_BSUB; break;
-				case EM_TOKEN_TYPE_ASTERISK: op = EM_CODE_OP_BMUL; break;
-				case EM_TOKEN_TYPE_SLASH: op = EM_CODE_OP_BDIV; break;
-				case EM_TOKEN_TYPE_MODULO: op = EM_CODE_OP_BMOD; break;
-				case EM_TOKEN_TYPE_BITWISE_OR: op = EM_CODE_OP_BBOR; break;
-				case EM_TOKEN_TYPE_BITWISE_XOR: op = EM_CODE_OP_BBXOR; break;
-				case EM_TOKEN_TYPE_BITWISE_AND: op = EM_CODE_OP_BBAND; break;
-				case EM_TOKEN_TYPE_BITWISE_LEFT_SHIFT: op = EM_CODE_OP_BBLSH; break;
-				case EM_TOKEN_TYPE_BITWISE_RIGHT_SHIFT: op = EM_CODE_OP_BBRSH; break;
-				case EM_TOKEN_TYPE_DOUBLE_EQUALS: op = EM_CODE_OP_BEQ; break;
-				case EM_TOKEN_TYPE_NOT_EQUALS: op = EM_CODE_OP_BNEQ; break;
-				case EM_TOKEN_TYPE_LESS_THAN: op = EM_CODE_OP_BLT; break;
-				case EM_TOKEN_TYPE_GREATER_THAN: op = EM_CODE_OP_BGT; break;
+			switch (node->op) {
+				case EM_NODE_OP_ADD: op = EM_CODE_OP_BADD; break;
+				case EM_NODE_OP_SUBTRACT: op = EM_CODE_OP_BSUB; break;
+				case EM_NODE_OP_MULTIPLY: op = EM_CODE_OP_BMUL; break;
+				case EM_NODE_OP_DIVIDE: op = EM_CODE_OP_BDIV; break;
+				case EM_NODE_OP_MODULO: op = EM_CODE_OP_BMOD; break;
+				case EM_NODE_OP_BITWISE_OR: op = EM_CODE_OP_BBOR; break;
+				case EM_NODE_OP_BITWISE_XOR: op = EM_CODE_OP_BBXOR; break;
+				case EM_NODE_OP_BITWISE_AND: op = EM_CODE_OP_BBAND; break;
+				case EM_NODE_OP_SHIFT_LEFT: op = EM_CODE_OP_BBLSH; break;
+				case EM_NODE_OP_SHIFT_RIGHT: op = EM_CODE_OP_BBRSH; break;
+				case EM_NODE_OP_EQUAL: op = EM_CODE_OP_BEQ; break;
+				case EM_NODE_OP_NOT_EQUAL: op = EM_CODE_OP_BNEQ; break;
+				case EM_NODE_OP_LESS_THAN: op = EM_CODE_OP_BLT; break;
+				case EM_NODE_OP_GREATER_THAN: op = EM_CODE_OP_BGT; break;
+				default: break;
 			}
 			em_code_write_uint8(slice, (uint8_t)op);
 			break;
 
 		/* member access */
 		case EM_NODE_TYPE_ACCESS:
-			if (node->first->next) { /* indexed */
+			if (node->nchildren > 1) { /* indexed */
 
-				em_code_write(compiler, node->first);
-				em_code_write(compiler, node->first->next);
+				em_code_write(compiler, node->children[0]);
+				em_code_write(compiler, node->children[1]);
 				set_position(compiler, node);
 				em_code_write_uint8(slice, EM_CODE_OP_LDIDX);
 			}
 			else { /* named */
-				em_code_write(compiler, node->first);
+				em_code_write(compiler, node->children[0]);
 				set_position(compiler, node);
 				em_code_write_uint8(slice, EM_CODE_OP_LDNM);
 
@@ -912,12 +826,11 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 
 		/* call */
 		case EM_NODE_TYPE_CALL:
-			for (node = node->first; node; node = node->next) {
+			for (uint32_t i = 0; i < node->nchildren; i++) {
 
-				em_code_write(compiler, node);
+				em_code_write(compiler, node->children[i]);
 				count++;
 			}
-			node = orig;
 			set_position(compiler, node);
 			em_code_write_uint8(slice, EM_CODE_OP_CALL);
 			em_code_write_uint16(slice, (uint16_t)count);
@@ -939,31 +852,44 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 
 		/* return */
 		case EM_NODE_TYPE_RETURN:
-			em_code_write(compiler, node->first);
+			if (node->flags & EM_NODE_RETURN_TAIL) {
+
+				node = node->children[0];
+				for (uint32_t i = 0; i < node->nchildren; i++) {
+
+					em_code_write(compiler, node->children[i]);
+					count++;
+				}
+				set_position(compiler, node);
+				em_code_write_uint8(slice, EM_CODE_OP_TCALL);
+				em_code_write_uint16(slice, (uint16_t)count);
+				break;
+			}
+			em_code_write(compiler, node->children[0]);
 			set_position(compiler, node);
 			em_code_write_uint8(slice, EM_CODE_OP_RSTR2);
 			break;
 
 		/* raise */
 		case EM_NODE_TYPE_RAISE:
-			em_code_write(compiler, node->first);
+			em_code_write(compiler, node->children[0]);
 			set_position(compiler, node);
 			em_code_write_uint8(slice, EM_CODE_OP_RSTR1);
 			break;
 
 		/* include */
 		case EM_NODE_TYPE_INCLUDE:
-			em_code_write(compiler, node->first);
+			em_code_write(compiler, node->children[0]);
 			set_position(compiler, node);
 			em_code_write_uint8(slice, EM_CODE_OP_INCLUDE);
 			break;
 
 		/* let statement */
 		case EM_NODE_TYPE_LET:
-			if (node->first->next) { /* indexed */
+			if (node->nchildren > 1) { /* indexed */
 
 				set_position(compiler, node);
-				for (size_t i = 0; i < node->tokens.nitems; i++) {
+				for (size_t i = 0; i < node->ntokens; i++) {
 
 					token = em_node_get_token(node, i);
 					hash = em_node_get_value(node, i).v.te_hash;
@@ -977,14 +903,14 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 							token->length, hash
 					);
 				}
-				em_code_write(compiler, node->first);
-				em_code_write(compiler, node->first->next);
+				em_code_write(compiler, node->children[0]);
+				em_code_write(compiler, node->children[1]);
 				set_position(compiler, node);
 				em_code_write_uint8(slice, EM_CODE_OP_STIDX);
 			}
 			else { /* named */
 				set_position(compiler, node);
-				for (size_t i = 0; i < node->tokens.nitems-1; i++) {
+				for (size_t i = 0; i+1 < node->ntokens; i++) {
 
 					token = em_node_get_token(node, i);
 					hash = em_node_get_value(node, i).v.te_hash;
@@ -998,13 +924,13 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 							token->length, hash
 					);
 				}
-				em_code_write(compiler, node->first);
+				em_code_write(compiler, node->children[0]);
 				set_position(compiler, node);
 
-				token = em_node_get_token(node, node->tokens.nitems-1);
-				hash = em_node_get_value(node, node->tokens.nitems-1).v.te_hash;
+				token = em_node_get_token(node, node->ntokens-1);
+				hash = em_node_get_value(node, node->ntokens-1).v.te_hash;
 
-				if (node->tokens.nitems > 1)
+				if (node->ntokens > 1)
 					em_code_write_uint8(slice, EM_CODE_OP_STNM);
 				else
 					em_code_write_uint8(slice, EM_CODE_OP_STOR);
@@ -1017,12 +943,12 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 
 		/* if statement */
 		case EM_NODE_TYPE_IF:
-			count = slice->position;
-			node = node->first;
-			while (node) {
+			pos_b = 0; /* chain of jumps to @end */
+			for (uint32_t i = 0; i < node->nchildren; i += 2) {
 
-				em_node_t *condition_node = node;
-				em_node_t *body_node = condition_node->next;
+				em_node_t *condition_node = node->children[i];
+				em_node_t *body_node = i+1 < node->nchildren? node->children[i+1]: NULL;
+				em_bool_t more = i+2 < node->nchildren; /* arms after this one */
 
 				if (!body_node) {
 
@@ -1033,111 +959,87 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 
 					em_code_write(compiler, condition_node);
 
-					int32_t jump = (int32_t)body_node->code_size;
-					if (body_node->next) jump += 5;
-
-					em_code_write_uint8(slice, EM_CODE_OP_JNTR);
-					em_code_write_int32(slice, jump);
+					/* without an else arm, the statement results in none */
+					em_code_write_uint8(slice, more? EM_CODE_OP_JNTR: EM_CODE_OP_JPNTR);
+					pos_a = write_fixup(slice); /* next arm */
 				}
 				em_code_write(compiler, body_node);
-				if (body_node->next) {
+				if (more) {
 
 					em_code_write_uint8(slice, EM_CODE_OP_JMP);
-
-					int32_t jump = PC_REL(slice, count + orig->code_size);
-					em_code_write_int32(slice, jump);
+					pos_b = chain_fixup(slice, pos_b); /* @end */
 				}
-
-				node = body_node->next;
+				if (condition_node)
+					resolve_fixup(slice, pos_a, slice->position);
 			}
+			/* @end */
+			resolve_chain(slice, pos_b, slice->position);
 			break;
 
 		/* for statement */
 		case EM_NODE_TYPE_FOR:
 			token = em_node_get_token(node, 0);
 			hash = em_utf8_strhash(token->value);
-			count = HASH_STR_SIZE(token->length);
-
-			pos_a = slice->position + node->first->code_size + 12 + count; /* @break */
-			pos_b = pos_a + 11; /* @start */
-			pos_c = pos_b + 3 + count * 2; /* @cond */
-			pos_d = pos_c + node->first->next->code_size + 7; /* @body */
-			pos_e = pos_d + node->first->next->next->code_size + 5; /* @end */
 
 			/* @init */
-			em_code_write_uint8(slice, EM_CODE_OP_SAVE3);
-			em_code_write_int32(slice, PC_REL(slice, pos_a)); /* SAVE3 @break */
-			em_code_write_uint8(slice, EM_CODE_OP_PNONE);
-			em_code_write(compiler, node->first);
-			em_code_write_uint8(slice, EM_CODE_OP_STOR);
-			em_code_write_hashed_string(
-					slice, token->value,
-					token->length, hash
-			);
-			em_code_write_uint8(slice, EM_CODE_OP_JMP);
-			em_code_write_int32(slice, PC_REL(slice, pos_c)); /* JMP @cond */
-			/* @break */
-			em_code_write_uint8(slice, EM_CODE_OP_JPNTR);
-			em_code_write_int32(slice, PC_REL(slice, pos_e+1)); /* JNTR @end+1 */
-			em_code_write_uint8(slice, EM_CODE_OP_SAVE3);
-			em_code_write_int32(slice, PC_REL(slice, pos_a)); /* SAVE3 @break */
-			em_code_write_uint8(slice, EM_CODE_OP_PNONE);
-			/* @start */
-			em_code_write_uint8(slice, EM_CODE_OP_LOAD);
+			em_code_write(compiler, node->children[0]);
+			em_code_write(compiler, node->children[1]);
+			set_position(compiler, node);
+
+			em_code_write_uint8(slice, EM_CODE_OP_FORPREP);
+			em_code_write_uint8(slice, (uint8_t)node->flags);
 			em_code_write_hashed_string(
 					slice, token->value,
 					token->length, hash
 			);
-			em_code_write_uint8(slice, EM_CODE_OP_UINC);
-			em_code_write_uint8(slice, EM_CODE_OP_STOR);
+			pos_a = write_fixup(slice); /* FORPREP @done */
+			/* @body */
+			pos_b = slice->position;
+			em_code_write(compiler, node->children[2]);
+			/* @next */
+			pos_c = slice->position;
+			em_code_write_uint8(slice, EM_CODE_OP_FORLOOP);
+			em_code_write_uint8(slice, (uint8_t)node->flags);
 			em_code_write_hashed_string(
 					slice, token->value,
 					token->length, hash
 			);
-			/* @cond */
-			em_code_write(compiler, node->first->next);
-			em_code_write_uint8(slice, EM_CODE_OP_BLT);
+			em_code_write_int32(slice, PC_REL(slice, pos_b)); /* FORLOOP @body */
+			em_code_write_uint8(slice, EM_CODE_OP_JMP);
+			pos_d = write_fixup(slice); /* JMP @done */
+			/* @break */
+			add_handler(compiler, 3, pos_b, pos_c, slice->position);
 			em_code_write_uint8(slice, EM_CODE_OP_JNTR);
-			em_code_write_int32(slice, PC_REL(slice, pos_e)); /* JNTR @end */
-			em_code_write_uint8(slice, EM_CODE_OP_POP);
-			/* @body */
-			em_code_write(compiler, node->first->next->next);
+			pos_e = write_fixup(slice); /* JNTR @breakend */
+			em_code_write_uint8(slice, EM_CODE_OP_PNONE);
 			em_code_write_uint8(slice, EM_CODE_OP_JMP);
-			em_code_write_int32(slice, PC_REL(slice, pos_b)); /* JMP @start */
-			/* @end */
-			em_code_write_uint8(slice, EM_CODE_OP_DSCD3);
+			em_code_write_int32(slice, PC_REL(slice, pos_c)); /* JMP @next */
+			/* @breakend */
+			resolve_fixup(slice, pos_e, slice->position);
+			em_code_write_uint8(slice, EM_CODE_OP_POP);
+			em_code_write_uint8(slice, EM_CODE_OP_POP);
+			em_code_write_uint8(slice, EM_CODE_OP_PNONE);
+			/* @done */
+			resolve_fixup(slice, pos_a, slice->position);
+			resolve_fixup(slice, pos_d, slice->position);
 			break;
 
 		/* foreach statement */
 		case EM_NODE_TYPE_FOREACH:
 			token = em_node_get_token(node, 0);
 			hash = em_utf8_strhash(token->value);
-			count = HASH_STR_SIZE(token->length);
-
-			pos_a = slice->position + 13 + node->first->code_size; /* @break */
-			pos_b = pos_a + 11; /* @start */
-			pos_c = pos_b + 7 + count; /* @body */
-			pos_d = pos_c + 5 + node->first->next->code_size; /* @breakend */
-			pos_e = pos_d + 9; /* @end */
 
 			/* @init */
-			em_code_write(compiler, node->first);
+			em_code_write(compiler, node->children[0]);
 			em_code_write_uint8(slice, EM_CODE_OP_LEN);
 			em_code_write_uint8(slice, EM_CODE_OP_PFLSE);
-			em_code_write_uint8(slice, EM_CODE_OP_PNONE);
-			em_code_write_uint8(slice, EM_CODE_OP_SAVE3);
-			em_code_write_int32(slice, PC_REL(slice, pos_a)); /* SAVE3 @break */
-			em_code_write_uint8(slice, EM_CODE_OP_JMP);
-			em_code_write_int32(slice, PC_REL(slice, pos_b)); /* JMP @start */
-			/* @break */
-			em_code_write_uint8(slice, EM_CODE_OP_JNTR);
-			em_code_write_int32(slice, PC_REL(slice, pos_d)); /* JNTR @breakend */
-			em_code_write_uint8(slice, EM_CODE_OP_SAVE3);
-			em_code_write_int32(slice, PC_REL(slice, pos_a)); /* SAVE3 @break */
+			/* @next */
+			pos_a = slice->position;
 			em_code_write_uint8(slice, EM_CODE_OP_PNONE);
 			/* @start */
+			pos_b = slice->position;
 			em_code_write_uint8(slice, EM_CODE_OP_BLTJXPIPI);
-			em_code_write_int32(slice, PC_REL(slice, pos_e)); /* BLTJXPIPI @end */
+			pos_c = write_fixup(slice); /* BLTJXPIPI @end */
 			em_code_write_uint8(slice, EM_CODE_OP_STOR);
 			em_code_write_hashed_string(
 					slice, token->value,
@@ -1145,56 +1047,55 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 			);
 			em_code_write_uint8(slice, EM_CODE_OP_POP);
 			/* @body */
-			em_code_write(compiler, node->first->next);
+			em_code_write(compiler, node->children[1]);
 			em_code_write_uint8(slice, EM_CODE_OP_JMP);
 			em_code_write_int32(slice, PC_REL(slice, pos_b)); /* JMP @start */
+			/* @break */
+			add_handler(compiler, 3, pos_a, slice->position, slice->position);
+			em_code_write_uint8(slice, EM_CODE_OP_JNTR);
+			pos_d = write_fixup(slice); /* JNTR @breakend */
+			em_code_write_uint8(slice, EM_CODE_OP_JMP);
+			em_code_write_int32(slice, PC_REL(slice, pos_a)); /* JMP @next */
 			/* @breakend */
+			resolve_fixup(slice, pos_d, slice->position);
 			em_code_write_uint8(slice, EM_CODE_OP_POP);
 			em_code_write_uint8(slice, EM_CODE_OP_POP);
 			em_code_write_uint8(slice, EM_CODE_OP_POP);
 			em_code_write_uint8(slice, EM_CODE_OP_PNONE);
-			em_code_write_uint8(slice, EM_CODE_OP_JMP);
-			em_code_write_int32(slice, 1);
 			/* @end */
-			em_code_write_uint8(slice, EM_CODE_OP_DSCD3);
+			resolve_fixup(slice, pos_c, slice->position);
 			break;
 
 		/* while statement */
 		case EM_NODE_TYPE_WHILE:
-			pos_a = slice->position + 11; /* @break */
-			pos_b = pos_a + 11; /* @start */
-			pos_c = pos_b + 6 + node->first->code_size; /* @body */
-			pos_d = pos_c + 5 + node->first->next->code_size; /* @end */
-
-			/* @init */
-			em_code_write_uint8(slice, EM_CODE_OP_PNONE);
-			em_code_write_uint8(slice, EM_CODE_OP_SAVE3);
-			em_code_write_int32(slice, PC_REL(slice, pos_a)); /* SAVE3 @break */
-			em_code_write_uint8(slice, EM_CODE_OP_JMP);
-			em_code_write_int32(slice, PC_REL(slice, pos_b)); /* JMP @start */
-			/* @break */
-			em_code_write_uint8(slice, EM_CODE_OP_JPNTR);
-			em_code_write_int32(slice, PC_REL(slice, pos_d+1)); /* JNTR @end+1 */
-			em_code_write_uint8(slice, EM_CODE_OP_SAVE3);
-			em_code_write_int32(slice, PC_REL(slice, pos_a)); /* SAVE3 @break */
+			/* @init; the value of the loop is kept above the depth that loop exits cut back to */
+			pos_a = slice->position;
 			em_code_write_uint8(slice, EM_CODE_OP_PNONE);
 			/* @start */
-			em_code_write(compiler, node->first);
+			pos_b = slice->position;
+			em_code_write(compiler, node->children[0]);
 			em_code_write_uint8(slice, EM_CODE_OP_JNTR);
-			em_code_write_int32(slice, PC_REL(slice, pos_d)); /* JNTR @end */
+			pos_c = write_fixup(slice); /* JNTR @end */
 			em_code_write_uint8(slice, EM_CODE_OP_POP);
 			/* @body */
-			em_code_write(compiler, node->first->next);
+			em_code_write(compiler, node->children[1]);
 			em_code_write_uint8(slice, EM_CODE_OP_JMP);
 			em_code_write_int32(slice, PC_REL(slice, pos_b)); /* JMP @start */
+			/* @break */
+			add_handler(compiler, 3, pos_a, slice->position, slice->position);
+			em_code_write_uint8(slice, EM_CODE_OP_JPNTR);
+			pos_d = write_fixup(slice); /* JPNTR @end */
+			em_code_write_uint8(slice, EM_CODE_OP_JMP);
+			em_code_write_int32(slice, PC_REL(slice, pos_a)); /* JMP @init */
 			/* @end */
-			em_code_write_uint8(slice, EM_CODE_OP_DSCD3);
+			resolve_fixup(slice, pos_c, slice->position);
+			resolve_fixup(slice, pos_d, slice->position);
 			break;
 
 		/* func statement */
 		case EM_NODE_TYPE_FUNC:
 			em_code_write_uint8(slice, EM_CODE_OP_DFUNC);
-			em_code_write_uint8(slice, node->tokens.nitems - (node->flags? 1: 0));
+			em_code_write_uint8(slice, node->ntokens - (node->flags? 1: 0));
 
 			if (node->flags) {
 
@@ -1210,7 +1111,7 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 					slice, "<anonymous>",
 					11, 0xc513fead
 			);
-			for (size_t i = 0; i < node->tokens.nitems; i++) {
+			for (size_t i = 0; i < node->ntokens; i++) {
 
 				if (!i && node->flags)
 					continue;
@@ -1222,8 +1123,9 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 						token->length, hash
 				);
 			}
-			em_code_write_uint32(slice, (uint32_t)node->first->code_size);
-			em_code_write(compiler, node->first);
+			pos_a = write_fixup(slice); /* length of body */
+			em_code_write(compiler, node->children[0]);
+			resolve_fixup(slice, pos_a, slice->position);
 
 			if (node->flags) {
 
@@ -1243,16 +1145,16 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 			token = em_node_get_token(node, 0);
 			hash = em_utf8_strhash(token->value);
 
-			if (node->first->next) { /* with base class */
+			if (node->nchildren > 1) { /* with base class */
 
-				em_code_write(compiler, node->first);
+				em_code_write(compiler, node->children[0]);
 				em_code_write_uint8(slice, EM_CODE_OP_DBGN);
-				em_code_write(compiler, node->first->next);
+				em_code_write(compiler, node->children[1]);
 			}
 			else { /* without base class */
 				em_code_write_uint8(slice, EM_CODE_OP_PNONE);
 				em_code_write_uint8(slice, EM_CODE_OP_DBGN);
-				em_code_write(compiler, node->first);
+				em_code_write(compiler, node->children[0]);
 			}
 			em_code_write_uint8(slice, EM_CODE_OP_DCLS);
 			em_code_write_hashed_string(
@@ -1265,22 +1167,16 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 		case EM_NODE_TYPE_TRY:
 			token = em_node_get_token(node, 0);
 			hash = em_utf8_strhash(token->value);
-			count = HASH_STR_SIZE(token->length);
 
-			pos_a = slice->position + 5; /* @try */
-			pos_b = pos_a + 5 + node->first->code_size; /* @catch */
-			pos_c = pos_b + 8 + node->first->next->code_size;
-			pos_c += count + node->first->next->next->code_size; /* @end */
-
-			/* @init */
-			em_code_write_uint8(slice, EM_CODE_OP_SAVE1);
-			em_code_write_int32(slice, PC_REL(slice, pos_b)); /* SAVE1 @catch */
 			/* @try */
-			em_code_write(compiler, node->first);
+			pos_a = slice->position;
+			em_code_write(compiler, node->children[0]);
+			pos_b = slice->position;
 			em_code_write_uint8(slice, EM_CODE_OP_JMP);
-			em_code_write_int32(slice, PC_REL(slice, pos_c)); /* JMP @end */
+			pos_c = write_fixup(slice); /* JMP @end */
 			/* @catch */
-			em_code_write(compiler, node->first->next);
+			add_handler(compiler, 1, pos_a, pos_b, slice->position);
+			em_code_write(compiler, node->children[1]);
 			em_code_write_uint8(slice, EM_CODE_OP_R1EISNTP);
 			em_code_write_uint8(slice, EM_CODE_OP_STOR);
 			em_code_write_hashed_string(
@@ -1288,224 +1184,549 @@ EM_API void em_code_write(em_code_compiler_t *compiler, em_node_t *node) {
 					token->length, hash
 			);
 			em_code_write_uint8(slice, EM_CODE_OP_POP);
-			em_code_write(compiler, node->first->next->next);
-			em_code_write_uint8(slice, EM_CODE_OP_JMP);
-			em_code_write_int32(slice, PC_REL(slice, pos_c+1)); /* JMP @end+1 */
+			em_code_write(compiler, node->children[2]);
 			/* @end */
-			em_code_write_uint8(slice, EM_CODE_OP_DSCD1);
+			resolve_fixup(slice, pos_c, slice->position);
 			break;
 	}
 }
 
-/* disassemble generated code */
-EM_API void em_code_disassemble(em_code_slice_t *slice, FILE *fp) {
+/* get name of operation */
+EM_API const char *em_code_get_op_name(em_code_op_t op) {
+
+	if (op <= 0 || op >= EM_CODE_OP_COUNT) return "Unknown";
+	return op_names[op];
+}
+
+/* disassemble instruction at current position */
+EM_API em_bool_t em_code_disassemble_inst(em_code_slice_t *slice, FILE *fp) {
 
-	slice->position = 0;
 	em_hash_t hash;
 	uint8_t count;
 
-	while (slice->position < slice->length) {
+	em_code_op_t op = (em_code_op_t)em_code_read_uint8(slice);
+	switch (op) {
 
-		fprintf(fp, "%08x  ", slice->position);
-		em_code_op_t op = (em_code_op_t)em_code_read_uint8(slice);
+		/* push int constant */
+		case EM_CODE_OP_PCINT:
+			fprintf(fp,
+				"PCINT " EM_INTTYPE_FORMAT "\n",
+				em_code_read_inttype(slice));
+			break;
 
-		switch (op) {
+		/* push float constant */
+		case EM_CODE_OP_PCFLT:
+			fprintf(fp,
+				"PCFLT " EM_FLOATTYPE_FORMAT "\n",
+				em_code_read_floattype(slice));
+			break;
 
-			/* push int constant */
-			case EM_CODE_OP_PCINT:
-				fprintf(fp,
-					"PCINT " EM_INTTYPE_FORMAT "\n",
-					em_code_read_inttype(slice));
-				break;
+		/* push string constant */
+		case EM_CODE_OP_PCSTR:
+			fprintf(fp,
+				"PCSTR \"%s\"\n",
+				em_code_read_string(slice));
+			break;
 
-			/* push float constant */
-			case EM_CODE_OP_PCFLT:
-				fprintf(fp,
-					"PCFLT " EM_FLOATTYPE_FORMAT "\n",
-					em_code_read_floattype(slice));
-				break;
+		/* set line */
+		case EM_CODE_OP_ESETL:
+			fprintf(fp,
+				"ESETL %hu\n",
+				em_code_read_uint16(slice));
+			break;
 
-			/* push string constant */
-			case EM_CODE_OP_PCSTR:
-				fprintf(fp,
-					"PCSTR \"%s\"\n",
-					em_code_read_string(slice));
-				break;
+		/* set column */
+		case EM_CODE_OP_ESETC:
+			fprintf(fp,
+				"ESETC %hhu\n",
+				em_code_read_uint8(slice));
+			break;
 
-			/* set line */
-			case EM_CODE_OP_ESETL:
-				fprintf(fp,
-					"ESETL %hu\n",
-					em_code_read_uint16(slice));
-				break;
+		/* set line and column */
+		case EM_CODE_OP_ESETLC:
+			fprintf(fp, "ESETLC %hu", em_code_read_uint16(slice));
+			fprintf(fp, " %hhu\n", em_code_read_uint8(slice));
+			break;
 
-			/* set column */
-			case EM_CODE_OP_ESETC:
-				fprintf(fp,
-					"ESETC %hhu\n",
-					em_code_read_uint8(slice));
-				break;
+		/* counted loop */
+		case EM_CODE_OP_FORPREP:
+		case EM_CODE_OP_FORLOOP:
+			fprintf(fp, "%s %hhu", op_names[op],
+				em_code_read_uint8(slice));
+			fprintf(fp, " \"%s\"",
+				em_code_read_hashed_string(slice, &hash));
+			fprintf(fp, " %+d\n",
+				em_code_read_int32(slice));
+			break;
 
-			/* single word instructions */
-			case EM_CODE_OP_PTRUE:
-			case EM_CODE_OP_PFLSE:
-			case EM_CODE_OP_PNONE:
-			case EM_CODE_OP_POP:
-			case EM_CODE_OP_UNEG:
-			case EM_CODE_OP_UNOT:
-			case EM_CODE_OP_UBNOT:
-			case EM_CODE_OP_UINC:
-			case EM_CODE_OP_UDEC:
-			case EM_CODE_OP_BADD:
-			case EM_CODE_OP_BSUB:
-			case EM_CODE_OP_BMUL:
-			case EM_CODE_OP_BDIV:
-			case EM_CODE_OP_BMOD:
-			case EM_CODE_OP_BBOR:
-			case EM_CODE_OP_BBXOR:
-			case EM_CODE_OP_BBAND:
-			case EM_CODE_OP_BBLSH:
-			case EM_CODE_OP_BBRSH:
-			case EM_CODE_OP_BEQ:
-			case EM_CODE_OP_BNEQ:
-			case EM_CODE_OP_BLT:
-			case EM_CODE_OP_BGT:
-			case EM_CODE_OP_LDIDX:
-			case EM_CODE_OP_STIDX:
-			case EM_CODE_OP_RSTR1:
-			case EM_CODE_OP_RSTR2:
-			case EM_CODE_OP_RSTR3:
-			case EM_CODE_OP_DSCD1:
-			case EM_CODE_OP_DSCD3:
-			case EM_CODE_OP_DBGN:
-			case EM_CODE_OP_INCLUDE:
-			case EM_CODE_OP_LEN:
-			case EM_CODE_OP_R1EISNTP:
-				fprintf(fp, "%s\n", op_names[op]);
-				break;
+		/* load variable and add int constant */
+		case EM_CODE_OP_LADDI:
+		case EM_CODE_OP_LADDII:
+			fprintf(fp, "%s \"%s\"", op_names[op],
+				em_code_read_hashed_string(slice, &hash));
+			fprintf(fp, " " EM_INTTYPE_FORMAT "\n",
+				em_code_read_inttype(slice));
+			break;
 
-			/* jumps */
-			case EM_CODE_OP_JMP:
-			case EM_CODE_OP_JTR:
-			case EM_CODE_OP_JNTR:
-			case EM_CODE_OP_JPNTR:
-			case EM_CODE_OP_SAVE1:
-			case EM_CODE_OP_SAVE3:
-			case EM_CODE_OP_BLTJXPIPI:
-				fprintf(fp, "%s %+d\n", op_names[op],
-					em_code_read_int32(slice));
-				break;
+		/* single word instructions */
+		case EM_CODE_OP_PTRUE:
+		case EM_CODE_OP_PFLSE:
+		case EM_CODE_OP_PNONE:
+		case EM_CODE_OP_POP:
+		case EM_CODE_OP_UNEG:
+		case EM_CODE_OP_UNOT:
+		case EM_CODE_OP_UBNOT:
+		case EM_CODE_OP_UINC:
+		case EM_CODE_OP_UDEC:
+		case EM_CODE_OP_BADD:
+		case EM_CODE_OP_BSUB:
+		case EM_CODE_OP_BMUL:
+		case EM_CODE_OP_BDIV:
+		case EM_CODE_OP_BMOD:
+		case EM_CODE_OP_BBOR:
+		case EM_CODE_OP_BBXOR:
+		case EM_CODE_OP_BBAND:
+		case EM_CODE_OP_BBLSH:
+		case EM_CODE_OP_BBRSH:
+		case EM_CODE_OP_BEQ:
+		case EM_CODE_OP_BNEQ:
+		case EM_CODE_OP_BLT:
+		case EM_CODE_OP_BGT:
+		case EM_CODE_OP_BADDII:
+		case EM_CODE_OP_BSUBII:
+		case EM_CODE_OP_BMULII:
+		case EM_CODE_OP_BEQII:
+		case EM_CODE_OP_BNEQII:
+		case EM_CODE_OP_BLTII:
+		case EM_CODE_OP_BGTII:
+		case EM_CODE_OP_LDIDX:
+		case EM_CODE_OP_STIDX:
+		case EM_CODE_OP_RSTR1:
+		case EM_CODE_OP_RSTR2:
+		case EM_CODE_OP_RSTR3:
+		case EM_CODE_OP_DBGN:
+		case EM_CODE_OP_INCLUDE:
+		case EM_CODE_OP_LEN:
+		case EM_CODE_OP_R1EISNTP:
+			fprintf(fp, "%s\n", op_names[op]);
+			break;
 
-			/* constructors and calls */
-			case EM_CODE_OP_CLIST:
-			case EM_CODE_OP_CMAP:
-			case EM_CODE_OP_CALL:
-			case EM_CODE_OP_PUTS:
-				fprintf(fp, "%s %hu\n", op_names[op],
-					em_code_read_uint16(slice));
-				break;
+		/* jumps */
+		case EM_CODE_OP_JMP:
+		case EM_CODE_OP_JTR:
+		case EM_CODE_OP_JNTR:
+		case EM_CODE_OP_JPNTR:
+		case EM_CODE_OP_BLTJXPIPI:
+		case EM_CODE_OP_JNLT:
+		case EM_CODE_OP_JNGT:
+		case EM_CODE_OP_JNEQ:
+		case EM_CODE_OP_JNNEQ:
+		case EM_CODE_OP_JNLTII:
+		case EM_CODE_OP_JNGTII:
+		case EM_CODE_OP_JNEQII:
+		case EM_CODE_OP_JNNEQII:
+			fprintf(fp, "%s %+d\n", op_names[op],
+				em_code_read_int32(slice));
+			break;
+
+		/* constructors and calls */
+		case EM_CODE_OP_CLIST:
+		case EM_CODE_OP_CMAP:
+		case EM_CODE_OP_CALL:
+		case EM_CODE_OP_TCALL:
+		case EM_CODE_OP_PUTS:
+			fprintf(fp, "%s %hu\n", op_names[op],
+				em_code_read_uint16(slice));
+			break;
 
-			/* loads and stores */
-			case EM_CODE_OP_LOAD:
-			case EM_CODE_OP_LDNM:
-			case EM_CODE_OP_STOR:
-			case EM_CODE_OP_STNM:
-				fprintf(fp, "%s \"%s\"\n", op_names[op],
-					em_code_read_hashed_string(slice, &hash));
-				break;
+		/* loads and stores */
+		case EM_CODE_OP_LOAD:
+		case EM_CODE_OP_LDNM:
+		case EM_CODE_OP_STOR:
+		case EM_CODE_OP_STNM:
+		case EM_CODE_OP_STORP:
+			fprintf(fp, "%s \"%s\"\n", op_names[op],
+				em_code_read_hashed_string(slice, &hash));
+			break;
+
+		/* define function */
+		case EM_CODE_OP_DFUNC:
+			count = em_code_read_uint8(slice);
+			fprintf(fp, "DFUNC \"%s\" (",
+				em_code_read_hashed_string(slice, &hash));
+			for (uint8_t i = 0; i < count; i++) {
 
-			/* define function */
-			case EM_CODE_OP_DFUNC:
-				count = em_code_read_uint8(slice);
-				fprintf(fp, "DFUNC \"%s\" (",
+				if (i) fputs(", ", fp);
+				fprintf(fp, "\"%s\"",
 					em_code_read_hashed_string(slice, &hash));
-				for (uint8_t i = 0; i < count; i++) {
+			}
+			fprintf(fp, ") +%u\n",
+				em_code_read_uint32(slice));
+			break;
 
-					if (i) fputs(", ", fp);
-					fprintf(fp, "\"%s\"",
-						em_code_read_hashed_string(slice, &hash));
-				}
-				fprintf(fp, ") +%u\n",
-					em_code_read_uint32(slice));
-				break;
+		/* define class */
+		case EM_CODE_OP_DCLS:
+			fprintf(fp, "DCLS \"%s\"\n",
+				em_code_read_hashed_string(slice, &hash));
+			break;
 
-			/* define class */
-			case EM_CODE_OP_DCLS:
-				fprintf(fp, "DCLS \"%s\"\n",
-					em_code_read_hashed_string(slice, &hash));
-				break;
+		/* handler table */
+		case EM_CODE_OP_HTAB: {
+			uint16_t nhandlers = em_code_read_uint16(slice);
+			fprintf(fp, "HTAB %hu\n", nhandlers);
+
+			for (uint16_t i = 0; i < nhandlers; i++) {
+
+				uint32_t start = em_code_read_uint32(slice);
+				uint32_t end = em_code_read_uint32(slice);
+				uint32_t handler = em_code_read_uint32(slice);
+				uint16_t depth = em_code_read_uint16(slice);
 
-			/* otherwise */
-			default:
-				fprintf(fp, "Unknown (0x%x)\n", op);
-				slice->position = 0;
-				return;
+				fprintf(fp, "            %08x-%08x -> %08x (level %u, depth %hu)\n",
+					start, end, handler, em_code_read_uint8(slice), depth);
+			}
+			break;
 		}
+
+		/* otherwise */
+		default:
+			fprintf(fp, "Unknown (0x%x)\n", op);
+			return EM_FALSE;
 	}
-	slice->position = 0;
+	return EM_TRUE;
 }
 
-/* recover context for level, within slice */
-static em_bool_t recover_context(
-		em_context_t *context,
-		em_code_slice_t *slice,
-		em_code_op_t op_level
-) {
-	uint32_t level = 0;
-	switch (op_level) {
-		case EM_CODE_OP_RSTR1: level = 1; break;
-		case EM_CODE_OP_RSTR2: level = 2; break;
-		case EM_CODE_OP_RSTR3: level = 3; break;
+/* disassemble generated code */
+EM_API void em_code_disassemble(em_code_slice_t *slice, FILE *fp) {
+
+	slice->position = 0;
+	while (slice->position < slice->length) {
+
+		fprintf(fp, "%08x  ", slice->position);
+		if (!em_code_disassemble_inst(slice, fp)) break;
 	}
+	slice->position = 0;
+}
 
-	for (size_t i = context->csp; i; i--) {
+/* skip string operand, checking that it is terminated inside of slice */
+static em_bool_t skip_string(em_code_slice_t *view, em_bool_t hashed) {
 
-		if (context->cstack[i-1].level == level) {
+	if (hashed) view->position += 4;
+	if (view->position+2 > view->length)
+		return EM_FALSE;
 
-			slice->position = context->cstack[i-1].pos;
+	size_t len = (size_t)em_code_read_uint16(view);
+	size_t end = view->position + len;
+	if (end >= view->length || ((const uint8_t *)view->data)[end])
+		return EM_FALSE;
 
-			size_t old_sp = context->sp;
-			context->sp = context->cstack[i-1].sp;
+	view->position = end + 1;
+	return EM_TRUE;
+}
 
-			for (size_t i = context->sp; i < old_sp; i++)
-				em_value_delete(context->stack[i]);
+/* get size of instruction at position (0 if invalid) */
+EM_API size_t em_code_get_inst_size(em_code_slice_t *slice, size_t pos) {
 
-			context->csp = i-1;
-			return EM_TRUE;
-		}
-		else if (context->cstack[i-1].level == 2)
+	em_code_slice_t view = *slice;
+	view.position = pos;
+
+	em_code_op_t op = (em_code_op_t)em_code_read_uint8(&view);
+	uint8_t count;
+	uint16_t count16;
+
+	switch (op) {
+
+		/* operations with fixed operands */
+		case EM_CODE_OP_PCINT:
+			view.position += sizeof(em_inttype_t);
+			break;
+		case EM_CODE_OP_PCFLT:
+			view.position += sizeof(em_floattype_t);
+			break;
+		case EM_CODE_OP_ESETL:
+		case EM_CODE_OP_CLIST:
+		case EM_CODE_OP_CMAP:
+		case EM_CODE_OP_CALL:
+		case EM_CODE_OP_TCALL:
+		case EM_CODE_OP_PUTS:
+			view.position += 2;
 			break;
+		case EM_CODE_OP_ESETC:
+			view.position += 1;
+			break;
+		case EM_CODE_OP_ESETLC:
+			view.position += 3;
+			break;
+		case EM_CODE_OP_JMP:
+		case EM_CODE_OP_JTR:
+		case EM_CODE_OP_JNTR:
+		case EM_CODE_OP_JPNTR:
+		case EM_CODE_OP_BLTJXPIPI:
+		case EM_CODE_OP_JNLT:
+		case EM_CODE_OP_JNGT:
+		case EM_CODE_OP_JNEQ:
+		case EM_CODE_OP_JNNEQ:
+		case EM_CODE_OP_JNLTII:
+		case EM_CODE_OP_JNGTII:
+		case EM_CODE_OP_JNEQII:
+		case EM_CODE_OP_JNNEQII:
+			view.position += 4;
+			break;
+
+		/* operations with string operands */
+		case EM_CODE_OP_PCSTR:
+			if (!skip_string(&view, EM_FALSE)) return 0;
+			break;
+		case EM_CODE_OP_LOAD:
+		case EM_CODE_OP_LDNM:
+		case EM_CODE_OP_STOR:
+		case EM_CODE_OP_STNM:
+		case EM_CODE_OP_STORP:
+		case EM_CODE_OP_DCLS:
+			if (!skip_string(&view, EM_TRUE)) return 0;
+			break;
+		case EM_CODE_OP_LADDI:
+		case EM_CODE_OP_LADDII:
+			if (!skip_string(&view, EM_TRUE)) return 0;
+			view.position += sizeof(em_inttype_t);
+			break;
+		case EM_CODE_OP_FORPREP:
+		case EM_CODE_OP_FORLOOP:
+			view.position += 1;
+			if (!skip_string(&view, EM_TRUE)) return 0;
+			view.position += 4;
+			break;
+		case EM_CODE_OP_DFUNC:
+			count = em_code_read_uint8(&view);
+			for (size_t i = 0; i <= count; i++)
+				if (!skip_string(&view, EM_TRUE)) return 0;
+			view.position += 4;
+			break;
+		case EM_CODE_OP_HTAB:
+			if (view.position+2 > view.length) return 0;
+			count16 = em_code_read_uint16(&view);
+			view.position += (size_t)count16 * EM_CODE_HANDLER_SIZE;
+			break;
+
+		/* single word instructions */
+		default:
+			if (!op || op >= EM_CODE_OP_COUNT)
+				return 0;
+			break;
+	}
+
+	if (view.position > slice->length)
+		return 0;
+	return view.position - pos;
+}
+
+/* get number of handlers in table */
+EM_API size_t em_code_get_handler_count(em_code_slice_t *slice) {
+
+	const uint8_t *data = (const uint8_t *)slice->data;
+	if (slice->length < 3 || data[0] != EM_CODE_OP_HTAB)
+		return 0;
+
+	uint16_t count;
+	memcpy(&count, data + 1, 2);
+	return (size_t)count;
+}
+
+/* decode handler from table */
+EM_API void em_code_get_handler(em_code_slice_t *slice, size_t index, em_code_handler_t *handler) {
+
+	const uint8_t *p = (const uint8_t *)slice->data + 3 + index * EM_CODE_HANDLER_SIZE;
+
+	memcpy(&handler->start, p, 4);
+	memcpy(&handler->end, p + 4, 4);
+	memcpy(&handler->handler, p + 8, 4);
+	memcpy(&handler->depth, p + 12, 2);
+	handler->level = p[14];
+}
+
+/* encode handler into table */
+EM_API void em_code_set_handler(em_code_slice_t *slice, size_t index, const em_code_handler_t *handler) {
+
+	uint8_t *p = (uint8_t *)slice->data + 3 + index * EM_CODE_HANDLER_SIZE;
+
+	memcpy(p, &handler->start, 4);
+	memcpy(p + 4, &handler->end, 4);
+	memcpy(p + 8, &handler->handler, 4);
+	memcpy(p + 12, &handler->depth, 2);
+	p[14] = handler->level;
+}
+
+/*
+ * Call value with the arguments on top of the stack. They are copied off
+ * of the stack first, since the stack may move while the call runs.
+ */
+static em_value_t call_from_stack(em_context_t *context, em_value_t value, size_t count) {
+
+	em_value_t buf[EM_FUNCTION_MAX_ARGUMENTS];
+	em_value_t *args = buf;
+
+	if (count > EM_FUNCTION_MAX_ARGUMENTS && !(args = em_malloc(sizeof(em_value_t) * count)))
+		return EM_VALUE_FAIL;
+	memcpy(args, &context->stack[context->sp-count], sizeof(em_value_t) * count);
+
+	em_value_t result = em_value_call(context, value, args, count, &context->op_pos);
+	if (args != buf) em_free(args);
+	return result;
+}
+
+/*
+ * Unwind to the innermost handler of the level that the instruction asked
+ * for. Signals left behind by calls and included files unwind as if the
+ * statement that sent them was here. Anything without a handler leaves the
+ * slice, as an error or as a signal for whatever ran it.
+ */
+static em_bool_t unwind(em_context_t *context, em_code_slice_t *slice, size_t base) {
+
+	em_code_op_t mode = slice->mode;
+	em_signal_t signal = context->signal;
+	em_bool_t sent = EM_FALSE; /* signal was sent from this slice */
+	em_value_t value;
+
+	context->signal = EM_SIGNAL_NONE;
+	if (mode == EM_CODE_OP_RSTR1 && signal) {
+
+		mode = signal == EM_SIGNAL_RETURN? EM_CODE_OP_RSTR2: EM_CODE_OP_RSTR3;
+		if (signal == EM_SIGNAL_RETURN) value = context->pass;
+		else value = signal == EM_SIGNAL_CONTINUE? EM_VALUE_TRUE: EM_VALUE_FALSE;
 	}
+	else if (mode == EM_CODE_OP_RSTR1)
+		value = context->pass;
+	else {
+		value = em_context_pop_value(context);
+		if (mode == EM_CODE_OP_RSTR2) signal = EM_SIGNAL_RETURN;
+		else signal = value.value.te_inttype? EM_SIGNAL_CONTINUE: EM_SIGNAL_BREAK;
+		sent = EM_TRUE;
+	}
+
+	/* returns always leave the slice */
+	size_t count = mode == EM_CODE_OP_RSTR2? 0: em_code_get_handler_count(slice);
+	uint8_t level = mode == EM_CODE_OP_RSTR1? 1: 3;
+
+	for (size_t i = 0; i < count; i++) {
+
+		em_code_handler_t handler;
+		em_code_get_handler(slice, i, &handler);
+
+		if (handler.level != level || slice->position <= handler.start || slice->position > handler.end)
+			continue;
+
+		while (context->sp > base + handler.depth)
+			em_value_delete(context->stack[--context->sp]);
+
+		context->stack[context->sp++] = value;
+		slice->position = handler.handler;
+		slice->mode = EM_CODE_OP_CALL;
+		return EM_TRUE;
+	}
+
+	while (context->sp > base)
+		em_value_delete(context->stack[--context->sp]);
+
+	if (mode == EM_CODE_OP_RSTR1) {
+
+		context->pass = value;
+		return EM_FALSE;
+	}
+	if (mode == EM_CODE_OP_RSTR2) context->pass = value;
+	if (sent) em_context_signal(context, signal, &context->op_pos);
+	else context->signal = signal;
 	return EM_FALSE;
 }
 
 /* run code slice */
 EM_API em_value_t em_code_run_slice(em_context_t *context, em_code_slice_t *slice) {
 
+	/* check slice once; the interpreter trusts it after that */
+	if (!slice->max_stack && em_code_verify(slice) != EM_RESULT_SUCCESS) {
+
+		em_log_runtime_error(&context->op_pos, "Invalid bytecode");
+		context->pass = EM_VALUE_FAIL;
+		return EM_VALUE_FAIL;
+	}
+	size_t base = context->sp;
+	size_t reserved = context->stack_reserved;
+	if (em_context_reserve_stack(context, slice->max_stack) != EM_RESULT_SUCCESS) {
+
+		em_log_runtime_error(&context->op_pos, "Stack overflow");
+		context->pass = EM_VALUE_FAIL;
+		return EM_VALUE_FAIL;
+	}
+
 	slice->position = 0;
 	slice->mode = EM_CODE_OP_CALL;
+#ifdef EM_PROFILE
+	em_code_op_t prev = 0;
+#endif
 
 	while (slice->position < slice->length) {
 
-		em_code_run_inst(context, slice);
+		/* run native code if compiled, otherwise interpret one instruction */
+		if (!slice->jit || !em_jit_run(context, slice)) {
+
+			size_t pos = slice->position;
+#ifdef EM_PROFILE
+			if (context->profile) {
+
+				em_code_op_t op = (em_code_op_t)((uint8_t *)slice->data)[pos];
+				uint64_t start = em_profile_clock();
+
+				em_code_run_inst(context, slice);
+				em_profile_record(slice, pos, prev, op, em_profile_clock() - start);
+				prev = op;
+			}
+			else
+#endif
+			em_code_run_inst(context, slice);
 
-		/* restore context */
-		size_t old_sp = context->sp;
-		em_value_t value = em_context_pop_value(context);
+			/* compile slices with hot loops */
+			if (slice->position < pos && context->use_jit && !slice->jit &&
+			    ++slice->hotness == EM_JIT_THRESHOLD)
+				(void)em_jit_compile(slice);
+		}
 
-		if (slice->mode != EM_CODE_OP_CALL &&
-		    !recover_context(context, slice, slice->mode)) {
+		/* continue at handler */
+		if (slice->mode != EM_CODE_OP_CALL && !unwind(context, slice, base)) {
 
-			context->pass = value;
-			context->mode = slice->mode;
+			em_context_trim_stack(context, reserved);
 			return EM_VALUE_FAIL;
 		}
-		else if (old_sp) em_context_push_value(context, value);
-		slice->mode = EM_CODE_OP_CALL;
 	}
-	return em_context_pop_value(context);
+	em_value_t result = em_context_pop_value(context);
+	em_context_trim_stack(context, reserved);
+	return result;
 }
 
+/*
+ * Slices are checked by the verifier before they run, so operands are read
+ * and values are moved on the stack without bounds checks.
+ */
+#define READ(p_type) ({\
+	p_type value_;\
+	memcpy(&value_, (uint8_t *)slice->data + slice->position, sizeof(p_type));\
+	slice->position += sizeof(p_type);\
+	value_;\
+})
+
+#define READ_STRING() ({\
+	size_t len_ = (size_t)READ(uint16_t);\
+	const char *string_ = (const char *)slice->data + slice->position;\
+	slice->position += len_ + 1;\
+	string_;\
+})
+
+#define READ_HASHED_STRING(p_hash) ({\
+	*(p_hash) = READ(em_hash_t);\
+	READ_STRING();\
+})
+
+#define PUSH(p_value) (context->stack[context->sp++] = (p_value))
+#define POP() (context->stack[--context->sp])
+
 /* run single instruction */
 #define FAIL ({\
 		context->pass = EM_VALUE_FAIL;\
@@ -1514,7 +1735,7 @@ EM_API em_value_t em_code_run_slice(em_context_t *context, em_code_slice_t *slic
 	})
 
 #define RUNTIME_ERROR(...) ({\
-	if (!em_log_catch(NULL))\
+	if (!em_log_catch(NULL) && !context->signal)\
 		em_log_runtime_error(&context->op_pos, __VA_ARGS__);\
 	context->pass = EM_VALUE_FAIL;\
 	slice->mode = EM_CODE_OP_RSTR1;\
@@ -1522,74 +1743,115 @@ EM_API em_value_t em_code_run_slice(em_context_t *context, em_code_slice_t *slic
 })
 
 #define UNARY_OPERATION(p_op, ...) ({\
-	a = em_context_pop_value(context);\
+	a = POP();\
 	b = em_value_##p_op;\
 	em_value_delete(a);\
 	if (!EM_VALUE_OK(b)) FAIL;\
 	__VA_ARGS__;\
-	em_context_push_value(context, b);\
+	PUSH(b);\
 })
 
 #define BINARY_OPERATION(p_name, ...) ({\
-	b = em_context_pop_value(context);\
-	a = em_context_pop_value(context);\
+	b = POP();\
+	a = POP();\
 	c = em_value_##p_name(a, b, &context->op_pos);\
 	em_value_delete(a);\
 	em_value_delete(b);\
 	if (!EM_VALUE_OK(c)) FAIL;\
 	__VA_ARGS__;\
-	em_context_push_value(context, c);\
+	PUSH(c);\
+})
+
+#define COMPARE_JUMP(p_name, ...) ({\
+	count = (size_t)READ(int32_t);\
+	b = POP();\
+	a = POP();\
+	c = em_value_##p_name(a, b, &context->op_pos);\
+	em_value_delete(a);\
+	em_value_delete(b);\
+	if (!EM_VALUE_OK(c)) FAIL;\
+	__VA_ARGS__;\
+	if (!em_value_is_true(c, &context->op_pos).value.te_inttype)\
+		slice->position += count;\
+	em_value_delete(c);\
+})
+
+/*
+ * Operations on two ints are rewritten to int-specialized operations the
+ * first time they run, and rewritten back if they later see another type.
+ */
+#define BOTH_INTS (context->sp >= 2 &&\
+	context->stack[context->sp-2].type == EM_VALUE_TYPE_INT &&\
+	context->stack[context->sp-1].type == EM_VALUE_TYPE_INT)
+
+#define QUICKEN(p_op) ({\
+	if (BOTH_INTS) *opp = (uint8_t)(p_op);\
+})
+
+#define DEQUICKEN(p_op) ({\
+	*opp = (uint8_t)(p_op);\
+	op = (p_op);\
+	goto dispatch;\
+})
+
+#define INT_OPERATION(p_generic, p_expr) ({\
+	if (!BOTH_INTS) DEQUICKEN(p_generic);\
+	b = context->stack[--context->sp];\
+	a = context->stack[context->sp-1];\
+	context->stack[context->sp-1] = EM_VALUE_INT(p_expr);\
+})
+
+#define INT_COMPARE_JUMP(p_generic, p_expr) ({\
+	if (!BOTH_INTS) DEQUICKEN(p_generic);\
+	count = (size_t)READ(int32_t);\
+	b = context->stack[--context->sp];\
+	a = context->stack[--context->sp];\
+	if (!(p_expr)) slice->position += count;\
 })
 
 EM_API void em_code_run_inst(em_context_t *context, em_code_slice_t *slice) {
 
-	em_code_op_t op = (em_code_op_t)em_code_read_uint8(slice);
+	uint8_t *opp = (uint8_t *)slice->data + slice->position;
+	em_code_op_t op = (em_code_op_t)READ(uint8_t);
 	em_value_t a, b, c;
 	size_t count;
 	em_hash_t hash;
 	const char *string;
 	em_result_t result;
+	uint8_t flags;
 
+dispatch:
 	switch (op) {
 
 		/* push constants */
 		case EM_CODE_OP_PCINT:
-			em_context_push_value(
-				context,
-				EM_VALUE_INT(em_code_read_inttype(slice))
-			);
+			PUSH(EM_VALUE_INT(READ(em_inttype_t)));
 			break;
 		case EM_CODE_OP_PCFLT:
-			em_context_push_value(
-				context,
-				EM_VALUE_INT(em_code_read_floattype(slice))
-			);
+			PUSH(EM_VALUE_FLOAT(READ(em_floattype_t)));
 			break;
 		case EM_CODE_OP_PCSTR:
-			string = em_code_read_string(slice);
-			em_context_push_value(
-				context,
-				em_string_new_from_utf8(string, em_utf8_strlen(string))
-			);
+			string = READ_STRING();
+			PUSH(em_string_new_from_utf8(string, em_utf8_strlen(string)));
 			break;
 		case EM_CODE_OP_PTRUE:
-			em_context_push_value(context, EM_VALUE_TRUE);
+			PUSH(EM_VALUE_TRUE);
 			break;
 		case EM_CODE_OP_PFLSE:
-			em_context_push_value(context, EM_VALUE_FALSE);
+			PUSH(EM_VALUE_FALSE);
 			break;
 		case EM_CODE_OP_PNONE:
-			em_context_push_value(context, em_none);
+			PUSH(em_none);
 			break;
 
 		/* remove value */
 		case EM_CODE_OP_POP:
-			em_value_delete(em_context_pop_value(context));
+			em_value_delete(POP());
 			break;
 
 		/* construct list */
 		case EM_CODE_OP_CLIST:
-			count = (size_t)em_code_read_uint16(slice);
+			count = (size_t)READ(uint16_t);
 			a = em_list_new(count);
 
 			for (size_t i = 0; i < count; i++) {
@@ -1598,8 +1860,24 @@ EM_API void em_code_run_inst(em_context_t *context, em_code_slice_t *slice) {
 				em_list_append(a, b);
 			}
 			for (size_t i = 0; i < count; i++)
-				em_value_delete(em_context_pop_value(context));
-			em_context_push_value(context, a);
+				em_value_delete(POP());
+			PUSH(a);
+			break;
+
+		/* construct map */
+		case EM_CODE_OP_CMAP:
+			count = (size_t)READ(uint16_t) * 2;
+			a = em_map_new();
+
+			for (size_t i = 0; i < count; i += 2) {
+
+				b = context->stack[context->sp-count+i];
+				c = context->stack[context->sp-count+i+1];
+				em_map_set_key(a, b, em_value_hash(b, &context->op_pos), c);
+			}
+			for (size_t i = 0; i < count; i++)
+				em_value_delete(POP());
+			PUSH(a);
 			break;
 
 		/* unary operations */
@@ -1616,17 +1894,20 @@ EM_API void em_code_run_inst(em_context_t *context, em_code_slice_t *slice) {
 			UNARY_OPERATION(add(a, EM_VALUE_INT(1), &context->op_pos));
 			break;
 		case EM_CODE_OP_UDEC:
-			UNARY_OPERATION(subtract(a, EM_VALUE_INT(-1), &context->op_pos));
+			UNARY_OPERATION(subtract(a, EM_VALUE_INT(1), &context->op_pos));
 			break;
 
 		/* binary operations */
 		case EM_CODE_OP_BADD:
+			QUICKEN(EM_CODE_OP_BADDII);
 			BINARY_OPERATION(add);
 			break;
 		case EM_CODE_OP_BSUB:
+			QUICKEN(EM_CODE_OP_BSUBII);
 			BINARY_OPERATION(subtract);
 			break;
 		case EM_CODE_OP_BMUL:
+			QUICKEN(EM_CODE_OP_BMULII);
 			BINARY_OPERATION(multiply);
 			break;
 		case EM_CODE_OP_BDIV:
@@ -1651,32 +1932,59 @@ EM_API void em_code_run_inst(em_context_t *context, em_code_slice_t *slice) {
 			BINARY_OPERATION(shift_right);
 			break;
 		case EM_CODE_OP_BEQ:
+			QUICKEN(EM_CODE_OP_BEQII);
 			BINARY_OPERATION(compare_equal);
 			break;
 		case EM_CODE_OP_BNEQ:
+			QUICKEN(EM_CODE_OP_BNEQII);
 			BINARY_OPERATION(compare_equal, c = EM_VALUE_INT_INV(c));
 			break;
 		case EM_CODE_OP_BLT:
+			QUICKEN(EM_CODE_OP_BLTII);
 			BINARY_OPERATION(compare_less_than);
 			break;
 		case EM_CODE_OP_BGT:
+			QUICKEN(EM_CODE_OP_BGTII);
 			BINARY_OPERATION(compare_greater_than);
 			break;
 
+		/* int-specialized binary operations */
+		case EM_CODE_OP_BADDII:
+			INT_OPERATION(EM_CODE_OP_BADD, EM_INTTYPE_ADD(a.value.te_inttype, b.value.te_inttype));
+			break;
+		case EM_CODE_OP_BSUBII:
+			INT_OPERATION(EM_CODE_OP_BSUB, EM_INTTYPE_SUB(a.value.te_inttype, b.value.te_inttype));
+			break;
+		case EM_CODE_OP_BMULII:
+			INT_OPERATION(EM_CODE_OP_BMUL, EM_INTTYPE_MUL(a.value.te_inttype, b.value.te_inttype));
+			break;
+		case EM_CODE_OP_BEQII:
+			INT_OPERATION(EM_CODE_OP_BEQ, a.value.te_inttype == b.value.te_inttype);
+			break;
+		case EM_CODE_OP_BNEQII:
+			INT_OPERATION(EM_CODE_OP_BNEQ, a.value.te_inttype != b.value.te_inttype);
+			break;
+		case EM_CODE_OP_BLTII:
+			INT_OPERATION(EM_CODE_OP_BLT, a.value.te_inttype < b.value.te_inttype);
+			break;
+		case EM_CODE_OP_BGTII:
+			INT_OPERATION(EM_CODE_OP_BGT, a.value.te_inttype > b.value.te_inttype);
+			break;
+
 		/* load value */
 		case EM_CODE_OP_LOAD:
-			string = em_code_read_hashed_string(slice, &hash);
+			string = READ_HASHED_STRING(&hash);
 
 			a = em_context_get_value(context, hash);
 			if (!EM_VALUE_OK(a))
 				RUNTIME_ERROR("Variable '%s' not defined", string);
-			em_context_push_value(context, a);
+			PUSH(a);
 			break;
 
 		/* load value at index */
 		case EM_CODE_OP_LDIDX:
-			b = em_context_pop_value(context);
-			a = em_context_pop_value(context);
+			b = POP();
+			a = POP();
 
 			c = em_value_get_by_index(a, b, &context->op_pos);
 			em_value_delete(a);
@@ -1684,23 +1992,50 @@ EM_API void em_code_run_inst(em_context_t *context, em_code_slice_t *slice) {
 
 			if (!EM_VALUE_OK(c))
 				RUNTIME_ERROR("Invalid index");
-			em_context_push_value(context, c);
+			PUSH(c);
+			break;
+
+		/* load member */
+		case EM_CODE_OP_LDNM:
+			string = READ_HASHED_STRING(&hash);
+			a = POP();
+
+			b = em_value_get_by_hash(a, hash, &context->op_pos);
+			em_value_delete(a);
+
+			if (!EM_VALUE_OK(b))
+				RUNTIME_ERROR("Attribute '%s' not defined", string);
+			PUSH(b);
 			break;
 
 		/* store value */
 		case EM_CODE_OP_STOR:
-			string = em_code_read_hashed_string(slice, &hash);
-			a = em_context_pop_value(context);
+			string = READ_HASHED_STRING(&hash);
+			a = POP();
 
 			em_context_set_value(context, hash, a);
-			em_context_push_value(context, a);
+			PUSH(a);
+			break;
+
+		/* store member */
+		case EM_CODE_OP_STNM:
+			string = READ_HASHED_STRING(&hash);
+			b = POP();
+			a = POP();
+
+			result = em_value_set_by_hash(a, hash, b, &context->op_pos);
+			em_value_delete(a);
+
+			if (result != EM_RESULT_SUCCESS)
+				RUNTIME_ERROR("Attribute '%s' not defined", string);
+			PUSH(b);
 			break;
 
 		/* store value at index */
 		case EM_CODE_OP_STIDX:
-			c = em_context_pop_value(context);
-			b = em_context_pop_value(context);
-			a = em_context_pop_value(context);
+			c = POP();
+			b = POP();
+			a = POP();
 
 			result = em_value_set_by_index(a, b, c, &context->op_pos);
 			em_value_delete(a);
@@ -1708,19 +2043,19 @@ EM_API void em_code_run_inst(em_context_t *context, em_code_slice_t *slice) {
 
 			if (result != EM_RESULT_SUCCESS)
 				RUNTIME_ERROR("Invalid index");
-			em_context_push_value(context, c);
+			PUSH(c);
 			break;
 
 		/* jump to position */
 		case EM_CODE_OP_JMP:
-			count = (size_t)em_code_read_int32(slice);
+			count = (size_t)READ(int32_t);
 			slice->position += count;
 			break;
 
 		/* jump to position if true */
 		case EM_CODE_OP_JTR:
-			count = (size_t)em_code_read_int32(slice);
-			a = em_context_pop_value(context);
+			count = (size_t)READ(int32_t);
+			a = POP();
 			b = em_value_is_true(a, &context->op_pos);
 
 			if (b.value.te_inttype)
@@ -1730,8 +2065,8 @@ EM_API void em_code_run_inst(em_context_t *context, em_code_slice_t *slice) {
 
 		/* jump to position if not true */
 		case EM_CODE_OP_JNTR:
-			count = (size_t)em_code_read_int32(slice);
-			a = em_context_pop_value(context);
+			count = (size_t)READ(int32_t);
+			a = POP();
 			b = em_value_is_true(a, &context->op_pos);
 
 			if (!b.value.te_inttype)
@@ -1741,48 +2076,108 @@ EM_API void em_code_run_inst(em_context_t *context, em_code_slice_t *slice) {
 
 		/* jump to position and push none if not true */
 		case EM_CODE_OP_JPNTR:
-			count = (size_t)em_code_read_int32(slice);
-			a = em_context_pop_value(context);
+			count = (size_t)READ(int32_t);
+			a = POP();
 			b = em_value_is_true(a, &context->op_pos);
 			em_value_delete(a);
 
 			if (!b.value.te_inttype) {
 
 				slice->position += count;
-				em_context_push_value(context, em_none);
+				PUSH(em_none);
 			}
 			break;
 
-		/* save context */
-		case EM_CODE_OP_SAVE3:
-			count = (size_t)em_code_read_int32(slice);
-			em_context_push_context(
-					context,
-					1,
-					slice->position + count,
-					context->sp
-			);
+		/* skip handler table */
+		case EM_CODE_OP_HTAB:
+			count = (size_t)READ(uint16_t);
+			slice->position += count * EM_CODE_HANDLER_SIZE;
 			break;
 
-		/* discard context */
-		case EM_CODE_OP_DSCD1:
-		case EM_CODE_OP_DSCD3:
-			if (context->csp) context->csp--;
+		/* call value */
+		case EM_CODE_OP_CALL:
+			count = (size_t)READ(uint16_t) - 1;
+			a = context->stack[context->sp-count-1];
+
+			for (size_t i = 0; i < count; i++)
+				em_value_incref(context->stack[context->sp-count+i]);
+
+			c = call_from_stack(context, a, count);
+
+			for (size_t i = 0; i < count; i++) {
+
+				b = POP();
+				if (em_value_is(c, b))
+					em_value_decref_no_free(b);
+				else em_value_decref(b);
+			}
+			context->sp--;
+			em_value_delete(a);
+
+			if (!EM_VALUE_OK(c)) FAIL; /* loop exits in called functions unwind here (see unwind) */
+			PUSH(c);
+			break;
+
+		/*
+		 * Call in tail position. Emerald functions are handed to the
+		 * call running this function to run in its place (see
+		 * function.c); anything else is called here before returning.
+		 */
+		case EM_CODE_OP_TCALL:
+			count = (size_t)READ(uint16_t) - 1;
+			a = context->stack[context->sp-count-1];
+
+			if (em_is_function(a)) {
+
+				for (size_t i = 0; i < count; i++)
+					em_value_incref(context->stack[context->sp-count+i]);
+
+				em_context_set_tail_call(context, a, &context->stack[context->sp-count], count, &context->op_pos);
+				context->sp -= count+1;
+
+				PUSH(em_none);
+				slice->mode = EM_CODE_OP_RSTR2;
+				break;
+			}
+			for (size_t i = 0; i < count; i++)
+				em_value_incref(context->stack[context->sp-count+i]);
+
+			c = call_from_stack(context, a, count);
+
+			for (size_t i = 0; i < count; i++) {
+
+				b = POP();
+				if (em_value_is(c, b))
+					em_value_decref_no_free(b);
+				else em_value_decref(b);
+			}
+			context->sp--;
+			em_value_delete(a);
+
+			if (!EM_VALUE_OK(c)) FAIL;
+			PUSH(c);
+			slice->mode = EM_CODE_OP_RSTR2;
+			break;
+
+		/* return or leave loop (see unwind) */
+		case EM_CODE_OP_RSTR2:
+		case EM_CODE_OP_RSTR3:
+			slice->mode = op;
 			break;
 
 		/* set error position */
 		case EM_CODE_OP_ESETL:
-			context->op_pos.line = (em_ssize_t)
-				em_code_read_uint16(slice);
+			context->op_pos.line = (uint32_t)
+				READ(uint16_t);
 			break;
 		case EM_CODE_OP_ESETC:
-			context->op_pos.column = (em_ssize_t)
-				em_code_read_uint8(slice);
+			context->op_pos.column = (uint32_t)
+				READ(uint8_t);
 			break;
 
 		/* print values */
 		case EM_CODE_OP_PUTS:
-			count = (size_t)em_code_read_uint16(slice);
+			count = (size_t)READ(uint16_t);
 			for (size_t i = 0; i < count; i++) {
 
 				if (i) fputc(' ', stdout);
@@ -1799,13 +2194,180 @@ EM_API void em_code_run_inst(em_context_t *context, em_code_slice_t *slice) {
 				if (!em_value_is(value, string))
 					em_value_delete(string);
 			}
-			a = em_context_pop_value(context);
+			a = POP();
 			for (size_t i = 0; i < count-1; i++)
-				em_value_delete(em_context_pop_value(context));
-			em_context_push_value(context, a);
+				em_value_delete(POP());
+			PUSH(a);
 			fputc('\n', stdout);
 			break;
 
+		/* set line and column */
+		case EM_CODE_OP_ESETLC:
+			context->op_pos.line = (uint32_t)
+				READ(uint16_t);
+			context->op_pos.column = (uint32_t)
+				READ(uint8_t);
+			break;
+
+		/* store value and pop */
+		case EM_CODE_OP_STORP:
+			string = READ_HASHED_STRING(&hash);
+			a = POP();
+
+			em_context_set_value(context, hash, a);
+			em_value_delete(a);
+			break;
+
+		/* load value and add int constant */
+		case EM_CODE_OP_LADDI:
+			string = READ_HASHED_STRING(&hash);
+			b = EM_VALUE_INT(READ(em_inttype_t));
+
+			a = em_context_get_value(context, hash);
+			if (!EM_VALUE_OK(a))
+				RUNTIME_ERROR("Variable '%s' not defined", string);
+
+			if (a.type == EM_VALUE_TYPE_INT) *opp = EM_CODE_OP_LADDII;
+
+			c = em_value_add(a, b, &context->op_pos);
+			em_value_delete(a);
+
+			if (!EM_VALUE_OK(c)) FAIL;
+			PUSH(c);
+			break;
+		case EM_CODE_OP_LADDII:
+			count = slice->position;
+			string = READ_HASHED_STRING(&hash);
+			b = EM_VALUE_INT(READ(em_inttype_t));
+
+			a = em_context_get_value(context, hash);
+			if (a.type != EM_VALUE_TYPE_INT) {
+
+				slice->position = count;
+				DEQUICKEN(EM_CODE_OP_LADDI);
+			}
+			PUSH(EM_VALUE_INT(EM_INTTYPE_ADD(a.value.te_inttype, b.value.te_inttype)));
+			break;
+
+		/* compare and jump to position if not true */
+		case EM_CODE_OP_JNLT:
+			QUICKEN(EM_CODE_OP_JNLTII);
+			COMPARE_JUMP(compare_less_than);
+			break;
+		case EM_CODE_OP_JNGT:
+			QUICKEN(EM_CODE_OP_JNGTII);
+			COMPARE_JUMP(compare_greater_than);
+			break;
+		case EM_CODE_OP_JNEQ:
+			QUICKEN(EM_CODE_OP_JNEQII);
+			COMPARE_JUMP(compare_equal);
+			break;
+		case EM_CODE_OP_JNNEQ:
+			QUICKEN(EM_CODE_OP_JNNEQII);
+			COMPARE_JUMP(compare_equal, c = EM_VALUE_INT_INV(c));
+			break;
+
+		/* int-specialized compare and jump */
+		case EM_CODE_OP_JNLTII:
+			INT_COMPARE_JUMP(EM_CODE_OP_JNLT, a.value.te_inttype < b.value.te_inttype);
+			break;
+		case EM_CODE_OP_JNGTII:
+			INT_COMPARE_JUMP(EM_CODE_OP_JNGT, a.value.te_inttype > b.value.te_inttype);
+			break;
+		case EM_CODE_OP_JNEQII:
+			INT_COMPARE_JUMP(EM_CODE_OP_JNEQ, a.value.te_inttype == b.value.te_inttype);
+			break;
+		case EM_CODE_OP_JNNEQII:
+			INT_COMPARE_JUMP(EM_CODE_OP_JNNEQ, a.value.te_inttype != b.value.te_inttype);
+			break;
+
+		/*
+		 * Counted loops keep the iterator and end value on the stack below
+		 * the value of the body. The variable is only stored when the body
+		 * could see it and loaded back when the body could redefine it.
+		 */
+		case EM_CODE_OP_FORPREP:
+			flags = READ(uint8_t);
+			string = READ_HASHED_STRING(&hash);
+			count = (size_t)READ(int32_t);
+
+			b = POP();
+			a = POP();
+
+			if (a.type != EM_VALUE_TYPE_INT || b.type != EM_VALUE_TYPE_INT) {
+
+				em_value_delete(a);
+				em_value_delete(b);
+				RUNTIME_ERROR("Expected integers for start and end values");
+			}
+			if (a.value.te_inttype >= b.value.te_inttype) {
+
+				PUSH(em_none);
+				slice->position += count;
+				break;
+			}
+			PUSH(a);
+			PUSH(b);
+
+			if (flags & (EM_NODE_NAME_READ | EM_NODE_NAME_WRITTEN))
+				em_context_set_value(context, hash, a);
+			break;
+		case EM_CODE_OP_FORLOOP:
+			flags = READ(uint8_t);
+			string = READ_HASHED_STRING(&hash);
+			count = (size_t)READ(int32_t);
+
+			c = POP();
+			a = context->stack[context->sp-2];
+			b = context->stack[context->sp-1];
+
+			if (flags & EM_NODE_NAME_WRITTEN) {
+
+				a = em_context_get_value(context, hash);
+				if (a.type != EM_VALUE_TYPE_INT) {
+
+					em_value_delete(c);
+					RUNTIME_ERROR("Expected integer for iterator");
+				}
+			}
+
+			/* next iteration */
+			if (a.value.te_inttype + 1 < b.value.te_inttype) {
+
+				a.value.te_inttype++;
+				context->stack[context->sp-2] = a;
+
+				if (flags & (EM_NODE_NAME_READ | EM_NODE_NAME_WRITTEN))
+					em_context_set_value(context, hash, a);
+				em_value_delete(c);
+				slice->position += count;
+				break;
+			}
+
+			/* done; leave value of body */
+			if (!(flags & (EM_NODE_NAME_READ | EM_NODE_NAME_WRITTEN)))
+				em_context_set_value(context, hash, a);
+			context->sp -= 2;
+			PUSH(c);
+			break;
+
+		/* include file */
+		case EM_CODE_OP_INCLUDE:
+			a = POP();
+			if (!em_is_string(a)) {
+
+				em_value_delete(a);
+				RUNTIME_ERROR("Expected string for path");
+			}
+			em_wpath_fix(pathbuf, PATHBUFSZ, EM_STRING(EM_OBJECT_FROM_VALUE(a))->data);
+
+			b = em_context_run_file(context, &context->op_pos, pathbuf);
+			em_value_delete(a);
+
+			if (!EM_VALUE_OK(b)) FAIL;
+			PUSH(b);
+			break;
+
 		/* unknown operation */
 		default:
 			RUNTIME_ERROR("Unknown / unimplemented operation (0x%x)", op);
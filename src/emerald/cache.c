@@ -0,0 +1,219 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emerald/core.h>
+#include <emerald/memory.h>
+#include <emerald/hash.h>
+#include <emerald/path.h>
+#include <emerald/bytecode.h>
+#include <emerald/cache.h>
+#include <emerald/verify.h>
+
+#if defined EM_UNIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define PATHBUFSZ 4096
+static EM_THREAD_LOCAL char pathbuf[PATHBUFSZ];
+static EM_THREAD_LOCAL char tmpbuf[PATHBUFSZ];
+
+/* get abi identifier of this build */
+static uint32_t get_abi(void) {
+
+	const uint16_t order = 0x0102;
+
+	return (uint32_t)sizeof(em_inttype_t) |
+	       ((uint32_t)sizeof(em_floattype_t) << 8) |
+	       ((uint32_t)*(const uint8_t *)&order << 16);
+}
+
+/* hash source text (64-bit fnv-1a) */
+static uint64_t get_source_hash(const char *text, size_t len) {
+
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < len; i++) {
+
+		hash ^= (uint8_t)text[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+/* get cache file path for source file */
+EM_API em_result_t em_code_cache_get_path(char *buf, size_t cnt, const char *path) {
+
+	const char *dir = getenv("EM_CACHE_DIR");
+	int len;
+
+	/* next to source file ("x.em" -> "x.emc") */
+	if (!dir || !*dir) {
+
+		size_t plen = strlen(path);
+		if (plen > 3 && !strcmp(path + plen - 3, ".em"))
+			plen -= 3;
+		len = snprintf(buf, cnt, "%.*s" EM_CODE_CACHE_EXT, (int)plen, path);
+	}
+
+	/* in cache directory; the hash keeps same-named files apart */
+	else {
+		if (em_path_basename(tmpbuf, PATHBUFSZ, path) != EM_RESULT_SUCCESS)
+			return EM_RESULT_FAILURE;
+
+		len = snprintf(buf, cnt, "%s%c%s-%08x" EM_CODE_CACHE_EXT, dir,
+			       EM_OS_PATH_DELIM_CHAR, tmpbuf, em_utf8_strhash(path));
+	}
+	if (len < 0 || (size_t)len >= cnt)
+		return EM_RESULT_FAILURE;
+	return EM_RESULT_SUCCESS;
+}
+
+/* load cached bytecode for source file */
+EM_API em_result_t em_code_cache_load(em_code_cache_t *cache, em_code_slice_t *slice, const char *path, const char *text, size_t len) {
+
+	*cache = EM_CODE_CACHE_INIT;
+	if (em_code_cache_get_path(pathbuf, PATHBUFSZ, path) != EM_RESULT_SUCCESS)
+		return EM_RESULT_FAILURE;
+
+	/* map file */
+#if defined EM_UNIX
+	int fd = open(pathbuf, O_RDONLY);
+	if (fd < 0) return EM_RESULT_FAILURE;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(em_code_cache_header_t)) {
+
+		close(fd);
+		return EM_RESULT_FAILURE;
+	}
+
+	/* private writable mapping; the interpreter rewrites operations in place */
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) return EM_RESULT_FAILURE;
+
+	cache->map = map;
+	cache->size = (size_t)st.st_size;
+	cache->mapped = EM_TRUE;
+
+	/* read file */
+#else
+	FILE *fp = fopen(pathbuf, "rb");
+	if (!fp) return EM_RESULT_FAILURE;
+
+	fseek(fp, 0, SEEK_END);
+	long flen = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if (flen < (long)sizeof(em_code_cache_header_t)) {
+
+		fclose(fp);
+		return EM_RESULT_FAILURE;
+	}
+
+	cache->map = em_malloc((size_t)flen);
+	cache->size = (size_t)flen;
+
+	size_t nread = fread(cache->map, 1, (size_t)flen, fp);
+	fclose(fp);
+
+	if (nread != (size_t)flen) {
+
+		em_code_cache_release(cache);
+		return EM_RESULT_FAILURE;
+	}
+#endif
+
+	/* validate header */
+	const em_code_cache_header_t *header = (const em_code_cache_header_t *)cache->map;
+	if (memcmp(header->magic, EM_CODE_CACHE_MAGIC, 4) != 0 ||
+	    header->version != EM_CODE_VERSION ||
+	    header->abi != get_abi() ||
+	    header->size != (uint64_t)len ||
+	    header->hash != get_source_hash(text, len) ||
+	    header->length != cache->size - sizeof(em_code_cache_header_t)) {
+
+		em_code_cache_release(cache);
+		return EM_RESULT_FAILURE;
+	}
+
+	slice->data = (uint8_t *)cache->map + sizeof(em_code_cache_header_t);
+	slice->position = 0;
+	slice->length = (size_t)header->length;
+
+	/* files may come from anywhere, so check them like compiled code */
+	if (em_code_verify(slice) != EM_RESULT_SUCCESS) {
+
+		em_code_cache_release(cache);
+		*slice = (em_code_slice_t){0};
+		return EM_RESULT_FAILURE;
+	}
+	return EM_RESULT_SUCCESS;
+}
+
+/* write bytecode cache for source file */
+EM_API em_result_t em_code_cache_store(em_code_slice_t *slice, const char *path, const char *text, size_t len) {
+
+	em_code_cache_header_t header = {0};
+
+	if (em_code_cache_get_path(pathbuf, PATHBUFSZ, path) != EM_RESULT_SUCCESS)
+		return EM_RESULT_FAILURE;
+
+	memcpy(header.magic, EM_CODE_CACHE_MAGIC, 4);
+	header.version = EM_CODE_VERSION;
+	header.abi = get_abi();
+	header.hash = get_source_hash(text, len);
+	header.size = (uint64_t)len;
+	header.length = (uint64_t)slice->length;
+
+	/* write to temporary file first so readers never see a partial file */
+#if defined EM_UNIX
+	long id = (long)getpid();
+#else
+	long id = 0;
+#endif
+	int n = snprintf(tmpbuf, PATHBUFSZ, "%s.%ld.tmp", pathbuf, id);
+	if (n < 0 || n >= PATHBUFSZ) return EM_RESULT_FAILURE;
+
+	FILE *fp = fopen(tmpbuf, "wb");
+	if (!fp) return EM_RESULT_FAILURE;
+
+	em_bool_t ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+		       fwrite(slice->data, 1, slice->length, fp) == slice->length;
+	if (fclose(fp) != 0) ok = EM_FALSE;
+
+#if defined EM_WINDOWS
+	if (ok) remove(pathbuf); /* rename does not replace files here */
+#endif
+	if (!ok || rename(tmpbuf, pathbuf) != 0) {
+
+		remove(tmpbuf);
+		return EM_RESULT_FAILURE;
+	}
+	return EM_RESULT_SUCCESS;
+}
+
+/* release loaded cache file */
+EM_API void em_code_cache_release(em_code_cache_t *cache) {
+
+	if (!cache->map) return;
+
+#if defined EM_UNIX
+	if (cache->mapped) munmap(cache->map, cache->size);
+	else em_free(cache->map);
+#else
+	em_free(cache->map);
+#endif
+	*cache = EM_CODE_CACHE_INIT;
+}
@@ -43,11 +43,8 @@ static em_value_t method_call(em_context_t *context, em_value_t v, em_value_t *a
 
 	em_method_t *method = EM_METHOD(EM_OBJECT_FROM_VALUE(v));
 
-	em_value_t newargs[EM_FUNCTION_MAX_ARGUMENTS+1] = {method->binding};
-	memcpy(newargs+1, args, nargs * sizeof(em_value_t));
-
 	em_value_incref(method->binding);
-	em_value_t result = em_value_call(context, method->function, newargs, nargs+1, pos);
+	em_value_t result = em_function_call_bound(context, method->function, method->binding, args, nargs, pos);
 	em_value_decref_no_free(method->binding);
 
 	return result;
@@ -95,13 +92,10 @@ static em_value_t class_call(em_context_t *context, em_value_t v, em_value_t *ar
 	em_value_t call = em_util_get_value(class->map, "_initialize");
 	if (EM_VALUE_OK(call)) {
 
-		em_value_t newargs[EM_FUNCTION_MAX_ARGUMENTS+1] = {instance};
-		memcpy(newargs+1, args, nargs * sizeof(em_value_t));
-
 		em_value_incref(v);
 		em_value_incref(instance);
 
-		em_value_t result = em_value_call(context, call, newargs, nargs+1, pos);
+		em_value_t result = em_function_call_bound(context, call, instance, args, nargs, pos);
 
 		em_value_decref_no_free(instance);
 		em_value_decref_no_free(v);
@@ -146,6 +140,8 @@ static void class_free(void *p) {
 
 	em_value_decref(class->map);
 	em_value_decref(class->clsbase);
+
+	if (class->node) EM_TREE_DECREF(class->node->tree);
 }
 
 /* create bound method */
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emerald/core.h>
+#include <emerald/node.h>
+#include <emerald/value.h>
+#include <emerald/none.h>
+#include <emerald/context.h>
+#include <emerald/closure.h>
+
+/*
+ * Before a tree is walked, each node is given the handler that evaluates
+ * it, and literals are given their value so they aren't parsed on every
+ * visit. Common shapes get handlers of their own (literals, names, simple
+ * lets and operations with an int literal on the right); everything else
+ * is bound to its visitor in context.c. Handlers read the first token and
+ * value straight from the node and call the handlers of their children
+ * directly.
+ */
+
+#define EVAL(p_context, p_node) ((p_node)->handler((p_context), (p_node)))
+
+/* unsupported node */
+static em_value_t eval_unsupported(em_context_t *context, em_node_t *node) {
+
+	em_log_runtime_error(EM_NODE_POS(node), "Unsupported node ('%s')", em_get_node_type_name(node->type));
+	return EM_VALUE_FAIL;
+}
+
+/* visitors */
+static em_node_handler_t visitors[EM_NODE_TYPE_COUNT] = {
+	[EM_NODE_TYPE_BLOCK] = em_context_visit_block,
+	[EM_NODE_TYPE_INT] = em_context_visit_int,
+	[EM_NODE_TYPE_FLOAT] = em_context_visit_float,
+	[EM_NODE_TYPE_STRING] = em_context_visit_string,
+	[EM_NODE_TYPE_IDENTIFIER] = em_context_visit_identifier,
+	[EM_NODE_TYPE_LIST] = em_context_visit_list,
+	[EM_NODE_TYPE_MAP] = em_context_visit_map,
+	[EM_NODE_TYPE_UNARY_OPERATION] = em_context_visit_unary_operation,
+	[EM_NODE_TYPE_BINARY_OPERATION] = em_context_visit_binary_operation,
+	[EM_NODE_TYPE_ACCESS] = em_context_visit_access,
+	[EM_NODE_TYPE_CALL] = em_context_visit_call,
+	[EM_NODE_TYPE_CONTINUE] = em_context_visit_continue,
+	[EM_NODE_TYPE_BREAK] = em_context_visit_break,
+	[EM_NODE_TYPE_RETURN] = em_context_visit_return,
+	[EM_NODE_TYPE_RAISE] = em_context_visit_raise,
+	[EM_NODE_TYPE_INCLUDE] = em_context_visit_include,
+	[EM_NODE_TYPE_LET] = em_context_visit_let,
+	[EM_NODE_TYPE_IF] = em_context_visit_if,
+	[EM_NODE_TYPE_FOR] = em_context_visit_for,
+	[EM_NODE_TYPE_FOREACH] = em_context_visit_foreach,
+	[EM_NODE_TYPE_WHILE] = em_context_visit_while,
+	[EM_NODE_TYPE_FUNC] = em_context_visit_func,
+	[EM_NODE_TYPE_CLASS] = em_context_visit_class,
+	[EM_NODE_TYPE_TRY] = em_context_visit_try,
+	[EM_NODE_TYPE_PUTS] = em_context_visit_puts,
+};
+
+/* literal */
+static em_value_t eval_constant(em_context_t *context, em_node_t *node) {
+
+	return node->constant;
+}
+
+/* block */
+static em_value_t eval_block(em_context_t *context, em_node_t *node) {
+
+	em_value_t result = em_none;
+	for (uint32_t i = 0; i < node->nchildren; i++) {
+
+		em_value_delete(result);
+
+		result = EVAL(context, node->children[i]);
+		if (!EM_VALUE_OK(result)) return EM_VALUE_FAIL;
+	}
+	return result;
+}
+
+/* variable */
+static em_value_t eval_identifier(em_context_t *context, em_node_t *node) {
+
+	em_value_t value = em_context_get_value(context, node->value.te_hash);
+	if (!EM_VALUE_OK(value)) {
+
+		em_log_runtime_error(EM_NODE_POS(node), "Variable '%s' not defined", node->tokens[0].value);
+		return EM_VALUE_FAIL;
+	}
+	return value;
+}
+
+/* named member */
+static em_value_t eval_member(em_context_t *context, em_node_t *node) {
+
+	em_value_t container = EVAL(context, node->children[0]);
+	if (!EM_VALUE_OK(container)) return EM_VALUE_FAIL;
+
+	em_value_t value = em_value_get_by_hash(container, node->value.te_hash, EM_NODE_POS(node));
+	if (!EM_VALUE_OK(value) && !em_log_catch(NULL) && !context->signal)
+		em_log_runtime_error(EM_NODE_POS(node), "Attribute '%s' not defined", node->tokens[0].value);
+
+	em_value_delete(container);
+	return value;
+}
+
+/* let with a single name */
+static em_value_t eval_let_name(em_context_t *context, em_node_t *node) {
+
+	em_value_t value = EVAL(context, node->children[0]);
+	if (!EM_VALUE_OK(value)) return EM_VALUE_FAIL;
+
+	em_value_t scope = context->scopestack[context->nscopestack-1];
+	if (em_value_set_by_hash(scope, node->value.te_hash, value, EM_NODE_POS(node)) != EM_RESULT_SUCCESS) {
+
+		if (!em_log_catch(NULL) && !context->signal)
+			em_log_runtime_error(EM_NODE_POS(node), "Attribute '%s' not defined", node->tokens[0].value);
+
+		em_value_delete(value);
+		return EM_VALUE_FAIL;
+	}
+	return value;
+}
+
+/* binary operation with an int literal on the right */
+static em_value_t eval_binary_int(em_context_t *context, em_node_t *node) {
+
+	em_value_t left = EVAL(context, node->children[0]);
+	if (!EM_VALUE_OK(left)) return EM_VALUE_FAIL;
+
+	em_value_t right = node->children[1]->constant;
+
+	/* same results as the int-specialized bytecode operations */
+	if (left.type == EM_VALUE_TYPE_INT) {
+
+		em_inttype_t a = left.value.te_inttype, b = right.value.te_inttype;
+		switch (node->op) {
+			case EM_NODE_OP_ADD: return EM_VALUE_INT(EM_INTTYPE_ADD(a, b));
+			case EM_NODE_OP_SUBTRACT: return EM_VALUE_INT(EM_INTTYPE_SUB(a, b));
+			case EM_NODE_OP_MULTIPLY: return EM_VALUE_INT(EM_INTTYPE_MUL(a, b));
+			case EM_NODE_OP_EQUAL: return EM_VALUE_INT(a == b);
+			case EM_NODE_OP_NOT_EQUAL: return EM_VALUE_INT(a != b);
+			case EM_NODE_OP_LESS_THAN: return EM_VALUE_INT(a < b);
+			case EM_NODE_OP_LESS_THAN_EQUAL: return EM_VALUE_INT(a <= b);
+			case EM_NODE_OP_GREATER_THAN: return EM_VALUE_INT(a > b);
+			case EM_NODE_OP_GREATER_THAN_EQUAL: return EM_VALUE_INT(a >= b);
+			default: break;
+		}
+	}
+
+	em_pos_t *pos = EM_NODE_POS(node);
+	em_value_t result;
+	switch (node->op) {
+		case EM_NODE_OP_ADD: result = em_value_add(left, right, pos); break;
+		case EM_NODE_OP_SUBTRACT: result = em_value_subtract(left, right, pos); break;
+		case EM_NODE_OP_MULTIPLY: result = em_value_multiply(left, right, pos); break;
+		case EM_NODE_OP_EQUAL: result = em_value_compare_equal(left, right, pos); break;
+		case EM_NODE_OP_NOT_EQUAL: result = EM_VALUE_INT_INV(em_value_compare_equal(left, right, pos)); break;
+		case EM_NODE_OP_LESS_THAN: result = em_value_compare_less_than(left, right, pos); break;
+		case EM_NODE_OP_LESS_THAN_EQUAL: result = EM_VALUE_INT_INV(em_value_compare_greater_than(left, right, pos)); break;
+		case EM_NODE_OP_GREATER_THAN: result = em_value_compare_greater_than(left, right, pos); break;
+		case EM_NODE_OP_GREATER_THAN_EQUAL: result = EM_VALUE_INT_INV(em_value_compare_less_than(left, right, pos)); break;
+		default: result = EM_VALUE_FAIL; break;
+	}
+	em_value_delete(left);
+	return result;
+}
+
+/* check if operator has an int-specialized handler */
+static em_bool_t is_int_operator(em_node_op_t op) {
+
+	switch (op) {
+		case EM_NODE_OP_ADD:
+		case EM_NODE_OP_SUBTRACT:
+		case EM_NODE_OP_MULTIPLY:
+		case EM_NODE_OP_EQUAL:
+		case EM_NODE_OP_NOT_EQUAL:
+		case EM_NODE_OP_LESS_THAN:
+		case EM_NODE_OP_LESS_THAN_EQUAL:
+		case EM_NODE_OP_GREATER_THAN:
+		case EM_NODE_OP_GREATER_THAN_EQUAL:
+			return EM_TRUE;
+		default:
+			return EM_FALSE;
+	}
+}
+
+/* get value of int literal */
+static em_value_t parse_int(const char *string) {
+
+	em_inttype_t value = 0;
+	for (; *string >= '0' && *string <= '9'; string++)
+		value = (value * 10) + (em_inttype_t)(*string - '0');
+	return EM_VALUE_INT(value);
+}
+
+/* bind handler and operands of node */
+static void bind(em_node_t *node) {
+
+	node->handler = node->type > 0 && node->type < EM_NODE_TYPE_COUNT && visitors[node->type]?
+		visitors[node->type]: eval_unsupported;
+
+	switch (node->type) {
+		case EM_NODE_TYPE_BLOCK:
+			node->handler = eval_block;
+			break;
+		case EM_NODE_TYPE_INT:
+			node->constant = parse_int(node->tokens[0].value);
+			node->handler = eval_constant;
+			break;
+#ifndef _ECLAIR
+		case EM_NODE_TYPE_FLOAT:
+			node->constant = EM_VALUE_FLOAT(0);
+			sscanf(node->tokens[0].value, EM_FLOATTYPE_FORMAT, &node->constant.value.te_floattype);
+			node->handler = eval_constant;
+			break;
+#endif
+		case EM_NODE_TYPE_IDENTIFIER:
+			node->handler = eval_identifier;
+			break;
+
+		/* negative literals (children are bound first) */
+		case EM_NODE_TYPE_UNARY_OPERATION:
+			if (node->op != EM_NODE_OP_NEGATIVE || node->children[0]->handler != eval_constant)
+				break;
+			if (node->children[0]->constant.type == EM_VALUE_TYPE_INT)
+				node->constant = EM_VALUE_INT(-node->children[0]->constant.value.te_inttype);
+			else node->constant = EM_VALUE_FLOAT(-node->children[0]->constant.value.te_floattype);
+			node->handler = eval_constant;
+			break;
+
+		case EM_NODE_TYPE_BINARY_OPERATION:
+			if (is_int_operator(node->op) && node->children[1]->handler == eval_constant &&
+			    node->children[1]->constant.type == EM_VALUE_TYPE_INT)
+				node->handler = eval_binary_int;
+			break;
+		case EM_NODE_TYPE_ACCESS:
+			if (node->nchildren < 2) node->handler = eval_member;
+			break;
+		case EM_NODE_TYPE_LET:
+			if (node->ntokens == 1 && node->nchildren < 2)
+				node->handler = eval_let_name;
+			break;
+	}
+}
+
+/* bind handlers and operands of nodes in tree */
+EM_API void em_closure_compile(em_node_t *node) {
+
+	if (!node) return;
+
+	for (uint32_t i = 0; i < node->nchildren; i++)
+		em_closure_compile(node->children[i]);
+	bind(node);
+}
@@ -3,6 +3,8 @@
  *
  * SPDX-License-Identifier: BSD-3-Clause
  */
+#define _GNU_SOURCE /* pthread_getattr_np */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,47 +22,25 @@
 #include <emerald/none.h>
 #include <emerald/function.h>
 #include <emerald/class.h>
+#include <emerald/fold.h>
+#include <emerald/closure.h>
+#include <emerald/jit.h>
+#include <emerald/regvm.h>
 #include <emerald/context.h>
 
-#define PATH_ENV_MAX 8
-#define PATH_ENV_SIZE 4096
-
-static char path_env[PATH_ENV_MAX][PATH_ENV_SIZE];
-static size_t path_env_count;
-
-/* visitors */
-static em_value_t (*visitors[EM_NODE_TYPE_COUNT])(em_context_t *, em_node_t *) = {
-	[EM_NODE_TYPE_BLOCK] = em_context_visit_block,
-	[EM_NODE_TYPE_INT] = em_context_visit_int,
-	[EM_NODE_TYPE_FLOAT] = em_context_visit_float,
-	[EM_NODE_TYPE_STRING] = em_context_visit_string,
-	[EM_NODE_TYPE_IDENTIFIER] = em_context_visit_identifier,
-	[EM_NODE_TYPE_LIST] = em_context_visit_list,
-	[EM_NODE_TYPE_MAP] = em_context_visit_map,
-	[EM_NODE_TYPE_UNARY_OPERATION] = em_context_visit_unary_operation,
-	[EM_NODE_TYPE_BINARY_OPERATION] = em_context_visit_binary_operation,
-	[EM_NODE_TYPE_ACCESS] = em_context_visit_access,
-	[EM_NODE_TYPE_CALL] = em_context_visit_call,
-	[EM_NODE_TYPE_CONTINUE] = em_context_visit_continue,
-	[EM_NODE_TYPE_BREAK] = em_context_visit_break,
-	[EM_NODE_TYPE_RETURN] = em_context_visit_return,
-	[EM_NODE_TYPE_RAISE] = em_context_visit_raise,
-	[EM_NODE_TYPE_INCLUDE] = em_context_visit_include,
-	[EM_NODE_TYPE_LET] = em_context_visit_let,
-	[EM_NODE_TYPE_IF] = em_context_visit_if,
-	[EM_NODE_TYPE_FOR] = em_context_visit_for,
-	[EM_NODE_TYPE_FOREACH] = em_context_visit_foreach,
-	[EM_NODE_TYPE_WHILE] = em_context_visit_while,
-	[EM_NODE_TYPE_FUNC] = em_context_visit_func,
-	[EM_NODE_TYPE_CLASS] = em_context_visit_class,
-	[EM_NODE_TYPE_TRY] = em_context_visit_try,
-	[EM_NODE_TYPE_PUTS] = em_context_visit_puts,
-};
+#ifdef EM_UNIX
+#include <sys/resource.h>
+#endif
+#if defined EM_UNIX && defined __GLIBC__
+#include <pthread.h>
+#endif
 
 /* NOTE: Always leave pathbuf1 for reuse, even if used previously */
 #define PATHBUFSZ 4096
-static char pathbuf1[PATHBUFSZ];
-static char pathbuf2[PATHBUFSZ];
+static EM_THREAD_LOCAL char pathbuf1[PATHBUFSZ];
+static EM_THREAD_LOCAL char pathbuf2[PATHBUFSZ];
+
+static EM_THREAD_LOCAL uintptr_t native_limit; /* lowest native stack address calls on this thread may reach */
 
 /* create context */
 EM_API em_context_t *em_context_new(const char **argv) {
@@ -105,106 +85,160 @@ EM_API em_result_t em_context_init(em_context_t *context, const char **argv) {
 	const char *stdlib_path = getenv("EM_PATH");
 	if (stdlib_path) context->dirstack[context->ndirstack++] = stdlib_path;
 
-	const char *path = getenv("EM_PATH");
-	const char *end = path;
+	/* each context splits its own copy */
+	if (stdlib_path) {
 
-	while (end && path_env_count < PATH_ENV_MAX &&
-	       context->ndirstack < EM_CONTEXT_MAX_DIRS) {
+		size_t len = strlen(stdlib_path);
+		context->path_env = em_malloc(len+1);
+		if (!context->path_env) return EM_RESULT_FAILURE;
+		memcpy(context->path_env, stdlib_path, len+1);
 
-		end = strchr(path, ':');
-		size_t len = end? (size_t)(end - path): strlen(path);
+		char *path = context->path_env;
+		while (path && context->ndirstack < EM_CONTEXT_MAX_DIRS) {
 
-		char *pathbuf = path_env[path_env_count++];
-		size_t real = len < PATH_ENV_SIZE-1? len: PATH_ENV_SIZE-1;
+			char *end = strchr(path, ':');
+			if (end) *end++ = 0;
 
-		memcpy(pathbuf, path, real);
-		pathbuf[real] = 0;
+			context->dirstack[context->ndirstack++] = path;
+			path = end;
+		}
+	}
 
-		path += len+1;
-		context->dirstack[context->ndirstack++] = pathbuf;
+	context->scopestack = em_malloc(sizeof(em_value_t) * EM_CONTEXT_MIN_SCOPE);
+	context->stack = em_malloc(sizeof(em_value_t) * EM_CONTEXT_MIN_STACK);
+	if (!context->scopestack || !context->stack) {
+
+		em_free(context->scopestack);
+		em_free(context->stack);
+		em_free(context->path_env);
+		return EM_RESULT_FAILURE;
 	}
+	context->scopestack_size = EM_CONTEXT_MIN_SCOPE;
+
+	context->stack_size = EM_CONTEXT_MIN_STACK;
 
 	context->nscopestack = 1;
 	context->scopestack[0] = em_map_new();
 
-	for (size_t i = 1; i < EM_CONTEXT_MAX_SCOPE; i++)
+	for (size_t i = 1; i < EM_CONTEXT_MIN_SCOPE; i++)
 		context->scopestack[i] = EM_VALUE_FAIL;
 
 	em_value_incref(context->scopestack[0]);
 	context->rec_first = NULL;
 	context->rec_last = NULL;
 	context->pass = EM_VALUE_FAIL;
+	context->signal = EM_SIGNAL_NONE;
+	context->tail_call = EM_VALUE_FAIL;
+	context->tail_nargs = 0;
 	context->mode = EM_CODE_TYPE_TREE;
 
 	context->sp = 0;
-	context->csp = 0;
+	context->stack_reserved = 0;
 	context->op_mode = EM_CODE_OP_CALL;
+	context->fold = getenv("EM_NO_FOLD")? EM_FALSE: EM_TRUE;
+	context->use_cache = getenv("EM_NO_CACHE") || !context->fold? EM_FALSE: EM_TRUE; /* cached code is folded */
+	context->use_jit = getenv("EM_NO_JIT")? EM_FALSE: EM_TRUE;
+	context->tier = getenv("EM_NO_TIER")? EM_FALSE: EM_TRUE;
+	context->profile = EM_FALSE;
+	context->code = NULL;
 
 	context->init = EM_TRUE;
 	return EM_RESULT_SUCCESS;
 }
 
-/* run code */
-static void remove_text(const char *text) {
-
-	em_node_t *node = EM_NODE(em_reflist_node.normal.first);
-	while (node) {
+/* leave file, raising signals that leave the outermost one */
+EM_API void em_context_leave_file(em_context_t *context) {
 
-		if (node->pos.text == text) node->pos.text = NULL;
-		node = EM_NODE(EM_REFOBJ(node)->next);
-	}
+	if (!--context->file_level && context->signal)
+		em_context_raise_signal(context);
+}
 
-	em_token_t *token = EM_TOKEN(em_reflist_token.normal.first);
-	while (token) {
+/* run compiled bytecode of file */
+EM_API em_value_t em_context_run_slice(em_context_t *context, const char *path, em_code_slice_t *slice) {
 
-		if (token->pos.text == text) token->pos.text = NULL;
-		token = EM_TOKEN(EM_REFOBJ(token)->next);
-	}
-}
+	context->file_level++;
 
-EM_API em_value_t em_context_run_text(em_context_t *context, const char *path, const char *text, em_ssize_t len) {
+	em_pos_t old_pos = context->op_pos;
+	context->op_pos = (em_pos_t){
+		.path = path,
+		.source = NULL,
+		.line = 0,
+		.column = 0,
+	};
+	em_value_t result = em_code_run_slice(context, slice);
 
-	if (!context || !context->init) return EM_VALUE_FAIL;
+	em_context_leave_file(context);
+	context->op_pos = old_pos;
+	return result;
+}
 
-	em_lexer_reset(&context->lexer, path, text, len);
-	context->lexer.pos.context = context;
+/* run code, caching bytecode if it came from a file */
+static em_value_t run_text(em_context_t *context, const char *path, const char *text, em_ssize_t len, em_bool_t store) {
 
-	if (em_lexer_make_tokens(&context->lexer) != EM_RESULT_SUCCESS)
+	if (em_lexer_reset(&context->lexer, path, text, len) != EM_RESULT_SUCCESS)
 		return EM_VALUE_FAIL;
 
-	em_parser_reset(&context->parser, context->lexer.first);
+	context->lexer.source->context = context;
+
+	em_parser_reset(&context->parser, &context->lexer);
 	if (em_parser_parse(&context->parser) != EM_RESULT_SUCCESS)
 		return EM_VALUE_FAIL;
 
 	em_node_t *node = context->parser.node;
-	EM_NODE_INCREF(node);
+	em_tree_t *tree = EM_TREE_INCREF(context->parser.tree);
+
+	if (context->fold) em_node_fold(node);
 
 	em_value_t result = EM_VALUE_FAIL;
 
-	/* tree-walk node */
-	if (context->mode == EM_CODE_TYPE_TREE)
-		result = em_context_visit(context, node);
+	/* tree-walk node, compiling hot parts to bytecode */
+	if (context->mode == EM_CODE_TYPE_TREE) {
 
-	/* compile and interpret bytecode */
-	else {
-		em_code_slice_t slice = {0};
-		em_code_compiler_t compiler = {0};
-		compiler.slice = &slice;
+		em_closure_compile(node);
+		context->file_level++;
+
+		/* signals may point into the code object */
+		em_code_t *code = em_code_new_node(node, path);
+		result = em_code_run(code, context);
+		em_context_leave_file(context);
+
+		EM_CODE_DECREF(code);
+	}
 
-		slice.length = em_code_get_size(&compiler, node);
+	/* compile and interpret register code */
+	else if (context->mode == EM_CODE_TYPE_REGISTER) {
+
+		em_reg_code_t code;
+		if (em_reg_compile(&code, node) != EM_RESULT_SUCCESS) {
+
+			em_log_runtime_error(EM_NODE_POS(node), "Failed to compile register code");
+			EM_TREE_DECREF(tree);
+			return EM_VALUE_FAIL;
+		}
+#ifdef EM_BYTECODE_DEBUG
+		em_reg_disassemble(&code, stdout);
+#endif
+		context->file_level++;
 
-		slice.data = em_malloc(slice.length);
-		memset(slice.data, 0, slice.length);
+		result = em_reg_run(context, &code);
+		em_reg_free(&code);
 
-		compiler.pos.line = 0;
-		compiler.pos.column = 0;
-		compiler.slice = &slice;
+		em_context_leave_file(context);
+	}
 
-		em_code_write(&compiler, node);
-		slice.position = 0;
+	/* compile and interpret bytecode */
+	else {
+		em_code_slice_t slice;
+		if (em_code_compile(&slice, node) != EM_RESULT_SUCCESS) {
 
+			EM_TREE_DECREF(tree);
+			return EM_VALUE_FAIL;
+		}
 		context->rec_last->slice = slice;
 
+		/* store before running, as the interpreter rewrites operations in place */
+		if (store) (void)em_code_cache_store(&slice, path, text, (size_t)len);
+
 		/* print hex dump */
 #ifdef EM_BYTECODE_DEBUG
 		printf("length: 0x%zx\n\n", slice.length);
@@ -236,29 +270,18 @@ EM_API em_value_t em_context_run_text(em_context_t *context, const char *path, c
 		em_code_disassemble(&slice, stdout);
 #endif
 		/* run bytecode */
-		context->file_level++;
-
-		em_pos_t old_pos = context->op_pos;
-		context->op_pos = (em_pos_t){
-			.path = path,
-			.text = NULL,
-			.line = 0,
-			.column = 0,
-		};
-		result = em_code_run_slice(context, &slice);
-
-		if (context->mode == EM_CODE_OP_RSTR2 && context->file_level == 1)
-			em_log_runtime_error(&context->op_pos, "Not in a function");
+		result = em_context_run_slice(context, path, &context->rec_last->slice);
+	}
+	EM_TREE_DECREF(tree);
+	return result;
+}
 
-		else if (context->mode == EM_CODE_OP_RSTR3 && context->file_level == 1)
-			em_log_runtime_error(&context->op_pos, "Not in a loop");
+/* run code */
+EM_API em_value_t em_context_run_text(em_context_t *context, const char *path, const char *text, em_ssize_t len) {
 
-		context->file_level--;
-	}
-	EM_NODE_DECREF(node);
+	if (!context || !context->init) return EM_VALUE_FAIL;
 
-	remove_text(text);
-	return result;
+	return run_text(context, path, text, len, EM_FALSE);
 }
 
 /* push directory to stack */
@@ -313,17 +336,90 @@ EM_API const char *em_context_popdir(em_context_t *context) {
 	return context->dirstack[--context->ndirstack];
 }
 
+/* resize stack array */
+static em_result_t resize(void **array, size_t *size, size_t new_size, size_t item_size) {
+
+	void *new_array = em_realloc(*array, new_size * item_size);
+	if (!new_array) return EM_RESULT_FAILURE;
+
+	*array = new_array;
+	*size = new_size;
+	return EM_RESULT_SUCCESS;
+}
+
+/* get size to grow stack array to for count items */
+static size_t grow_size(size_t size, size_t count) {
+
+	while (size < count) size *= 2;
+	return size;
+}
+
+/* get size of native stack that threads are given by default */
+EM_API size_t em_context_get_stack_size(void) {
+
+#ifdef EM_UNIX
+	struct rlimit limit;
+	if (!getrlimit(RLIMIT_STACK, &limit) && limit.rlim_cur != RLIM_INFINITY)
+		return (size_t)limit.rlim_cur;
+#endif
+	return EM_CONTEXT_NATIVE_STACK;
+}
+
+/*
+ * Get the lowest native stack address of the current thread that calls may
+ * reach, leaving a quarter of the stack for whatever runs below the deepest
+ * call. The stack is assumed to grow down. Where the bounds of the thread's
+ * stack can't be found, the stack is measured from the first call on the
+ * thread instead.
+ */
+static uintptr_t get_native_limit(void) {
+
+	if (native_limit) return native_limit;
+
+	char here;
+	uintptr_t top = (uintptr_t)&here;
+	size_t size = 0;
+
+#if defined EM_UNIX && defined __GLIBC__
+	pthread_attr_t attr;
+	void *addr;
+	if (!pthread_getattr_np(pthread_self(), &attr)) {
+
+		if (pthread_attr_getstack(&attr, &addr, &size)) size = 0;
+		else top = (uintptr_t)addr + size;
+		pthread_attr_destroy(&attr);
+	}
+#endif
+	if (!size) size = em_context_get_stack_size();
+
+	size = size / 4 * 3;
+	native_limit = top > size? top - size: 1;
+	return native_limit;
+}
+
 /* push scope to stack */
 EM_API em_result_t em_context_push_scope(em_context_t *context) {
 
 	if (!context || !context->init) return EM_RESULT_FAILURE;
 
 	/* no space */
-	if (context->nscopestack >= EM_CONTEXT_MAX_SCOPE) {
+	char here;
+	if (context->nscopestack >= EM_CONTEXT_MAX_SCOPE || (uintptr_t)&here < get_native_limit()) {
 
 		em_log_fatal("Reached scope stack limit");
 		return EM_RESULT_FAILURE;
 	}
+	if (context->nscopestack >= context->scopestack_size) {
+
+		size_t old_size = context->scopestack_size;
+		if (resize((void **)&context->scopestack, &context->scopestack_size, old_size * 2, sizeof(em_value_t)) != EM_RESULT_SUCCESS) {
+
+			em_log_fatal("Failed to grow scope stack");
+			return EM_RESULT_FAILURE;
+		}
+		for (size_t i = old_size; i < context->scopestack_size; i++)
+			context->scopestack[i] = EM_VALUE_FAIL;
+	}
 
 	size_t index = context->nscopestack++;
 	if (!EM_VALUE_OK(context->scopestack[index])) {
@@ -350,6 +446,15 @@ EM_API void em_context_pop_scope(em_context_t *context) {
 
 	em_value_t map = context->scopestack[--context->nscopestack];
 	em_map_soft_reset(map);
+
+	/* shrink after deep recursion, dropping the maps kept for reuse */
+	size_t size = context->scopestack_size;
+	if (size > EM_CONTEXT_MIN_SCOPE && context->nscopestack < size / 4) {
+
+		for (size_t i = size / 2; i < size; i++)
+			em_value_decref(context->scopestack[i]);
+		(void)resize((void **)&context->scopestack, &context->scopestack_size, size / 2, sizeof(em_value_t));
+	}
 }
 
 /* set value in current scope */
@@ -373,31 +478,51 @@ EM_API em_value_t em_context_get_value(em_context_t *context, em_hash_t key) {
 	return EM_VALUE_FAIL;
 }
 
-/* push value to stack */
-EM_API void em_context_push_value(em_context_t *context, em_value_t value) {
+/*
+ * Reserve room for count values above the top of the stack. The bytecode
+ * interpreter reserves the deepest stack use of a slice before running it
+ * and pushes without checks after that. The stack may move when it grows,
+ * so pointers into it aren't kept across anything that can run code.
+ */
+EM_API em_result_t em_context_reserve_stack(em_context_t *context, size_t count) {
+
+	size_t need = context->sp + count;
+	if (need > EM_CONTEXT_MAX_STACK) return EM_RESULT_FAILURE;
+
+	if (need > context->stack_size &&
+	    resize((void **)&context->stack, &context->stack_size, grow_size(context->stack_size, need), sizeof(em_value_t)) != EM_RESULT_SUCCESS)
+		return EM_RESULT_FAILURE;
 
-	if (context->sp < EM_CONTEXT_MAX_STACK)
-		context->stack[context->sp++] = value;
+	if (need > context->stack_reserved)
+		context->stack_reserved = need;
+	return EM_RESULT_SUCCESS;
 }
 
-/* pop value from stack */
-EM_API em_value_t em_context_pop_value(em_context_t *context) {
+/* restore previous reservation and shrink value stack */
+EM_API void em_context_trim_stack(em_context_t *context, size_t reserved) {
 
-	if (context->sp) return context->stack[--context->sp];
-	return EM_VALUE_FAIL;
+	context->stack_reserved = reserved;
+
+	size_t size = context->stack_size;
+	if (size > EM_CONTEXT_MIN_STACK && reserved < size / 4 && context->sp < size / 4)
+		(void)resize((void **)&context->stack, &context->stack_size, size / 2, sizeof(em_value_t));
 }
 
-/* save context to context stack */
-EM_API void em_context_push_context(em_context_t *context, uint32_t level, size_t pos, size_t sp) {
+/* push value to stack */
+EM_API em_result_t em_context_push_value(em_context_t *context, em_value_t value) {
 
-	if (context->csp < EM_CONTEXT_MAX_STACK) {
+	if (context->sp >= context->stack_size && em_context_reserve_stack(context, 1) != EM_RESULT_SUCCESS)
+		return EM_RESULT_FAILURE;
 
-		size_t i = context->csp++;
+	context->stack[context->sp++] = value;
+	return EM_RESULT_SUCCESS;
+}
 
-		context->cstack[i].level = level;
-		context->cstack[i].pos = pos;
-		context->cstack[i].sp = sp;
-	}
+/* pop value from stack */
+EM_API em_value_t em_context_pop_value(em_context_t *context) {
+
+	if (context->sp) return context->stack[--context->sp];
+	return EM_VALUE_FAIL;
 }
 
 /* run code from file */
@@ -456,6 +581,14 @@ EM_API em_value_t em_context_run_file(em_context_t *context, em_pos_t *pos, cons
 	fbuf[len] = 0;
 	em_file_close(fp);
 
+	/* look for cached bytecode, which skips the front end entirely */
+	em_bool_t use_cache = context->mode == EM_CODE_TYPE_BINARY && context->use_cache;
+	em_code_cache_t cache = EM_CODE_CACHE_INIT;
+	em_code_slice_t slice = {0};
+
+	em_bool_t cached = use_cache &&
+			   em_code_cache_load(&cache, &slice, rpath, fbuf, len) == EM_RESULT_SUCCESS;
+
 	/* make file record */
 	size_t reclen = strlen(rpath);
 
@@ -463,6 +596,8 @@ EM_API em_value_t em_context_run_file(em_context_t *context, em_pos_t *pos, cons
 	memset(recfile, 0, sizeof(em_recfile_t)+reclen+1);
 
 	memcpy(recfile->rpath, rpath, reclen);
+	recfile->slice = slice;
+	recfile->cache = cache;
 
 	/* add file to run list */
 	if (!context->rec_first) context->rec_first = recfile;
@@ -470,10 +605,12 @@ EM_API em_value_t em_context_run_file(em_context_t *context, em_pos_t *pos, cons
 	context->rec_last = recfile;
 
 	/* run code */
-	em_value_t result = em_context_run_text(context, recfile->rpath, fbuf, (em_ssize_t)len);
+	em_value_t result;
+	if (cached) result = em_context_run_slice(context, recfile->rpath, &recfile->slice);
+	else result = run_text(context, recfile->rpath, fbuf, (em_ssize_t)len, use_cache);
+	em_free(fbuf);
 
 	/* clean up */
-	em_free(fbuf);
 	if (buf) {
 
 		(void)em_context_popdir(context);
@@ -485,27 +622,21 @@ EM_API em_value_t em_context_run_file(em_context_t *context, em_pos_t *pos, cons
 /* visit node */
 EM_API em_value_t em_context_visit(em_context_t *context, em_node_t *node) {
 
-	if (!visitors[node->type]) {
-
-		em_log_runtime_error(&node->pos, "Unsupported node ('%s')", em_get_node_type_name(node->type));
-		return EM_VALUE_FAIL;
-	}
-	return visitors[node->type](context, node);
+	/* files are bound before they run; this catches trees built elsewhere */
+	if (!node->handler) em_closure_compile(node);
+	return node->handler(context, node);
 }
 
 /* visit block */
 EM_API em_value_t em_context_visit_block(em_context_t *context, em_node_t *node) {
 
-	em_node_t *cur = node->first;
 	em_value_t result = em_none;
-	while (cur) {
+	for (uint32_t i = 0; i < node->nchildren; i++) {
 
 		em_value_delete(result);
 
-		result = em_context_visit(context, cur);
+		result = em_context_visit(context, node->children[i]);
 		if (!EM_VALUE_OK(result)) return EM_VALUE_FAIL;
-
-		cur = cur->next;
 	}
 	return result;
 }
@@ -513,7 +644,7 @@ EM_API em_value_t em_context_visit_block(em_context_t *context, em_node_t *node)
 /* visit integer */
 EM_API em_value_t em_context_visit_int(em_context_t *context, em_node_t *node) {
 
-	em_token_t *token = em_node_get_token(node, 0);
+	em_node_token_t *token = em_node_get_token(node, 0);
 
 	em_inttype_t value = 0;
 
@@ -527,13 +658,13 @@ EM_API em_value_t em_context_visit_int(em_context_t *context, em_node_t *node) {
 /* visit float */
 EM_API em_value_t em_context_visit_float(em_context_t *context, em_node_t *node) {
 
-	em_token_t *token = em_node_get_token(node, 0);
+	em_node_token_t *token = em_node_get_token(node, 0);
 
 	em_floattype_t value;
 #ifndef _ECLAIR
 	sscanf(token->value, EM_FLOATTYPE_FORMAT, &value);
 #else
-	em_log_runtime_error(&node->pos, "Unsupported on platform"); /* TODO: Add Eclair OS support for floats */
+	em_log_runtime_error(EM_NODE_POS(node), "Unsupported on platform"); /* TODO: Add Eclair OS support for floats */
 	return EM_VALUE_FAIL;
 #endif
 
@@ -543,21 +674,18 @@ EM_API em_value_t em_context_visit_float(em_context_t *context, em_node_t *node)
 /* visit string */
 EM_API em_value_t em_context_visit_string(em_context_t *context, em_node_t *node) {
 
-	em_token_t *token = em_node_get_token(node, 0);
+	em_node_token_t *token = em_node_get_token(node, 0);
 	return em_string_new_from_utf8(token->value, em_utf8_strlen(token->value));
 }
 
 /* visit identifier */
 EM_API em_value_t em_context_visit_identifier(em_context_t *context, em_node_t *node) {
 
-	em_token_t *token = em_node_get_token(node, 0);
-	em_hash_t key = em_node_get_value(node, 0).v.te_hash;
-
-	em_value_t value = em_context_get_value(context, key);
+	em_value_t value = em_context_get_value(context, node->value.te_hash);
 
 	if (!EM_VALUE_OK(value)) {
 
-		em_log_runtime_error(&node->pos, "Variable '%s' not defined", token->value);
+		em_log_runtime_error(EM_NODE_POS(node), "Variable '%s' not defined", node->tokens[0].value);
 		return EM_VALUE_FAIL;
 	}
 	return value;
@@ -566,27 +694,16 @@ EM_API em_value_t em_context_visit_identifier(em_context_t *context, em_node_t *
 /* visit list */
 EM_API em_value_t em_context_visit_list(em_context_t *context, em_node_t *node) {
 
-	size_t nchildren = 0;
-
-	em_node_t *cur = node->first;
-	while (cur) {
-
-		nchildren++;
-		cur = cur->next;
-	}
-	cur = node->first;
+	em_value_t list = em_list_new(node->nchildren);
+	for (uint32_t i = 0; i < node->nchildren; i++) {
 
-	em_value_t list = em_list_new(nchildren);
-	while (cur) {
-
-		em_value_t value = em_context_visit(context, cur);
+		em_value_t value = em_context_visit(context, node->children[i]);
 		if (!EM_VALUE_OK(value)) {
 
 			em_value_delete(list);
 			return EM_VALUE_FAIL;
 		}
 		em_list_append(list, value);
-		cur = cur->next;
 	}
 	return list;
 }
@@ -594,13 +711,12 @@ EM_API em_value_t em_context_visit_list(em_context_t *context, em_node_t *node)
 /* visit map */
 EM_API em_value_t em_context_visit_map(em_context_t *context, em_node_t *node) {
 
-	em_node_t *cur = node->first;
 	em_value_t map = em_map_new();
 
-	while (cur) {
+	for (uint32_t i = 0; i+1 < node->nchildren; i += 2) {
 
-		em_node_t *key_node = cur;
-		em_node_t *value_node = key_node->next;
+		em_node_t *key_node = node->children[i];
+		em_node_t *value_node = node->children[i+1];
 
 		em_value_t key = em_context_visit(context, key_node);
 		if (!EM_VALUE_OK(key)) {
@@ -617,11 +733,10 @@ EM_API em_value_t em_context_visit_map(em_context_t *context, em_node_t *node) {
 		}
 
 		/* set item */
-		em_hash_t hash = em_value_hash(key, &key_node->pos);
+		em_hash_t hash = em_value_hash(key, EM_NODE_POS(key_node));
 		em_map_set_key(map, key, hash, value);
 
 		em_value_delete(key);
-		cur = value_node->next;
 	}
 	return map;
 }
@@ -629,8 +744,7 @@ EM_API em_value_t em_context_visit_map(em_context_t *context, em_node_t *node) {
 /* visit unary operation */
 EM_API em_value_t em_context_visit_unary_operation(em_context_t *context, em_node_t *node) {
 
-	em_token_t *token = em_node_get_token(node, 0);
-	em_node_t *right_node = node->first;
+	em_node_t *right_node = node->children[0];
 
 	em_value_t right = em_context_visit(context, right_node);
 	if (!EM_VALUE_OK(right)) return EM_VALUE_FAIL;
@@ -638,17 +752,23 @@ EM_API em_value_t em_context_visit_unary_operation(em_context_t *context, em_nod
 	/* operation */
 	em_value_t result;
 
-	if (token->type == EM_TOKEN_TYPE_PLUS)
-		result = right;
-	else if (token->type == EM_TOKEN_TYPE_MINUS)
-		result = em_value_multiply(right, EM_VALUE_INT(-1), &node->pos);
-	else if (token->type == EM_TOKEN_TYPE_BITWISE_NOT)
-		result = em_value_not(right, &node->pos);
-	else if (!strcmp(token->value, "not"))
-		result = EM_VALUE_INT_INV(em_value_is_true(right, &node->pos));
-	else {
-		em_log_runtime_error(&node->pos, "Unsupported operation ('%s')", token->value);
-		result = EM_VALUE_FAIL;
+	switch (node->op) {
+		case EM_NODE_OP_POSITIVE:
+			result = right;
+			break;
+		case EM_NODE_OP_NEGATIVE:
+			result = em_value_multiply(right, EM_VALUE_INT(-1), EM_NODE_POS(node));
+			break;
+		case EM_NODE_OP_BITWISE_NOT:
+			result = em_value_not(right, EM_NODE_POS(node));
+			break;
+		case EM_NODE_OP_NOT:
+			result = EM_VALUE_INT_INV(em_value_is_true(right, EM_NODE_POS(node)));
+			break;
+		default:
+			em_log_runtime_error(EM_NODE_POS(node), "Unsupported operation ('%s')", em_node_get_token(node, 0)->value);
+			result = EM_VALUE_FAIL;
+			break;
 	}
 
 	if (!em_value_is(result, right))
@@ -659,100 +779,57 @@ EM_API em_value_t em_context_visit_unary_operation(em_context_t *context, em_nod
 /* visit binary operation */
 EM_API em_value_t em_context_visit_binary_operation(em_context_t *context, em_node_t *node) {
 
-	em_node_t *left_node = node->first;
-	em_token_t *token = em_node_get_token(node, 0);
-	em_node_t *right_node = left_node->next;
+	em_node_t *left_node = node->children[0];
+	em_node_t *right_node = node->children[1];
+	em_pos_t *pos = EM_NODE_POS(node);
 
 	em_value_t left = em_context_visit(context, left_node);
 	if (!EM_VALUE_OK(left)) return EM_VALUE_FAIL;
 
 	/* special case to not evaluate value for and and or */
-	em_value_t right = EM_VALUE_FAIL;
-	if (!!strcmp(token->value, "and") && !!strcmp(token->value, "or")) {
-
-		right = em_context_visit(context, right_node);
-		if (!EM_VALUE_OK(right)) {
-
-			em_value_delete(left);
-			return EM_VALUE_FAIL;
-		}
-	}
-
-	/* operation */
-	em_value_t result;
-
-	if (token->type == EM_TOKEN_TYPE_PLUS)
-		result = em_value_add(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_MINUS)
-		result = em_value_subtract(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_ASTERISK)
-		result = em_value_multiply(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_SLASH)
-		result = em_value_divide(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_MODULO)
-		result = em_value_modulo(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_BITWISE_OR)
-		result = em_value_or(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_BITWISE_XOR)
-		result = em_value_xor(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_BITWISE_AND)
-		result = em_value_and(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_BITWISE_LEFT_SHIFT)
-		result = em_value_shift_left(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_BITWISE_RIGHT_SHIFT)
-		result = em_value_shift_right(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_DOUBLE_EQUALS)
-		result = em_value_compare_equal(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_NOT_EQUALS)
-		result = EM_VALUE_INT_INV(em_value_compare_equal(left, right, &node->pos));
-
-	else if (token->type == EM_TOKEN_TYPE_LESS_THAN)
-		result = em_value_compare_less_than(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_LESS_THAN_EQUALS)
-		result = EM_VALUE_INT_INV(em_value_compare_greater_than(left, right, &node->pos));
-
-	else if (token->type == EM_TOKEN_TYPE_GREATER_THAN)
-		result = em_value_compare_greater_than(left, right, &node->pos);
-
-	else if (token->type == EM_TOKEN_TYPE_GREATER_THAN_EQUALS)
-		result = EM_VALUE_INT_INV(em_value_compare_less_than(left, right, &node->pos));
-
-	/* special case to not evaluate value for and and or */
-	else if (!strcmp(token->value, "or")) {
+	em_value_t result, right = EM_VALUE_FAIL;
+	if (node->op == EM_NODE_OP_AND || node->op == EM_NODE_OP_OR) {
 
-		result = em_value_is_true(left, &node->pos);
-		if (!result.value.te_inttype) {
+		result = em_value_is_true(left, pos);
+		if (EM_VALUE_OK(result) && !!result.value.te_inttype == (node->op == EM_NODE_OP_AND)) {
 
 			right = em_context_visit(context, right_node);
-			if (EM_VALUE_OK(right)) result = em_value_is_true(right, &node->pos);
+			result = EM_VALUE_OK(right)? em_value_is_true(right, pos): EM_VALUE_FAIL;
 		}
+		em_value_delete(left);
+		em_value_delete(right);
+		return result;
 	}
 
-	else if (!strcmp(token->value, "and")) {
+	right = em_context_visit(context, right_node);
+	if (!EM_VALUE_OK(right)) {
 
-		result = em_value_is_true(left, &node->pos);
-		if (result.value.te_inttype) {
-
-			right = em_context_visit(context, right_node);
-			if (EM_VALUE_OK(right)) result = em_value_is_true(right, &node->pos);
-		}
+		em_value_delete(left);
+		return EM_VALUE_FAIL;
 	}
 
-	else {
-		em_log_runtime_error(&node->pos, "Unsupported operation ('%s')", token->value);
-		result = EM_VALUE_FAIL;
+	/* operation */
+	switch (node->op) {
+		case EM_NODE_OP_ADD: result = em_value_add(left, right, pos); break;
+		case EM_NODE_OP_SUBTRACT: result = em_value_subtract(left, right, pos); break;
+		case EM_NODE_OP_MULTIPLY: result = em_value_multiply(left, right, pos); break;
+		case EM_NODE_OP_DIVIDE: result = em_value_divide(left, right, pos); break;
+		case EM_NODE_OP_MODULO: result = em_value_modulo(left, right, pos); break;
+		case EM_NODE_OP_BITWISE_OR: result = em_value_or(left, right, pos); break;
+		case EM_NODE_OP_BITWISE_XOR: result = em_value_xor(left, right, pos); break;
+		case EM_NODE_OP_BITWISE_AND: result = em_value_and(left, right, pos); break;
+		case EM_NODE_OP_SHIFT_LEFT: result = em_value_shift_left(left, right, pos); break;
+		case EM_NODE_OP_SHIFT_RIGHT: result = em_value_shift_right(left, right, pos); break;
+		case EM_NODE_OP_EQUAL: result = em_value_compare_equal(left, right, pos); break;
+		case EM_NODE_OP_NOT_EQUAL: result = EM_VALUE_INT_INV(em_value_compare_equal(left, right, pos)); break;
+		case EM_NODE_OP_LESS_THAN: result = em_value_compare_less_than(left, right, pos); break;
+		case EM_NODE_OP_LESS_THAN_EQUAL: result = EM_VALUE_INT_INV(em_value_compare_greater_than(left, right, pos)); break;
+		case EM_NODE_OP_GREATER_THAN: result = em_value_compare_greater_than(left, right, pos); break;
+		case EM_NODE_OP_GREATER_THAN_EQUAL: result = EM_VALUE_INT_INV(em_value_compare_less_than(left, right, pos)); break;
+		default:
+			em_log_runtime_error(pos, "Unsupported operation ('%s')", em_node_get_token(node, 0)->value);
+			result = EM_VALUE_FAIL;
+			break;
 	}
 
 	em_value_delete(left);
@@ -763,9 +840,8 @@ EM_API em_value_t em_context_visit_binary_operation(em_context_t *context, em_no
 /* visit member access */
 EM_API em_value_t em_context_visit_access(em_context_t *context, em_node_t *node) {
 
-	em_node_t *container_node = node->first;
-	em_token_t *name_token = em_node_get_token(node, 0);
-	em_node_t *index_node = container_node->next;
+	em_node_t *container_node = node->children[0];
+	em_node_t *index_node = node->nchildren > 1? node->children[1]: NULL;
 
 	em_value_t container = em_context_visit(context, container_node);
 	if (!EM_VALUE_OK(container)) return EM_VALUE_FAIL;
@@ -779,18 +855,17 @@ EM_API em_value_t em_context_visit_access(em_context_t *context, em_node_t *node
 			em_value_delete(container);
 			return EM_VALUE_FAIL;
 		}
-		value = em_value_get_by_index(container, index, &node->pos);
+		value = em_value_get_by_index(container, index, EM_NODE_POS(node));
 
-		if (!EM_VALUE_OK(value) && !em_log_catch(NULL))
-			em_log_runtime_error(&node->pos, "Invalid index");
+		if (!EM_VALUE_OK(value) && !em_log_catch(NULL) && !context->signal)
+			em_log_runtime_error(EM_NODE_POS(node), "Invalid index");
 	}
 	else {
 
-		em_hash_t hash = em_node_get_value(node, 0).v.te_hash;
-		value = em_value_get_by_hash(container, hash, &node->pos);
+		value = em_value_get_by_hash(container, node->value.te_hash, EM_NODE_POS(node));
 
-		if (!EM_VALUE_OK(value) && !em_log_catch(NULL))
-			em_log_runtime_error(&node->pos, "Attribute '%s' not defined", name_token->value);
+		if (!EM_VALUE_OK(value) && !em_log_catch(NULL) && !context->signal)
+			em_log_runtime_error(EM_NODE_POS(node), "Attribute '%s' not defined", node->tokens[0].value);
 	}
 
 	em_value_delete(container);
@@ -798,35 +873,34 @@ EM_API em_value_t em_context_visit_access(em_context_t *context, em_node_t *node
 	return value;
 }
 
-/* visit call */
-EM_API em_value_t em_context_visit_call(em_context_t *context, em_node_t *node) {
-
-	em_node_t *call_node = node->first;
+/* get function and argument values of call (arguments are referenced) */
+static em_bool_t visit_call_values(em_context_t *context, em_node_t *node, em_value_t *call, em_value_t *args, size_t *nargs) {
 
-	em_value_t call = em_context_visit(context, call_node);
-	if (!EM_VALUE_OK(call)) return EM_VALUE_FAIL;
-
-	em_value_t args[EM_FUNCTION_MAX_ARGUMENTS];
-	size_t nargs = 0;
+	*call = em_context_visit(context, node->children[0]);
+	if (!EM_VALUE_OK(*call)) return EM_FALSE;
 
 	/* get argument values */
-	em_node_t *arg_node = call_node->next;
-	while (arg_node && nargs < EM_FUNCTION_MAX_ARGUMENTS) {
+	*nargs = 0;
+	while (*nargs+1 < node->nchildren && *nargs < EM_FUNCTION_MAX_ARGUMENTS) {
 
-		args[nargs] = em_context_visit(context, arg_node);
-		if (!EM_VALUE_OK(args[nargs])) {
+		args[*nargs] = em_context_visit(context, node->children[*nargs+1]);
+		if (!EM_VALUE_OK(args[*nargs])) {
 
-			for (size_t i = 0; i < nargs; i++)
+			for (size_t i = 0; i < *nargs; i++)
 				em_value_decref(args[i]);
-			em_value_delete(call);
-			return EM_VALUE_FAIL;
+			em_value_delete(*call);
+			return EM_FALSE;
 		}
-		em_value_incref(args[nargs]);
-		arg_node = arg_node->next;
-		nargs++;
+		em_value_incref(args[*nargs]);
+		(*nargs)++;
 	}
+	return EM_TRUE;
+}
 
-	em_value_t result = em_value_call(context, call, args, nargs, &node->pos);
+/* call function and release values */
+static em_value_t finish_call(em_context_t *context, em_node_t *node, em_value_t call, em_value_t *args, size_t nargs) {
+
+	em_value_t result = em_value_call(context, call, args, nargs, EM_NODE_POS(node));
 
 	for (size_t i = 0; i < nargs; i++) {
 
@@ -838,45 +912,142 @@ EM_API em_value_t em_context_visit_call(em_context_t *context, em_node_t *node)
 	return result;
 }
 
+/* visit call */
+EM_API em_value_t em_context_visit_call(em_context_t *context, em_node_t *node) {
+
+	em_value_t call, args[EM_FUNCTION_MAX_ARGUMENTS];
+	size_t nargs;
+
+	if (!visit_call_values(context, node, &call, args, &nargs))
+		return EM_VALUE_FAIL;
+	return finish_call(context, node, call, args, nargs);
+}
+
+/*
+ * Calls of emerald functions in tail position aren't made by the function
+ * making them. It saves the call and returns, and the call that is running
+ * the function runs the new one in its place (see function.c).
+ */
+EM_API void em_context_set_tail_call(em_context_t *context, em_value_t call, em_value_t *args, size_t nargs, em_pos_t *pos) {
+
+	em_context_drop_tail_call(context);
+
+	em_value_incref(call);
+	context->tail_call = call;
+	memcpy(context->tail_args, args, nargs * sizeof(em_value_t));
+	context->tail_nargs = nargs;
+	context->tail_pos = *pos;
+
+	context->pass = em_none;
+	em_context_signal(context, EM_SIGNAL_RETURN, pos);
+}
+
+/* drop pending tail call */
+EM_API void em_context_drop_tail_call(em_context_t *context) {
+
+	if (!EM_VALUE_OK(context->tail_call)) return;
+
+	for (size_t i = 0; i < context->tail_nargs; i++)
+		em_value_decref(context->tail_args[i]);
+	em_value_decref(context->tail_call);
+
+	context->tail_call = EM_VALUE_FAIL;
+	context->tail_nargs = 0;
+}
+
+/*
+ * Send signal to enclosing loop or call. Nothing is formatted until the
+ * signal turns out to have nowhere to go, so the position is copied in case
+ * the statement is freed first.
+ */
+EM_API em_value_t em_context_signal(em_context_t *context, em_signal_t signal, const em_pos_t *pos) {
+
+	context->signal = signal;
+	context->signal_pos = *pos;
+	return EM_VALUE_FAIL;
+}
+
+/* clear signal if it is pending */
+EM_API em_bool_t em_context_catch_signal(em_context_t *context, em_signal_t signal) {
+
+	if (context->signal != signal) return EM_FALSE;
+
+	context->signal = EM_SIGNAL_NONE;
+	return EM_TRUE;
+}
+
+/* raise pending signal as error */
+EM_API void em_context_raise_signal(em_context_t *context) {
+
+	em_signal_t signal = context->signal;
+	context->signal = EM_SIGNAL_NONE;
+
+	switch (signal) {
+		case EM_SIGNAL_BREAK:
+			em_log_raise(&em_class_system_break, &context->signal_pos, "Not in a loop");
+			break;
+		case EM_SIGNAL_CONTINUE:
+			em_log_raise(&em_class_system_continue, &context->signal_pos, "Not in a loop");
+			break;
+		case EM_SIGNAL_RETURN:
+			em_context_drop_tail_call(context);
+			em_log_raise(&em_class_system_return, &context->signal_pos, "Not in a function");
+			break;
+	}
+}
+
 /* visit continue statement */
 EM_API em_value_t em_context_visit_continue(em_context_t *context, em_node_t *node) {
 
-	em_log_raise(&em_class_system_continue, &node->pos, "Not in a loop");
-	return EM_VALUE_FAIL;
+	return em_context_signal(context, EM_SIGNAL_CONTINUE, EM_NODE_POS(node));
 }
 
 /* visit break statement */
 EM_API em_value_t em_context_visit_break(em_context_t *context, em_node_t *node) {
 
-	em_log_raise(&em_class_system_break, &node->pos, "Not in a loop");
-	return EM_VALUE_FAIL;
+	return em_context_signal(context, EM_SIGNAL_BREAK, EM_NODE_POS(node));
 }
 
 /* visit return statement */
 EM_API em_value_t em_context_visit_return(em_context_t *context, em_node_t *node) {
 
-	em_node_t *value_node = node->first;
+	em_node_t *value_node = node->children[0];
+	em_value_t value;
 
-	em_value_t value = em_context_visit(context, value_node);
+	/* call in tail position */
+	if (node->flags & EM_NODE_RETURN_TAIL) {
+
+		em_value_t call, args[EM_FUNCTION_MAX_ARGUMENTS];
+		size_t nargs;
+
+		if (!visit_call_values(context, value_node, &call, args, &nargs))
+			return EM_VALUE_FAIL;
+
+		if (em_is_function(call)) {
+
+			em_context_set_tail_call(context, call, args, nargs, EM_NODE_POS(value_node));
+			return EM_VALUE_FAIL;
+		}
+		value = finish_call(context, value_node, call, args, nargs);
+	}
+	else value = em_context_visit(context, value_node);
 	if (!EM_VALUE_OK(value)) return EM_VALUE_FAIL;
 
 	context->pass = value;
-
-	em_log_raise(&em_class_system_return, &node->pos, "Not in a function");
-	return EM_VALUE_FAIL;
+	return em_context_signal(context, EM_SIGNAL_RETURN, EM_NODE_POS(node));
 }
 
 /* visit raise statement */
 EM_API em_value_t em_context_visit_raise(em_context_t *context, em_node_t *node) {
 
-	em_node_t *value_node = node->first;
+	em_node_t *value_node = node->children[0];
 
 	em_value_t value = em_context_visit(context, value_node);
 	if (!EM_VALUE_OK(value)) return EM_VALUE_FAIL;
 
 	if (!em_is_map(value)) {
 
-		em_log_runtime_error(&node->pos, "Expected map");
+		em_log_runtime_error(EM_NODE_POS(node), "Expected map");
 		em_value_delete(value);
 		return EM_VALUE_FAIL;
 	}
@@ -885,11 +1056,11 @@ EM_API em_value_t em_context_visit_raise(em_context_t *context, em_node_t *node)
 	em_value_t class = em_map_get(value, em_utf8_strhash("_class"));
 	if (!em_is_class(class)) {
 
-		em_log_runtime_error(&node->pos, "Expected map to be instance of class");
+		em_log_runtime_error(EM_NODE_POS(node), "Expected map to be instance of class");
 		return EM_VALUE_FAIL;
 	}
 
-	em_value_t string = em_value_to_string(value, &node->pos);
+	em_value_t string = em_value_to_string(value, EM_NODE_POS(node));
 	if (!EM_VALUE_OK(string)) {
 
 		em_value_delete(value);
@@ -904,21 +1075,21 @@ EM_API em_value_t em_context_visit_raise(em_context_t *context, em_node_t *node)
 
 	context->pass = value;
 
-	em_log_raise(&class, &node->pos, buf);
+	em_log_raise(&class, EM_NODE_POS(node), "%s", buf);
 	return EM_VALUE_FAIL;
 }
 
 /* visit include statement */
 EM_API em_value_t em_context_visit_include(em_context_t *context, em_node_t *node) {
 
-	em_node_t *path_node = node->first;
+	em_node_t *path_node = node->children[0];
 
 	em_value_t path = em_context_visit(context, path_node);
 	if (!EM_VALUE_OK(path)) return EM_VALUE_FAIL;
 
 	if (!em_is_string(path)) {
 
-		em_log_runtime_error(&path_node->pos, "Expected string for path");
+		em_log_runtime_error(EM_NODE_POS(path_node), "Expected string for path");
 		em_value_delete(path);
 		return EM_VALUE_FAIL;
 	}
@@ -926,7 +1097,7 @@ EM_API em_value_t em_context_visit_include(em_context_t *context, em_node_t *nod
 	const em_wchar_t *wpath = EM_STRING(EM_OBJECT_FROM_VALUE(path))->data;
 	em_wpath_fix(pathbuf2, PATHBUFSZ, wpath);
 
-	em_value_t result = em_context_run_file(context, &node->pos, pathbuf2);
+	em_value_t result = em_context_run_file(context, EM_NODE_POS(node), pathbuf2);
 	em_value_delete(path);
 
 	return result;
@@ -935,14 +1106,8 @@ EM_API em_value_t em_context_visit_include(em_context_t *context, em_node_t *nod
 /* visit let statement */
 EM_API em_value_t em_context_visit_let(em_context_t *context, em_node_t *node) {
 
-	em_node_t *index_node = node->first;
-	em_node_t *value_node = index_node->next;
-
-	if (!value_node) {
-
-		value_node = index_node;
-		index_node = NULL;
-	}
+	em_node_t *index_node = node->nchildren > 1? node->children[0]: NULL;
+	em_node_t *value_node = node->children[node->nchildren-1];
 
 	em_value_t value = em_context_visit(context, value_node);
 	if (!EM_VALUE_OK(value)) return EM_VALUE_FAIL;
@@ -959,24 +1124,25 @@ EM_API em_value_t em_context_visit_let(em_context_t *context, em_node_t *node) {
 	}
 
 	/* resolve names up until the last name, or including the last name if an index is provided */
-	size_t ntokens = node->tokens.nitems;
+	size_t ntokens = node->ntokens;
 
 	em_value_t container = context->scopestack[context->nscopestack-1];
 	const char *prevname = NULL;
 	for (size_t i = 0; i < (index_node? ntokens: ntokens-1); i++) {
 
-		em_token_t *token = em_node_get_token(node, i);
+		em_node_token_t *token = em_node_get_token(node, i);
 		em_hash_t hash = em_node_get_value(node, i).v.te_hash;
+		em_pos_t *pos = EM_TREE_POS(node->tree, token->offset);
 
 		if (!i) container = em_context_get_value(context, hash);
-		else container = em_value_get_by_hash(container, hash, &token->pos);
+		else container = em_value_get_by_hash(container, hash, pos);
 
 		if (!EM_VALUE_OK(container)) {
 
-			if (!em_log_catch(NULL)) {
+			if (!em_log_catch(NULL) && !context->signal) {
 
-				if (prevname) em_log_runtime_error(&token->pos, "Attribute '%s' not defined", token->value);
-				else em_log_runtime_error(&token->pos, "Variable '%s' not defined", token->value);
+				if (prevname) em_log_runtime_error(pos, "Attribute '%s' not defined", token->value);
+				else em_log_runtime_error(pos, "Variable '%s' not defined", token->value);
 			}
 
 			em_value_delete(index);
@@ -985,26 +1151,26 @@ EM_API em_value_t em_context_visit_let(em_context_t *context, em_node_t *node) {
 		}
 		prevname = token->value;
 	}
-	em_token_t *name_token = em_node_get_token(node, ntokens-1);
+	em_node_token_t *name_token = em_node_get_token(node, ntokens-1);
 	em_hash_t name_hash = em_node_get_value(node, ntokens-1).v.te_hash;
 
 	/* set value */
 	if (index_node) {
 
-		if (em_value_set_by_index(container, index, value, &node->pos) != EM_RESULT_SUCCESS) {
+		if (em_value_set_by_index(container, index, value, EM_NODE_POS(node)) != EM_RESULT_SUCCESS) {
 
-			if (!em_log_catch(NULL))
-				em_log_runtime_error(&node->pos, "Invalid index");
+			if (!em_log_catch(NULL) && !context->signal)
+				em_log_runtime_error(EM_NODE_POS(node), "Invalid index");
 
 			em_value_delete(index);
 			em_value_delete(value);
 			return EM_VALUE_FAIL;
 		}
 	}
-	else if (em_value_set_by_hash(container, name_hash, value, &node->pos) != EM_RESULT_SUCCESS) {
+	else if (em_value_set_by_hash(container, name_hash, value, EM_NODE_POS(node)) != EM_RESULT_SUCCESS) {
 
-		if (!em_log_catch(NULL))
-			em_log_runtime_error(&node->pos, "Attribute '%s' not defined", name_token->value);
+		if (!em_log_catch(NULL) && !context->signal)
+			em_log_runtime_error(EM_NODE_POS(node), "Attribute '%s' not defined", name_token->value);
 
 		em_value_delete(index);
 		em_value_delete(value);
@@ -1018,15 +1184,15 @@ EM_API em_value_t em_context_visit_let(em_context_t *context, em_node_t *node) {
 /* visit if statement */
 EM_API em_value_t em_context_visit_if(em_context_t *context, em_node_t *node) {
 
-	em_node_t *condition_node = node->first;
-	em_node_t *body_node = condition_node->next;
+	em_node_t *condition_node = node->children[0];
+	em_node_t *body_node = node->children[1];
 
 	em_value_t result = em_none;
 
 	em_value_t condition = em_context_visit(context, condition_node);
 	if (!EM_VALUE_OK(condition)) return EM_VALUE_FAIL;
 
-	em_inttype_t truthiness = em_value_is_true(condition, &condition_node->pos).value.te_inttype;
+	em_inttype_t truthiness = em_value_is_true(condition, EM_NODE_POS(condition_node)).value.te_inttype;
 	em_value_delete(condition);
 
 	if (truthiness) {
@@ -1038,10 +1204,10 @@ EM_API em_value_t em_context_visit_if(em_context_t *context, em_node_t *node) {
 	}
 
 	/* evaluate elif and else statements */
-	condition_node = body_node->next;
-	body_node = condition_node? condition_node->next: NULL;
+	for (uint32_t i = 2; i < node->nchildren; i += 2) {
 
-	while (condition_node) {
+		condition_node = node->children[i];
+		body_node = i+1 < node->nchildren? node->children[i+1]: NULL;
 
 		/* is else statement */
 		if (!body_node) {
@@ -1060,7 +1226,7 @@ EM_API em_value_t em_context_visit_if(em_context_t *context, em_node_t *node) {
 				return EM_VALUE_FAIL;
 			}
 
-			truthiness = em_value_is_true(condition, &condition_node->pos).value.te_inttype? EM_TRUE: EM_FALSE;
+			truthiness = em_value_is_true(condition, EM_NODE_POS(condition_node)).value.te_inttype? EM_TRUE: EM_FALSE;
 			em_value_delete(condition);
 		}
 
@@ -1075,20 +1241,23 @@ EM_API em_value_t em_context_visit_if(em_context_t *context, em_node_t *node) {
 
 			break;
 		}
-
-		condition_node = body_node->next;
-		body_node = condition_node? condition_node->next: NULL;
 	}
 	return result;
 }
 
+/* count loop iteration of tree code, returning true once it is hot */
+static em_bool_t count_iteration(em_context_t *context) {
+
+	em_code_t *code = context->code;
+	return code && ++code->hotness >= EM_CODE_TIER_THRESHOLD && context->tier;
+}
+
 /* visit for statement */
 EM_API em_value_t em_context_visit_for(em_context_t *context, em_node_t *node) {
 
-	em_token_t *name_token = em_node_get_token(node, 0);
-	em_node_t *start_node = node->first;
-	em_node_t *end_node = start_node->next;
-	em_node_t *body_node = end_node->next;
+	em_node_t *start_node = node->children[0];
+	em_node_t *end_node = node->children[1];
+	em_node_t *body_node = node->children[2];
 
 	em_value_t start = em_context_visit(context, start_node);
 	if (!EM_VALUE_OK(start)) return EM_VALUE_FAIL;
@@ -1102,7 +1271,7 @@ EM_API em_value_t em_context_visit_for(em_context_t *context, em_node_t *node) {
 
 	if (start.type != EM_VALUE_TYPE_INT || end.type != EM_VALUE_TYPE_INT) {
 
-		em_log_runtime_error(&node->pos, "Expected integers for start and end values");
+		em_log_runtime_error(EM_NODE_POS(node), "Expected integers for start and end values");
 		em_value_delete(start);
 		em_value_delete(end);
 		return EM_VALUE_FAIL;
@@ -1110,57 +1279,71 @@ EM_API em_value_t em_context_visit_for(em_context_t *context, em_node_t *node) {
 
 	/* evaluate body */
 	em_value_t result = em_none;
-	em_hash_t hash = em_node_get_value(node, 0).v.te_hash;
+	em_hash_t hash = node->value.te_hash;
+
+	/*
+	 * The iterator is only stored each iteration if the body could see
+	 * it, and only loaded back if the body could redefine it. Otherwise
+	 * the last value is stored once the loop is done.
+	 */
+	em_bool_t store = (node->flags & (EM_NODE_NAME_READ | EM_NODE_NAME_WRITTEN))? EM_TRUE: EM_FALSE;
+	em_bool_t load = (node->flags & EM_NODE_NAME_WRITTEN)? EM_TRUE: EM_FALSE;
 
-	for (em_inttype_t i = start.value.te_inttype; i < end.value.te_inttype; i++) {
+	em_inttype_t i = start.value.te_inttype;
+	for (; i < end.value.te_inttype; i++) {
 
-		em_context_set_value(context, hash, EM_VALUE_INT(i));
+		(void)count_iteration(context);
+		if (store) em_context_set_value(context, hash, EM_VALUE_INT(i));
 		em_value_delete(result);
 
 		result = em_context_visit(context, body_node);
 		if (!EM_VALUE_OK(result)) {
 
 			/* continue or break statement */
-			if (em_log_catch(&em_class_system_continue)) {
+			if (em_context_catch_signal(context, EM_SIGNAL_CONTINUE)) {
 
 				result = em_none;
-				em_log_clear();
 				continue;
 			}
-			if (em_log_catch(&em_class_system_break)) {
+			if (em_context_catch_signal(context, EM_SIGNAL_BREAK)) {
 
 				result = em_none;
-				em_log_clear();
 				break;
 			}
+			if (!store) em_context_set_value(context, hash, EM_VALUE_INT(i));
 			return EM_VALUE_FAIL;
 		}
 
 		/* update i */
+		if (!load) continue;
+
 		em_value_t value = em_context_get_value(context, hash);
 		if (value.type != EM_VALUE_TYPE_INT) {
 
-			em_log_runtime_error(&node->pos, "Expected integer for iterator");
+			em_log_runtime_error(EM_NODE_POS(node), "Expected integer for iterator");
 			em_value_delete(result);
 			return EM_VALUE_FAIL;
 		}
 		i = value.value.te_inttype;
 	}
+
+	/* store last value seen by body */
+	if (!store && start.value.te_inttype < end.value.te_inttype)
+		em_context_set_value(context, hash, EM_VALUE_INT(i < end.value.te_inttype? i: i-1));
 	return result;
 }
 
 /* visit foreach statement */
 EM_API em_value_t em_context_visit_foreach(em_context_t *context, em_node_t *node) {
 
-	em_token_t *name_token = em_node_get_token(node, 0);
-	em_node_t *iterable_node = node->first;
-	em_node_t *body_node = iterable_node->next;
-	em_hash_t hash = em_node_get_value(node, 0).v.te_hash;
+	em_node_t *iterable_node = node->children[0];
+	em_node_t *body_node = node->children[1];
+	em_hash_t hash = node->value.te_hash;
 
 	em_value_t iterable = em_context_visit(context, iterable_node);
 	if (!EM_VALUE_OK(iterable)) return EM_VALUE_FAIL;
 
-	em_value_t length = em_value_length_of(iterable, &node->pos);
+	em_value_t length = em_value_length_of(iterable, EM_NODE_POS(node));
 	if (!EM_VALUE_OK(length)) {
 
 		em_value_delete(iterable);
@@ -1171,32 +1354,31 @@ EM_API em_value_t em_context_visit_foreach(em_context_t *context, em_node_t *nod
 	em_value_t result = em_none;
 	for (em_inttype_t i = 0; i < length.value.te_inttype; i++) {
 
-		em_value_t value = em_value_get_by_index(iterable, EM_VALUE_INT(i), &node->pos);
+		em_value_t value = em_value_get_by_index(iterable, EM_VALUE_INT(i), EM_NODE_POS(node));
 		em_value_delete(result);
 
 		if (!EM_VALUE_OK(value)) {
 
-			if (!em_log_catch(NULL))
-				em_log_runtime_error(&node->pos, "Couldn't finish iteration");
+			if (!em_log_catch(NULL) && !context->signal)
+				em_log_runtime_error(EM_NODE_POS(node), "Couldn't finish iteration");
 			em_value_delete(iterable);
 			return EM_VALUE_FAIL;
 		}
 		em_context_set_value(context, hash, value);
+		(void)count_iteration(context);
 
 		result = em_context_visit(context, body_node);
 		if (!EM_VALUE_OK(result)) {
 
 			/* continue or break statement */
-			if (em_log_catch(&em_class_system_continue)) {
+			if (em_context_catch_signal(context, EM_SIGNAL_CONTINUE)) {
 
 				result = em_none;
-				em_log_clear();
 				continue;
 			}
-			if (em_log_catch(&em_class_system_break)) {
+			if (em_context_catch_signal(context, EM_SIGNAL_BREAK)) {
 
 				result = em_none;
-				em_log_clear();
 				break;
 			}
 			else {
@@ -1213,13 +1395,13 @@ EM_API em_value_t em_context_visit_foreach(em_context_t *context, em_node_t *nod
 /* visit while statement */
 EM_API em_value_t em_context_visit_while(em_context_t *context, em_node_t *node) {
 
-	em_node_t *condition_node = node->first;
-	em_node_t *body_node = condition_node->next;
+	em_node_t *condition_node = node->children[0];
+	em_node_t *body_node = node->children[1];
 
 	em_value_t condition = em_context_visit(context, condition_node);
 	if (!EM_VALUE_OK(condition)) return EM_VALUE_FAIL;
 
-	em_inttype_t truthiness = em_value_is_true(condition, &node->pos).value.te_inttype;
+	em_inttype_t truthiness = em_value_is_true(condition, EM_NODE_POS(node)).value.te_inttype;
 	em_value_delete(condition);
 
 	em_value_t result = em_none;
@@ -1231,21 +1413,30 @@ EM_API em_value_t em_context_visit_while(em_context_t *context, em_node_t *node)
 		if (!EM_VALUE_OK(result)) {
 
 			/* continue or break statement */
-			if (em_log_catch(&em_class_system_continue)) {
+			if (em_context_catch_signal(context, EM_SIGNAL_CONTINUE)) {
 
 				result = em_none;
-				em_log_clear();
 				continue;
 			}
-			if (em_log_catch(&em_class_system_break)) {
+			if (em_context_catch_signal(context, EM_SIGNAL_BREAK)) {
 
 				result = em_none;
-				em_log_clear();
 				break;
 			}
 			else return EM_VALUE_FAIL;
 		}
 
+		/* continue in the vm from the loop header once hot */
+		if (count_iteration(context)) {
+
+			if (em_code_is_compilable(node)) {
+
+				em_value_delete(result);
+				return em_code_run_node(context, node);
+			}
+			context->code->hotness = 0;
+		}
+
 		condition = em_context_visit(context, condition_node);
 		if (!EM_VALUE_OK(condition)) {
 
@@ -1253,7 +1444,7 @@ EM_API em_value_t em_context_visit_while(em_context_t *context, em_node_t *node)
 			return EM_VALUE_FAIL;
 		}
 
-		truthiness = em_value_is_true(condition, &node->pos).value.te_inttype;
+		truthiness = em_value_is_true(condition, EM_NODE_POS(node)).value.te_inttype;
 		em_value_delete(condition);
 	}
 	return result;
@@ -1266,7 +1457,7 @@ EM_API em_value_t em_context_visit_func(em_context_t *context, em_node_t *node)
 	const char *name = "<anonymous>";
 	if (node->flags) name = em_node_get_token(node, firstarg++)->value;
 
-	em_node_t *body_node = node->first;
+	em_node_t *body_node = node->children[0];
 
 	/* collect arguments */
 	size_t nargnames = 0;
@@ -1274,14 +1465,14 @@ EM_API em_value_t em_context_visit_func(em_context_t *context, em_node_t *node)
 
 	while (nargnames < EM_FUNCTION_MAX_ARGUMENTS) {
 
-		em_token_t *token = em_node_get_token(node, firstarg + nargnames);
+		em_node_token_t *token = em_node_get_token(node, firstarg + nargnames);
 		if (!token) break;
 
 		argnames[nargnames++] = token->value;
 	}
 
 	/* set value */
-	em_code_t *code = em_code_new_node(body_node, node->pos.path);
+	em_code_t *code = em_code_new_node(body_node, node->tree->source->path);
 
 	em_value_t value = em_function_new(code, name, nargnames, argnames);
 	if (node->flags) em_context_set_value(context, em_utf8_strhash(name), value);
@@ -1292,15 +1483,9 @@ EM_API em_value_t em_context_visit_func(em_context_t *context, em_node_t *node)
 /* visit class statement */
 EM_API em_value_t em_context_visit_class(em_context_t *context, em_node_t *node) {
 
-	em_token_t *name_token = em_node_get_token(node, 0);
-	em_node_t *base_node = node->first;
-	em_node_t *body_node = base_node->next;
-
-	if (!body_node) {
-
-		body_node = base_node;
-		base_node = NULL;
-	}
+	em_node_token_t *name_token = em_node_get_token(node, 0);
+	em_node_t *base_node = node->nchildren > 1? node->children[0]: NULL;
+	em_node_t *body_node = node->children[node->nchildren-1];
 
 	/* evaluate base class */
 	em_value_t base = EM_VALUE_FAIL;
@@ -1311,7 +1496,7 @@ EM_API em_value_t em_context_visit_class(em_context_t *context, em_node_t *node)
 
 		if (!em_is_class(base)) {
 
-			em_log_runtime_error(&base_node->pos, "Base class is not a class");
+			em_log_runtime_error(EM_NODE_POS(base_node), "Base class is not a class");
 			em_value_delete(base);
 			return EM_VALUE_FAIL;
 		}
@@ -1332,6 +1517,12 @@ EM_API em_value_t em_context_visit_class(em_context_t *context, em_node_t *node)
 	em_value_t map = em_map_copy(context->scopestack[context->nscopestack-1]);
 	em_value_t class = em_class_new(name_token->value, base, map);
 
+	/* the class name is kept by the tree */
+	if (EM_VALUE_OK(class)) {
+
+		EM_CLASS(EM_OBJECT_FROM_VALUE(class))->node = node;
+		EM_TREE_INCREF(node->tree);
+	}
 	em_context_pop_scope(context);
 
 	/* set value */
@@ -1342,17 +1533,17 @@ EM_API em_value_t em_context_visit_class(em_context_t *context, em_node_t *node)
 /* visit try statement */
 EM_API em_value_t em_context_visit_try(em_context_t *context, em_node_t *node) {
 
-	em_node_t *try_node = node->first;
-	em_token_t *name_token = em_node_get_token(node, 0);
-	em_node_t *class_node = try_node->next;
-	em_node_t *catch_node = class_node->next;
+	em_node_t *try_node = node->children[0];
+	em_node_token_t *name_token = em_node_get_token(node, 0);
+	em_node_t *class_node = node->children[1];
+	em_node_t *catch_node = node->children[2];
 
 	em_value_t class = em_context_visit(context, class_node);
 	if (!EM_VALUE_OK(class)) return EM_VALUE_FAIL;
 
 	if (!em_is_class(class)) {
 
-		em_log_runtime_error(&catch_node->pos, "Expected class");
+		em_log_runtime_error(EM_NODE_POS(catch_node), "Expected class");
 		em_value_delete(class);
 		return EM_VALUE_FAIL;
 	}
@@ -1377,17 +1568,15 @@ EM_API em_value_t em_context_visit_try(em_context_t *context, em_node_t *node) {
 /* visit puts statement */
 EM_API em_value_t em_context_visit_puts(em_context_t *context, em_node_t *node) {
 
-	em_node_t *cur = node->first;
-
 	em_value_t result = em_none;
-	while (cur) {
+	for (uint32_t i = 0; i < node->nchildren; i++) {
 
 		em_value_delete(result);
 
-		result = em_context_visit(context, cur);
+		result = em_context_visit(context, node->children[i]);
 		if (!EM_VALUE_OK(result)) return EM_VALUE_FAIL;
 
-		em_value_t string = em_value_to_string(result, &node->pos);
+		em_value_t string = em_value_to_string(result, EM_NODE_POS(node));
 		if (!EM_VALUE_OK(string)) {
 
 			em_value_delete(result);
@@ -1396,11 +1585,10 @@ EM_API em_value_t em_context_visit_puts(em_context_t *context, em_node_t *node)
 
 		em_string_t *strobject = EM_STRING(EM_OBJECT_FROM_VALUE(string));
 		em_wchar_write(stdout, strobject->data, strobject->length);
-		if (cur->next) fprintf(stdout, " ");
+		if (i+1 < node->nchildren) fprintf(stdout, " ");
 
 		if (!em_value_is(result, string))
 			em_value_delete(string);
-		cur = cur->next;
 	}
 	fprintf(stdout, "\n");
 	return result;
@@ -1411,15 +1599,23 @@ EM_API void em_context_destroy(em_context_t *context) {
 
 	if (!context || !context->init) return;
 
-	for (size_t i = 0; i < EM_CONTEXT_MAX_SCOPE; i++)
+	for (size_t i = 0; i < context->scopestack_size; i++)
 		em_value_decref(context->scopestack[i]);
+	em_context_drop_tail_call(context);
+
+	em_free(context->scopestack);
+	em_free(context->stack);
+	em_free(context->path_env);
 
 	em_recfile_t *recfile = context->rec_first;
 	while (recfile) {
 
 		em_recfile_t *next = recfile->next;
 
-		if (recfile->slice.data)
+		em_jit_free(&recfile->slice);
+		if (recfile->cache.map)
+			em_code_cache_release(&recfile->cache);
+		else if (recfile->slice.data)
 			em_free(recfile->slice.data);
 
 		em_free(recfile);
@@ -12,7 +12,7 @@
 #include <emerald/file.h>
 
 #define ERRBUFSZ 256
-static char errbuf[ERRBUFSZ];
+static EM_THREAD_LOCAL char errbuf[ERRBUFSZ];
 
 #if defined EM_WINDOWS
 #include <windows.h>
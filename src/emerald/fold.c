@@ -0,0 +1,352 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <emerald/core.h>
+#include <emerald/utf8.h>
+#include <emerald/wchar.h>
+#include <emerald/string.h>
+#include <emerald/value.h>
+#include <emerald/node.h>
+#include <emerald/fold.h>
+
+#define MAX_FOLD_STRING 256 /* longest string literal to create (in characters) */
+
+#define STRBUFSZ (MAX_FOLD_STRING*4+1)
+static EM_THREAD_LOCAL char strbuf[STRBUFSZ];
+
+/* get value of constant node */
+static em_bool_t get_constant(em_node_t *node, em_value_t *value) {
+
+	em_node_token_t *token;
+	em_value_t inner;
+
+	switch (node->type) {
+		case EM_NODE_TYPE_INT:
+		case EM_NODE_TYPE_FLOAT:
+		case EM_NODE_TYPE_STRING:
+			break;
+
+		/* negative numbers are stored as negated literals */
+		case EM_NODE_TYPE_UNARY_OPERATION:
+			if (node->op != EM_NODE_OP_NEGATIVE ||
+			    (node->children[0]->type != EM_NODE_TYPE_INT && node->children[0]->type != EM_NODE_TYPE_FLOAT) ||
+			    !get_constant(node->children[0], &inner))
+				return EM_FALSE;
+
+			if (inner.type == EM_VALUE_TYPE_INT)
+				*value = EM_VALUE_INT(-inner.value.te_inttype);
+			else *value = EM_VALUE_FLOAT(-inner.value.te_floattype);
+			return EM_TRUE;
+
+		default:
+			return EM_FALSE;
+	}
+
+	token = em_node_get_token(node, 0);
+	if (node->type == EM_NODE_TYPE_INT) {
+
+		em_inttype_t it_value = 0;
+		for (const char *string = token->value; *string >= '0' && *string <= '9'; string++)
+			it_value = (it_value * 10) + (em_inttype_t)(*string - '0');
+		*value = EM_VALUE_INT(it_value);
+	}
+	else if (node->type == EM_NODE_TYPE_FLOAT) {
+
+		em_floattype_t ft_value = 0;
+#ifndef _ECLAIR
+		sscanf(token->value, EM_FLOATTYPE_FORMAT, &ft_value);
+#endif
+		*value = EM_VALUE_FLOAT(ft_value);
+	}
+	else *value = em_string_new_from_utf8(token->value, em_utf8_strlen(token->value));
+
+	return EM_VALUE_OK(*value);
+}
+
+/* create literal node from value, in place of node */
+static em_node_t *make_literal(em_value_t value, em_node_t *orig) {
+
+	em_node_type_t type;
+	em_bool_t negative = EM_FALSE;
+	int len;
+
+	/* number */
+	if (value.type == EM_VALUE_TYPE_INT) {
+
+		em_inttype_t it_value = value.value.te_inttype;
+		if (it_value < -EM_INTTYPE_MAX) return NULL;
+
+		negative = it_value < 0;
+		len = snprintf(strbuf, STRBUFSZ, EM_INTTYPE_FORMAT, negative? -it_value: it_value);
+
+		type = EM_NODE_TYPE_INT;
+	}
+	else if (value.type == EM_VALUE_TYPE_FLOAT) {
+
+		em_floattype_t ft_value = value.value.te_floattype;
+		if (!isfinite(ft_value)) return NULL;
+
+		negative = signbit(ft_value) != 0;
+		len = snprintf(strbuf, STRBUFSZ, "%.17g", negative? -ft_value: ft_value);
+
+		type = EM_NODE_TYPE_FLOAT;
+	}
+
+	/* string */
+	else if (em_is_string(value)) {
+
+		em_string_t *string = EM_STRING(EM_OBJECT_FROM_VALUE(value));
+		if (string->length > MAX_FOLD_STRING ||
+		    em_wchar_to_utf8(strbuf, STRBUFSZ, string->data) != EM_RESULT_SUCCESS)
+			return NULL;
+		len = (int)strlen(strbuf);
+
+		type = EM_NODE_TYPE_STRING;
+	}
+	else return NULL;
+
+	if (len < 0 || len >= STRBUFSZ) return NULL;
+
+	em_node_t *node = em_node_new(orig->tree, type, orig->offset);
+	if (!node) return NULL;
+	em_node_add_text(node, strbuf, (size_t)len, orig->offset);
+
+	if (!negative) return node;
+
+	/* wrap negative number */
+	em_node_t *unary = em_node_new(orig->tree, EM_NODE_TYPE_UNARY_OPERATION, orig->offset);
+	if (!unary) return NULL;
+	em_node_add_text(unary, "-", 1, orig->offset);
+	unary->op = EM_NODE_OP_NEGATIVE;
+	em_node_add_child(unary, node);
+
+	return unary;
+}
+
+/* remove range of children from node */
+static void remove_children(em_node_t *node, uint32_t index, uint32_t count) {
+
+	memmove(&node->children[index], &node->children[index+count],
+		(node->nchildren - index - count) * sizeof(em_node_t *));
+	node->nchildren -= count;
+}
+
+/* get literal node with folded value, or node if it can't be made */
+static em_node_t *replace_with_value(em_node_t *node, em_value_t value) {
+
+	em_node_t *literal = make_literal(value, node);
+	return literal? literal: node;
+}
+
+/* check truthiness of constant value */
+static em_bool_t is_true(em_value_t value, em_pos_t *pos) {
+
+	return em_value_is_true(value, pos).value.te_inttype? EM_TRUE: EM_FALSE;
+}
+
+/* apply binary operator to constant values */
+static em_value_t apply_binary(em_node_op_t op, em_value_t left, em_value_t right, em_pos_t *pos) {
+
+	switch (op) {
+		case EM_NODE_OP_ADD: return em_value_add(left, right, pos);
+		case EM_NODE_OP_SUBTRACT: return em_value_subtract(left, right, pos);
+		case EM_NODE_OP_MULTIPLY: return em_value_multiply(left, right, pos);
+		case EM_NODE_OP_DIVIDE: return em_value_divide(left, right, pos);
+		case EM_NODE_OP_MODULO: return em_value_modulo(left, right, pos);
+		case EM_NODE_OP_BITWISE_OR: return em_value_or(left, right, pos);
+		case EM_NODE_OP_BITWISE_XOR: return em_value_xor(left, right, pos);
+		case EM_NODE_OP_BITWISE_AND: return em_value_and(left, right, pos);
+		case EM_NODE_OP_SHIFT_LEFT: return em_value_shift_left(left, right, pos);
+		case EM_NODE_OP_SHIFT_RIGHT: return em_value_shift_right(left, right, pos);
+		case EM_NODE_OP_EQUAL: return em_value_compare_equal(left, right, pos);
+		case EM_NODE_OP_NOT_EQUAL: return EM_VALUE_INT_INV(em_value_compare_equal(left, right, pos));
+		case EM_NODE_OP_LESS_THAN: return em_value_compare_less_than(left, right, pos);
+		case EM_NODE_OP_LESS_THAN_EQUAL: return EM_VALUE_INT_INV(em_value_compare_greater_than(left, right, pos));
+		case EM_NODE_OP_GREATER_THAN: return em_value_compare_greater_than(left, right, pos);
+		case EM_NODE_OP_GREATER_THAN_EQUAL: return EM_VALUE_INT_INV(em_value_compare_less_than(left, right, pos));
+		default: return EM_VALUE_FAIL;
+	}
+}
+
+/* fold unary operation */
+static em_node_t *fold_unary_operation(em_node_t *node) {
+
+	em_value_t right, result;
+
+	/* already a negative literal */
+	if (node->op == EM_NODE_OP_NEGATIVE &&
+	    (node->children[0]->type == EM_NODE_TYPE_INT || node->children[0]->type == EM_NODE_TYPE_FLOAT))
+		return node;
+
+	if (!get_constant(node->children[0], &right))
+		return node;
+
+	switch (node->op) {
+		case EM_NODE_OP_POSITIVE: result = right; break;
+		case EM_NODE_OP_NEGATIVE: result = em_value_multiply(right, EM_VALUE_INT(-1), EM_NODE_POS(node)); break;
+		case EM_NODE_OP_BITWISE_NOT: result = em_value_not(right, EM_NODE_POS(node)); break;
+		case EM_NODE_OP_NOT: result = EM_VALUE_INT_INV(em_value_is_true(right, EM_NODE_POS(node))); break;
+		default: result = EM_VALUE_FAIL; break;
+	}
+
+	em_node_t *new = node;
+	if (EM_VALUE_OK(result))
+		new = replace_with_value(node, result);
+	else if (em_log_catch(NULL))
+		em_log_clear();
+
+	if (!em_value_is(result, right))
+		em_value_delete(result);
+	em_value_delete(right);
+	return new;
+}
+
+/* fold binary operation */
+static em_node_t *fold_binary_operation(em_node_t *node) {
+
+	em_node_t *left_node = node->children[0];
+	em_node_t *right_node = node->children[1];
+	em_value_t left, right, result;
+
+	if (!get_constant(left_node, &left))
+		return node;
+
+	/* short-circuited operations only need a deciding left side */
+	if (node->op == EM_NODE_OP_AND || node->op == EM_NODE_OP_OR) {
+
+		em_bool_t is_and = node->op == EM_NODE_OP_AND;
+		em_bool_t truthiness = is_true(left, EM_NODE_POS(node));
+		em_value_delete(left);
+
+		if (truthiness != is_and)
+			return replace_with_value(node, EM_VALUE_INT(truthiness));
+
+		else if (get_constant(right_node, &right)) {
+
+			em_node_t *new = replace_with_value(node, EM_VALUE_INT(is_true(right, EM_NODE_POS(node))));
+			em_value_delete(right);
+			return new;
+		}
+		return node;
+	}
+
+	if (!get_constant(right_node, &right)) {
+
+		em_value_delete(left);
+		return node;
+	}
+
+	/* integer division by zero traps, so leave it to run time */
+	if ((node->op == EM_NODE_OP_DIVIDE || node->op == EM_NODE_OP_MODULO) &&
+	    right.type == EM_VALUE_TYPE_INT && !right.value.te_inttype)
+		result = EM_VALUE_FAIL;
+	else result = apply_binary(node->op, left, right, EM_NODE_POS(node));
+
+	em_node_t *new = node;
+	if (EM_VALUE_OK(result)) {
+
+		new = replace_with_value(node, result);
+		em_value_delete(result);
+	}
+	else if (em_log_catch(NULL))
+		em_log_clear();
+
+	em_value_delete(left);
+	em_value_delete(right);
+	return new;
+}
+
+/* prune statically dead arms of if statement */
+static em_node_t *fold_if(em_node_t *node) {
+
+	uint32_t i = 0;
+	em_value_t condition;
+
+	/* each arm is a condition and a body, except for an else arm */
+	while (i+1 < node->nchildren) {
+
+		em_node_t *condition_node = node->children[i];
+		if (!get_constant(condition_node, &condition)) {
+
+			i += 2;
+			continue;
+		}
+		em_bool_t truthiness = is_true(condition, EM_NODE_POS(condition_node));
+		em_value_delete(condition);
+
+		/* never taken */
+		if (!truthiness) remove_children(node, i, 2);
+
+		/* always taken; later arms are unreachable */
+		else {
+			node->nchildren = i+2;
+			remove_children(node, i, 1);
+			break;
+		}
+	}
+
+	/* no arms left */
+	if (!node->nchildren) {
+
+		em_node_t *block = em_node_new(node->tree, EM_NODE_TYPE_BLOCK, node->offset);
+		return block? block: node;
+	}
+
+	/* only else arm left */
+	else if (node->nchildren == 1)
+		return node->children[0];
+	return node;
+}
+
+/* remove loop that never runs */
+static em_node_t *fold_while(em_node_t *node) {
+
+	em_value_t condition;
+
+	if (!get_constant(node->children[0], &condition))
+		return node;
+
+	em_bool_t truthiness = is_true(condition, EM_NODE_POS(node->children[0]));
+	em_value_delete(condition);
+
+	if (!truthiness) {
+
+		em_node_t *block = em_node_new(node->tree, EM_NODE_TYPE_BLOCK, node->offset);
+		if (block) return block;
+	}
+	return node;
+}
+
+/* fold children of node, then get node or what it folds into */
+static em_node_t *fold(em_node_t *node) {
+
+	for (uint32_t i = 0; i < node->nchildren; i++)
+		node->children[i] = fold(node->children[i]);
+
+	switch (node->type) {
+		case EM_NODE_TYPE_UNARY_OPERATION:
+			return fold_unary_operation(node);
+		case EM_NODE_TYPE_BINARY_OPERATION:
+			return fold_binary_operation(node);
+		case EM_NODE_TYPE_IF:
+			return fold_if(node);
+		case EM_NODE_TYPE_WHILE:
+			return fold_while(node);
+		default:
+			return node;
+	}
+}
+
+/* fold constant expressions and prune dead branches */
+EM_API void em_node_fold(em_node_t *node) {
+
+	/* the root block has no parent to be replaced in */
+	for (uint32_t i = 0; i < node->nchildren; i++)
+		node->children[i] = fold(node->children[i]);
+}
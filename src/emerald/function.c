@@ -12,6 +12,7 @@
 #include <emerald/hash.h>
 #include <emerald/string.h>
 #include <emerald/none.h>
+#include <emerald/map.h>
 #include <emerald/context.h>
 #include <emerald/function.h>
 
@@ -50,44 +51,94 @@ static em_value_t builtin_to_string(em_value_t v, em_pos_t *pos) {
 	return em_string_new_from_utf8(buf, em_utf8_strlen(buf));
 }
 
-/* call function */
-static em_value_t call(struct em_context *context, em_value_t v, em_value_t *args, size_t nargs, em_pos_t *pos) {
+/* check number of arguments to function */
+static em_bool_t check_args(em_function_t *function, size_t nargs, em_pos_t *pos) {
 
-	em_function_t *function = EM_FUNCTION(EM_OBJECT_FROM_VALUE(v));
-	if (nargs != function->nargnames) {
+	if (nargs == function->nparams) return EM_TRUE;
+
+	if (nargs > function->nparams)
+		em_log_runtime_error(pos, "Too many arguments to function '%s'", function->name);
+	else em_log_runtime_error(pos, "Too few arguments to function '%s'", function->name);
+	return EM_FALSE;
+}
 
-		if (nargs > function->nargnames)
-			em_log_runtime_error(pos, "Too many arguments to function '%s'", function->name);
-		else em_log_runtime_error(pos, "Too few arguments to function '%s'", function->name);
+/*
+ * Call function. A call in tail position returns with the call saved in
+ * the context, and the saved function runs next in the same scope. The
+ * scope isn't cleared first, so names that the new function doesn't define
+ * still resolve to the values the old one left, as they would have in its
+ * own scope below. A bound value (the instance of a method) is passed
+ * separately, so the arguments don't have to be copied to put it in front.
+ */
+static em_value_t call_function(struct em_context *context, em_function_t *function, em_value_t binding, em_value_t *args, size_t nargs, em_pos_t *pos) {
 
+	size_t first = EM_VALUE_OK(binding)? 1: 0;
+	if (!check_args(function, first + nargs, pos))
 		return EM_VALUE_FAIL;
-	}
 
 	if (em_context_push_scope(context) != EM_RESULT_SUCCESS)
 		return EM_VALUE_FAIL;
 
+	/* parameters go straight into the new scope */
+	em_value_t scope = context->scopestack[context->nscopestack-1];
+	if (first) em_map_set(scope, function->params[0].hash, binding);
+
 	for (size_t i = 0; i < nargs; i++)
-		em_context_set_value(context, em_utf8_strhash(function->argnames[i]), args[i]);
+		em_map_set(scope, function->params[first+i].hash, args[i]);
+
+	em_value_t result;
+	em_value_t tail = EM_VALUE_FAIL; /* function of last tail call */
+	for (;;) {
+
+		result = em_code_run(function->body, context);
+		if (EM_VALUE_OK(result) || !EM_VALUE_OK(context->tail_call) ||
+		    !em_context_catch_signal(context, EM_SIGNAL_RETURN))
+			break;
+
+		em_value_decref(tail);
 
-	em_value_t result = em_code_run(function->body, context);
+		/* take tail call */
+		tail = context->tail_call;
+		context->tail_call = EM_VALUE_FAIL;
+		function = EM_FUNCTION(EM_OBJECT_FROM_VALUE(tail));
+
+		size_t tail_nargs = context->tail_nargs;
+		context->tail_nargs = 0;
+
+		if (!check_args(function, tail_nargs, &context->tail_pos)) {
+
+			for (size_t i = 0; i < tail_nargs; i++)
+				em_value_decref(context->tail_args[i]);
+			break;
+		}
+		for (size_t i = 0; i < tail_nargs; i++) {
+
+			em_map_set(scope, function->params[i].hash, context->tail_args[i]);
+			em_value_decref(context->tail_args[i]);
+		}
+	}
 
 	/* pop_scope may or may not delete result, so prevent it from doing so */
 	em_value_incref(result);
 	em_value_incref(context->pass);
 
 	em_context_pop_scope(context);
+	em_value_decref(tail);
 
 	em_value_decref_no_free(context->pass);
 	em_value_decref(result);
 
-	if (em_log_catch(&em_class_system_return)) {
-
-		em_log_clear();
+	if (em_context_catch_signal(context, EM_SIGNAL_RETURN))
 		return context->pass;
-	}
 	return EM_VALUE_OK(result)? em_none: EM_VALUE_FAIL;
 }
 
+/* call function */
+static em_value_t call(struct em_context *context, em_value_t v, em_value_t *args, size_t nargs, em_pos_t *pos) {
+
+	return call_function(context, EM_FUNCTION(EM_OBJECT_FROM_VALUE(v)), EM_VALUE_FAIL, args, nargs, pos);
+}
+
 /* get string representation of function */
 static em_value_t to_string(em_value_t v, em_pos_t *pos) {
 
@@ -121,19 +172,36 @@ EM_API em_value_t em_builtin_function_new(const char *name, em_builtin_function_
 /* create function */
 EM_API em_value_t em_function_new(em_code_t *body, const char *name, size_t nargnames, const char **argnames) {
 
-	em_value_t value = em_object_new(&type, sizeof(em_function_t) + nargnames * sizeof(const char *));
+	em_value_t value = em_object_new(&type, sizeof(em_function_t) + nargnames * sizeof(em_function_param_t));
 	em_function_t *function = EM_FUNCTION(EM_OBJECT_FROM_VALUE(value));
 
 	EM_REFOBJ(function)->free = function_free;
 
 	function->body = body;
 	function->name = name;
-	function->nargnames = nargnames;
-	memcpy(function->argnames, argnames, nargnames * sizeof(const char *));
+	function->nparams = nargnames;
 
+	for (size_t i = 0; i < nargnames; i++) {
+
+		function->params[i].name = argnames[i];
+		function->params[i].hash = em_utf8_strhash(argnames[i]);
+	}
 	return value;
 }
 
+/* call function with value bound to first parameter */
+EM_API em_value_t em_function_call_bound(struct em_context *context, em_value_t v, em_value_t binding, em_value_t *args, size_t nargs, em_pos_t *pos) {
+
+	if (em_is_function(v))
+		return call_function(context, EM_FUNCTION(EM_OBJECT_FROM_VALUE(v)), binding, args, nargs, pos);
+
+	/* builtins take all of their arguments in one array */
+	em_value_t newargs[EM_FUNCTION_MAX_ARGUMENTS+1] = {binding};
+	memcpy(newargs+1, args, nargs * sizeof(em_value_t));
+
+	return em_value_call(context, v, newargs, nargs+1, pos);
+}
+
 /* check if value is builtin function */
 EM_API em_bool_t em_is_builtin_function(em_value_t v) {
 
@@ -0,0 +1,575 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emerald/core.h>
+#include <emerald/memory.h>
+#include <emerald/context.h>
+#include <emerald/bytecode.h>
+#include <emerald/jit.h>
+
+#ifdef EM_JIT_ENABLED
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Each instruction of a slice is translated by copying a machine code
+ * template and patching in its operands and jump targets. Integer
+ * arithmetic, comparisons, constants, position updates, jumps and counted
+ * loops have inline templates that fall back to the interpreter when their
+ * operands aren't ints. Every other instruction calls em_code_run_inst.
+ *
+ * While native code runs, registers hold:
+ *   rbx  slice
+ *   r12  context
+ *   r13  table of native addresses by bytecode position
+ *
+ * Native code returns to the interpreter when the slice ends or when an
+ * instruction unwinds (slice->mode is no longer CALL).
+ */
+
+/* entry point of native code */
+typedef void (*entry_t)(em_context_t *context, em_code_slice_t *slice, void **table, void *start);
+
+/* compiled slice */
+typedef struct jit_code {
+	uint8_t *code; /* executable memory */
+	size_t size; /* size of executable memory */
+	void **table; /* native address by bytecode position */
+	void *exit; /* address of exit stub */
+	entry_t entry; /* entry point */
+} jit_code_t;
+
+/* code buffer */
+typedef struct buffer {
+	uint8_t *data;
+	size_t len, cap;
+} buffer_t;
+
+/* jump to patch after layout */
+typedef struct fixup {
+	size_t at; /* position of rel32 in buffer */
+	size_t target; /* bytecode position of target */
+} fixup_t;
+
+/* offsets used by templates */
+#define SLICE_POS ((uint32_t)offsetof(em_code_slice_t, position))
+#define SLICE_LEN ((uint32_t)offsetof(em_code_slice_t, length))
+#define SLICE_MODE ((uint32_t)offsetof(em_code_slice_t, mode))
+#define CTX_SP ((uint32_t)offsetof(em_context_t, sp))
+#define CTX_STACK ((uint32_t)offsetof(em_context_t, stack))
+#define CTX_LINE ((uint32_t)offsetof(em_context_t, op_pos.line))
+#define CTX_COLUMN ((uint32_t)offsetof(em_context_t, op_pos.column))
+#define VALUE_DATA ((uint32_t)offsetof(em_value_t, value))
+
+/* stack slot relative to rax = stack + sp * 16 (n = 1 is top) */
+#define SLOT_TYPE(n) ((uint32_t)0 - (uint32_t)(n) * 16)
+#define SLOT_DATA(n) ((uint32_t)0 - (uint32_t)(n) * 16 + VALUE_DATA)
+
+/* add bytes to buffer */
+static void emit(buffer_t *buf, const void *data, size_t len) {
+
+	if (buf->len + len > buf->cap) {
+
+		size_t cap = buf->cap? buf->cap * 2: 4096;
+		while (cap < buf->len + len) cap *= 2;
+
+		buf->data = buf->data? em_realloc(buf->data, cap): em_malloc(cap);
+		buf->cap = cap;
+	}
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+#define EMIT(...) do {\
+	const uint8_t bytes[] = {__VA_ARGS__};\
+	emit(buf, bytes, sizeof(bytes));\
+} while (0)
+
+static void emit_u32(buffer_t *buf, uint32_t value) {
+
+	emit(buf, &value, 4);
+}
+
+static void emit_u64(buffer_t *buf, uint64_t value) {
+
+	emit(buf, &value, 8);
+}
+
+/* emit rel32 to bytecode position */
+static void emit_target(buffer_t *buf, fixup_t *fixups, size_t *nfixups, size_t target) {
+
+	fixups[*nfixups].at = buf->len;
+	fixups[*nfixups].target = target;
+	(*nfixups)++;
+	emit_u32(buf, 0);
+}
+
+/* emit rel32 to position in buffer */
+static void emit_rel(buffer_t *buf, size_t to) {
+
+	emit_u32(buf, (uint32_t)((int32_t)to - (int32_t)(buf->len + 4)));
+}
+
+/* emit jump to exit stub if instruction unwound */
+static void emit_check_mode(buffer_t *buf, size_t exit) {
+
+	EMIT(0x81, 0xbb); /* cmp dword [rbx+mode], CALL */
+	emit_u32(buf, SLICE_MODE);
+	emit_u32(buf, EM_CODE_OP_CALL);
+	EMIT(0x0f, 0x85); /* jne exit */
+	emit_rel(buf, exit);
+}
+
+/* emit call to interpreter for instruction, then continue at new position */
+static void emit_generic(buffer_t *buf, size_t pos, size_t next, size_t exit) {
+
+	EMIT(0x48, 0xc7, 0x83); /* mov qword [rbx+position], pos */
+	emit_u32(buf, SLICE_POS);
+	emit_u32(buf, (uint32_t)pos);
+	EMIT(0x4c, 0x89, 0xe7); /* mov rdi, r12 */
+	EMIT(0x48, 0x89, 0xde); /* mov rsi, rbx */
+	EMIT(0x48, 0xb8); /* mov rax, em_code_run_inst */
+	emit_u64(buf, (uint64_t)(uintptr_t)&em_code_run_inst);
+	EMIT(0xff, 0xd0); /* call rax */
+
+	emit_check_mode(buf, exit);
+
+	EMIT(0x48, 0x8b, 0x83); /* mov rax, [rbx+position] */
+	emit_u32(buf, SLICE_POS);
+	EMIT(0x48, 0x3d); /* cmp rax, next */
+	emit_u32(buf, (uint32_t)next);
+	EMIT(0x74, 18); /* je +18 (next instruction) */
+	EMIT(0x48, 0x3b, 0x83); /* cmp rax, [rbx+length] */
+	emit_u32(buf, SLICE_LEN);
+	EMIT(0x0f, 0x83); /* jae exit */
+	emit_rel(buf, exit);
+	EMIT(0x41, 0xff, 0x64, 0xc5, 0x00); /* jmp [r13+rax*8] */
+}
+
+/* emit rax = stack + sp * 16, branching to slow path if fewer than count values */
+static size_t emit_load_stack(buffer_t *buf, uint32_t count) {
+
+	EMIT(0x49, 0x8b, 0x84, 0x24); /* mov rax, [r12+sp] */
+	emit_u32(buf, CTX_SP);
+	EMIT(0x48, 0x3d); /* cmp rax, count */
+	emit_u32(buf, count);
+	EMIT(0x0f, 0x82); /* jb slow */
+	size_t slow = buf->len;
+	emit_u32(buf, 0);
+	EMIT(0x48, 0xc1, 0xe0, 0x04); /* shl rax, 4 */
+	EMIT(0x49, 0x03, 0x84, 0x24); /* add rax, [r12+stack] (may have moved since last instruction) */
+	emit_u32(buf, CTX_STACK);
+	return slow;
+}
+
+/* emit branch to slow path if stack slot isn't an int */
+static size_t emit_check_int(buffer_t *buf, uint32_t slot) {
+
+	EMIT(0x81, 0xb8); /* cmp dword [rax+type], INT */
+	emit_u32(buf, SLOT_TYPE(slot));
+	emit_u32(buf, EM_VALUE_TYPE_INT);
+	EMIT(0x0f, 0x85); /* jne slow */
+	size_t slow = buf->len;
+	emit_u32(buf, 0);
+	return slow;
+}
+
+/* point rel32 placeholders at current position */
+static void patch_here(buffer_t *buf, const size_t *at, size_t count) {
+
+	for (size_t i = 0; i < count; i++) {
+
+		int32_t rel = (int32_t)buf->len - (int32_t)(at[i] + 4);
+		memcpy(buf->data + at[i], &rel, 4);
+	}
+}
+
+/* emit push of int constant (room was checked when the slice started) */
+static void emit_push_int(buffer_t *buf, em_inttype_t value) {
+
+	EMIT(0x49, 0x8b, 0x84, 0x24); /* mov rax, [r12+sp] */
+	emit_u32(buf, CTX_SP);
+	EMIT(0x48, 0x8d, 0x48, 0x01); /* lea rcx, [rax+1] */
+	EMIT(0x49, 0x89, 0x8c, 0x24); /* mov [r12+sp], rcx */
+	emit_u32(buf, CTX_SP);
+	EMIT(0x48, 0xc1, 0xe0, 0x04); /* shl rax, 4 */
+	EMIT(0x49, 0x03, 0x84, 0x24); /* add rax, [r12+stack] (may have moved since last instruction) */
+	emit_u32(buf, CTX_STACK);
+	EMIT(0xc7, 0x80); /* mov dword [rax+type], INT */
+	emit_u32(buf, 0);
+	emit_u32(buf, EM_VALUE_TYPE_INT);
+	EMIT(0x48, 0xb9); /* mov rcx, value */
+	emit_u64(buf, (uint64_t)value);
+	EMIT(0x48, 0x89, 0x88); /* mov [rax+data], rcx */
+	emit_u32(buf, VALUE_DATA);
+}
+
+/* emit int binary operation; result replaces the second value from the top */
+static void emit_int_operation(buffer_t *buf, em_code_op_t op, size_t pos, size_t next, size_t exit) {
+
+	size_t slow[3];
+	slow[0] = emit_load_stack(buf, 2);
+	slow[1] = emit_check_int(buf, 2);
+	slow[2] = emit_check_int(buf, 1);
+
+	EMIT(0x48, 0x8b, 0x88); /* mov rcx, [rax+a] */
+	emit_u32(buf, SLOT_DATA(2));
+
+	switch (op) {
+		case EM_CODE_OP_BADD: EMIT(0x48, 0x03, 0x88); break; /* add rcx, [rax+b] */
+		case EM_CODE_OP_BSUB: EMIT(0x48, 0x2b, 0x88); break; /* sub rcx, [rax+b] */
+		case EM_CODE_OP_BMUL: EMIT(0x48, 0x0f, 0xaf, 0x88); break; /* imul rcx, [rax+b] */
+		default: EMIT(0x48, 0x3b, 0x88); break; /* cmp rcx, [rax+b] */
+	}
+	emit_u32(buf, SLOT_DATA(1));
+
+	uint8_t setcc = 0;
+	switch (op) {
+		case EM_CODE_OP_BEQ: setcc = 0x94; break; /* sete */
+		case EM_CODE_OP_BNEQ: setcc = 0x95; break; /* setne */
+		case EM_CODE_OP_BLT: setcc = 0x9c; break; /* setl */
+		case EM_CODE_OP_BGT: setcc = 0x9f; break; /* setg */
+		default: break;
+	}
+	if (setcc) {
+
+		EMIT(0x0f, setcc, 0xc1); /* setcc cl */
+		EMIT(0x0f, 0xb6, 0xc9); /* movzx ecx, cl */
+	}
+
+	EMIT(0x48, 0x89, 0x88); /* mov [rax+a], rcx */
+	emit_u32(buf, SLOT_DATA(2));
+	EMIT(0x49, 0xff, 0x8c, 0x24); /* dec qword [r12+sp] */
+	emit_u32(buf, CTX_SP);
+	EMIT(0xe9); /* jmp done */
+	size_t done = buf->len;
+	emit_u32(buf, 0);
+
+	patch_here(buf, slow, 3);
+	emit_generic(buf, pos, next, exit);
+	patch_here(buf, &done, 1);
+}
+
+/* emit int compare and jump if not true */
+static void emit_int_compare_jump(buffer_t *buf, em_code_op_t op, size_t pos, size_t next, size_t exit, size_t target, fixup_t *fixups, size_t *nfixups) {
+
+	size_t slow[3];
+	slow[0] = emit_load_stack(buf, 2);
+	slow[1] = emit_check_int(buf, 2);
+	slow[2] = emit_check_int(buf, 1);
+
+	EMIT(0x48, 0x8b, 0x88); /* mov rcx, [rax+a] */
+	emit_u32(buf, SLOT_DATA(2));
+	EMIT(0x48, 0x8b, 0x90); /* mov rdx, [rax+b] */
+	emit_u32(buf, SLOT_DATA(1));
+	EMIT(0x49, 0x83, 0xac, 0x24); /* sub qword [r12+sp], 2 */
+	emit_u32(buf, CTX_SP);
+	EMIT(0x02);
+	EMIT(0x48, 0x39, 0xd1); /* cmp rcx, rdx */
+
+	uint8_t jcc = 0x85;
+	switch (op) {
+		case EM_CODE_OP_JNLT: jcc = 0x8d; break; /* jge */
+		case EM_CODE_OP_JNGT: jcc = 0x8e; break; /* jle */
+		case EM_CODE_OP_JNEQ: jcc = 0x85; break; /* jne */
+		case EM_CODE_OP_JNNEQ: jcc = 0x84; break; /* je */
+		default: break;
+	}
+	EMIT(0x0f, jcc); /* jcc target */
+	emit_target(buf, fixups, nfixups, target);
+	EMIT(0xe9); /* jmp done */
+	size_t done = buf->len;
+	emit_u32(buf, 0);
+
+	patch_here(buf, slow, 3);
+	emit_generic(buf, pos, next, exit);
+	patch_here(buf, &done, 1);
+}
+
+/* emit step of counted loop that doesn't touch its variable */
+static void emit_for_loop(buffer_t *buf, size_t pos, size_t next, size_t exit, size_t target, fixup_t *fixups, size_t *nfixups) {
+
+	size_t slow[3];
+	slow[0] = emit_load_stack(buf, 3);
+	slow[1] = emit_check_int(buf, 1); /* value of body */
+
+	EMIT(0x48, 0x8b, 0x88); /* mov rcx, [rax+counter] */
+	emit_u32(buf, SLOT_DATA(3));
+	EMIT(0x48, 0xff, 0xc1); /* inc rcx */
+	EMIT(0x48, 0x3b, 0x88); /* cmp rcx, [rax+end] */
+	emit_u32(buf, SLOT_DATA(2));
+	EMIT(0x0f, 0x8d); /* jge slow (leaving the loop) */
+	slow[2] = buf->len;
+	emit_u32(buf, 0);
+	EMIT(0x48, 0x89, 0x88); /* mov [rax+counter], rcx */
+	emit_u32(buf, SLOT_DATA(3));
+	EMIT(0x49, 0xff, 0x8c, 0x24); /* dec qword [r12+sp] */
+	emit_u32(buf, CTX_SP);
+	EMIT(0xe9); /* jmp target */
+	emit_target(buf, fixups, nfixups, target);
+
+	patch_here(buf, slow, 3);
+	emit_generic(buf, pos, next, exit);
+}
+
+/* get generic operation of quickened operation */
+static em_code_op_t get_generic_op(em_code_op_t op) {
+
+	switch (op) {
+		case EM_CODE_OP_BADDII: return EM_CODE_OP_BADD;
+		case EM_CODE_OP_BSUBII: return EM_CODE_OP_BSUB;
+		case EM_CODE_OP_BMULII: return EM_CODE_OP_BMUL;
+		case EM_CODE_OP_BEQII: return EM_CODE_OP_BEQ;
+		case EM_CODE_OP_BNEQII: return EM_CODE_OP_BNEQ;
+		case EM_CODE_OP_BLTII: return EM_CODE_OP_BLT;
+		case EM_CODE_OP_BGTII: return EM_CODE_OP_BGT;
+		case EM_CODE_OP_LADDII: return EM_CODE_OP_LADDI;
+		case EM_CODE_OP_JNLTII: return EM_CODE_OP_JNLT;
+		case EM_CODE_OP_JNGTII: return EM_CODE_OP_JNGT;
+		case EM_CODE_OP_JNEQII: return EM_CODE_OP_JNEQ;
+		case EM_CODE_OP_JNNEQII: return EM_CODE_OP_JNNEQ;
+		default: return op;
+	}
+}
+
+/* free compiled code */
+static void free_code(jit_code_t *jit) {
+
+	if (jit->code) munmap(jit->code, jit->size);
+	if (jit->table) em_free(jit->table);
+	em_free(jit);
+}
+
+/* compile slice to native code */
+EM_API em_bool_t em_jit_compile(em_code_slice_t *slice) {
+
+	if (slice->jit) return EM_TRUE;
+	if (!slice->length || slice->length > INT32_MAX || sizeof(em_value_t) != 16)
+		return EM_FALSE;
+
+	const uint8_t *data = (const uint8_t *)slice->data;
+	size_t length = slice->length;
+
+	buffer_t buffer = {0}, *buf = &buffer;
+	size_t *native = em_malloc(sizeof(size_t) * (length+1));
+	fixup_t *fixups = em_malloc(sizeof(fixup_t) * length);
+	size_t nfixups = 0;
+
+	for (size_t i = 0; i <= length; i++)
+		native[i] = (size_t)-1;
+
+	/* prologue */
+	EMIT(0x53); /* push rbx */
+	EMIT(0x41, 0x54); /* push r12 */
+	EMIT(0x41, 0x55); /* push r13 */
+	EMIT(0x49, 0x89, 0xfc); /* mov r12, rdi */
+	EMIT(0x48, 0x89, 0xf3); /* mov rbx, rsi */
+	EMIT(0x49, 0x89, 0xd5); /* mov r13, rdx */
+	EMIT(0xff, 0xe1); /* jmp rcx */
+
+	/* exit stub */
+	size_t exit = buf->len;
+	EMIT(0x41, 0x5d); /* pop r13 */
+	EMIT(0x41, 0x5c); /* pop r12 */
+	EMIT(0x5b); /* pop rbx */
+	EMIT(0xc3); /* ret */
+
+	/* instructions */
+	for (size_t pos = 0; pos < length;) {
+
+		size_t size = em_code_get_inst_size(slice, pos);
+		if (!size) {
+
+			em_free(buf->data);
+			em_free(fixups);
+			em_free(native);
+			return EM_FALSE;
+		}
+		size_t next = pos + size;
+		const uint8_t *operand = data + pos + 1;
+
+		em_code_op_t op = get_generic_op((em_code_op_t)data[pos]);
+		native[pos] = buf->len;
+
+		int32_t rel = 0;
+		if (size >= 5) memcpy(&rel, data + next - 4, 4);
+		size_t target = (size_t)((int64_t)next + rel);
+
+		uint16_t line;
+		em_inttype_t value;
+
+		switch (op) {
+			/* position updates */
+			case EM_CODE_OP_ESETL:
+			case EM_CODE_OP_ESETLC:
+				memcpy(&line, operand, 2);
+				EMIT(0x41, 0xc7, 0x84, 0x24); /* mov dword [r12+line], line */
+				emit_u32(buf, CTX_LINE);
+				emit_u32(buf, line);
+				if (op == EM_CODE_OP_ESETL) break;
+				operand += 2;
+				/* fall through */
+			case EM_CODE_OP_ESETC:
+				EMIT(0x41, 0xc7, 0x84, 0x24); /* mov dword [r12+column], column */
+				emit_u32(buf, CTX_COLUMN);
+				emit_u32(buf, *operand);
+				break;
+
+			/* constants */
+			case EM_CODE_OP_PCINT:
+				memcpy(&value, operand, sizeof(em_inttype_t));
+				emit_push_int(buf, value);
+				break;
+			case EM_CODE_OP_PTRUE:
+			case EM_CODE_OP_PFLSE:
+				emit_push_int(buf, op == EM_CODE_OP_PTRUE);
+				break;
+
+			/* arithmetic and comparisons */
+			case EM_CODE_OP_BADD:
+			case EM_CODE_OP_BSUB:
+			case EM_CODE_OP_BMUL:
+			case EM_CODE_OP_BEQ:
+			case EM_CODE_OP_BNEQ:
+			case EM_CODE_OP_BLT:
+			case EM_CODE_OP_BGT:
+				emit_int_operation(buf, op, pos, next, exit);
+				break;
+
+			/* jumps */
+			case EM_CODE_OP_JMP:
+				if (target > length) goto generic;
+				EMIT(0xe9); /* jmp target */
+				emit_target(buf, fixups, &nfixups, target);
+				break;
+			case EM_CODE_OP_JNLT:
+			case EM_CODE_OP_JNGT:
+			case EM_CODE_OP_JNEQ:
+			case EM_CODE_OP_JNNEQ:
+				if (target > length) goto generic;
+				emit_int_compare_jump(buf, op, pos, next, exit, target, fixups, &nfixups);
+				break;
+
+			/* counted loops */
+			case EM_CODE_OP_FORLOOP:
+				if (*operand || target > length) goto generic;
+				emit_for_loop(buf, pos, next, exit, target, fixups, &nfixups);
+				break;
+
+			default:
+			generic:
+				emit_generic(buf, pos, next, exit);
+				break;
+		}
+		pos = next;
+	}
+
+	/* end of slice */
+	native[length] = buf->len;
+	EMIT(0x48, 0xc7, 0x83); /* mov qword [rbx+position], length */
+	emit_u32(buf, SLICE_POS);
+	emit_u32(buf, (uint32_t)length);
+	EMIT(0xe9); /* jmp exit */
+	emit_rel(buf, exit);
+
+	/* resolve jumps */
+	for (size_t i = 0; i < nfixups; i++) {
+
+		size_t to = native[fixups[i].target];
+		if (to == (size_t)-1) {
+
+			em_free(buf->data);
+			em_free(fixups);
+			em_free(native);
+			return EM_FALSE;
+		}
+		int32_t rel = (int32_t)to - (int32_t)(fixups[i].at + 4);
+		memcpy(buf->data + fixups[i].at, &rel, 4);
+	}
+	em_free(fixups);
+
+	/* copy to executable memory */
+	long pagesize = sysconf(_SC_PAGESIZE);
+	size_t mapsize = EM_ALIGN(buf->len, (size_t)(pagesize > 0? pagesize: 4096));
+
+	void *map = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+
+		em_free(buf->data);
+		em_free(native);
+		return EM_FALSE;
+	}
+	memcpy(map, buf->data, buf->len);
+	em_free(buf->data);
+
+	jit_code_t *jit = em_malloc(sizeof(jit_code_t));
+	jit->code = map;
+	jit->size = mapsize;
+	jit->table = em_malloc(sizeof(void *) * (length+1));
+	jit->exit = jit->code + exit;
+	jit->entry = (entry_t)(void *)jit->code;
+
+	for (size_t i = 0; i <= length; i++)
+		jit->table[i] = native[i] != (size_t)-1? (void *)(jit->code + native[i]): jit->exit;
+	em_free(native);
+
+	if (mprotect(map, mapsize, PROT_READ | PROT_EXEC) < 0) {
+
+		free_code(jit);
+		return EM_FALSE;
+	}
+
+	slice->jit = jit;
+	return EM_TRUE;
+}
+
+/* run native code from current position */
+EM_API em_bool_t em_jit_run(em_context_t *context, em_code_slice_t *slice) {
+
+	jit_code_t *jit = slice->jit;
+	if (!jit || slice->position >= slice->length)
+		return EM_FALSE;
+
+	void *start = jit->table[slice->position];
+	if (start == jit->exit) return EM_FALSE;
+
+	jit->entry(context, slice, jit->table, start);
+	return EM_TRUE;
+}
+
+/* free native code of slice */
+EM_API void em_jit_free(em_code_slice_t *slice) {
+
+	if (!slice->jit) return;
+
+	free_code(slice->jit);
+	slice->jit = NULL;
+}
+
+#else
+
+/* compile slice to native code */
+EM_API em_bool_t em_jit_compile(em_code_slice_t *slice) {
+
+	return EM_FALSE;
+}
+
+/* run native code from current position */
+EM_API em_bool_t em_jit_run(em_context_t *context, em_code_slice_t *slice) {
+
+	return EM_FALSE;
+}
+
+/* free native code of slice */
+EM_API void em_jit_free(em_code_slice_t *slice) {
+
+	slice->jit = NULL;
+}
+#endif
@@ -11,22 +11,63 @@
 #include <emerald/log.h>
 #include <emerald/lexer.h>
 
+#if defined __GNUC__ && defined __SSE2__
+ #include <emmintrin.h>
+ #define SCAN_SSE2
+#endif
+
 /* predictable ctype alternatives */
 #define ISDIGIT(c) (((c) >= '0') && ((c) <= '9'))
 #define ISIDENT(c) ((((c) >= 'a') && ((c) <= 'z')) || (((c) >= 'A') && (c <= 'Z')) || ((c) == '_'))
 #define ISIDENT_A(c) (ISIDENT(c) || ISDIGIT(c))
 #define ISDELIM(c) (((c) == '\'') || ((c) == '"'))
 
-/* keywords list */
-static const char *keywords[] = {
-	"if", "elif", "else",
-	"and", "or", "not",
-	"for", "foreach", "while", "to", "in",
-	"let", "include", "puts", "gets", "then", "end", "return", "try", "catch", "raise",
-	"func", "class", "of",
-	"continue", "break",
+/*
+ * Keywords by perfect hash of their first and last characters and length.
+ * Identifiers are ASCII, so the hash of one can only land on a keyword of
+ * the same shape, which is then compared in full.
+ */
+#define KEYWORD_HASH(s, len) (((unsigned)(s)[0]*35 + (unsigned)(s)[(len)-1]*21 + (unsigned)(len)) & 63)
+#define KEYWORD_MIN 2
+#define KEYWORD_MAX 8
+
+static const char *keywords[64] = {
+	[1] = "foreach",
+	[3] = "puts",
+	[6] = "end",
+	[8] = "gets",
+	[9] = "or",
+	[11] = "let",
+	[12] = "try",
+	[13] = "of",
+	[15] = "for",
+	[17] = "not",
+	[19] = "while",
+	[21] = "func",
+	[22] = "catch",
+	[26] = "continue",
+	[28] = "else",
+	[34] = "return",
+	[35] = "in",
+	[36] = "raise",
+	[38] = "then",
+	[43] = "include",
+	[49] = "elif",
+	[50] = "break",
+	[57] = "to",
+	[58] = "and",
+	[59] = "if",
+	[61] = "class",
 };
-#define N_KEYWORDS (sizeof(keywords) / sizeof(const char *))
+
+/* check if identifier is a keyword */
+static em_bool_t is_keyword(const char *value, size_t len) {
+
+	if (len < KEYWORD_MIN || len > KEYWORD_MAX) return EM_FALSE;
+
+	const char *keyword = keywords[KEYWORD_HASH(value, len)];
+	return (em_bool_t)(keyword && !strcmp(keyword, value));
+}
 
 /* identify an escape character */
 static int getescchar(int c) {
@@ -40,6 +81,123 @@ static int getescchar(int c) {
 	}
 }
 
+/*
+ * Runs of blanks, identifier characters and plain string contents are
+ * measured 16 bytes at a time where SSE2 is available (always on x86-64)
+ * and a byte at a time otherwise. Each run stops at the first byte that
+ * isn't part of it, so newlines, escapes and non-ASCII characters are still
+ * left to advance.
+ */
+#ifdef SCAN_SSE2
+ #define EQ(v, c) _mm_cmpeq_epi8(v, _mm_set1_epi8(c)) /* bytes equal to c */
+ #define RANGE(v, lo, hi) _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((lo)-1)), _mm_cmplt_epi8(v, _mm_set1_epi8((hi)+1))) /* ascii bytes from lo to hi */
+ #define OUT(m) (~(unsigned)_mm_movemask_epi8(m) & 0xffff) /* bytes not in mask */
+#endif
+
+/* get length of run of spaces, tabs and carriage returns */
+static em_ssize_t span_blank(const char *p, em_ssize_t n) {
+
+	em_ssize_t i = 0;
+#ifdef SCAN_SSE2
+	for (; i+16 <= n; i += 16) {
+
+		__m128i v = _mm_loadu_si128((const __m128i *)(p+i));
+		unsigned out = OUT(_mm_or_si128(_mm_or_si128(EQ(v, ' '), EQ(v, '\t')), EQ(v, '\r')));
+		if (out) return i + __builtin_ctz(out);
+	}
+#endif
+	while (i < n && (p[i] == ' ' || p[i] == '\t' || p[i] == '\r'))
+		i++;
+	return i;
+}
+
+/* get length of run of letters, digits and underscores */
+static em_ssize_t span_ident(const char *p, em_ssize_t n) {
+
+	em_ssize_t i = 0;
+#ifdef SCAN_SSE2
+	for (; i+16 <= n; i += 16) {
+
+		__m128i v = _mm_loadu_si128((const __m128i *)(p+i));
+		__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		unsigned out = OUT(_mm_or_si128(_mm_or_si128(RANGE(lower, 'a', 'z'), RANGE(v, '0', '9')), EQ(v, '_')));
+		if (out) return i + __builtin_ctz(out);
+	}
+#endif
+	while (i < n && ISIDENT_A(p[i]))
+		i++;
+	return i;
+}
+
+/* get length of run of ascii string contents, up to delimiter, escape or newline */
+static em_ssize_t span_string(const char *p, em_ssize_t n, char delim) {
+
+	em_ssize_t i = 0;
+#ifdef SCAN_SSE2
+	for (; i+16 <= n; i += 16) {
+
+		__m128i v = _mm_loadu_si128((const __m128i *)(p+i));
+		__m128i stop = _mm_or_si128(_mm_or_si128(EQ(v, delim), EQ(v, '\\')), EQ(v, '\n'));
+		unsigned out = OUT(_mm_andnot_si128(stop, _mm_cmpgt_epi8(v, _mm_setzero_si128())));
+		if (out) return i + __builtin_ctz(out);
+	}
+#endif
+	while (i < n && (signed char)p[i] > 0 && p[i] != delim && p[i] != '\\' && p[i] != '\n')
+		i++;
+	return i;
+}
+
+/* advance cursor */
+static void advance(em_cursor_t *cur) {
+
+	if (cur->lastchsz < 0) return; /* prior error */
+
+	cur->index += cur->lastchsz;
+	cur->pos.column++;
+	cur->pos.offset = (uint32_t)cur->index;
+	if (cur->index >= 0 && cur->index < cur->len) {
+
+		/* only decode characters that aren't ascii */
+		unsigned char b = (unsigned char)cur->text[cur->index];
+		if (b < 0x80) {
+
+			cur->cc = b;
+			cur->lastchsz = 1;
+		}
+		else if ((cur->cc = em_utf8_getch(&cur->text[cur->index], &cur->lastchsz)) < 0)
+			return;
+	}
+	else {
+
+		cur->cc = 0;
+		return;
+	}
+
+	/* adjust line and column values, recording the start of a line the first time it's passed */
+	if (cur->cc == '\n' || !cur->pos.line) {
+
+		em_ssize_t lstart = cur->pos.line? cur->index+1: 0;
+		cur->pos.column = cur->pos.line? 0: 1;
+		cur->pos.line++;
+
+		em_source_t *source = cur->pos.source;
+		if (source && cur->pos.line > source->nlines)
+			(void)em_source_add_line(source, lstart);
+	}
+}
+
+/* advance cursor over count bytes, counting a column for each */
+static void jump(em_cursor_t *cur, em_ssize_t count) {
+
+	cur->index += count-1;
+	cur->pos.column += (uint32_t)(count-1);
+	cur->lastchsz = 1;
+	advance(cur);
+}
+
+/* get number of bytes left after cursor */
+#define REMAINING(cur) ((cur)->len - (cur)->index)
+
 /* initialize lexer */
 EM_API em_result_t em_lexer_init(em_lexer_t *lexer) {
 
@@ -51,41 +209,45 @@ EM_API em_result_t em_lexer_init(em_lexer_t *lexer) {
 	}
 
 	/* initialize */
-	lexer->pos = EM_POS_INIT;
-	lexer->initial_pos = EM_POS_INIT;
-	lexer->first = NULL;
-	lexer->last = NULL;
+	lexer->cur = EM_CURSOR_INIT;
+	lexer->source = NULL;
+	lexer->token = NULL;
+	lexer->eof = NULL;
+	lexer->last_type = EM_TOKEN_TYPE_NONE;
+	lexer->error = EM_FALSE;
 
 	lexer->init = EM_TRUE;
 	return EM_RESULT_SUCCESS;
 }
 
 /* reset lexer */
-EM_API void em_lexer_reset(em_lexer_t *lexer, const char *path, const char *text, em_ssize_t len) {
+EM_API em_result_t em_lexer_reset(em_lexer_t *lexer, const char *path, const char *text, em_ssize_t len) {
 
-	if (!lexer || !lexer->init) return;
-
-	em_token_t *cur = lexer->first;
-	while (cur) {
+	if (!lexer || !lexer->init) return EM_RESULT_FAILURE;
 
-		em_token_t *next = cur->next;
+	/* tokens and nodes of the previous source keep it as long as they need it */
+	em_source_t *source = em_source_new(path, text, len);
+	if (!source) return EM_RESULT_FAILURE;
 
-		cur->next = NULL;
-		EM_TOKEN_DECREF(cur);
+	em_source_decref(lexer->source);
+	lexer->source = source;
 
-		cur = next;
-	}
+	lexer->cur = EM_CURSOR_INIT;
+	lexer->cur.pos.path = path;
+	lexer->cur.pos.source = source;
+	lexer->cur.text = source->text;
+	lexer->cur.len = len;
 
-	lexer->first = NULL;
-	lexer->last = NULL;
+	advance(&lexer->cur);
 
-	lexer->pos = EM_POS_INIT;
-	lexer->pos.path = path;
-	lexer->pos.text = text;
-	lexer->pos.len = len;
+	/* end of file to give out after an error */
+	if (lexer->eof) EM_TOKEN_DECREF(lexer->eof);
+	if (!(lexer->eof = EM_TOKEN_INCREF(em_token_new(EM_TOKEN_TYPE_EOF, &lexer->cur.pos, "", 0))))
+		return EM_RESULT_FAILURE;
 
-	em_pos_advance(&lexer->pos);
-	memcpy(&lexer->initial_pos, &lexer->pos, sizeof(em_pos_t));
+	lexer->last_type = EM_TOKEN_TYPE_NONE;
+	lexer->error = EM_FALSE;
+	return EM_RESULT_SUCCESS;
 }
 
 /* add token with length specified */
@@ -94,10 +256,7 @@ EM_API em_token_t *em_lexer_add_token_full(em_lexer_t *lexer, em_token_type_t ty
 	em_token_t *token = EM_TOKEN_INCREF(em_token_new(type, pos, value, len));
 	if (!token) return NULL;
 
-	if (!lexer->first) lexer->first = token;
-	if (lexer->last) lexer->last->next = token;
-	lexer->last = token;
-
+	lexer->token = token;
 	return token;
 }
 
@@ -107,167 +266,189 @@ EM_API em_token_t *em_lexer_add_token(em_lexer_t *lexer, em_token_type_t type, e
 	return em_lexer_add_token_full(lexer, type, pos, value, strlen(value));
 }
 
-/* generate tokens from input text */
-EM_API em_result_t em_lexer_make_tokens(em_lexer_t *lexer) {
+/* get next token from input text */
+EM_API em_token_t *em_lexer_next(em_lexer_t *lexer) {
+
+	if (!lexer->error && em_lexer_make_token(lexer) != EM_RESULT_SUCCESS) {
+
+		if (lexer->token) EM_TOKEN_DECREF(lexer->token);
+		lexer->token = NULL;
+		lexer->error = EM_TRUE;
+	}
+
+	/* the error is already raised, so the parser only has to stop */
+	if (lexer->error) return EM_TOKEN_INCREF(lexer->eof);
+
+	em_token_t *token = lexer->token;
+	lexer->token = NULL;
+	lexer->last_type = token->type;
+	return token;
+}
+
+/* make next token from input text */
+EM_API em_result_t em_lexer_make_token(em_lexer_t *lexer) {
 
-	while (lexer->pos.cc) {
+	while (lexer->cur.cc && !lexer->token) {
 
 		/* whitespace */
-		if (strchr(" \t\r\n", lexer->pos.cc))
-			em_pos_advance(&lexer->pos);
+		if (lexer->cur.cc == ' ' || lexer->cur.cc == '\t' || lexer->cur.cc == '\r')
+			jump(&lexer->cur, span_blank(lexer->cur.text+lexer->cur.index, REMAINING(&lexer->cur)));
+		else if (lexer->cur.cc == '\n')
+			advance(&lexer->cur);
 
-		/* comment */
-		else if (lexer->pos.cc == '#') {
+		/* comment (the newline resets the column) */
+		else if (lexer->cur.cc == '#') {
 
-			while (lexer->pos.cc && lexer->pos.cc != '\n')
-				em_pos_advance(&lexer->pos);
+			const char *p = lexer->cur.text+lexer->cur.index;
+			const char *end = memchr(p, '\n', (size_t)REMAINING(&lexer->cur));
+			jump(&lexer->cur, end? end-p: REMAINING(&lexer->cur));
 		}
 
 		/* make a number */
-		else if (ISDIGIT(lexer->pos.cc)) {
+		else if (ISDIGIT(lexer->cur.cc)) {
 
 			if (em_lexer_make_number(lexer) != EM_RESULT_SUCCESS)
 				return EM_RESULT_FAILURE;
 		}
 
 		/* make an identifier */
-		else if (ISIDENT(lexer->pos.cc)) {
+		else if (ISIDENT(lexer->cur.cc)) {
 
 			if (em_lexer_make_identifier(lexer) != EM_RESULT_SUCCESS)
 				return EM_RESULT_FAILURE;
 		}
 
 		/* make a string */
-		else if (ISDELIM(lexer->pos.cc)) {
+		else if (ISDELIM(lexer->cur.cc)) {
 
 			if (em_lexer_make_string(lexer) != EM_RESULT_SUCCESS)
 				return EM_RESULT_FAILURE;
 		}
 
 		/* plus */
-		else if (lexer->pos.cc == '+') {
+		else if (lexer->cur.cc == '+') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_PLUS, &lexer->pos, "+"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_PLUS, &lexer->cur.pos, "+"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* minus */
-		else if (lexer->pos.cc == '-') {
+		else if (lexer->cur.cc == '-') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_MINUS, &lexer->pos, "-"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_MINUS, &lexer->cur.pos, "-"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* asterisk */
-		else if (lexer->pos.cc == '*') {
+		else if (lexer->cur.cc == '*') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_ASTERISK, &lexer->pos, "*"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_ASTERISK, &lexer->cur.pos, "*"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* slash */
-		else if (lexer->pos.cc == '/') {
+		else if (lexer->cur.cc == '/') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_SLASH, &lexer->pos, "/"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_SLASH, &lexer->cur.pos, "/"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* modulo */
-		else if (lexer->pos.cc == '%') {
+		else if (lexer->cur.cc == '%') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_MODULO, &lexer->pos, "%"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_MODULO, &lexer->cur.pos, "%"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* open parenthesis */
-		else if (lexer->pos.cc == '(') {
+		else if (lexer->cur.cc == '(') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_OPEN_PAREN, &lexer->pos, "("))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_OPEN_PAREN, &lexer->cur.pos, "("))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* closing parenthesis */
-		else if (lexer->pos.cc == ')') {
+		else if (lexer->cur.cc == ')') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_CLOSE_PAREN, &lexer->pos, ")"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_CLOSE_PAREN, &lexer->cur.pos, ")"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* open bracket */
-		else if (lexer->pos.cc == '{') {
+		else if (lexer->cur.cc == '{') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_OPEN_BRACKET, &lexer->pos, "{"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_OPEN_BRACKET, &lexer->cur.pos, "{"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* closing bracket */
-		else if (lexer->pos.cc == '}') {
+		else if (lexer->cur.cc == '}') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_CLOSE_BRACKET, &lexer->pos, "}"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_CLOSE_BRACKET, &lexer->cur.pos, "}"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* open square bracket */
-		else if (lexer->pos.cc == '[') {
+		else if (lexer->cur.cc == '[') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_OPEN_SQUARE_BRACKET, &lexer->pos, "["))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_OPEN_SQUARE_BRACKET, &lexer->cur.pos, "["))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* closing square bracket */
-		else if (lexer->pos.cc == ']') {
+		else if (lexer->cur.cc == ']') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_CLOSE_SQUARE_BRACKET, &lexer->pos, "]"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_CLOSE_SQUARE_BRACKET, &lexer->cur.pos, "]"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* comma */
-		else if (lexer->pos.cc == ',') {
+		else if (lexer->cur.cc == ',') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_COMMA, &lexer->pos, ","))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_COMMA, &lexer->cur.pos, ","))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* dot */
-		else if (lexer->pos.cc == '.') {
+		else if (lexer->cur.cc == '.') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_DOT, &lexer->pos, "."))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_DOT, &lexer->cur.pos, "."))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* colon */
-		else if (lexer->pos.cc == ':') {
+		else if (lexer->cur.cc == ':') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_COLON, &lexer->pos, ":"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_COLON, &lexer->cur.pos, ":"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* equals */
-		else if (lexer->pos.cc == '=') {
+		else if (lexer->cur.cc == '=') {
 
-			em_pos_t pos = lexer->pos;
-			em_pos_advance(&lexer->pos);
+			em_pos_t pos = lexer->cur.pos;
+			advance(&lexer->cur);
 
 			em_token_type_t type = EM_TOKEN_TYPE_EQUALS;
 			const char *value = "=";
 
-			if (lexer->pos.cc == '=') {
+			if (lexer->cur.cc == '=') {
 
-				em_pos_advance(&lexer->pos);
+				advance(&lexer->cur);
 				type = EM_TOKEN_TYPE_DOUBLE_EQUALS;
 				value = "==";
 			}
@@ -277,23 +458,23 @@ EM_API em_result_t em_lexer_make_tokens(em_lexer_t *lexer) {
 		}
 
 		/* less than */
-		else if (lexer->pos.cc == '<') {
+		else if (lexer->cur.cc == '<') {
 
-			em_pos_t pos = lexer->pos;
-			em_pos_advance(&lexer->pos);
+			em_pos_t pos = lexer->cur.pos;
+			advance(&lexer->cur);
 
 			em_token_type_t type = EM_TOKEN_TYPE_LESS_THAN;
 			const char *value = "<";
 
-			if (lexer->pos.cc == '=') {
+			if (lexer->cur.cc == '=') {
 
-				em_pos_advance(&lexer->pos);
+				advance(&lexer->cur);
 				type = EM_TOKEN_TYPE_LESS_THAN_EQUALS;
 				value = "<=";
 			}
-			else if (lexer->pos.cc == '<') {
+			else if (lexer->cur.cc == '<') {
 
-				em_pos_advance(&lexer->pos);
+				advance(&lexer->cur);
 				type = EM_TOKEN_TYPE_BITWISE_LEFT_SHIFT;
 				value = "<<";
 			}
@@ -303,23 +484,23 @@ EM_API em_result_t em_lexer_make_tokens(em_lexer_t *lexer) {
 		}
 
 		/* greater than */
-		else if (lexer->pos.cc == '>') {
+		else if (lexer->cur.cc == '>') {
 
-			em_pos_t pos = lexer->pos;
-			em_pos_advance(&lexer->pos);
+			em_pos_t pos = lexer->cur.pos;
+			advance(&lexer->cur);
 
 			em_token_type_t type = EM_TOKEN_TYPE_GREATER_THAN;
 			const char *value = ">";
 
-			if (lexer->pos.cc == '=') {
+			if (lexer->cur.cc == '=') {
 
-				em_pos_advance(&lexer->pos);
+				advance(&lexer->cur);
 				type = EM_TOKEN_TYPE_GREATER_THAN_EQUALS;
 				value = ">=";
 			}
-			else if (lexer->pos.cc == '>') {
+			else if (lexer->cur.cc == '>') {
 
-				em_pos_advance(&lexer->pos);
+				advance(&lexer->cur);
 				type = EM_TOKEN_TYPE_BITWISE_RIGHT_SHIFT;
 				value = ">>";
 			}
@@ -329,71 +510,71 @@ EM_API em_result_t em_lexer_make_tokens(em_lexer_t *lexer) {
 		}
 
 		/* not equals */
-		else if (lexer->pos.cc == '!') {
+		else if (lexer->cur.cc == '!') {
 
-			em_pos_t pos = lexer->pos;
-			em_pos_advance(&lexer->pos);
+			em_pos_t pos = lexer->cur.pos;
+			advance(&lexer->cur);
 
-			if (lexer->pos.cc != '=') {
+			if (lexer->cur.cc != '=') {
 
-				em_log_syntax_error(&lexer->pos, "Expected '='");
+				em_log_syntax_error(&lexer->cur.pos, "Expected '='");
 				return EM_RESULT_FAILURE;
 			}
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 
 			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_NOT_EQUALS, &pos, "!="))
 				return EM_RESULT_FAILURE;
 		}
 
 		/* bitwise and */
-		else if (lexer->pos.cc == '&') {
+		else if (lexer->cur.cc == '&') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_BITWISE_AND, &lexer->pos, "&"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_BITWISE_AND, &lexer->cur.pos, "&"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* bitwise or */
-		else if (lexer->pos.cc == '|') {
+		else if (lexer->cur.cc == '|') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_BITWISE_OR, &lexer->pos, "|"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_BITWISE_OR, &lexer->cur.pos, "|"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* bitwise xor */
-		else if (lexer->pos.cc == '^') {
+		else if (lexer->cur.cc == '^') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_BITWISE_XOR, &lexer->pos, "^"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_BITWISE_XOR, &lexer->cur.pos, "^"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* bitwise not */
-		else if (lexer->pos.cc == '~') {
+		else if (lexer->cur.cc == '~') {
 
-			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_BITWISE_NOT, &lexer->pos, "~"))
+			if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_BITWISE_NOT, &lexer->cur.pos, "~"))
 				return EM_RESULT_FAILURE;
-			em_pos_advance(&lexer->pos);
+			advance(&lexer->cur);
 		}
 
 		/* unrecognized */
 		else {
 
 			char cc[5];
-			em_ssize_t size = em_utf8_putch(cc, lexer->pos.cc);
+			em_ssize_t size = em_utf8_putch(cc, lexer->cur.cc);
 			if (size < 0)
-				em_log_syntax_error(&lexer->pos, "Unrecognized character");
+				em_log_syntax_error(&lexer->cur.pos, "Unrecognized character");
 			else {
 				
 				cc[size] = 0;
-				em_log_syntax_error(&lexer->pos, "Unrecognized character '%s'", cc);
+				em_log_syntax_error(&lexer->cur.pos, "Unrecognized character '%s'", cc);
 			}
 			return EM_RESULT_FAILURE;
 		}
 	}
 
-	if (!em_lexer_add_token(lexer, EM_TOKEN_TYPE_EOF, &lexer->pos, ""))
+	if (!lexer->token && !em_lexer_add_token(lexer, EM_TOKEN_TYPE_EOF, &lexer->cur.pos, ""))
 		return EM_RESULT_FAILURE;
 	return EM_RESULT_SUCCESS;
 }
@@ -401,30 +582,30 @@ EM_API em_result_t em_lexer_make_tokens(em_lexer_t *lexer) {
 /* make numeric token */
 EM_API em_result_t em_lexer_make_number(em_lexer_t *lexer) {
 
-	em_pos_t pos = lexer->pos;
+	em_cursor_t start = lexer->cur;
 	size_t len = 0;
 	em_token_type_t type = EM_TOKEN_TYPE_INT;
 
-	while (ISDIGIT(lexer->pos.cc) || lexer->pos.cc == '.') {
+	while (ISDIGIT(lexer->cur.cc) || lexer->cur.cc == '.') {
 
-		if (lexer->pos.cc == '.') {
+		if (lexer->cur.cc == '.') {
 			if (type == EM_TOKEN_TYPE_FLOAT)
 				break;
 			else type = EM_TOKEN_TYPE_FLOAT;
 		}
 
-		em_ssize_t chlen = em_utf8_getchlen(lexer->pos.cc);
+		em_ssize_t chlen = em_utf8_getchlen(lexer->cur.cc);
 		if (chlen < 1 || chlen > 4) {
 
-			em_log_syntax_error(&lexer->pos, "Invalid UTF-8 ordinal %d\n", lexer->pos.cc);
+			em_log_syntax_error(&lexer->cur.pos, "Invalid UTF-8 ordinal %d\n", lexer->cur.cc);
 			return EM_RESULT_FAILURE;
 		}
 		len += (size_t)chlen;
 
-		em_pos_advance(&lexer->pos);
+		advance(&lexer->cur);
 	}
 
-	if (!em_lexer_add_token_full(lexer, type, &pos, pos.text+pos.index, len))
+	if (!em_lexer_add_token_full(lexer, type, &start.pos, start.text+start.index, len))
 		return EM_RESULT_FAILURE;
 	return EM_RESULT_SUCCESS;
 }
@@ -432,81 +613,69 @@ EM_API em_result_t em_lexer_make_number(em_lexer_t *lexer) {
 /* make identifier or keyword token */
 EM_API em_result_t em_lexer_make_identifier(em_lexer_t *lexer) {
 
-	em_pos_t pos = lexer->pos;
-	size_t len = 0;
-
-	while (ISIDENT_A(lexer->pos.cc)) {
+	em_cursor_t start = lexer->cur;
+	size_t len = (size_t)span_ident(start.text+start.index, REMAINING(&start));
 
-		em_ssize_t chlen = em_utf8_getchlen(lexer->pos.cc);
-		if (chlen < 1 || chlen > 4) {
-
-			em_log_syntax_error(&lexer->pos, "Invalid UTF-8 ordinal %d\n", lexer->pos.cc);
-			return EM_RESULT_FAILURE;
-		}
-		len += (size_t)chlen;
-
-		em_pos_advance(&lexer->pos);
-	}
+	jump(&lexer->cur, (em_ssize_t)len);
 
 	em_token_t *token;
-	em_token_t *last = lexer->last;
-
-	if (!(token = em_lexer_add_token_full(lexer, EM_TOKEN_TYPE_IDENTIFIER, &pos, pos.text+pos.index, len)))
+	if (!(token = em_lexer_add_token_full(lexer, EM_TOKEN_TYPE_IDENTIFIER, &start.pos, start.text+start.index, len)))
 		return EM_RESULT_FAILURE;
 
 	/* identify a keyword */
-	if (!last || last->type != EM_TOKEN_TYPE_DOT) {
-
-		for (int i = 0; i < N_KEYWORDS; i++) {
-			if (!strcmp(keywords[i], token->value)) {
-
-				token->type = EM_TOKEN_TYPE_KEYWORD;
-				break;
-			}
-		}
-	}
+	if (lexer->last_type != EM_TOKEN_TYPE_DOT && is_keyword(token->value, len))
+		token->type = EM_TOKEN_TYPE_KEYWORD;
 	return EM_RESULT_SUCCESS;
 }
 
 /* make string token */
 EM_API em_result_t em_lexer_make_string(em_lexer_t *lexer) {
 
-	em_pos_t pos = lexer->pos;
+	em_pos_t pos = lexer->cur.pos;
 	size_t len = 0;
 
-	int delim = lexer->pos.cc;
-	em_pos_advance(&lexer->pos);
-	em_pos_t vstart = lexer->pos; /* value start position */
+	int delim = lexer->cur.cc;
+	advance(&lexer->cur);
+	em_cursor_t vstart = lexer->cur; /* value start position */
 
-	while (lexer->pos.cc && lexer->pos.cc != delim) {
+	while (lexer->cur.cc && lexer->cur.cc != delim) {
+
+		/* plain ascii run */
+		em_ssize_t run = span_string(lexer->cur.text+lexer->cur.index, REMAINING(&lexer->cur), (char)delim);
+		if (run) {
+
+			len += (size_t)run;
+			jump(&lexer->cur, run);
+			continue;
+		}
 
 		em_ssize_t chlen;
 
 		/* escape character */
-		if (lexer->pos.cc == '\\') {
+		if (lexer->cur.cc == '\\') {
 
-			em_pos_advance(&lexer->pos);
-			chlen = em_utf8_getchlen(getescchar(lexer->pos.cc));
+			advance(&lexer->cur);
+			chlen = em_utf8_getchlen(getescchar(lexer->cur.cc));
 		}
-		else chlen = em_utf8_getchlen(lexer->pos.cc);
+		else chlen = em_utf8_getchlen(lexer->cur.cc);
 
 		if (chlen < 1 || chlen > 4) {
 
-			em_log_syntax_error(&lexer->pos, "Invalid UTF-8 ordinal %d\n", lexer->pos.cc);
+			em_log_syntax_error(&lexer->cur.pos, "Invalid UTF-8 ordinal %d\n", lexer->cur.cc);
 			return EM_RESULT_FAILURE;
 		}
 		len += (size_t)chlen;
 
-		em_pos_advance(&lexer->pos);
+		advance(&lexer->cur);
 	}
 
 	/* expected delimeter */
-	if (lexer->pos.cc != delim) {
+	if (lexer->cur.cc != delim) {
 
-		em_log_syntax_error(&lexer->pos, "Unexpected end of file");
+		em_log_syntax_error(&lexer->cur.pos, "Unexpected end of file");
 		return EM_RESULT_FAILURE;
 	}
-	em_pos_advance(&lexer->pos);
+	advance(&lexer->cur);
 
 	/* create token value */
 	em_token_t *token;
@@ -516,10 +685,20 @@ EM_API em_result_t em_lexer_make_string(em_lexer_t *lexer) {
 	size_t i = 0;
 	while (i < len) {
 
+		/* same runs as above, copied as they are */
+		em_ssize_t run = span_string(vstart.text+vstart.index, REMAINING(&vstart), (char)delim);
+		if (run) {
+
+			memcpy(token->value+i, vstart.text+vstart.index, (size_t)run);
+			i += (size_t)run;
+			jump(&vstart, run);
+			continue;
+		}
+
 		int ch = vstart.cc;
 		if (ch == '\\') {
 
-			em_pos_advance(&vstart);
+			advance(&vstart);
 			ch = getescchar(vstart.cc);
 		}
 
@@ -527,13 +706,13 @@ EM_API em_result_t em_lexer_make_string(em_lexer_t *lexer) {
 		em_ssize_t chlen = em_utf8_getchlen(ch);
 		if (chlen < 1 || chlen > 4) {
 
-			em_log_syntax_error(&vstart, "Invalid UTF-8 ordinal %d\n", ch);
+			em_log_syntax_error(&vstart.pos, "Invalid UTF-8 ordinal %d\n", ch);
 			return EM_RESULT_FAILURE;
 		}
 		if (i+(size_t)chlen > len) break;
 
 		em_utf8_putch(token->value+i, ch);
-		em_pos_advance(&vstart);
+		advance(&vstart);
 		i += (size_t)chlen;
 	}
 	return EM_RESULT_SUCCESS;
@@ -544,16 +723,13 @@ EM_API void em_lexer_destroy(em_lexer_t *lexer) {
 
 	if (!lexer || !lexer->init) return;
 
-	em_token_t *cur = lexer->first;
-	while (cur) {
-
-		em_token_t *next = cur->next;
+	if (lexer->token) EM_TOKEN_DECREF(lexer->token);
+	if (lexer->eof) EM_TOKEN_DECREF(lexer->eof);
+	lexer->token = NULL;
+	lexer->eof = NULL;
 
-		cur->next = NULL;
-		em_refobj_decref(EM_REFOBJ(cur));
-
-		cur = next;
-	}
+	em_source_decref(lexer->source);
+	lexer->source = NULL;
 
 	lexer->init = EM_FALSE;
 }
@@ -8,8 +8,8 @@
 #include <string.h>
 #include <stdarg.h>
 #include <emerald/core.h>
-#include <emerald/utf8.h>
 #include <emerald/class.h>
+#include <emerald/source.h>
 #include <emerald/log.h>
 
 #ifdef DEBUG
@@ -19,21 +19,26 @@ em_log_level_t em_log_hide_level = EM_LOG_LEVEL_ERROR;
 #endif
 
 #define LINEBUFSZ 128
-static char linebuf[LINEBUFSZ];
-static FILE *logfile = NULL;
+static EM_THREAD_LOCAL char linebuf[LINEBUFSZ];
 
-/* raised error */
-static em_bool_t err = EM_FALSE;
-static em_bool_t printerr = EM_FALSE;
-static em_value_t errclass = EM_VALUE_FAIL;
+/*
+ * Raised error (each thread has its own). Most raised errors are caught, so
+ * only the message is kept when an error is raised; the position and
+ * source line are added when it is printed.
+ */
+static EM_THREAD_LOCAL em_bool_t err = EM_FALSE;
+static EM_THREAD_LOCAL em_value_t errclass = EM_VALUE_FAIL;
+static EM_THREAD_LOCAL em_pos_t errpos;
+static EM_THREAD_LOCAL em_bool_t has_errpos;
 
 #define ERRNAMESZ 128
-static char errname[ERRNAMESZ];
+static EM_THREAD_LOCAL char errname[ERRNAMESZ];
+
+#define ERRPATHSZ 1024
+static EM_THREAD_LOCAL char errpath[ERRPATHSZ];
 
 #define ERRBUFSZ 1024
-static char errbuf[ERRBUFSZ];
-static char *errbufp = errbuf;
-static const char *errmsg = errbuf;
+static EM_THREAD_LOCAL char errbuf[ERRBUFSZ];
 
 /* log level names */
 #define COL_GREEN "\e[32m"
@@ -49,39 +54,6 @@ static const char *levelnames[EM_LOG_LEVEL_COUNT] = {
 	COL_RED "Fatal" COL_RESET,
 };
 
-/* advance position */
-EM_API void em_pos_advance(em_pos_t *pos) {
-
-	if (pos->lastchsz < 0) return; /* prior error */
-
-	pos->index += pos->lastchsz;
-	pos->column++;
-	if (pos->index >= 0 && pos->index < pos->len) {
-
-		pos->cc = em_utf8_getch(&pos->text[pos->index], &pos->lastchsz);
-		if (pos->cc < 0) return;
-	}
-	else {
-		
-		pos->cc = 0;
-		return;
-	}
-
-	/* adjust line and column values, and determine the range of the line */
-	if (pos->cc == '\n' || pos->lstart < 0) {
-
-		pos->line++;
-		pos->column = (pos->lstart < 0)? 1: 0;
-
-		pos->lstart = (pos->lstart < 0)? 0: pos->index+1;
-		em_ssize_t i = pos->lstart;
-
-		while (i < pos->len && pos->text[i] != '\n')
-			i++;
-		pos->lend = i;
-	}
-}
-
 /* log a basic message */
 EM_API void em_log(em_log_level_t level, const char *file, long line, const char *fmt, ...) {
 
@@ -111,17 +83,27 @@ EM_API void em_log_error(const em_pos_t *pos, const char *fmt, ...) {
 /* log an error with va_list */
 EM_API void em_log_verror(const em_pos_t *pos, const char *fmt, va_list args) {
 
+	/* positions of nodes only have an offset until they're shown */
+	em_pos_t found;
+	if (pos && !pos->line && pos->source) {
+
+		found = *pos;
+		em_source_find(pos->source, pos->offset, &found.line, &found.column);
+		pos = &found;
+	}
+
 	em_log_begin(EM_LOG_LEVEL_ERROR);
-	if (pos) em_log_printf(" (File '%s', Line %ld, Column %ld):\n  ", pos->path, pos->line, pos->column);
+	if (pos) em_log_printf(" (File '%s', Line %lu, Column %lu):\n  ", pos->path, (unsigned long)pos->line, (unsigned long)pos->column);
 	else em_log_printf(": ");
-	errmsg = errbufp;
 
 	em_log_vprintf(fmt, args);
 
-	if (pos && pos->text && pos->lstart >= 0 && pos->lend >= 0) {
+	const char *start;
+	em_ssize_t lnlen = pos? em_source_get_line(pos->source, pos->line, &start): -1;
+	if (lnlen >= 0) {
 
-		size_t len = (size_t)EM_MIN(pos->lend-pos->lstart, LINEBUFSZ-1);
-		memcpy(linebuf, pos->text+pos->lstart, len);
+		size_t len = (size_t)EM_MIN(lnlen, LINEBUFSZ-1);
+		memcpy(linebuf, start, len);
 		linebuf[len] = 0;
 
 		em_log_printf("\n -> %s", linebuf);
@@ -142,23 +124,33 @@ EM_API void em_log_raise(em_value_t *cls, const em_pos_t *pos, const char *fmt,
 	strncpy(errname, name, ERRNAMESZ);
 
 	errclass = *cls;
-
-	/* print the error message to a string */
 	err = EM_TRUE;
-	printerr = EM_TRUE;
 
+	/* the arguments don't outlive the call, so the message is written now */
 	va_list args;
 	va_start(args, fmt);
-	em_log_verror(pos, fmt, args);
+	vsnprintf(errbuf, ERRBUFSZ, fmt, args);
 	va_end(args);
 
-	printerr = EM_FALSE;
+	/* the position may not outlive it either */
+	has_errpos = pos? EM_TRUE: EM_FALSE;
+	if (pos) {
+
+		errpos = *pos;
+		if (pos->path) {
+
+			strncpy(errpath, pos->path, ERRPATHSZ-1);
+			errpath[ERRPATHSZ-1] = 0;
+			errpos.path = errpath;
+		}
+		em_source_incref(errpos.source);
+	}
 }
 
 /* get raised error message */
 EM_API const char *em_log_get_message(void) {
 
-	return errmsg;
+	return errbuf;
 }
 
 /* check if raised error has such name */
@@ -180,9 +172,9 @@ EM_API void em_log_clear(void) {
 	}
 
 	err = EM_FALSE;
-	printerr = EM_FALSE;
-	errbufp = errbuf;
-	errmsg = errbuf;
+	if (has_errpos) em_source_decref(errpos.source);
+	has_errpos = EM_FALSE;
+	errbuf[0] = 0;
 }
 
 /* print raised error if present */
@@ -194,18 +186,13 @@ EM_API void em_log_flush(void) {
 		return;
 	}
 
-	em_log_printf("%s", errbuf);
-	err = EM_FALSE;
-	printerr = EM_FALSE;
-	errbufp = errbuf;
-	errmsg = errbuf;
+	em_log_error(has_errpos? &errpos: NULL, "%s", errbuf);
+	em_log_clear();
 }
 
 /* begin log message */
 EM_API void em_log_begin(em_log_level_t level) {
 
-	if (printerr) errbufp = errbuf;
-
 	em_log_printf("%s", levelnames[level]);
 }
 
@@ -221,14 +208,7 @@ EM_API void em_log_printf(const char *fmt, ...) {
 /* print log message with va_list */
 EM_API void em_log_vprintf(const char *fmt, va_list args) {
 
-	if (!logfile) logfile = stderr;
-
-	if (!printerr) vfprintf(logfile, fmt, args);
-	else {
-
-		int nbytes = vsnprintf(errbufp, ERRBUFSZ - (size_t)(errbufp - errbuf), fmt, args);
-		if (nbytes >= 0) errbufp += nbytes;
-	}
+	vfprintf(stderr, fmt, args);
 }
 
 /* end log message */
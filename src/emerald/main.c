@@ -16,24 +16,25 @@
 #include <emerald/context.h>
 #include <emerald/map.h>
 #include <emerald/string.h>
+#include <emerald/profile.h>
 #include <emerald/main.h>
 
 EM_API em_bool_t em_print_allocation_traffic;
 
-em_reflist_t em_reflist_token = EM_REFLIST_INIT;
-em_reflist_t em_reflist_node = EM_REFLIST_INIT;
-em_reflist_t em_reflist_object = EM_REFLIST_INIT;
-em_reflist_t em_reflist_code = EM_REFLIST_INIT;
+EM_THREAD_LOCAL em_reflist_t em_reflist_token = EM_REFLIST_INIT;
+EM_THREAD_LOCAL em_reflist_t em_reflist_tree = EM_REFLIST_INIT;
+EM_THREAD_LOCAL em_reflist_t em_reflist_object = EM_REFLIST_INIT;
+EM_THREAD_LOCAL em_reflist_t em_reflist_code = EM_REFLIST_INIT;
 
 em_value_t em_none = EM_VALUE_FAIL;
 
-em_value_t em_class_error = EM_VALUE_FAIL;
-em_value_t em_class_syntax_error = EM_VALUE_FAIL;
-em_value_t em_class_runtime_error = EM_VALUE_FAIL;
-em_value_t em_class_system_break = EM_VALUE_FAIL;
-em_value_t em_class_system_continue = EM_VALUE_FAIL;
-em_value_t em_class_system_return = EM_VALUE_FAIL;
-em_value_t em_class_system_exit = EM_VALUE_FAIL;
+EM_THREAD_LOCAL em_value_t em_class_error = EM_VALUE_FAIL;
+EM_THREAD_LOCAL em_value_t em_class_syntax_error = EM_VALUE_FAIL;
+EM_THREAD_LOCAL em_value_t em_class_runtime_error = EM_VALUE_FAIL;
+EM_THREAD_LOCAL em_value_t em_class_system_break = EM_VALUE_FAIL;
+EM_THREAD_LOCAL em_value_t em_class_system_continue = EM_VALUE_FAIL;
+EM_THREAD_LOCAL em_value_t em_class_system_return = EM_VALUE_FAIL;
+EM_THREAD_LOCAL em_value_t em_class_system_exit = EM_VALUE_FAIL;
 
 static em_init_flag_t init_flags;
 
@@ -106,9 +107,17 @@ EM_API em_result_t em_init(em_init_flag_t flags) {
 	if (flags & EM_INIT_FLAG_PRINT_ALLOC_TRAFFIC)
 		em_print_allocation_traffic = EM_TRUE;
 
+	em_none = em_none_new();
+
+	return em_thread_init();
+}
+
+/* initialize emerald for calling thread */
+EM_API em_result_t em_thread_init(void) {
+
 	if (em_reflist_init(&em_reflist_token) != EM_RESULT_SUCCESS)
 		return EM_RESULT_FAILURE;
-	if (em_reflist_init(&em_reflist_node) != EM_RESULT_SUCCESS)
+	if (em_reflist_init(&em_reflist_tree) != EM_RESULT_SUCCESS)
 		return EM_RESULT_FAILURE;
 	if (em_reflist_init(&em_reflist_object) != EM_RESULT_SUCCESS)
 		return EM_RESULT_FAILURE;
@@ -116,9 +125,6 @@ EM_API em_result_t em_init(em_init_flag_t flags) {
 	if (em_reflist_init(&em_reflist_code) != EM_RESULT_SUCCESS)
 		return EM_RESULT_FAILURE;
 
-	em_none = em_none_new();
-	em_value_incref(em_none);
-
 	/* create error classes */
 	em_class_error = create_error_class("Error", EM_VALUE_FAIL);
 	em_class_syntax_error = create_error_class("SyntaxError", em_class_error);
@@ -131,23 +137,32 @@ EM_API em_result_t em_init(em_init_flag_t flags) {
 	return EM_RESULT_SUCCESS;
 }
 
-/* quit emerald */
-EM_API void em_quit(void) {
+/* quit emerald for calling thread */
+EM_API void em_thread_quit(void) {
+
+	/* an error left raised (such as SystemExit) holds on to its source */
+	if (em_log_catch(NULL)) em_log_clear();
 
 	em_value_decref(em_class_runtime_error);
 	em_value_decref(em_class_syntax_error);
 	em_value_decref(em_class_error);
 
-	em_value_decref(em_none);
-
 	em_reflist_destroy(&em_reflist_code);
 
 	if (!(init_flags & EM_INIT_FLAG_NO_EXIT_FREE))
 		em_reflist_destroy(&em_reflist_object);
 
-	em_reflist_destroy(&em_reflist_node);
+	em_reflist_destroy(&em_reflist_tree);
 	em_reflist_destroy(&em_reflist_token);
 
+	em_profile_reset(); /* profiles are kept per thread */
+
 	if (!(init_flags & EM_INIT_FLAG_NO_PRINT_ALLOCS))
 		em_print_allocs();
 }
+
+/* quit emerald */
+EM_API void em_quit(void) {
+
+	em_thread_quit();
+}
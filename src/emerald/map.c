@@ -79,7 +79,7 @@ static em_value_t to_string(em_value_t v, em_pos_t *pos) {
 		return em_string_new_from_utf8("{...}", 5);
 
 	em_value_t args[1] = {};
-	return em_value_call(pos->context, value, args, 0, pos);
+	return em_value_call(pos->source? pos->source->context: NULL, value, args, 0, pos);
 }
 
 /* free map */
@@ -20,10 +20,11 @@ em_bool_t em_track_allocations = EM_FALSE;
 
 em_bool_t em_print_allocation_traffic = EM_FALSE;
 
-size_t em_memory_usage;
+/* counts and lists are kept for each thread */
+EM_THREAD_LOCAL size_t em_memory_usage;
 
-static size_t nalloc; /* current number of allocations */
-static size_t ntotal; /* total number of allocations */
+static EM_THREAD_LOCAL size_t nalloc; /* current number of allocations */
+static EM_THREAD_LOCAL size_t ntotal; /* total number of allocations */
 
 /* per file memory tracking linked list */
 struct mlist;
@@ -44,8 +45,8 @@ struct mlist {
 	char path[]; /* file path */
 };
 
-static struct mlist *first = NULL;
-static struct mlist *last = NULL;
+static EM_THREAD_LOCAL struct mlist *first = NULL;
+static EM_THREAD_LOCAL struct mlist *last = NULL;
 
 /* track allocation */
 static void *track_alloc(size_t size, const char *file, em_ssize_t line) {
@@ -205,4 +206,6 @@ EM_API void em_print_allocs(void) {
 		free(list);
 		list = next;
 	}
+	first = NULL;
+	last = NULL;
 }
@@ -41,15 +41,16 @@
 #define WHENCE_CURSOR 1
 #define WHENCE_END 2
 
+/* open files (each thread has its own, like the maps that refer to them) */
 #define MAX_FILES 32
-struct {
+static EM_THREAD_LOCAL struct {
 	em_value_t map; /* file object */
 	void *fp; /* file pointer */
 	em_inttype_t flags; /* open flags */
 } files[MAX_FILES];
 
 #define PATHBUFSZ 4096
-static char pathbuf[PATHBUFSZ];
+static EM_THREAD_LOCAL char pathbuf[PATHBUFSZ];
 
 /* os module */
 static em_result_t initialize(em_context_t *context, em_value_t map);
@@ -23,8 +23,9 @@
 #include <emerald/module/array.h>
 #include <emerald/module/posix.h>
 
-static struct termios original; /* original settings */
-static em_bool_t modified_stdin = EM_FALSE; /* tcsetattr modified stdin */
+/* only the thread that changed the terminal restores it */
+static EM_THREAD_LOCAL struct termios original; /* original settings */
+static EM_THREAD_LOCAL em_bool_t modified_stdin = EM_FALSE; /* tcsetattr modified stdin */
 
 #define DECLARE_FUNCTION(name) em_value_t module_posix_##name(em_context_t *context, em_value_t *args, size_t nargs, em_pos_t *pos)
 #define SET_FUNCTION(mod, name) em_util_set_function(mod, #name, module_posix_##name)
@@ -17,7 +17,7 @@
 #include <emerald/module/site.h>
 
 #define READBUFSZ 4096
-static char readbuf[READBUFSZ];
+static EM_THREAD_LOCAL char readbuf[READBUFSZ];
 
 /* site module */
 static em_result_t initialize(em_context_t *context, em_value_t map);
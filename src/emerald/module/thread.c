@@ -0,0 +1,911 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <emerald/core.h>
+#include <emerald/log.h>
+#include <emerald/main.h>
+#include <emerald/none.h>
+#include <emerald/util.h>
+#include <emerald/path.h>
+#include <emerald/context.h>
+#include <emerald/function.h>
+#include <emerald/string.h>
+#include <emerald/list.h>
+#include <emerald/map.h>
+#include <emerald/module.h>
+#include <emerald/module/thread.h>
+
+#define PATHBUFSZ 4096
+static EM_THREAD_LOCAL char pathbuf[PATHBUFSZ];
+
+#define CHANNEL_CAPACITY 16 /* default number of messages a channel holds */
+#define MAX_DEPTH 64 /* deepest nesting of lists and maps that can be copied */
+
+/* thread module */
+static em_result_t initialize(em_context_t *context, em_value_t map);
+
+em_module_t em_module_thread = {
+	.initialize = initialize,
+};
+
+/* copied value tags */
+#define TAG_NONE 0
+#define TAG_INT 1
+#define TAG_FLOAT 2
+#define TAG_STRING 3
+#define TAG_LIST 4
+#define TAG_MAP 5
+#define TAG_CHANNEL 6
+
+struct channel;
+
+/*
+ * Copied value. Messages are made by one thread and read and freed by
+ * another, so they are allocated with malloc rather than em_malloc (which
+ * tracks allocations for each thread).
+ */
+typedef struct message {
+	unsigned char *data; /* encoded value */
+	size_t size; /* size of encoded value */
+	size_t cap; /* allocated size of data */
+	size_t pos; /* read position */
+	struct channel **channels; /* channels referred to (referenced) */
+	size_t nchannels; /* number of channels */
+	size_t cchannels; /* allocated number of channels */
+} message_t;
+
+#define MESSAGE_INIT ((message_t){NULL})
+
+/*
+ * Channel shared between threads. Channels may be sent through each other,
+ * or through themselves, so messages queued in channels can keep a group of
+ * channels referenced after every object that could reach it is gone. Such
+ * groups are found and freed by collect_channels.
+ */
+typedef struct channel {
+	pthread_mutex_t lock; /* guards closed and the queue */
+	pthread_cond_t not_empty; /* signalled when a message is added or channel is closed */
+	pthread_cond_t not_full; /* signalled when a message is taken or channel is closed */
+	em_bool_t closed; /* no more messages may be sent */
+	size_t capacity; /* maximum number of messages */
+
+	/* queue, also only changed with channels_lock held */
+	size_t count; /* number of messages */
+	size_t head; /* index of oldest message */
+
+	/* guarded by channels_lock */
+	size_t refcnt; /* number of channel objects and messages referring to channel */
+	size_t nqueued; /* number of those messages that are queued in channels */
+	struct channel *prev; /* previous channel */
+	struct channel *next; /* next channel */
+	struct channel *work; /* next channel to scan while collecting */
+	em_bool_t reached; /* reached while collecting */
+
+	message_t messages[]; /* ring of messages (part of queue) */
+} channel_t;
+
+/* guards reference counts and queues of all channels, taken after the lock of any one */
+static pthread_mutex_t channels_lock = PTHREAD_MUTEX_INITIALIZER;
+static channel_t *channels; /* all channels */
+
+/* spawned thread */
+typedef struct worker {
+	pthread_t thread; /* native thread */
+	pthread_mutex_t lock; /* guards reference count */
+	size_t refcnt; /* held by thread and by thread object */
+	em_bool_t joined; /* thread has been joined */
+	em_bool_t failed; /* file or main function raised an error */
+	message_t args; /* arguments of main function */
+	message_t result; /* result of main function */
+	em_code_type_t mode; /* settings of spawning context */
+	em_bool_t fold;
+	em_bool_t use_jit;
+	em_bool_t tier;
+	char path[]; /* resolved file path */
+} worker_t;
+
+/* objects referring to channels and threads */
+typedef struct channel_object {
+	em_object_t base;
+	channel_t *channel; /* shared channel */
+} channel_object_t;
+
+typedef struct thread_object {
+	em_object_t base;
+	worker_t *worker; /* spawned thread */
+} thread_object_t;
+
+#define CHANNEL_OBJECT(p) ((channel_object_t *)(p))
+#define THREAD_OBJECT(p) ((thread_object_t *)(p))
+
+static em_value_t channel_object_new(channel_t *channel);
+static em_bool_t is_channel(em_value_t v);
+static em_bool_t is_thread(em_value_t v);
+
+/* add reference to channel */
+static channel_t *channel_retain(channel_t *channel) {
+
+	pthread_mutex_lock(&channels_lock);
+	channel->refcnt++;
+	pthread_mutex_unlock(&channels_lock);
+	return channel;
+}
+
+static void message_free(message_t *msg);
+
+/* unlink channel from list of channels */
+static void channel_unlink(channel_t *channel) {
+
+	if (channel->prev) channel->prev->next = channel->next;
+	else channels = channel->next;
+	if (channel->next) channel->next->prev = channel->prev;
+}
+
+/* count references of message as queued or not (with channels_lock held) */
+static void message_set_queued(message_t *msg, em_bool_t queued) {
+
+	for (size_t i = 0; i < msg->nchannels; i++) {
+
+		if (queued) msg->channels[i]->nqueued++;
+		else msg->channels[i]->nqueued--;
+	}
+}
+
+/* free channel that nothing refers to */
+static void channel_free(channel_t *channel) {
+
+	pthread_mutex_lock(&channels_lock);
+	for (size_t i = 0; i < channel->count; i++)
+		message_set_queued(&channel->messages[(channel->head + i) % channel->capacity], EM_FALSE);
+	pthread_mutex_unlock(&channels_lock);
+
+	for (size_t i = 0; i < channel->count; i++)
+		message_free(&channel->messages[(channel->head + i) % channel->capacity]);
+
+	pthread_cond_destroy(&channel->not_full);
+	pthread_cond_destroy(&channel->not_empty);
+	pthread_mutex_destroy(&channel->lock);
+	free(channel);
+}
+
+/*
+ * Take channels that can only be reached through messages queued in each
+ * other (with channels_lock held). References that don't come from queued
+ * messages belong to objects and messages that are being passed around, so
+ * their channels are kept, along with every channel their queues reach.
+ * The references that the queues of the rest hold are dropped, and the rest
+ * are returned in a list linked through next, to be freed once the lock is
+ * released.
+ */
+static channel_t *collect_channels(void) {
+
+	channel_t *work = NULL;
+	for (channel_t *channel = channels; channel; channel = channel->next) {
+
+		channel->reached = channel->refcnt > channel->nqueued;
+		if (channel->reached) {
+
+			channel->work = work;
+			work = channel;
+		}
+	}
+
+	while (work) {
+
+		channel_t *channel = work;
+		work = channel->work;
+
+		for (size_t i = 0; i < channel->count; i++) {
+
+			message_t *msg = &channel->messages[(channel->head + i) % channel->capacity];
+			for (size_t j = 0; j < msg->nchannels; j++) {
+
+				channel_t *other = msg->channels[j];
+				if (other->reached) continue;
+
+				other->reached = EM_TRUE;
+				other->work = work;
+				work = other;
+			}
+		}
+	}
+
+	channel_t *garbage = NULL;
+	channel_t *next;
+	for (channel_t *channel = channels; channel; channel = next) {
+
+		next = channel->next;
+		if (channel->reached) continue;
+
+		channel_unlink(channel);
+		channel->next = garbage;
+		garbage = channel;
+	}
+
+	for (channel_t *channel = garbage; channel; channel = channel->next) {
+
+		for (size_t i = 0; i < channel->count; i++) {
+
+			message_t *msg = &channel->messages[(channel->head + i) % channel->capacity];
+			for (size_t j = 0; j < msg->nchannels; j++) {
+
+				channel_t *other = msg->channels[j];
+				if (!other->reached) continue;
+
+				other->refcnt--;
+				other->nqueued--;
+			}
+			msg->nchannels = 0;
+		}
+	}
+	return garbage;
+}
+
+/* remove reference to channel */
+static void channel_release(channel_t *channel) {
+
+	channel_t *garbage = NULL;
+
+	pthread_mutex_lock(&channels_lock);
+	size_t refcnt = --channel->refcnt;
+	if (!refcnt) channel_unlink(channel);
+
+	/* the last reference from outside of the queues is gone */
+	else if (refcnt == channel->nqueued) garbage = collect_channels();
+	pthread_mutex_unlock(&channels_lock);
+
+	if (!refcnt) channel_free(channel);
+	while (garbage) {
+
+		channel_t *next = garbage->next;
+		channel_free(garbage);
+		garbage = next;
+	}
+}
+
+/* free message */
+static void message_free(message_t *msg) {
+
+	for (size_t i = 0; i < msg->nchannels; i++)
+		channel_release(msg->channels[i]);
+
+	free(msg->data);
+	free(msg->channels);
+	*msg = MESSAGE_INIT;
+}
+
+/* add data to message */
+static em_result_t message_write(message_t *msg, const void *data, size_t size, em_pos_t *pos) {
+
+	if (msg->size + size > msg->cap) {
+
+		size_t cap = msg->cap? msg->cap: 64;
+		while (cap < msg->size + size) cap *= 2;
+
+		unsigned char *p = realloc(msg->data, cap);
+		if (!p) {
+
+			em_log_runtime_error(pos, "Out of memory");
+			return EM_RESULT_FAILURE;
+		}
+		msg->data = p;
+		msg->cap = cap;
+	}
+	memcpy(msg->data + msg->size, data, size);
+	msg->size += size;
+	return EM_RESULT_SUCCESS;
+}
+
+/* read data from message */
+static void message_read(message_t *msg, void *data, size_t size) {
+
+	memcpy(data, msg->data + msg->pos, size);
+	msg->pos += size;
+}
+
+/* add channel to message */
+static em_result_t message_add_channel(message_t *msg, channel_t *channel, em_pos_t *pos) {
+
+	if (msg->nchannels >= msg->cchannels) {
+
+		size_t cchannels = msg->cchannels? msg->cchannels * 2: 4;
+		channel_t **channels = realloc(msg->channels, cchannels * sizeof(channel_t *));
+		if (!channels) {
+
+			em_log_runtime_error(pos, "Out of memory");
+			return EM_RESULT_FAILURE;
+		}
+		msg->channels = channels;
+		msg->cchannels = cchannels;
+	}
+
+	size_t index = msg->nchannels;
+	msg->channels[msg->nchannels++] = channel_retain(channel);
+	return message_write(msg, &index, sizeof(index), pos);
+}
+
+#define WRITE(msg, value) \
+	if (message_write(msg, &(value), sizeof(value), pos) != EM_RESULT_SUCCESS) \
+		return EM_RESULT_FAILURE
+
+/* copy value into message */
+static em_result_t encode(message_t *msg, em_value_t v, int depth, em_pos_t *pos) {
+
+	unsigned char tag;
+
+	if (depth > MAX_DEPTH) {
+
+		em_log_runtime_error(pos, "Value is nested too deeply to copy to another thread");
+		return EM_RESULT_FAILURE;
+	}
+
+	if (v.type == EM_VALUE_TYPE_INT) {
+
+		tag = TAG_INT;
+		WRITE(msg, tag);
+		WRITE(msg, v.value.te_inttype);
+	}
+	else if (v.type == EM_VALUE_TYPE_FLOAT) {
+
+		tag = TAG_FLOAT;
+		WRITE(msg, tag);
+		WRITE(msg, v.value.te_floattype);
+	}
+	else if (em_value_is(em_none, v)) {
+
+		tag = TAG_NONE;
+		WRITE(msg, tag);
+	}
+	else if (em_is_string(v)) {
+
+		em_string_t *string = EM_STRING(EM_OBJECT_FROM_VALUE(v));
+
+		tag = TAG_STRING;
+		WRITE(msg, tag);
+		WRITE(msg, string->length);
+		if (message_write(msg, string->data, string->length * sizeof(em_wchar_t), pos) != EM_RESULT_SUCCESS)
+			return EM_RESULT_FAILURE;
+	}
+	else if (em_is_list(v)) {
+
+		size_t nitems = EM_LIST(EM_OBJECT_FROM_VALUE(v))->nitems;
+
+		tag = TAG_LIST;
+		WRITE(msg, tag);
+		WRITE(msg, nitems);
+		for (size_t i = 0; i < nitems; i++) {
+
+			if (encode(msg, em_list_get(v, (em_ssize_t)i), depth+1, pos) != EM_RESULT_SUCCESS)
+				return EM_RESULT_FAILURE;
+		}
+	}
+	else if (em_is_map(v)) {
+
+		em_map_t *map = EM_MAP(EM_OBJECT_FROM_VALUE(v));
+
+		/* entries without a value have been deleted */
+		size_t count = 0;
+		for (em_map_entry_t *entry = map->first; entry; entry = entry->next)
+			if (EM_VALUE_OK(entry->value)) count++;
+
+		tag = TAG_MAP;
+		WRITE(msg, tag);
+		WRITE(msg, count);
+		for (em_map_entry_t *entry = map->first; entry; entry = entry->next) {
+
+			if (!EM_VALUE_OK(entry->value)) continue;
+
+			unsigned char has_key = EM_VALUE_OK(entry->key);
+			WRITE(msg, entry->key_hash);
+			WRITE(msg, has_key);
+			if (has_key && encode(msg, entry->key, depth+1, pos) != EM_RESULT_SUCCESS)
+				return EM_RESULT_FAILURE;
+			if (encode(msg, entry->value, depth+1, pos) != EM_RESULT_SUCCESS)
+				return EM_RESULT_FAILURE;
+		}
+	}
+	else if (is_channel(v)) {
+
+		tag = TAG_CHANNEL;
+		WRITE(msg, tag);
+		return message_add_channel(msg, CHANNEL_OBJECT(EM_OBJECT_FROM_VALUE(v))->channel, pos);
+	}
+	else {
+		em_log_runtime_error(pos, "Value can't be copied to another thread");
+		return EM_RESULT_FAILURE;
+	}
+	return EM_RESULT_SUCCESS;
+}
+
+/* create value from message */
+static em_value_t decode(message_t *msg) {
+
+	unsigned char tag;
+	message_read(msg, &tag, sizeof(tag));
+
+	switch (tag) {
+		case TAG_INT: {
+			em_inttype_t value;
+			message_read(msg, &value, sizeof(value));
+			return EM_VALUE_INT(value);
+		}
+		case TAG_FLOAT: {
+			em_floattype_t value;
+			message_read(msg, &value, sizeof(value));
+			return EM_VALUE_FLOAT(value);
+		}
+		case TAG_STRING: {
+			size_t length;
+			message_read(msg, &length, sizeof(length));
+
+			em_value_t string = em_string_new_from_wchar((const em_wchar_t *)(msg->data + msg->pos), length);
+			msg->pos += length * sizeof(em_wchar_t);
+			return string;
+		}
+		case TAG_LIST: {
+			size_t nitems;
+			message_read(msg, &nitems, sizeof(nitems));
+
+			em_value_t list = em_list_new(nitems);
+			for (size_t i = 0; i < nitems; i++)
+				em_list_append(list, decode(msg));
+			return list;
+		}
+		case TAG_MAP: {
+			size_t count;
+			message_read(msg, &count, sizeof(count));
+
+			em_value_t map = em_map_new();
+			for (size_t i = 0; i < count; i++) {
+
+				em_hash_t hash;
+				unsigned char has_key;
+				message_read(msg, &hash, sizeof(hash));
+				message_read(msg, &has_key, sizeof(has_key));
+
+				em_value_t key = has_key? decode(msg): EM_VALUE_FAIL;
+				em_value_t value = decode(msg);
+				if (has_key) em_map_set_key(map, key, hash, value);
+				else em_map_set(map, hash, value);
+			}
+			return map;
+		}
+		case TAG_CHANNEL: {
+			size_t index;
+			message_read(msg, &index, sizeof(index));
+			return channel_object_new(msg->channels[index]);
+		}
+		default:
+			return em_none;
+	}
+}
+
+/* channel type */
+static em_value_t channel_to_string(em_value_t v, em_pos_t *pos);
+
+static em_object_type_t channel_type = {
+	.to_string = channel_to_string,
+};
+
+/* get string representation of channel */
+static em_value_t channel_to_string(em_value_t v, em_pos_t *pos) {
+
+	channel_t *channel = CHANNEL_OBJECT(EM_OBJECT_FROM_VALUE(v))->channel;
+
+	char buf[128];
+	snprintf(buf, 128, "<Channel of capacity %zu>", channel->capacity);
+
+	return em_string_new_from_utf8(buf, strlen(buf));
+}
+
+/* free channel object */
+static void channel_object_free(void *p) {
+
+	channel_release(CHANNEL_OBJECT(p)->channel);
+}
+
+/* create channel object */
+static em_value_t channel_object_new(channel_t *channel) {
+
+	em_value_t value = em_object_new(&channel_type, sizeof(channel_object_t));
+	channel_object_t *object = CHANNEL_OBJECT(EM_OBJECT_FROM_VALUE(value));
+
+	EM_REFOBJ(object)->free = channel_object_free;
+	object->channel = channel_retain(channel);
+	return value;
+}
+
+/* determine if value is channel */
+static em_bool_t is_channel(em_value_t v) {
+
+	return v.type == EM_VALUE_TYPE_OBJECT && EM_OBJECT_FROM_VALUE(v)->type == &channel_type;
+}
+
+/* remove reference to worker */
+static void worker_release(worker_t *worker) {
+
+	pthread_mutex_lock(&worker->lock);
+	size_t refcnt = --worker->refcnt;
+	pthread_mutex_unlock(&worker->lock);
+	if (refcnt) return;
+
+	message_free(&worker->args);
+	message_free(&worker->result);
+	pthread_mutex_destroy(&worker->lock);
+	free(worker);
+}
+
+/* thread type */
+static em_value_t thread_to_string(em_value_t v, em_pos_t *pos);
+
+static em_object_type_t thread_type = {
+	.to_string = thread_to_string,
+};
+
+/* get string representation of thread */
+static em_value_t thread_to_string(em_value_t v, em_pos_t *pos) {
+
+	worker_t *worker = THREAD_OBJECT(EM_OBJECT_FROM_VALUE(v))->worker;
+
+	char buf[128];
+	snprintf(buf, 128, "<Thread '%.100s'>", worker->path);
+
+	return em_string_new_from_utf8(buf, strlen(buf));
+}
+
+/* free thread object; a thread that was never joined cleans up after itself */
+static void thread_object_free(void *p) {
+
+	worker_t *worker = THREAD_OBJECT(p)->worker;
+
+	if (!worker->joined) pthread_detach(worker->thread);
+	worker_release(worker);
+}
+
+/* determine if value is thread */
+static em_bool_t is_thread(em_value_t v) {
+
+	return v.type == EM_VALUE_TYPE_OBJECT && EM_OBJECT_FROM_VALUE(v)->type == &thread_type;
+}
+
+/* run file and main function of worker */
+static em_result_t worker_run(em_context_t *context, worker_t *worker) {
+
+	em_value_t value = em_context_run_file(context, NULL, worker->path);
+	if (EM_VALUE_OK(value)) {
+
+		em_value_delete(value);
+
+		value = em_none;
+		em_value_t function = em_util_get_value(context->scopestack[0], "main");
+		if (EM_VALUE_OK(function)) {
+
+			em_value_t args = decode(&worker->args);
+			em_value_incref(args);
+
+			em_value_t argv[EM_FUNCTION_MAX_ARGUMENTS];
+			size_t nargs = EM_LIST(EM_OBJECT_FROM_VALUE(args))->nitems;
+			for (size_t i = 0; i < nargs; i++)
+				argv[i] = em_list_get(args, (em_ssize_t)i);
+
+			/* result may only be held by the arguments */
+			value = em_value_call(context, function, argv, nargs, NULL);
+			em_value_incref(value);
+			em_value_decref(args);
+			em_value_decref_no_free(value);
+		}
+	}
+
+	/* exit ends the thread with its code as the result */
+	if (!EM_VALUE_OK(value) && em_log_catch(&em_class_system_exit)) {
+
+		em_log_clear();
+		value = context->pass;
+	}
+	if (!EM_VALUE_OK(value)) return EM_RESULT_FAILURE;
+
+	em_result_t result = encode(&worker->result, value, 0, NULL);
+	em_value_delete(value);
+	return result;
+}
+
+/* entry point of spawned thread */
+static void *worker_main(void *p) {
+
+	worker_t *worker = (worker_t *)p;
+	worker->failed = EM_TRUE;
+
+	if (em_thread_init() == EM_RESULT_SUCCESS) {
+
+		em_context_t context = EM_CONTEXT_INIT;
+		if (em_context_init(&context, NULL) == EM_RESULT_SUCCESS &&
+		    em_module_init_all(&context) == EM_RESULT_SUCCESS) {
+
+			/* cache files are written under names that are only unique to the process */
+			context.mode = worker->mode;
+			context.fold = worker->fold;
+			context.use_jit = worker->use_jit;
+			context.tier = worker->tier;
+			context.use_cache = EM_FALSE;
+
+			if (worker_run(&context, worker) == EM_RESULT_SUCCESS)
+				worker->failed = EM_FALSE;
+		}
+		if (worker->failed && em_log_catch(NULL)) em_log_flush();
+
+		em_module_destroy_all(&context);
+		em_context_destroy(&context);
+		em_thread_quit();
+	}
+
+	worker_release(worker);
+	return NULL;
+}
+
+/* run file on new thread */
+static em_value_t thread_spawn(em_context_t *context, em_value_t *args, size_t nargs, em_pos_t *pos) {
+
+	const em_wchar_t *path;
+
+	if (em_util_parse_args(pos, args, nargs, "Wv*", &path, NULL) != EM_RESULT_SUCCESS)
+		return EM_VALUE_FAIL;
+	if (nargs-1 > EM_FUNCTION_MAX_ARGUMENTS) {
+
+		em_log_runtime_error(pos, "Too many arguments");
+		return EM_VALUE_FAIL;
+	}
+
+	/* resolve path here, where the directory of the calling file is known */
+	em_wpath_fix(pathbuf, PATHBUFSZ, path);
+	const char *rpath = em_context_resolve(context, pathbuf);
+	if (!rpath) {
+
+		em_log_runtime_error(pos, "No such file or directory: '%s'", pathbuf);
+		return EM_VALUE_FAIL;
+	}
+
+	size_t len = strlen(rpath);
+	worker_t *worker = malloc(sizeof(worker_t)+len+1);
+	if (!worker) {
+
+		em_log_runtime_error(pos, "Out of memory");
+		return EM_VALUE_FAIL;
+	}
+	memset(worker, 0, sizeof(worker_t));
+	memcpy(worker->path, rpath, len+1);
+
+	/* copy arguments as list */
+	unsigned char tag = TAG_LIST;
+	size_t count = nargs-1;
+
+	em_bool_t ok = message_write(&worker->args, &tag, sizeof(tag), pos) == EM_RESULT_SUCCESS &&
+		       message_write(&worker->args, &count, sizeof(count), pos) == EM_RESULT_SUCCESS;
+	for (size_t i = 1; ok && i < nargs; i++)
+		ok = encode(&worker->args, args[i], 0, pos) == EM_RESULT_SUCCESS;
+	if (!ok) {
+
+		message_free(&worker->args);
+		free(worker);
+		return EM_VALUE_FAIL;
+	}
+
+	worker->refcnt = 2;
+	worker->mode = context->mode;
+	worker->fold = context->fold;
+	worker->use_jit = context->use_jit;
+	worker->tier = context->tier;
+	pthread_mutex_init(&worker->lock, NULL);
+
+	/* give the thread as much stack as the main thread, which limits recursion the same way */
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+
+	pthread_attr_setstacksize(&attr, em_context_get_stack_size());
+
+	int rc = pthread_create(&worker->thread, &attr, worker_main, worker);
+	pthread_attr_destroy(&attr);
+	if (rc) {
+
+		em_log_runtime_error(pos, "Can't start thread: %s", strerror(rc));
+		pthread_mutex_destroy(&worker->lock);
+		message_free(&worker->args);
+		free(worker);
+		return EM_VALUE_FAIL;
+	}
+
+	em_value_t value = em_object_new(&thread_type, sizeof(thread_object_t));
+	thread_object_t *object = THREAD_OBJECT(EM_OBJECT_FROM_VALUE(value));
+
+	EM_REFOBJ(object)->free = thread_object_free;
+	object->worker = worker;
+	return value;
+}
+
+/* wait for thread and get result */
+static em_value_t thread_join(em_context_t *context, em_value_t *args, size_t nargs, em_pos_t *pos) {
+
+	em_value_t value;
+
+	if (em_util_parse_args(pos, args, nargs, "o", &value) != EM_RESULT_SUCCESS)
+		return EM_VALUE_FAIL;
+	if (!is_thread(value)) {
+
+		em_log_runtime_error(pos, "Expected thread");
+		return EM_VALUE_FAIL;
+	}
+
+	worker_t *worker = THREAD_OBJECT(EM_OBJECT_FROM_VALUE(value))->worker;
+	if (worker->joined) {
+
+		em_log_runtime_error(pos, "Thread has already been joined");
+		return EM_VALUE_FAIL;
+	}
+	pthread_join(worker->thread, NULL);
+	worker->joined = EM_TRUE;
+
+	if (worker->failed) {
+
+		em_log_runtime_error(pos, "Thread '%s' failed", worker->path);
+		return EM_VALUE_FAIL;
+	}
+	return decode(&worker->result);
+}
+
+/* create channel */
+static em_value_t thread_Channel(em_context_t *context, em_value_t *args, size_t nargs, em_pos_t *pos) {
+
+	em_inttype_t capacity = CHANNEL_CAPACITY;
+
+	if (nargs && em_util_parse_args(pos, args, nargs, "i", &capacity) != EM_RESULT_SUCCESS)
+		return EM_VALUE_FAIL;
+	if (capacity < 1) {
+
+		em_log_runtime_error(pos, "Channel capacity must be at least 1");
+		return EM_VALUE_FAIL;
+	}
+
+	channel_t *channel = malloc(sizeof(channel_t) + (size_t)capacity * sizeof(message_t));
+	if (!channel) {
+
+		em_log_runtime_error(pos, "Out of memory");
+		return EM_VALUE_FAIL;
+	}
+	pthread_mutex_init(&channel->lock, NULL);
+	pthread_cond_init(&channel->not_empty, NULL);
+	pthread_cond_init(&channel->not_full, NULL);
+	channel->refcnt = 0;
+	channel->nqueued = 0;
+	channel->closed = EM_FALSE;
+	channel->capacity = (size_t)capacity;
+	channel->count = 0;
+	channel->head = 0;
+
+	pthread_mutex_lock(&channels_lock);
+	channel->prev = NULL;
+	channel->next = channels;
+	if (channels) channels->prev = channel;
+	channels = channel;
+	pthread_mutex_unlock(&channels_lock);
+
+	return channel_object_new(channel);
+}
+
+/* get channel argument */
+static channel_t *get_channel(em_value_t *args, size_t nargs, const char *format, em_value_t *value, em_pos_t *pos) {
+
+	em_value_t object;
+
+	if (em_util_parse_args(pos, args, nargs, format, &object, value) != EM_RESULT_SUCCESS)
+		return NULL;
+	if (!is_channel(object)) {
+
+		em_log_runtime_error(pos, "Expected channel");
+		return NULL;
+	}
+	return CHANNEL_OBJECT(EM_OBJECT_FROM_VALUE(object))->channel;
+}
+
+/* send copy of value, waiting while channel is full */
+static em_value_t thread_send(em_context_t *context, em_value_t *args, size_t nargs, em_pos_t *pos) {
+
+	em_value_t value;
+
+	channel_t *channel = get_channel(args, nargs, "ov", &value, pos);
+	if (!channel) return EM_VALUE_FAIL;
+
+	message_t msg = MESSAGE_INIT;
+	if (encode(&msg, value, 0, pos) != EM_RESULT_SUCCESS) {
+
+		message_free(&msg);
+		return EM_VALUE_FAIL;
+	}
+
+	pthread_mutex_lock(&channel->lock);
+	while (channel->count == channel->capacity && !channel->closed)
+		pthread_cond_wait(&channel->not_full, &channel->lock);
+
+	if (channel->closed) {
+
+		pthread_mutex_unlock(&channel->lock);
+		message_free(&msg);
+		em_log_runtime_error(pos, "Channel is closed");
+		return EM_VALUE_FAIL;
+	}
+	pthread_mutex_lock(&channels_lock);
+	message_set_queued(&msg, EM_TRUE);
+	channel->messages[(channel->head + channel->count++) % channel->capacity] = msg;
+	pthread_mutex_unlock(&channels_lock);
+
+	pthread_cond_signal(&channel->not_empty);
+	pthread_mutex_unlock(&channel->lock);
+	return em_none;
+}
+
+/* receive value, waiting while channel is empty (none once channel is closed and empty) */
+static em_value_t thread_receive(em_context_t *context, em_value_t *args, size_t nargs, em_pos_t *pos) {
+
+	channel_t *channel = get_channel(args, nargs, "o", NULL, pos);
+	if (!channel) return EM_VALUE_FAIL;
+
+	pthread_mutex_lock(&channel->lock);
+	while (!channel->count && !channel->closed)
+		pthread_cond_wait(&channel->not_empty, &channel->lock);
+
+	if (!channel->count) {
+
+		pthread_mutex_unlock(&channel->lock);
+		return em_none;
+	}
+	pthread_mutex_lock(&channels_lock);
+	message_t msg = channel->messages[channel->head];
+	message_set_queued(&msg, EM_FALSE);
+	channel->head = (channel->head + 1) % channel->capacity;
+	channel->count--;
+	pthread_mutex_unlock(&channels_lock);
+
+	pthread_cond_signal(&channel->not_full);
+	pthread_mutex_unlock(&channel->lock);
+
+	em_value_t value = decode(&msg);
+	message_free(&msg);
+	return value;
+}
+
+/* close channel, waking any threads waiting on it */
+static em_value_t thread_close(em_context_t *context, em_value_t *args, size_t nargs, em_pos_t *pos) {
+
+	channel_t *channel = get_channel(args, nargs, "o", NULL, pos);
+	if (!channel) return EM_VALUE_FAIL;
+
+	pthread_mutex_lock(&channel->lock);
+	channel->closed = EM_TRUE;
+	pthread_cond_broadcast(&channel->not_empty);
+	pthread_cond_broadcast(&channel->not_full);
+	pthread_mutex_unlock(&channel->lock);
+	return em_none;
+}
+
+/* initialize module */
+static em_result_t initialize(em_context_t *context, em_value_t map) {
+
+	em_value_t mod = em_map_new();
+	em_util_set_value(map, "__module_thread", mod);
+
+	em_util_set_function(mod, "spawn", thread_spawn);
+	em_util_set_function(mod, "join", thread_join);
+
+	em_util_set_function(mod, "Channel", thread_Channel);
+	em_util_set_function(mod, "send", thread_send);
+	em_util_set_function(mod, "receive", thread_receive);
+	em_util_set_function(mod, "close", thread_close);
+
+	return EM_RESULT_SUCCESS;
+}
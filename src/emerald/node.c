@@ -7,7 +7,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <emerald/core.h>
+#include <emerald/memory.h>
+#include <emerald/hash.h>
 #include <emerald/node.h>
+#include <emerald/source.h>
 
 /* node type names */
 static const char *typenames[EM_NODE_TYPE_COUNT] = {
@@ -39,36 +42,72 @@ static const char *typenames[EM_NODE_TYPE_COUNT] = {
 	"PUTS",
 };
 
-/* free callback */
-static void node_free(void *p) {
+#define BLOCK_MIN 4096 /* size of first block of tree */
+#define BLOCK_MAX 65536 /* size that blocks stop doubling at */
+
+/* allocate memory from blocks */
+static void *block_alloc(em_tree_block_t **blocks, size_t size) {
+
+	size = EM_ALIGN(size, sizeof(void *));
+
+	em_tree_block_t *block = *blocks;
+	if (!block || block->size - block->used < size) {
+
+		size_t bsize = block? EM_MIN(block->size * 2, BLOCK_MAX): BLOCK_MIN;
+		if (bsize < size) bsize = size;
 
-	em_node_t *node = EM_NODE(p);
+		em_tree_block_t *new = em_malloc(sizeof(em_tree_block_t) + bsize);
+		if (!new) return NULL;
 
-	if (node->parent) {
-		 if (node->parent->first == node) node->parent->first = node->next;
-		 if (node->parent->last == node) node->parent->last = node->prev;
+		new->prev = block;
+		new->size = bsize;
+		new->used = 0;
+		*blocks = block = new;
 	}
-	if (node->prev) node->prev->next = node->next;
-	if (node->next) node->next->prev = node->prev;
+	void *p = block->data + block->used;
+	block->used += size;
+	return p;
+}
+
+/* grow memory from blocks, in place if it was the last given out */
+static void *block_grow(em_tree_block_t **blocks, void *p, size_t size, size_t newsize) {
+
+	size = EM_ALIGN(size, sizeof(void *));
+	newsize = EM_ALIGN(newsize, sizeof(void *));
 
-	/* unreference relatives */
-	em_node_t *cur = node->first;
-	while (cur) {
+	em_tree_block_t *block = *blocks;
+	if (p && block && (char *)p + size == block->data + block->used &&
+	    newsize - size <= block->size - block->used) {
 
-		em_node_t *next = cur->next;
-		EM_NODE_DECREF(cur);
-		cur = next;
+		block->used += newsize - size;
+		return p;
 	}
-	
-	/* unreference tokens */
-	em_generic_result_t res = {.p = EM_TRUE};
-	for (size_t i = 0; i < node->tokens.nitems && res.p; i++) {
+	void *new = block_alloc(blocks, newsize);
+	if (new && size) memcpy(new, p, size);
+	return new;
+}
+
+/* free blocks */
+static void block_free(em_tree_block_t *block) {
 
-		res = em_array_get(&node->tokens, i);
-		if (res.p) EM_TOKEN_DECREF((em_token_t *)res.v.t_voidp);
+	while (block) {
+
+		em_tree_block_t *prev = block->prev;
+		em_free(block);
+		block = prev;
 	}
-	em_array_destroy(&node->values);
-	em_array_destroy(&node->tokens);
+}
+
+/* free callback */
+static void tree_free(void *p) {
+
+	em_tree_t *tree = EM_TREE(p);
+
+	block_free(tree->blocks);
+	block_free(tree->scratch);
+	em_free(tree->children);
+
+	em_source_decref(tree->source);
 }
 
 /* get name from type */
@@ -79,36 +118,85 @@ EM_API const char *em_get_node_type_name(em_node_type_t type) {
 	return typenames[type];
 }
 
-/* create node */
-EM_API em_node_t *em_node_new(em_node_type_t type, em_pos_t *pos) {
+/* create tree */
+EM_API em_tree_t *em_tree_new(em_source_t *source) {
 
-	em_node_t *node = EM_NODE(em_refobj_new(&em_reflist_node, sizeof(em_node_t), EM_CLEANUP_MODE_IMMEDIATE));
-	if (!node) return NULL;
+	em_tree_t *tree = EM_TREE(em_refobj_new(&em_reflist_tree, sizeof(em_tree_t), EM_CLEANUP_MODE_IMMEDIATE));
+	if (!tree) return NULL;
 
-	EM_NODE_INCREF(node);
-	EM_REFOBJ(node)->free = node_free;
+	EM_TREE_INCREF(tree);
+	EM_REFOBJ(tree)->free = tree_free;
 
-	node->type = type;
-	memcpy(&node->pos, pos, sizeof(node->pos));
-	node->flags = 0;
-	node->parent = NULL;
-	node->first = NULL;
-	node->last = NULL;
-	node->prev = NULL;
-	node->next = NULL;
-	node->tokens = EM_ARRAY_INIT;
-	node->values = EM_ARRAY_INIT;
+	tree->source = em_source_incref(source);
+	tree->blocks = NULL;
+	tree->scratch = NULL;
+	tree->children = NULL;
+	tree->parsed = EM_FALSE;
 
-	if (em_array_init(&node->tokens) != EM_RESULT_SUCCESS) {
+	return tree;
+}
 
-		EM_NODE_DECREF(node);
-		return NULL;
-	}
-	if (em_array_init(&node->values) != EM_RESULT_SUCCESS) {
+/* count children of nodes under node */
+static size_t count_children(em_node_t *node) {
 
-		EM_NODE_DECREF(node);
-		return NULL;
-	}
+	size_t count = node->nchildren;
+	for (uint32_t i = 0; i < node->nchildren; i++)
+		count += count_children(node->children[i]);
+	return count;
+}
+
+/* copy children of nodes under node into array */
+static em_node_t **copy_children(em_node_t *node, em_node_t **p) {
+
+	if (node->nchildren) memcpy(p, node->children, node->nchildren * sizeof(em_node_t *));
+	node->children = p;
+	p += node->nchildren;
+
+	for (uint32_t i = 0; i < node->nchildren; i++)
+		p = copy_children(node->children[i], p);
+	return p;
+}
+
+/* move children of nodes under root into one array */
+EM_API void em_tree_layout(em_tree_t *tree, em_node_t *root) {
+
+	if (!tree || !root || tree->parsed) return;
+	tree->parsed = EM_TRUE;
+
+	size_t count = count_children(root);
+	if (!count) return;
+
+	/* ranges stay where they are if there's no room for them */
+	em_node_t **children = em_malloc(count * sizeof(em_node_t *));
+	if (!children) return;
+
+	copy_children(root, children);
+	tree->children = children;
+
+	block_free(tree->scratch);
+	tree->scratch = NULL;
+}
+
+/* create node */
+EM_API em_node_t *em_node_new(em_tree_t *tree, em_node_type_t type, uint32_t offset) {
+
+	em_node_t *node = block_alloc(&tree->blocks, sizeof(em_node_t));
+	if (!node) return NULL;
+
+	node->type = (uint8_t)type;
+	node->op = EM_NODE_OP_NONE;
+	node->flags = 0;
+	node->offset = offset;
+	node->tree = tree;
+	node->children = NULL;
+	node->nchildren = 0;
+	node->ntokens = 0;
+	node->nvalues = 0;
+	node->tokens = NULL;
+	node->value = (em_generic_t){0};
+	node->values = NULL;
+	node->handler = NULL;
+	node->constant = EM_VALUE_FAIL;
 
 	return node;
 }
@@ -116,54 +204,215 @@ EM_API em_node_t *em_node_new(em_node_type_t type, em_pos_t *pos) {
 /* add child node */
 EM_API void em_node_add_child(em_node_t *node, em_node_t *child) {
 
-	if (!node || !child) return;
+	if (!node || !child || node->nchildren == UINT32_MAX) return;
+
+	em_tree_t *tree = node->tree;
+	uint32_t n = node->nchildren;
 
-	child->prev = node->last;
-	if (!node->first) node->first = child;
-	if (node->last) node->last->next = child;
-	node->last = child;
+	/* ranges double in size while parsing, and are full once laid out */
+	if (tree->parsed || !(n & (n-1))) {
 
-	child->parent = node;
+		size_t cap = tree->parsed? n+1: (n? n*2: 1);
+		em_node_t **children = block_grow(tree->parsed? &tree->blocks: &tree->scratch,
+			node->children, n * sizeof(em_node_t *), cap * sizeof(em_node_t *));
+		if (!children) return;
 
-	EM_NODE_INCREF(child);
+		node->children = children;
+	}
+	node->children[node->nchildren++] = child;
 }
 
-/* add token */
+/* add text as token */
+EM_API void em_node_add_text(em_node_t *node, const char *value, size_t length, uint32_t offset) {
+
+	if (!node || node->ntokens == UINT16_MAX || length > UINT32_MAX) return;
+
+	em_tree_t *tree = node->tree;
+	size_t n = node->ntokens;
+
+	em_node_token_t *tokens = block_grow(&tree->blocks, node->tokens,
+		n * sizeof(em_node_token_t), (n+1) * sizeof(em_node_token_t));
+	if (!tokens) return;
+	node->tokens = tokens;
+
+	char *copy = block_alloc(&tree->blocks, length+1);
+	if (!copy) return;
+
+	memcpy(copy, value, length);
+	copy[length] = 0;
+
+	tokens[n].value = copy;
+	tokens[n].length = (uint32_t)length;
+	tokens[n].offset = offset;
+	node->ntokens++;
+}
+
+/* add copy of token */
 EM_API void em_node_add_token(em_node_t *node, em_token_t *token) {
 
 	if (!node || !token) return;
 
-	em_generic_t value = {.t_voidp = token};
-	(void)em_array_add(&node->tokens, value);
+	em_node_add_text(node, token->value, token->length, token->pos.offset);
+}
+
+/* resolve operator from token */
+static em_node_op_t get_operator(em_node_type_t type, em_token_t *token) {
+
+	if (type == EM_NODE_TYPE_UNARY_OPERATION) {
+		switch (token->type) {
+			case EM_TOKEN_TYPE_PLUS: return EM_NODE_OP_POSITIVE;
+			case EM_TOKEN_TYPE_MINUS: return EM_NODE_OP_NEGATIVE;
+			case EM_TOKEN_TYPE_BITWISE_NOT: return EM_NODE_OP_BITWISE_NOT;
+			case EM_TOKEN_TYPE_KEYWORD:
+				if (!strcmp(token->value, "not")) return EM_NODE_OP_NOT;
+				return EM_NODE_OP_NONE;
+			default: return EM_NODE_OP_NONE;
+		}
+	}
+	switch (token->type) {
+		case EM_TOKEN_TYPE_PLUS: return EM_NODE_OP_ADD;
+		case EM_TOKEN_TYPE_MINUS: return EM_NODE_OP_SUBTRACT;
+		case EM_TOKEN_TYPE_ASTERISK: return EM_NODE_OP_MULTIPLY;
+		case EM_TOKEN_TYPE_SLASH: return EM_NODE_OP_DIVIDE;
+		case EM_TOKEN_TYPE_MODULO: return EM_NODE_OP_MODULO;
+		case EM_TOKEN_TYPE_BITWISE_OR: return EM_NODE_OP_BITWISE_OR;
+		case EM_TOKEN_TYPE_BITWISE_XOR: return EM_NODE_OP_BITWISE_XOR;
+		case EM_TOKEN_TYPE_BITWISE_AND: return EM_NODE_OP_BITWISE_AND;
+		case EM_TOKEN_TYPE_BITWISE_LEFT_SHIFT: return EM_NODE_OP_SHIFT_LEFT;
+		case EM_TOKEN_TYPE_BITWISE_RIGHT_SHIFT: return EM_NODE_OP_SHIFT_RIGHT;
+		case EM_TOKEN_TYPE_DOUBLE_EQUALS: return EM_NODE_OP_EQUAL;
+		case EM_TOKEN_TYPE_NOT_EQUALS: return EM_NODE_OP_NOT_EQUAL;
+		case EM_TOKEN_TYPE_LESS_THAN: return EM_NODE_OP_LESS_THAN;
+		case EM_TOKEN_TYPE_LESS_THAN_EQUALS: return EM_NODE_OP_LESS_THAN_EQUAL;
+		case EM_TOKEN_TYPE_GREATER_THAN: return EM_NODE_OP_GREATER_THAN;
+		case EM_TOKEN_TYPE_GREATER_THAN_EQUALS: return EM_NODE_OP_GREATER_THAN_EQUAL;
+		case EM_TOKEN_TYPE_KEYWORD:
+			if (!strcmp(token->value, "and")) return EM_NODE_OP_AND;
+			if (!strcmp(token->value, "or")) return EM_NODE_OP_OR;
+			return EM_NODE_OP_NONE;
+		default: return EM_NODE_OP_NONE;
+	}
+}
+
+/* add operator token and resolve operator */
+EM_API void em_node_set_operator(em_node_t *node, em_token_t *token) {
 
-	EM_TOKEN_INCREF(token);
+	if (!node || !token) return;
+
+	em_node_add_token(node, token);
+	node->op = get_operator(node->type, token);
 }
 
 /* add generic value */
 EM_API void em_node_add_value(em_node_t *node, em_generic_t value) {
 
-	if (!node) return;
+	if (!node || node->nvalues == UINT16_MAX) return;
+
+	if (node->nvalues) {
 
-	(void)em_array_add(&node->values, value);
+		size_t n = node->nvalues-1;
+		em_generic_t *values = block_grow(&node->tree->blocks, node->values,
+			n * sizeof(em_generic_t), (n+1) * sizeof(em_generic_t));
+		if (!values) return;
+
+		node->values = values;
+		node->values[n] = value;
+	}
+	else node->value = value;
+
+	node->nvalues++;
 }
 
 /* get token */
-EM_API em_token_t *em_node_get_token(em_node_t *node, size_t index) {
-
-	if (!node) return NULL;
+EM_API em_node_token_t *em_node_get_token(em_node_t *node, size_t index) {
 
-	em_generic_result_t res = em_array_get(&node->tokens, index);
-	if (!res.p) return NULL;
+	if (!node || index >= node->ntokens) return NULL;
 
-	return (em_token_t *)res.v.t_voidp;
+	return &node->tokens[index];
 }
 
 /* get value */
 EM_API em_generic_result_t em_node_get_value(em_node_t *node, size_t index) {
 
-	if (!node) return (em_generic_result_t){.p = EM_FALSE};
+	if (!node || index >= node->nvalues) return (em_generic_result_t){.p = EM_FALSE};
 
-	return em_array_get(&node->values, index);
+	return (em_generic_result_t){.v = index? node->values[index-1]: node->value, .p = EM_TRUE};
+}
+
+/* check if token names variable */
+static em_bool_t token_is_name(em_node_token_t *token, em_hash_t hash) {
+
+	return token && em_utf8_strhash(token->value) == hash;
+}
+
+/* check how a variable name is used in tree */
+EM_API uint32_t em_node_get_name_usage(em_node_t *node, em_hash_t hash) {
+
+	uint32_t usage = 0;
+
+	switch (node->type) {
+		/* cannot run code outside of the tree */
+		case EM_NODE_TYPE_BLOCK:
+		case EM_NODE_TYPE_INT:
+		case EM_NODE_TYPE_FLOAT:
+		case EM_NODE_TYPE_STRING:
+		case EM_NODE_TYPE_LIST:
+		case EM_NODE_TYPE_MAP:
+		case EM_NODE_TYPE_IF:
+		case EM_NODE_TYPE_WHILE:
+		case EM_NODE_TYPE_CONTINUE:
+		case EM_NODE_TYPE_BREAK:
+			break;
+
+		case EM_NODE_TYPE_IDENTIFIER:
+			if (em_node_get_value(node, 0).v.te_hash == hash)
+				usage |= EM_NODE_NAME_READ;
+			break;
+
+		/* member and index definitions don't redefine the name, but may run methods */
+		case EM_NODE_TYPE_LET:
+			if (node->ntokens > 1 || node->nchildren > 1)
+				usage |= EM_NODE_NAME_READ;
+			else if (em_node_get_value(node, 0).v.te_hash == hash)
+				usage |= EM_NODE_NAME_WRITTEN;
+			break;
+
+		case EM_NODE_TYPE_FOR:
+		case EM_NODE_TYPE_FOREACH:
+			if (em_node_get_value(node, 0).v.te_hash == hash)
+				usage |= EM_NODE_NAME_WRITTEN;
+			break;
+
+		/* functions run in their own scope when called */
+		case EM_NODE_TYPE_FUNC:
+			if (node->flags && token_is_name(em_node_get_token(node, 0), hash))
+				usage |= EM_NODE_NAME_WRITTEN;
+			return usage;
+
+		case EM_NODE_TYPE_CLASS:
+			usage |= EM_NODE_NAME_READ;
+			if (token_is_name(em_node_get_token(node, 0), hash))
+				usage |= EM_NODE_NAME_WRITTEN;
+			break;
+
+		case EM_NODE_TYPE_TRY:
+			if (token_is_name(em_node_get_token(node, 0), hash))
+				usage |= EM_NODE_NAME_WRITTEN;
+			break;
+
+		/* included files share the scope */
+		case EM_NODE_TYPE_INCLUDE:
+			return EM_NODE_NAME_READ | EM_NODE_NAME_WRITTEN;
+
+		/* calls, operators on objects and printing may run any function */
+		default:
+			usage |= EM_NODE_NAME_READ;
+			break;
+	}
+
+	for (uint32_t i = 0; i < node->nchildren; i++)
+		usage |= em_node_get_name_usage(node->children[i], hash);
+	return usage;
 }
 
 /* print node information */
@@ -173,27 +422,22 @@ static void print_node(em_node_t *node, int level) {
 	printf("<%s:%u", em_get_node_type_name(node->type), node->flags);
 
 	/* include tokens */
-	if (node->tokens.nitems) {
+	if (node->ntokens) {
 
 		printf(" (");
-		for (size_t i = 0; i < node->tokens.nitems; i++) {
+		for (size_t i = 0; i < node->ntokens; i++) {
 
 			if (i) printf(", ");
 
-			em_token_t *token = em_node_get_token(node, i);
-			printf("%s:'%s'", em_get_token_type_name(token->type), token->value);
+			printf("'%s'", em_node_get_token(node, i)->value);
 		}
 		printf(")");
 	}
 	printf(">\n");
 
 	/* include children */
-	em_node_t *cur = node->first;
-	while (cur) {
-
-		print_node(cur, level+2);
-		cur = cur->next;
-	}
+	for (uint32_t i = 0; i < node->nchildren; i++)
+		print_node(node->children[i], level+2);
 }
 
 EM_API void em_node_print(em_node_t *node) {
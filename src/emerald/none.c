@@ -40,8 +40,14 @@ static em_value_t to_string(em_value_t v, em_pos_t *pos) {
 	return em_string_new_from_utf8("none", 4);
 }
 
-/* create none */
+/* there is only one none, and it is never freed */
+static em_object_t none = {
+	.base = {.mode = EM_CLEANUP_MODE_IMMORTAL},
+	.type = &type,
+};
+
+/* get none */
 EM_API em_value_t em_none_new(void) {
 
-	return em_object_new(&type, sizeof(em_object_t));
+	return EM_OBJECT_AS_VALUE(&none);
 }
@@ -10,6 +10,11 @@
 #include <emerald/hash.h>
 #include <emerald/parser.h>
 
+/* raise syntax error, unless the lexer has raised one and handed out the end of the file */
+#define SYNTAX_ERROR(parser, ...) do {\
+		if (!(parser)->lexer->error) em_log_syntax_error(__VA_ARGS__);\
+	} while (0)
+
 /* check if token is in list of match pairs */
 static em_bool_t is_token_in(em_token_t *token, em_token_pair_t *pairs, size_t npairs) {
 
@@ -31,34 +36,42 @@ EM_API em_result_t em_parser_init(em_parser_t *parser) {
 	if (!parser || parser->init)
 		return EM_RESULT_FAILURE;
 
+	parser->lexer = NULL;
 	parser->token = NULL;
 	parser->node = NULL;
+	parser->tree = NULL;
 	parser->init = EM_TRUE;
 
 	return EM_RESULT_SUCCESS;
 }
 
 /* reset parser */
-EM_API void em_parser_reset(em_parser_t *parser, em_token_t *token) {
+EM_API void em_parser_reset(em_parser_t *parser, em_lexer_t *lexer) {
 
-	parser->token = token;
-	if (parser->node) EM_NODE_DECREF(parser->node);
+	if (parser->token) EM_TOKEN_DECREF(parser->token);
+	if (parser->tree) EM_TREE_DECREF(parser->tree);
 
+	parser->lexer = lexer;
+	parser->token = em_lexer_next(lexer);
 	parser->node = NULL;
+	parser->tree = NULL;
 }
 
 /* advance parser */
 EM_API void em_parser_advance(em_parser_t *parser) {
 
-	if (!parser->token) return;
+	if (!parser->token || parser->token->type == EM_TOKEN_TYPE_EOF) return;
 
-	parser->token = parser->token->next;
+	EM_TOKEN_DECREF(parser->token);
+	parser->token = em_lexer_next(parser->lexer);
 }
 
 /* parse tokens */
 EM_API em_result_t em_parser_parse(em_parser_t *parser) {
 
-	parser->node = em_node_new(EM_NODE_TYPE_BLOCK, &parser->token->pos);
+	if (!(parser->tree = em_tree_new(parser->lexer->source)))
+		return EM_RESULT_FAILURE;
+	parser->node = em_node_new(parser->tree, EM_NODE_TYPE_BLOCK, parser->token->pos.offset);
 
 	while (parser->token->type != EM_TOKEN_TYPE_EOF) {
 
@@ -67,6 +80,9 @@ EM_API em_result_t em_parser_parse(em_parser_t *parser) {
 
 		em_node_add_child(parser->node, statement);
 	}
+	if (parser->lexer->error) return EM_RESULT_FAILURE;
+
+	em_tree_layout(parser->tree, parser->node);
 	return EM_RESULT_SUCCESS;
 }
 
@@ -74,19 +90,20 @@ EM_API em_result_t em_parser_parse(em_parser_t *parser) {
 EM_API em_node_t *em_parser_statement(em_parser_t *parser) {
 
 	em_token_t *token = parser->token;
+	em_pos_t pos = token->pos; /* token is released once the parser moves past it */
 
 	/* continue */
 	if (em_token_matches(token, EM_TOKEN_TYPE_KEYWORD, "continue")) {
 
 		em_parser_advance(parser);
-		return em_node_new(EM_NODE_TYPE_CONTINUE, &token->pos);
+		return em_node_new(parser->tree, EM_NODE_TYPE_CONTINUE, pos.offset);
 	}
 
 	/* break */
 	else if (em_token_matches(token, EM_TOKEN_TYPE_KEYWORD, "break")) {
 
 		em_parser_advance(parser);
-		return em_node_new(EM_NODE_TYPE_BREAK, &token->pos);
+		return em_node_new(parser->tree, EM_NODE_TYPE_BREAK, pos.offset);
 	}
 
 	/* return value */
@@ -97,7 +114,7 @@ EM_API em_node_t *em_parser_statement(em_parser_t *parser) {
 		em_node_t *expr = em_parser_expr(parser);
 		if (!expr) return NULL;
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_RETURN, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_RETURN, pos.offset);
 		em_node_add_child(node, expr);
 
 		return node;
@@ -111,7 +128,7 @@ EM_API em_node_t *em_parser_statement(em_parser_t *parser) {
 		em_node_t *expr = em_parser_expr(parser);
 		if (!expr) return NULL;
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_RAISE, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_RAISE, pos.offset);
 		em_node_add_child(node, expr);
 
 		return node;
@@ -125,7 +142,7 @@ EM_API em_node_t *em_parser_statement(em_parser_t *parser) {
 		em_node_t *expr = em_parser_expr(parser);
 		if (!expr) return NULL;
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_INCLUDE, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_INCLUDE, pos.offset);
 		em_node_add_child(node, expr);
 
 		return node;
@@ -143,15 +160,14 @@ EM_API em_node_t *em_parser_binop(em_parser_t *parser, em_node_t *(*func)(em_par
 
 	while (is_token_in(parser->token, pairs, npairs)) {
 
-		em_token_t *op = parser->token;
+		em_node_t *new = em_node_new(parser->tree, EM_NODE_TYPE_BINARY_OPERATION, left->offset);
+		em_node_add_child(new, left);
+		em_node_set_operator(new, parser->token);
 		em_parser_advance(parser);
 
 		em_node_t *right = func(parser);
-		if (!right) { EM_NODE_DECREF(left); return NULL; }
+		if (!right) return NULL;
 
-		em_node_t *new = em_node_new(EM_NODE_TYPE_BINARY_OPERATION, &left->pos);
-		em_node_add_child(new, left);
-		em_node_add_token(new, op);
 		em_node_add_child(new, right);
 
 		left = new;
@@ -215,11 +231,7 @@ EM_API em_node_t *em_parser_call(em_parser_t *parser) {
 		em_bool_t error = EM_FALSE;
 		em_node_t *new = em_parser_call_extension(parser, next, &error);
 
-		if (!new && error) {
-			
-			EM_NODE_DECREF(next);
-			return NULL;
-		}
+		if (!new && error) return NULL;
 		prev = next;
 		next = new;
 	}
@@ -236,7 +248,7 @@ EM_API em_node_t *em_parser_call_extension(em_parser_t *parser, em_node_t *facto
 
 		em_parser_advance(parser);
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_CALL, &factor->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_CALL, factor->offset);
 		em_node_add_child(node, factor);
 
 		/* arguments */
@@ -246,7 +258,6 @@ EM_API em_node_t *em_parser_call_extension(em_parser_t *parser, em_node_t *facto
 			if (!expr) {
 
 				*error = EM_TRUE;
-				EM_NODE_DECREF(node);
 				return NULL;
 			}
 			em_node_add_child(node, expr);
@@ -259,7 +270,6 @@ EM_API em_node_t *em_parser_call_extension(em_parser_t *parser, em_node_t *facto
 				if (!expr) {
 
 					*error = EM_TRUE;
-					EM_NODE_DECREF(node);
 					return NULL;
 				}
 				em_node_add_child(node, expr);
@@ -269,9 +279,8 @@ EM_API em_node_t *em_parser_call_extension(em_parser_t *parser, em_node_t *facto
 		/* end */
 		if (parser->token->type != EM_TOKEN_TYPE_CLOSE_PAREN) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected ')'");
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected ')'");
 			*error = EM_TRUE;
-			EM_NODE_DECREF(node);
 			return NULL;
 		}
 		em_parser_advance(parser);
@@ -285,21 +294,19 @@ EM_API em_node_t *em_parser_call_extension(em_parser_t *parser, em_node_t *facto
 		em_parser_advance(parser);
 		if (parser->token->type != EM_TOKEN_TYPE_IDENTIFIER) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected member name after '.'");
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected member name after '.'");
 			*error = EM_TRUE;
 			return NULL;
 		}
-		em_token_t *name = parser->token;
-		em_parser_advance(parser);
-
-		em_node_t *node = em_node_new(EM_NODE_TYPE_ACCESS, &factor->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_ACCESS, factor->offset);
 
 		em_node_add_child(node, factor);
-		em_node_add_token(node, name);
+		em_node_add_token(node, parser->token);
 
-		em_generic_t value = {.te_hash = em_utf8_strhash(name->value)};
+		em_generic_t value = {.te_hash = em_utf8_strhash(parser->token->value)};
 		em_node_add_value(node, value);
 
+		em_parser_advance(parser);
 		return node;
 	}
 
@@ -315,13 +322,13 @@ EM_API em_node_t *em_parser_call_extension(em_parser_t *parser, em_node_t *facto
 		}
 		if (parser->token->type != EM_TOKEN_TYPE_CLOSE_SQUARE_BRACKET) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected ']'");
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected ']'");
 			*error = EM_TRUE;
 			return NULL;
 		}
 		em_parser_advance(parser);
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_ACCESS, &factor->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_ACCESS, factor->offset);
 		em_node_add_child(node, factor);
 		em_node_add_child(node, expr);
 
@@ -332,10 +339,8 @@ EM_API em_node_t *em_parser_call_extension(em_parser_t *parser, em_node_t *facto
 	else return NULL;
 }
 
-/* factor */
-EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
-
-	em_token_t *token = parser->token;
+/* factor starting with token */
+static em_node_t *parse_factor(em_parser_t *parser, em_token_t *token) {
 
 	/* unary operation */
 	em_token_pair_t pairs[] = {
@@ -353,8 +358,8 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 
 		if (!factor) return NULL;
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_UNARY_OPERATION, &token->pos);
-		em_node_add_token(node, token);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_UNARY_OPERATION, token->pos.offset);
+		em_node_set_operator(node, token);
 		em_node_add_child(node, factor);
 
 		return node;
@@ -370,7 +375,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 
 		if (parser->token->type != EM_TOKEN_TYPE_CLOSE_PAREN) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected ')'");
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected ')'");
 			return NULL;
 		}
 		em_parser_advance(parser);
@@ -383,11 +388,11 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 
 		em_parser_advance(parser);
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_LIST, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_LIST, token->pos.offset);
 		if (parser->token->type != EM_TOKEN_TYPE_CLOSE_SQUARE_BRACKET) {
 
 			em_node_t *expr = em_parser_expr(parser);
-			if (!expr) { EM_NODE_DECREF(node); return NULL; }
+			if (!expr) return NULL;
 			em_node_add_child(node, expr);
 
 			while (parser->token->type == EM_TOKEN_TYPE_COMMA) {
@@ -397,7 +402,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 					break;
 
 				expr = em_parser_expr(parser);
-				if (!expr) { EM_NODE_DECREF(node); return NULL; }
+				if (!expr) return NULL;
 				em_node_add_child(node, expr);
 			}
 		}
@@ -405,8 +410,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 		/* end */
 		if (parser->token->type != EM_TOKEN_TYPE_CLOSE_SQUARE_BRACKET) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected ']'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected ']'");
 			return NULL;
 		}
 		em_parser_advance(parser);
@@ -418,23 +422,22 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 
 		em_parser_advance(parser);
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_MAP, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_MAP, token->pos.offset);
 		if (parser->token->type != EM_TOKEN_TYPE_CLOSE_BRACKET) {
 
 			em_node_t *expr = em_parser_expr(parser);
-			if (!expr) { EM_NODE_DECREF(node); return NULL; }
+			if (!expr) return NULL;
 			em_node_add_child(node, expr);
 
 			if (parser->token->type != EM_TOKEN_TYPE_COLON) {
 
-				em_log_syntax_error(&parser->token->pos, "Expected ':'");
-				EM_NODE_DECREF(node);
+				SYNTAX_ERROR(parser, &parser->token->pos, "Expected ':'");
 				return NULL;
 			}
 			em_parser_advance(parser);
 
 			expr = em_parser_expr(parser);
-			if (!expr) { EM_NODE_DECREF(node); return NULL; }
+			if (!expr) return NULL;
 			em_node_add_child(node, expr);
 
 			/* more */
@@ -445,19 +448,18 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 					break;
 
 				expr = em_parser_expr(parser);
-				if (!expr) { EM_NODE_DECREF(node); return NULL; }
+				if (!expr) return NULL;
 				em_node_add_child(node, expr);
 
 				if (parser->token->type != EM_TOKEN_TYPE_COLON) {
 
-					em_log_syntax_error(&parser->token->pos, "Expected ':'");
-					EM_NODE_DECREF(node);
+					SYNTAX_ERROR(parser, &parser->token->pos, "Expected ':'");
 					return NULL;
 				}
 				em_parser_advance(parser);
 
 				expr = em_parser_expr(parser);
-				if (!expr) { EM_NODE_DECREF(node); return NULL; }
+				if (!expr) return NULL;
 				em_node_add_child(node, expr);
 			}
 		}
@@ -465,8 +467,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 		/* end */
 		if (parser->token->type != EM_TOKEN_TYPE_CLOSE_BRACKET) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected '}'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected '}'");
 			return NULL;
 		}
 		em_parser_advance(parser);
@@ -479,7 +480,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 
 		em_parser_advance(parser);
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_INT, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_INT, token->pos.offset);
 		em_node_add_token(node, token);
 
 		return node;
@@ -490,7 +491,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 
 		em_parser_advance(parser);
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_FLOAT, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_FLOAT, token->pos.offset);
 		em_node_add_token(node, token);
 
 		return node;
@@ -501,7 +502,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 
 		em_parser_advance(parser);
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_STRING, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_STRING, token->pos.offset);
 		em_node_add_token(node, token);
 
 		return node;
@@ -512,7 +513,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 
 		em_parser_advance(parser);
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_IDENTIFIER, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_IDENTIFIER, token->pos.offset);
 		em_node_add_token(node, token);
 
 		em_generic_t value = {.te_hash = em_utf8_strhash(token->value)};
@@ -545,19 +546,18 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 		em_node_t *expr = em_parser_expr(parser);
 		if (!expr) return NULL;
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_IF, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_IF, token->pos.offset);
 		em_node_add_child(node, expr);
 
 		if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "then")) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected 'then'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'then'");
 			return NULL;
 		}
 		em_parser_advance(parser);
 
 		/* main body */
-		em_node_t *block = em_node_new(EM_NODE_TYPE_BLOCK, &parser->token->pos);
+		em_node_t *block = em_node_new(parser->tree, EM_NODE_TYPE_BLOCK, parser->token->pos.offset);
 		em_node_add_child(node, block);
 
 		em_token_pair_t pairs[] = {
@@ -568,7 +568,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 		while (!is_token_in(parser->token, pairs, EM_TOKEN_PAIR_COUNT(pairs))) {
 
 			em_node_t *statement = em_parser_statement(parser);
-			if (!statement) { EM_NODE_DECREF(node); return NULL; }
+			if (!statement) return NULL;
 			em_node_add_child(block, statement);
 		}
 
@@ -578,24 +578,23 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 			em_parser_advance(parser);
 
 			expr = em_parser_expr(parser);
-			if (!expr) { EM_NODE_DECREF(node); return NULL; }
+			if (!expr) return NULL;
 			em_node_add_child(node, expr);
 
 			if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "then")) {
 
-				em_log_syntax_error(&parser->token->pos, "Expected 'then'");
-				EM_NODE_DECREF(node);
+				SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'then'");
 				return NULL;
 			}
 			em_parser_advance(parser);
 
-			block = em_node_new(EM_NODE_TYPE_BLOCK, &parser->token->pos);
+			block = em_node_new(parser->tree, EM_NODE_TYPE_BLOCK, parser->token->pos.offset);
 			em_node_add_child(node, block);
 
 			while (!is_token_in(parser->token, pairs, EM_TOKEN_PAIR_COUNT(pairs))) {
 
 				em_node_t *statement = em_parser_statement(parser);
-				if (!statement) { EM_NODE_DECREF(node); return NULL; }
+				if (!statement) return NULL;
 				em_node_add_child(block, statement);
 			}
 		}
@@ -606,19 +605,18 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 			em_parser_advance(parser);
 			if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "then")) {
 
-				em_log_syntax_error(&parser->token->pos, "Expected 'then'");
-				EM_NODE_DECREF(node);
+				SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'then'");
 				return NULL;
 			}
 			em_parser_advance(parser);
 
-			block = em_node_new(EM_NODE_TYPE_BLOCK, &parser->token->pos);
+			block = em_node_new(parser->tree, EM_NODE_TYPE_BLOCK, parser->token->pos.offset);
 			em_node_add_child(node, block);
 
 			while (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
 				em_node_t *statement = em_parser_statement(parser);
-				if (!statement) { EM_NODE_DECREF(node); return NULL; }
+				if (!statement) return NULL;
 				em_node_add_child(block, statement);
 			}
 		}
@@ -626,8 +624,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 		/* end */
 		if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected 'end'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'end'");
 			return NULL;
 		}
 		em_parser_advance(parser);
@@ -642,68 +639,65 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 
 		if (parser->token->type != EM_TOKEN_TYPE_IDENTIFIER) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected iterator name");
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected iterator name");
 			return NULL;
 		}
-		em_token_t *name = parser->token;
-		em_parser_advance(parser);
-
-		em_node_t *node = em_node_new(EM_NODE_TYPE_FOR, &token->pos);
-		em_node_add_token(node, name);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_FOR, token->pos.offset);
+		em_node_add_token(node, parser->token);
 
-		em_generic_t hash_value = {.te_hash = em_utf8_strhash(name->value)};
+		em_generic_t hash_value = {.te_hash = em_utf8_strhash(parser->token->value)};
 		em_node_add_value(node, hash_value);
+		em_parser_advance(parser);
 
 		if (parser->token->type != EM_TOKEN_TYPE_EQUALS) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected '='");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected '='");
 			return NULL;
 		}
 		em_parser_advance(parser);
 
 		em_node_t *start = em_parser_expr(parser);
-		if (!start) { EM_NODE_DECREF(node); return NULL; }
+		if (!start) return NULL;
 		em_node_add_child(node, start);
 
 		if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "to")) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected 'to'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'to'");
 			return NULL;
 		}
 		em_parser_advance(parser);
 
 		em_node_t *end = em_parser_expr(parser);
-		if (!end) { EM_NODE_DECREF(node); return NULL; }
+		if (!end) return NULL;
 		em_node_add_child(node, end);
 
 		if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "then")) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected 'then'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'then'");
 			return NULL;
 		}
 		em_parser_advance(parser);
 
 		/* loop body */
-		em_node_t *block = em_node_new(EM_NODE_TYPE_BLOCK, &parser->token->pos);
+		em_node_t *block = em_node_new(parser->tree, EM_NODE_TYPE_BLOCK, parser->token->pos.offset);
 		em_node_add_child(node, block);
 
 		while (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
 			em_node_t *statement = em_parser_statement(parser);
-			if (!statement) { EM_NODE_DECREF(node); return NULL; }
+			if (!statement) return NULL;
 			em_node_add_child(block, statement);
 		}
 		if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected 'end'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'end'");
 			return NULL;
 		}
 		em_parser_advance(parser);
 
+		/* find out if the iterator has to be kept in sync with the body */
+		node->flags = (uint16_t)em_node_get_name_usage(block, hash_value.te_hash);
+
 		return node;
 	}
 
@@ -713,51 +707,47 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 		em_parser_advance(parser);
 		if (parser->token->type != EM_TOKEN_TYPE_IDENTIFIER) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected iterator name");
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected iterator name");
 			return NULL;
 		}
-		em_token_t *name = parser->token;
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_FOREACH, token->pos.offset);
+		em_node_add_token(node, parser->token);
+
+		em_generic_t hash_value = {.te_hash = em_utf8_strhash(parser->token->value)};
+		em_node_add_value(node, hash_value);
 		em_parser_advance(parser);
 
 		if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "in")) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected 'in'");
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'in'");
 			return NULL;
 		}
 		em_parser_advance(parser);
 
 		em_node_t *expr = em_parser_expr(parser);
 		if (!expr) return NULL;
-
-		em_node_t *node = em_node_new(EM_NODE_TYPE_FOREACH, &token->pos);
-		em_node_add_token(node, name);
 		em_node_add_child(node, expr);
 
-		em_generic_t hash_value = {.te_hash = em_utf8_strhash(name->value)};
-		em_node_add_value(node, hash_value);
-
 		/* body */
 		if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "then")) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected 'then'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'then'");
 			return NULL;
 		}
 		em_parser_advance(parser);
 
-		em_node_t *block = em_node_new(EM_NODE_TYPE_BLOCK, &parser->token->pos);
+		em_node_t *block = em_node_new(parser->tree, EM_NODE_TYPE_BLOCK, parser->token->pos.offset);
 		em_node_add_child(node, block);
 
 		while (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
 			em_node_t *statement = em_parser_statement(parser);
-			if (!statement) { EM_NODE_DECREF(node); return NULL; }
+			if (!statement) return NULL;
 			em_node_add_child(block, statement);
 		}
 		if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected 'end'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'end'");
 			return NULL;
 		}
 		em_parser_advance(parser);
@@ -773,30 +763,28 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 		em_node_t *expr = em_parser_expr(parser);
 		if (!expr) return NULL;
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_WHILE, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_WHILE, token->pos.offset);
 		em_node_add_child(node, expr);
 
 		if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "then")) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected 'then'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'then'");
 			return NULL;
 		}
 		em_parser_advance(parser);
 
-		em_node_t *block = em_node_new(EM_NODE_TYPE_BLOCK, &parser->token->pos);
+		em_node_t *block = em_node_new(parser->tree, EM_NODE_TYPE_BLOCK, parser->token->pos.offset);
 		em_node_add_child(node, block);
 
 		while (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
 			em_node_t *statement = em_parser_statement(parser);
-			if (!statement) { EM_NODE_DECREF(node); return NULL; }
+			if (!statement) return NULL;
 			em_node_add_child(block, statement);
 		}
 		if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected 'end'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'end'");
 			return NULL;
 		}
 		em_parser_advance(parser);
@@ -812,7 +800,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 		em_node_t *expr = em_parser_expr(parser);
 		if (!expr) return NULL;
 
-		em_node_t *node = em_node_new(EM_NODE_TYPE_PUTS, &token->pos);
+		em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_PUTS, token->pos.offset);
 		em_node_add_child(node, expr);
 
 		while (parser->token->type == EM_TOKEN_TYPE_COMMA) {
@@ -820,7 +808,7 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 			em_parser_advance(parser);
 
 			expr = em_parser_expr(parser);
-			if (!expr) { EM_NODE_DECREF(node); return NULL; }
+			if (!expr) return NULL;
 			em_node_add_child(node, expr);
 		}
 
@@ -830,37 +818,46 @@ EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
 	/* end of file */
 	else if (token->type == EM_TOKEN_TYPE_EOF) {
 
-		em_log_syntax_error(&token->pos, "Unexpected end of file");
+		SYNTAX_ERROR(parser, &token->pos, "Unexpected end of file");
 		return NULL;
 	}
 
 	/* other token */
 	else {
 
-		em_log_syntax_error(&token->pos, "Unexpected token '%s'", token->value);
+		SYNTAX_ERROR(parser, &token->pos, "Unexpected token '%s'", token->value);
 		return NULL;
 	}
 }
 
+/* factor */
+EM_API em_node_t *em_parser_factor(em_parser_t *parser) {
+
+	/* hold the first token, which most factors use after moving past it */
+	em_token_t *token = EM_TOKEN_INCREF(parser->token);
+	em_node_t *node = parse_factor(parser, token);
+
+	EM_TOKEN_DECREF(token);
+	return node;
+}
+
 /* variable definition */
 EM_API em_node_t *em_parser_let_statement(em_parser_t *parser) {
 
-	em_token_t *token = parser->token;
+	em_pos_t pos = parser->token->pos;
 
 	em_parser_advance(parser);
 	if (parser->token->type != EM_TOKEN_TYPE_IDENTIFIER) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected variable name");
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected variable name");
 		return NULL;
 	}
-	em_token_t *name = parser->token;
-	em_parser_advance(parser);
-
-	em_node_t *node = em_node_new(EM_NODE_TYPE_LET, &token->pos);
-	em_node_add_token(node, name);
+	em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_LET, pos.offset);
+	em_node_add_token(node, parser->token);
 
-	em_generic_t hash_value = {.te_hash = em_utf8_strhash(name->value)};
+	em_generic_t hash_value = {.te_hash = em_utf8_strhash(parser->token->value)};
 	em_node_add_value(node, hash_value);
+	em_parser_advance(parser);
 
 	/* member accesses */
 	while (parser->token->type == EM_TOKEN_TYPE_DOT) {
@@ -868,8 +865,7 @@ EM_API em_node_t *em_parser_let_statement(em_parser_t *parser) {
 		em_parser_advance(parser);
 		if (parser->token->type != EM_TOKEN_TYPE_IDENTIFIER) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected member name");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected member name");
 			return NULL;
 		}
 		em_node_add_token(node, parser->token);
@@ -886,13 +882,12 @@ EM_API em_node_t *em_parser_let_statement(em_parser_t *parser) {
 		em_parser_advance(parser);
 
 		em_node_t *expr = em_parser_expr(parser);
-		if (!expr) { EM_NODE_DECREF(node); return NULL; }
+		if (!expr) return NULL;
 		em_node_add_child(node, expr);
 
 		if (parser->token->type != EM_TOKEN_TYPE_CLOSE_SQUARE_BRACKET) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected ']'");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected ']'");
 			return NULL;
 		}
 		em_parser_advance(parser);
@@ -901,52 +896,67 @@ EM_API em_node_t *em_parser_let_statement(em_parser_t *parser) {
 	/* value */
 	if (parser->token->type != EM_TOKEN_TYPE_EQUALS) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected '='");
-		EM_NODE_DECREF(node);
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected '='");
 		return NULL;
 	}
 	em_parser_advance(parser);
 
 	em_node_t *value = em_parser_expr(parser);
-	if (!value) { EM_NODE_DECREF(node); return NULL; }
+	if (!value) return NULL;
 
 	em_node_add_child(node, value);
 	return node;
 }
 
+/*
+ * Mark returns of calls in a function body. Nothing in the function runs
+ * after them, so the call can run in place of the function, except inside
+ * of try statements, which have to see errors raised by the call. Nested
+ * functions and classes are marked when they are parsed.
+ */
+static void mark_tail_calls(em_node_t *node) {
+
+	switch (node->type) {
+
+		case EM_NODE_TYPE_RETURN:
+			if (node->children[0]->type == EM_NODE_TYPE_CALL)
+				node->flags |= EM_NODE_RETURN_TAIL;
+			return;
+
+		case EM_NODE_TYPE_FUNC:
+		case EM_NODE_TYPE_CLASS:
+		case EM_NODE_TYPE_TRY:
+			return;
+	}
+	for (uint32_t i = 0; i < node->nchildren; i++)
+		mark_tail_calls(node->children[i]);
+}
+
 /* function definition */
 EM_API em_node_t *em_parser_func_statement(em_parser_t *parser) {
 
-	em_token_t *token = parser->token;
+	em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_FUNC, parser->token->pos.offset);
 	em_parser_advance(parser);
 
-	em_token_t *name = NULL;
 	if (parser->token->type == EM_TOKEN_TYPE_IDENTIFIER) {
 
-		name = parser->token;
+		em_node_add_token(node, parser->token);
+		node->flags = 1;
 		em_parser_advance(parser);
 	}
 
 	if (parser->token->type != EM_TOKEN_TYPE_OPEN_PAREN) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected '('");
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected '('");
 		return NULL;
 	}
 	em_parser_advance(parser);
 
-	em_node_t *node = em_node_new(EM_NODE_TYPE_FUNC, &token->pos);
-	if (name) {
-		
-		em_node_add_token(node, name);
-		node->flags = 1;
-	}
-
 	if (parser->token->type != EM_TOKEN_TYPE_CLOSE_PAREN) {
 
 		if (parser->token->type != EM_TOKEN_TYPE_IDENTIFIER) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected argument name");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected argument name");
 			return NULL;
 		}
 		em_node_add_token(node, parser->token);
@@ -957,8 +967,7 @@ EM_API em_node_t *em_parser_func_statement(em_parser_t *parser) {
 			em_parser_advance(parser);
 			if (parser->token->type != EM_TOKEN_TYPE_IDENTIFIER) {
 
-				em_log_syntax_error(&parser->token->pos, "Expected argument name");
-				EM_NODE_DECREF(node);
+				SYNTAX_ERROR(parser, &parser->token->pos, "Expected argument name");
 				return NULL;
 			}
 			em_node_add_token(node, parser->token);
@@ -967,8 +976,7 @@ EM_API em_node_t *em_parser_func_statement(em_parser_t *parser) {
 	}
 	if (parser->token->type != EM_TOKEN_TYPE_CLOSE_PAREN) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected ')'");
-		EM_NODE_DECREF(node);
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected ')'");
 		return NULL;
 	}
 	em_parser_advance(parser);
@@ -976,78 +984,73 @@ EM_API em_node_t *em_parser_func_statement(em_parser_t *parser) {
 	/* body */
 	if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "then")) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected 'then'");
-		EM_NODE_DECREF(node);
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'then'");
 		return NULL;
 	}
 	em_parser_advance(parser);
 
-	em_node_t *block = em_node_new(EM_NODE_TYPE_BLOCK, &parser->token->pos);
+	em_node_t *block = em_node_new(parser->tree, EM_NODE_TYPE_BLOCK, parser->token->pos.offset);
 	em_node_add_child(node, block);
 
 	while (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
 		em_node_t *statement = em_parser_statement(parser);
-		if (!statement) { EM_NODE_DECREF(node); return NULL; }
+		if (!statement) return NULL;
 		em_node_add_child(block, statement);
 	}
 	if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected 'end'");
-		EM_NODE_DECREF(node);
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'end'");
 		return NULL;
 	}
 	em_parser_advance(parser);
 
+	mark_tail_calls(block);
 	return node;
 }
 
 /* class definition */
 EM_API em_node_t *em_parser_class_statement(em_parser_t *parser) {
 
-	em_token_t *token = parser->token;
+	em_pos_t pos = parser->token->pos;
 	em_parser_advance(parser);
 
 	if (parser->token->type != EM_TOKEN_TYPE_IDENTIFIER) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected class name");
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected class name");
 		return NULL;
 	}
-	em_token_t *name = parser->token;
+	em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_CLASS, pos.offset);
+	em_node_add_token(node, parser->token);
 	em_parser_advance(parser);
 
-	em_node_t *node = em_node_new(EM_NODE_TYPE_CLASS, &token->pos);
-	em_node_add_token(node, name);
-
 	if (em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "of")) {
 
 		em_parser_advance(parser);
 
 		em_node_t *expr = em_parser_expr(parser);
-		if (!expr) { EM_NODE_DECREF(node); return NULL; }
+		if (!expr) return NULL;
 		em_node_add_child(node, expr);
 	}
 	if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "then")) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected 'then'");
-		EM_NODE_DECREF(node);
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'then'");
 		return NULL;
 	}
 	em_parser_advance(parser);
 
-	em_node_t *block = em_node_new(EM_NODE_TYPE_BLOCK, &parser->token->pos);
+	em_node_t *block = em_node_new(parser->tree, EM_NODE_TYPE_BLOCK, parser->token->pos.offset);
 	em_node_add_child(node, block);
 
 	while (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
 		em_node_t *statement = em_parser_statement(parser);
-		if (!statement) { EM_NODE_DECREF(node); return NULL; }
+		if (!statement) return NULL;
 		em_node_add_child(block, statement);
 	}
 	if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected 'end'");
-		EM_NODE_DECREF(node);
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'end'");
 		return NULL;
 	}
 	em_parser_advance(parser);
@@ -1058,30 +1061,29 @@ EM_API em_node_t *em_parser_class_statement(em_parser_t *parser) {
 /* try catch block */
 EM_API em_node_t *em_parser_try_statement(em_parser_t *parser) {
 
-	em_token_t *token = parser->token;
+	em_pos_t pos = parser->token->pos;
 	em_parser_advance(parser);
 
 	if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "then")) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected 'then'");
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'then'");
 		return NULL;
 	}
 	em_parser_advance(parser);
 
-	em_node_t *node = em_node_new(EM_NODE_TYPE_TRY, &token->pos);
-	em_node_t *block = em_node_new(EM_NODE_TYPE_BLOCK, &parser->token->pos);
+	em_node_t *node = em_node_new(parser->tree, EM_NODE_TYPE_TRY, pos.offset);
+	em_node_t *block = em_node_new(parser->tree, EM_NODE_TYPE_BLOCK, parser->token->pos.offset);
 	em_node_add_child(node, block);
 
 	while (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "catch")) {
 
 		em_node_t *statement = em_parser_statement(parser);
-		if (!statement) { EM_NODE_DECREF(node); return NULL; }
+		if (!statement) return NULL;
 		em_node_add_child(block, statement);
 	}
 	if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "catch")) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected 'catch'");
-		EM_NODE_DECREF(node);
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'catch'");
 		return NULL;
 	}
 	em_parser_advance(parser);
@@ -1094,39 +1096,36 @@ EM_API em_node_t *em_parser_try_statement(em_parser_t *parser) {
 
 		if (parser->token->type != EM_TOKEN_TYPE_EQUALS) {
 
-			em_log_syntax_error(&parser->token->pos, "Expected '='");
-			EM_NODE_DECREF(node);
+			SYNTAX_ERROR(parser, &parser->token->pos, "Expected '='");
 			return NULL;
 		}
 		em_parser_advance(parser);
 
 		em_node_t *expr = em_parser_expr(parser);
-		if (!expr) { EM_NODE_DECREF(node); return NULL; }
+		if (!expr) return NULL;
 		em_node_add_child(node, expr);
 	}
 
 	/* catch body */
 	if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "then")) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected 'then'");
-		EM_NODE_DECREF(node);
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'then'");
 		return NULL;
 	}
 	em_parser_advance(parser);
 
-	block = em_node_new(EM_NODE_TYPE_BLOCK, &parser->token->pos);
+	block = em_node_new(parser->tree, EM_NODE_TYPE_BLOCK, parser->token->pos.offset);
 	em_node_add_child(node, block);
 
 	while (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
 		em_node_t *statement = em_parser_statement(parser);
-		if (!statement) { EM_NODE_DECREF(node); return NULL; }
+		if (!statement) return NULL;
 		em_node_add_child(block, statement);
 	}
 	if (!em_token_matches(parser->token, EM_TOKEN_TYPE_KEYWORD, "end")) {
 
-		em_log_syntax_error(&parser->token->pos, "Expected 'end'");
-		EM_NODE_DECREF(node);
+		SYNTAX_ERROR(parser, &parser->token->pos, "Expected 'end'");
 		return NULL;
 	}
 	em_parser_advance(parser);
@@ -1139,6 +1138,7 @@ EM_API void em_parser_destroy(em_parser_t *parser) {
 
 	if (!parser || !parser->init) return;
 
-	if (parser->node) EM_NODE_DECREF(parser->node);
+	if (parser->token) EM_TOKEN_DECREF(parser->token);
+	if (parser->tree) EM_TREE_DECREF(parser->tree);
 	parser->init = EM_FALSE;
 }
@@ -0,0 +1,420 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emerald/core.h>
+#include <emerald/memory.h>
+#include <emerald/bytecode.h>
+#include <emerald/peephole.h>
+
+/*
+ * The fused sequences were picked from operation pair frequencies of the
+ * compiled test programs and standard library (4304 instructions):
+ *
+ *   ESETL/ESETC runs  1777 instructions  -> one ESETL, ESETC or ESETLC
+ *   STOR  POP          108               -> STORP
+ *   LOAD  PCINT BADD   43 / 7            -> LADDI (loop counters)
+ *   Bxx   JNTR          30               -> JNLT, JNGT, JNEQ, JNNEQ
+ *
+ * PNONE POP pairs and jumps to jumps are left behind by the loop and if
+ * statement layouts and are removed or threaded as well.
+ */
+
+#define NO_INDEX ((size_t)-1)
+#define MAX_JUMP_CHAIN 16
+
+/* decoded instruction */
+typedef struct inst {
+	size_t pos; /* position in original slice */
+	size_t size; /* size in original slice */
+	em_code_op_t op; /* operation */
+	size_t target; /* index of target instruction */
+	em_bool_t jump; /* has relative target */
+	em_bool_t label; /* targeted by another instruction */
+	size_t out; /* index of first output instruction at or after this one */
+} inst_t;
+
+/* output instruction */
+typedef struct out {
+	em_code_op_t op; /* operation */
+	size_t src[2]; /* operand positions in original slice */
+	size_t srclen[2]; /* operand lengths */
+	uint8_t imm[3]; /* immediate operand bytes */
+	size_t nimm; /* number of immediate bytes */
+	size_t target; /* index of target instruction */
+	em_bool_t jump; /* has relative target */
+	size_t pos; /* position in new slice */
+} out_t;
+
+/* collected position updates */
+typedef struct eset {
+	em_bool_t has_line, has_column;
+	uint16_t line;
+	uint8_t column;
+} eset_t;
+
+/* check if operation ends with a relative target */
+static em_bool_t has_target(em_code_op_t op) {
+
+	switch (op) {
+		case EM_CODE_OP_JMP:
+		case EM_CODE_OP_JTR:
+		case EM_CODE_OP_JNTR:
+		case EM_CODE_OP_JPNTR:
+		case EM_CODE_OP_BLTJXPIPI:
+		case EM_CODE_OP_JNLT:
+		case EM_CODE_OP_JNGT:
+		case EM_CODE_OP_JNEQ:
+		case EM_CODE_OP_JNNEQ:
+		case EM_CODE_OP_JNLTII:
+		case EM_CODE_OP_JNGTII:
+		case EM_CODE_OP_JNEQII:
+		case EM_CODE_OP_JNNEQII:
+		case EM_CODE_OP_FORPREP:
+		case EM_CODE_OP_FORLOOP:
+		case EM_CODE_OP_DFUNC: /* length of function body */
+			return EM_TRUE;
+		default:
+			return EM_FALSE;
+	}
+}
+
+/* check if operation sets position */
+static em_bool_t is_eset(em_code_op_t op) {
+
+	return op == EM_CODE_OP_ESETL || op == EM_CODE_OP_ESETC || op == EM_CODE_OP_ESETLC;
+}
+
+/* add position update to set */
+static void add_eset(eset_t *eset, const uint8_t *data, const inst_t *inst) {
+
+	const uint8_t *p = data + inst->pos + 1;
+
+	if (inst->op != EM_CODE_OP_ESETC) {
+
+		memcpy(&eset->line, p, 2);
+		eset->has_line = EM_TRUE;
+		p += 2;
+	}
+	if (inst->op != EM_CODE_OP_ESETL) {
+
+		eset->column = *p;
+		eset->has_column = EM_TRUE;
+	}
+}
+
+/* get next non-position instruction, collecting skipped position updates */
+static size_t next_op(inst_t *insts, size_t ninst, const uint8_t *data, size_t i, eset_t *eset) {
+
+	for (i++; i < ninst; i++) {
+
+		if (insts[i].label) return NO_INDEX;
+		if (!is_eset(insts[i].op)) return i;
+		add_eset(eset, data, &insts[i]);
+	}
+	return NO_INDEX;
+}
+
+/* emit collected position updates */
+static void emit_eset(out_t *outs, size_t *nout, const eset_t *eset) {
+
+	if (!eset->has_line && !eset->has_column)
+		return;
+
+	out_t *out = &outs[(*nout)++];
+	memset(out, 0, sizeof(out_t));
+
+	if (eset->has_line) {
+
+		out->op = eset->has_column? EM_CODE_OP_ESETLC: EM_CODE_OP_ESETL;
+		memcpy(out->imm, &eset->line, 2);
+		out->nimm = 2;
+	}
+	else out->op = EM_CODE_OP_ESETC;
+
+	if (eset->has_column)
+		out->imm[out->nimm++] = eset->column;
+}
+
+/* emit instruction, optionally with a different operation */
+static void emit_inst(out_t *outs, size_t *nout, const inst_t *inst, em_code_op_t op) {
+
+	out_t *out = &outs[(*nout)++];
+	memset(out, 0, sizeof(out_t));
+
+	out->op = op;
+	out->src[0] = inst->pos + 1;
+	out->srclen[0] = inst->size - 1;
+
+	if (inst->jump) {
+
+		out->srclen[0] -= 4;
+		out->jump = EM_TRUE;
+		out->target = inst->target;
+	}
+}
+
+/* get position in new slice of original instruction */
+static size_t new_pos(const inst_t *insts, size_t ninst, const out_t *outs, size_t nout, size_t newlength, size_t index) {
+
+	size_t t = index < ninst? insts[index].out: nout;
+	return t < nout? outs[t].pos: newlength;
+}
+
+/* run peephole optimizer on slice */
+EM_API em_result_t em_code_optimize(em_code_slice_t *slice) {
+
+	const uint8_t *data = (const uint8_t *)slice->data;
+	size_t length = slice->length;
+
+	if (!length) return EM_RESULT_SUCCESS;
+
+	size_t *posmap = em_malloc(sizeof(size_t) * (length+1));
+	inst_t *insts = em_malloc(sizeof(inst_t) * length);
+	out_t *outs = em_malloc(sizeof(out_t) * length);
+	uint8_t *newdata = NULL;
+	em_result_t result = EM_RESULT_FAILURE;
+
+	for (size_t i = 0; i <= length; i++)
+		posmap[i] = NO_INDEX;
+
+	/* decode instructions */
+	size_t ninst = 0;
+	for (size_t pos = 0; pos < length;) {
+
+		size_t size = em_code_get_inst_size(slice, pos);
+		if (!size) goto done;
+
+		inst_t *inst = &insts[ninst];
+		memset(inst, 0, sizeof(inst_t));
+
+		inst->pos = pos;
+		inst->size = size;
+		inst->op = (em_code_op_t)data[pos];
+		inst->jump = has_target(inst->op);
+
+		posmap[pos] = ninst++;
+		pos += size;
+	}
+	posmap[length] = ninst;
+
+	/* resolve targets */
+	for (size_t i = 0; i < ninst; i++) {
+
+		inst_t *inst = &insts[i];
+		if (!inst->jump) continue;
+
+		uint32_t rel;
+		memcpy(&rel, data + inst->pos + inst->size - 4, 4);
+
+		size_t end = inst->pos + inst->size;
+		size_t target = inst->op == EM_CODE_OP_DFUNC? end + rel: end + (size_t)(int32_t)rel;
+		if (target > length || posmap[target] == NO_INDEX)
+			goto done;
+
+		inst->target = posmap[target];
+	}
+
+	/* thread jumps through unconditional jumps */
+	for (size_t i = 0; i < ninst; i++) {
+
+		inst_t *inst = &insts[i];
+		if (inst->op != EM_CODE_OP_JMP && inst->op != EM_CODE_OP_JTR &&
+		    inst->op != EM_CODE_OP_JNTR && inst->op != EM_CODE_OP_JPNTR)
+			continue;
+
+		for (size_t hops = 0; hops < MAX_JUMP_CHAIN; hops++) {
+
+			size_t t = inst->target;
+			if (t >= ninst || insts[t].op != EM_CODE_OP_JMP || t == i)
+				break;
+			inst->target = insts[t].target;
+		}
+	}
+
+	for (size_t i = 0; i < ninst; i++) {
+
+		if (insts[i].jump && insts[i].target < ninst)
+			insts[insts[i].target].label = EM_TRUE;
+	}
+
+	/* handler ranges and handlers are kept on instruction boundaries */
+	size_t nhandlers = em_code_get_handler_count(slice);
+	for (size_t i = 0; i < nhandlers; i++) {
+
+		em_code_handler_t handler;
+		em_code_get_handler(slice, i, &handler);
+		if (!handler.level) continue;
+
+		size_t bounds[3] = {handler.start, handler.end, handler.handler};
+		for (size_t j = 0; j < 3; j++) {
+
+			if (bounds[j] > length || posmap[bounds[j]] == NO_INDEX)
+				goto done;
+			if (posmap[bounds[j]] < ninst)
+				insts[posmap[bounds[j]]].label = EM_TRUE;
+		}
+	}
+
+	/* fuse sequences */
+	size_t nout = 0;
+	for (size_t i = 0; i < ninst;) {
+
+		inst_t *inst = &insts[i];
+		inst->out = nout;
+
+		eset_t eset = {0};
+		size_t j, k;
+
+		/* push none and pop */
+		if (inst->op == EM_CODE_OP_PNONE && i+1 < ninst &&
+		    insts[i+1].op == EM_CODE_OP_POP && !insts[i+1].label) {
+
+			insts[i+1].out = nout;
+			i += 2;
+			continue;
+		}
+
+		/* jump to next instruction */
+		if (inst->op == EM_CODE_OP_JMP && inst->target == i+1) {
+
+			i++;
+			continue;
+		}
+
+		/* run of position updates */
+		if (is_eset(inst->op)) {
+
+			add_eset(&eset, data, inst);
+			for (i++; i < ninst && is_eset(insts[i].op) && !insts[i].label; i++) {
+
+				insts[i].out = nout;
+				add_eset(&eset, data, &insts[i]);
+			}
+			emit_eset(outs, &nout, &eset);
+			continue;
+		}
+
+		/* load variable and add int constant */
+		if (inst->op == EM_CODE_OP_LOAD &&
+		    (j = next_op(insts, ninst, data, i, &eset)) != NO_INDEX &&
+		    insts[j].op == EM_CODE_OP_PCINT &&
+		    (k = next_op(insts, ninst, data, j, &eset)) != NO_INDEX &&
+		    insts[k].op == EM_CODE_OP_BADD) {
+
+			emit_eset(outs, &nout, &eset);
+			emit_inst(outs, &nout, inst, EM_CODE_OP_LADDI);
+
+			out_t *out = &outs[nout-1];
+			out->src[1] = insts[j].pos + 1;
+			out->srclen[1] = insts[j].size - 1;
+
+			for (i++; i <= k; i++) insts[i].out = nout;
+			continue;
+		}
+		eset = (eset_t){0};
+
+		/* compare and jump if not true */
+		if (inst->op >= EM_CODE_OP_BEQ && inst->op <= EM_CODE_OP_BGT &&
+		    (j = next_op(insts, ninst, data, i, &eset)) != NO_INDEX &&
+		    insts[j].op == EM_CODE_OP_JNTR) {
+
+			em_code_op_t op = EM_CODE_OP_JNEQ;
+			switch (inst->op) {
+				case EM_CODE_OP_BNEQ: op = EM_CODE_OP_JNNEQ; break;
+				case EM_CODE_OP_BLT: op = EM_CODE_OP_JNLT; break;
+				case EM_CODE_OP_BGT: op = EM_CODE_OP_JNGT; break;
+				default: break;
+			}
+			emit_eset(outs, &nout, &eset);
+			emit_inst(outs, &nout, &insts[j], op);
+
+			for (i++; i <= j; i++) insts[i].out = nout;
+			continue;
+		}
+		eset = (eset_t){0};
+
+		/* store variable and pop */
+		if (inst->op == EM_CODE_OP_STOR &&
+		    (j = next_op(insts, ninst, data, i, &eset)) != NO_INDEX &&
+		    insts[j].op == EM_CODE_OP_POP) {
+
+			emit_eset(outs, &nout, &eset);
+			emit_inst(outs, &nout, inst, EM_CODE_OP_STORP);
+
+			for (i++; i <= j; i++) insts[i].out = nout;
+			continue;
+		}
+
+		/* otherwise */
+		emit_inst(outs, &nout, inst, inst->op);
+		i++;
+	}
+
+	/* lay out output */
+	size_t newlength = 0;
+	for (size_t i = 0; i < nout; i++) {
+
+		out_t *out = &outs[i];
+		out->pos = newlength;
+		newlength += 1 + out->srclen[0] + out->srclen[1] + out->nimm + (out->jump? 4: 0);
+	}
+
+	/* encode output */
+	newdata = em_malloc(newlength? newlength: 1);
+	for (size_t i = 0; i < nout; i++) {
+
+		out_t *out = &outs[i];
+		uint8_t *p = newdata + out->pos;
+
+		*p++ = (uint8_t)out->op;
+		for (size_t c = 0; c < 2; c++) {
+
+			memcpy(p, data + out->src[c], out->srclen[c]);
+			p += out->srclen[c];
+		}
+		memcpy(p, out->imm, out->nimm);
+		p += out->nimm;
+
+		if (out->jump) {
+
+			size_t target = new_pos(insts, ninst, outs, nout, newlength, out->target);
+
+			int32_t rel = (int32_t)target - (int32_t)(p + 4 - newdata);
+			memcpy(p, &rel, 4);
+		}
+	}
+
+	/* move handlers with their instructions (the table is copied from the start of the slice) */
+	em_code_slice_t view = {.data = newdata, .length = newlength};
+	for (size_t i = 0; i < nhandlers; i++) {
+
+		em_code_handler_t handler;
+		em_code_get_handler(slice, i, &handler);
+		if (!handler.level) continue;
+
+		handler.start = (uint32_t)new_pos(insts, ninst, outs, nout, newlength, posmap[handler.start]);
+		handler.end = (uint32_t)new_pos(insts, ninst, outs, nout, newlength, posmap[handler.end]);
+		handler.handler = (uint32_t)new_pos(insts, ninst, outs, nout, newlength, posmap[handler.handler]);
+		em_code_set_handler(&view, i, &handler);
+	}
+
+	em_free(slice->data);
+	slice->data = newdata;
+	slice->length = newlength;
+	slice->capacity = newlength;
+	slice->position = 0;
+	newdata = NULL;
+	result = EM_RESULT_SUCCESS;
+
+done:
+	if (newdata) em_free(newdata);
+	em_free(outs);
+	em_free(insts);
+	em_free(posmap);
+	return result;
+}
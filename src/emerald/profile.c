@@ -0,0 +1,358 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <emerald/core.h>
+#include <emerald/memory.h>
+#include <emerald/bytecode.h>
+#include <emerald/profile.h>
+
+#ifdef EM_PROFILE
+
+/*
+ * Every instruction the interpreter runs is counted by operation, by
+ * position in its slice and by the operation that ran before it in the same
+ * slice. Times are read around each instruction, so they include everything
+ * the instruction does (a CALL includes the function it calls). Each slice
+ * keeps a copy of its bytecode so that it can still be disassembled after
+ * the slice is freed.
+ */
+
+#define HOT_INSTS 20 /* instructions in hot list */
+#define HOT_PAIRS 20 /* pairs in pair list */
+#define HOT_SLICES 5 /* slices in annotated disassembly */
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+ #define UNIT "cycles"
+#elif defined EM_UNIX
+ #define UNIT "ns"
+#else
+ #define UNIT "ticks"
+#endif
+
+/* profiled slice */
+typedef struct entry {
+	struct entry *next; /* next slice */
+	size_t index; /* number of slice in order of first run */
+	em_code_slice_t code; /* copy of bytecode */
+	uint64_t *counts; /* executions by position */
+	uint64_t *times; /* time by position */
+	uint64_t total; /* total time */
+} entry_t;
+
+/* instruction or pair in sorted list */
+typedef struct item {
+	entry_t *entry;
+	size_t pos; /* position, or pair index */
+	uint64_t count;
+	uint64_t time;
+} item_t;
+
+/* each thread profiles the code it runs */
+static EM_THREAD_LOCAL uint64_t op_counts[EM_CODE_OP_COUNT];
+static EM_THREAD_LOCAL uint64_t op_times[EM_CODE_OP_COUNT];
+static EM_THREAD_LOCAL uint64_t pair_counts[EM_CODE_OP_COUNT][EM_CODE_OP_COUNT];
+static EM_THREAD_LOCAL entry_t *first_entry, *last_entry;
+static EM_THREAD_LOCAL size_t nentries;
+
+/* get timestamp in profiler units */
+EM_API uint64_t em_profile_clock(void) {
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+	return (uint64_t)__builtin_ia32_rdtsc();
+#elif defined EM_UNIX
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#else
+	return (uint64_t)clock();
+#endif
+}
+
+/* make entry for slice */
+static entry_t *new_entry(em_code_slice_t *slice) {
+
+	entry_t *entry = em_malloc(sizeof(entry_t));
+	if (!entry) return NULL;
+
+	memset(entry, 0, sizeof(entry_t));
+	entry->index = nentries++;
+	entry->code.length = slice->length;
+	entry->code.data = em_malloc(slice->length? slice->length: 1);
+	entry->counts = em_malloc((slice->length+1) * sizeof(uint64_t));
+	entry->times = em_malloc((slice->length+1) * sizeof(uint64_t));
+
+	if (!entry->code.data || !entry->counts || !entry->times) {
+
+		em_free(entry->code.data);
+		em_free(entry->counts);
+		em_free(entry->times);
+		em_free(entry);
+		return NULL;
+	}
+	memcpy(entry->code.data, slice->data, slice->length);
+	memset(entry->counts, 0, (slice->length+1) * sizeof(uint64_t));
+	memset(entry->times, 0, (slice->length+1) * sizeof(uint64_t));
+
+	if (!first_entry) first_entry = entry;
+	if (last_entry) last_entry->next = entry;
+	last_entry = entry;
+
+	slice->profile = entry;
+	return entry;
+}
+
+/* record execution of instruction */
+EM_API void em_profile_record(em_code_slice_t *slice, size_t pos, em_code_op_t prev, em_code_op_t op, uint64_t time) {
+
+	entry_t *entry = slice->profile;
+	if (!entry && !(entry = new_entry(slice))) return;
+
+	if (op <= 0 || op >= EM_CODE_OP_COUNT) return;
+
+	op_counts[op]++;
+	op_times[op] += time;
+	if (prev > 0 && prev < EM_CODE_OP_COUNT)
+		pair_counts[prev][op]++;
+
+	if (pos <= entry->code.length) {
+
+		entry->counts[pos]++;
+		entry->times[pos] += time;
+	}
+	entry->total += time;
+}
+
+/* sort items by time, then count */
+static int compare_time(const void *a, const void *b) {
+
+	const item_t *ia = a, *ib = b;
+	if (ia->time != ib->time) return ia->time < ib->time? 1: -1;
+	if (ia->count != ib->count) return ia->count < ib->count? 1: -1;
+	return 0;
+}
+
+/* sort items by count */
+static int compare_count(const void *a, const void *b) {
+
+	const item_t *ia = a, *ib = b;
+	if (ia->count != ib->count) return ia->count < ib->count? 1: -1;
+	return 0;
+}
+
+/* get percentage */
+static double percent(uint64_t part, uint64_t whole) {
+
+	return whole? (double)part * 100.0 / (double)whole: 0.0;
+}
+
+/* print operations by time */
+static void report_ops(FILE *fp, uint64_t count, uint64_t time) {
+
+	item_t items[EM_CODE_OP_COUNT];
+	size_t nitems = 0;
+
+	for (size_t i = 1; i < EM_CODE_OP_COUNT; i++) {
+
+		if (!op_counts[i]) continue;
+		items[nitems++] = (item_t){NULL, i, op_counts[i], op_times[i]};
+	}
+	qsort(items, nitems, sizeof(item_t), compare_time);
+
+	fprintf(fp, "Operations (%llu instructions, %llu " UNIT "):\n",
+		(unsigned long long)count, (unsigned long long)time);
+	fprintf(fp, "  %-10s %12s %7s %14s %7s %10s\n", "op", "count", "%", UNIT, "%", "avg");
+
+	for (size_t i = 0; i < nitems; i++) {
+
+		fprintf(fp, "  %-10s %12llu %6.2f%% %14llu %6.2f%% %10.1f\n",
+			em_code_get_op_name((em_code_op_t)items[i].pos),
+			(unsigned long long)items[i].count, percent(items[i].count, count),
+			(unsigned long long)items[i].time, percent(items[i].time, time),
+			(double)items[i].time / (double)items[i].count);
+	}
+	fputc('\n', fp);
+}
+
+/* print instruction at position of entry */
+static void print_inst(FILE *fp, entry_t *entry, size_t pos) {
+
+	entry->code.position = pos;
+	if (!em_code_disassemble_inst(&entry->code, fp))
+		entry->code.position = entry->code.length;
+}
+
+/* print hottest instructions */
+static void report_insts(FILE *fp, uint64_t time) {
+
+	item_t items[HOT_INSTS+1];
+	size_t nitems = 0;
+
+	/* keep the hottest instructions in order */
+	for (entry_t *entry = first_entry; entry; entry = entry->next) {
+		for (size_t pos = 0; pos < entry->code.length; pos++) {
+
+			if (!entry->counts[pos]) continue;
+
+			item_t item = {entry, pos, entry->counts[pos], entry->times[pos]};
+			if (nitems == HOT_INSTS && compare_time(&item, &items[nitems-1]) >= 0)
+				continue;
+
+			size_t i = nitems < HOT_INSTS? nitems++: nitems-1;
+			for (; i && compare_time(&item, &items[i-1]) < 0; i--)
+				items[i] = items[i-1];
+			items[i] = item;
+		}
+	}
+
+	fputs("Hot instructions:\n", fp);
+	fprintf(fp, "  %5s %8s %12s %14s %7s  %s\n", "slice", "pos", "count", UNIT, "%", "instruction");
+
+	for (size_t i = 0; i < nitems; i++) {
+
+		fprintf(fp, "  %5zu %08zx %12llu %14llu %6.2f%%  ",
+			items[i].entry->index, items[i].pos,
+			(unsigned long long)items[i].count,
+			(unsigned long long)items[i].time, percent(items[i].time, time));
+		print_inst(fp, items[i].entry, items[i].pos);
+	}
+	fputc('\n', fp);
+}
+
+/* print most frequent pairs of operations */
+static void report_pairs(FILE *fp, uint64_t count) {
+
+	item_t items[HOT_PAIRS+1];
+	size_t nitems = 0;
+
+	for (size_t a = 1; a < EM_CODE_OP_COUNT; a++) {
+		for (size_t b = 1; b < EM_CODE_OP_COUNT; b++) {
+
+			if (!pair_counts[a][b]) continue;
+
+			item_t item = {NULL, a * EM_CODE_OP_COUNT + b, pair_counts[a][b], 0};
+			if (nitems == HOT_PAIRS && compare_count(&item, &items[nitems-1]) >= 0)
+				continue;
+
+			size_t i = nitems < HOT_PAIRS? nitems++: nitems-1;
+			for (; i && compare_count(&item, &items[i-1]) < 0; i--)
+				items[i] = items[i-1];
+			items[i] = item;
+		}
+	}
+
+	fputs("Operation pairs:\n", fp);
+	fprintf(fp, "  %-10s %-10s %12s %7s\n", "first", "second", "count", "%");
+
+	for (size_t i = 0; i < nitems; i++) {
+
+		fprintf(fp, "  %-10s %-10s %12llu %6.2f%%\n",
+			em_code_get_op_name((em_code_op_t)(items[i].pos / EM_CODE_OP_COUNT)),
+			em_code_get_op_name((em_code_op_t)(items[i].pos % EM_CODE_OP_COUNT)),
+			(unsigned long long)items[i].count, percent(items[i].count, count));
+	}
+	fputc('\n', fp);
+}
+
+/* print annotated disassembly of hottest slices */
+static void report_slices(FILE *fp, uint64_t time) {
+
+	if (!nentries) return;
+
+	item_t *items = em_malloc(nentries * sizeof(item_t));
+	if (!items) return;
+
+	size_t nitems = 0;
+	for (entry_t *entry = first_entry; entry; entry = entry->next)
+		items[nitems++] = (item_t){entry, 0, 0, entry->total};
+	qsort(items, nitems, sizeof(item_t), compare_time);
+
+	for (size_t i = 0; i < nitems && i < HOT_SLICES; i++) {
+
+		entry_t *entry = items[i].entry;
+		fprintf(fp, "Slice %zu (%llu " UNIT ", %.2f%%):\n", entry->index,
+			(unsigned long long)entry->total, percent(entry->total, time));
+
+		entry->code.position = 0;
+		while (entry->code.position < entry->code.length) {
+
+			size_t pos = entry->code.position;
+			fprintf(fp, "  %12llu %14llu  %08zx  ",
+				(unsigned long long)entry->counts[pos],
+				(unsigned long long)entry->times[pos], pos);
+			if (!em_code_disassemble_inst(&entry->code, fp)) break;
+		}
+		fputc('\n', fp);
+	}
+	em_free(items);
+}
+
+/* print hot operations, instructions and pairs */
+EM_API void em_profile_report(FILE *fp) {
+
+	uint64_t count = 0, time = 0;
+	for (size_t i = 1; i < EM_CODE_OP_COUNT; i++) {
+
+		count += op_counts[i];
+		time += op_times[i];
+	}
+	if (!count) {
+
+		fputs("No bytecode was run\n", fp);
+		return;
+	}
+	report_ops(fp, count, time);
+	report_insts(fp, time);
+	report_pairs(fp, count);
+	report_slices(fp, time);
+}
+
+/* discard recorded data */
+EM_API void em_profile_reset(void) {
+
+	entry_t *entry = first_entry;
+	while (entry) {
+
+		entry_t *next = entry->next;
+
+		em_free(entry->code.data);
+		em_free(entry->counts);
+		em_free(entry->times);
+		em_free(entry);
+		entry = next;
+	}
+	first_entry = last_entry = NULL;
+	nentries = 0;
+
+	memset(op_counts, 0, sizeof(op_counts));
+	memset(op_times, 0, sizeof(op_times));
+	memset(pair_counts, 0, sizeof(pair_counts));
+}
+
+#else
+
+/* get timestamp in profiler units */
+EM_API uint64_t em_profile_clock(void) {
+
+	return 0;
+}
+
+/* record execution of instruction */
+EM_API void em_profile_record(em_code_slice_t *slice, size_t pos, em_code_op_t prev, em_code_op_t op, uint64_t time) {
+}
+
+/* print hot operations, instructions and pairs */
+EM_API void em_profile_report(FILE *fp) {
+}
+
+/* discard recorded data */
+EM_API void em_profile_reset(void) {
+}
+#endif
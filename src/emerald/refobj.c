@@ -203,7 +203,7 @@ EM_API em_refobj_t *em_refobj_incref(em_refobj_t *obj) {
 
 	if (!obj) return NULL;
 
-	obj->refcnt++;
+	if (obj->mode != EM_CLEANUP_MODE_IMMORTAL) obj->refcnt++;
 	return obj;
 }
 
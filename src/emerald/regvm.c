@@ -0,0 +1,1223 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emerald/core.h>
+#include <emerald/memory.h>
+#include <emerald/context.h>
+#include <emerald/none.h>
+#include <emerald/utf8.h>
+#include <emerald/wchar.h>
+#include <emerald/hash.h>
+#include <emerald/path.h>
+#include <emerald/string.h>
+#include <emerald/list.h>
+#include <emerald/map.h>
+#include <emerald/log.h>
+#include <emerald/regvm.h>
+
+/*
+ * Register code is compiled from the same trees as stack bytecode, but
+ * operations name their operands and destination directly (ADD r0, r0, k1)
+ * instead of moving values through the value stack. Registers only hold
+ * temporaries; variables still live in scopes. Like stack slots, registers
+ * hold values without a reference, and each operation deletes the values it
+ * consumes. Operands at or above EM_REG_CONST name int and float constants.
+ *
+ * Nodes that this compiler doesn't handle (functions, classes, try, raise
+ * and foreach) are run on the tree-walker from the register code.
+ */
+
+#define PATHBUFSZ 4096
+static EM_THREAD_LOCAL char pathbuf[PATHBUFSZ];
+
+/* operation names */
+static const char *op_names[EM_REG_OP_COUNT] = {
+	NULL,
+	"LOADK", "KSTR", "MOVE", "DEL",
+	"LOAD", "STOR", "GETNM", "SETNM",
+	"GETIDX", "SETIDX",
+	"LIST", "MAP",
+	"NEG", "NOT", "BNOT", "BOOL",
+	"ADD", "SUB", "MUL", "DIV", "MOD",
+	"BOR", "BXOR", "BAND", "BLSH", "BRSH",
+	"EQ", "NEQ", "LT", "GT", "LE", "GE",
+	"JMP", "JT", "JF",
+	"JNEQ", "JNNEQ", "JNLT", "JNGT", "JNLE", "JNGE",
+	"FORPREP", "FORLOOP",
+	"CALL", "PUTS", "INCLUDE", "RAISE", "VISIT",
+};
+
+/* operation flags */
+#define FLAG_DISCARD 0x1 /* STOR: delete value after storing it */
+#define FLAG_IN_LOOP 0x1 /* CALL, VISIT: followed by jumps for break and continue */
+
+/* RAISE kinds */
+#define RAISE_RETURN 0
+#define RAISE_BREAK 1
+#define RAISE_CONTINUE 2
+
+/* loop being compiled */
+typedef struct loop {
+	struct loop *prev; /* enclosing loop */
+	uint16_t dest; /* register with value of loop */
+	size_t brk; /* chain of jumps to break */
+	size_t cont; /* chain of jumps to continue */
+} loop_t;
+
+/* compiler state */
+typedef struct compiler {
+	em_reg_code_t *code; /* code being written */
+	size_t top; /* first free register */
+	loop_t *loop; /* innermost loop */
+	em_bool_t ok; /* false if out of memory or registers */
+} compiler_t;
+
+static void compile(compiler_t *c, em_node_t *node, uint16_t dest, em_bool_t want);
+
+/* make room for one more item in array */
+static em_bool_t grow(void **items, size_t *cap, size_t count, size_t size) {
+
+	if (count < *cap) return EM_TRUE;
+
+	size_t ncap = *cap? *cap * 2: 64;
+	void *p = *items? em_realloc(*items, ncap * size): em_malloc(ncap * size);
+	if (!p) return EM_FALSE;
+
+	*items = p;
+	*cap = ncap;
+	return EM_TRUE;
+}
+
+/* add instruction */
+static size_t emit(compiler_t *c, em_node_t *node, em_reg_op_t op, uint8_t flags, uint16_t a, uint16_t b, uint16_t cc, uint32_t x) {
+
+	em_reg_code_t *code = c->code;
+	if (!c->ok) return 0;
+
+	/* source nodes are kept in a parallel array */
+	if (code->ninsts == code->capinsts) {
+
+		size_t cap = code->capinsts;
+		em_node_t **nodes = code->nodes?
+			em_realloc(code->nodes, (cap? cap * 2: 64) * sizeof(em_node_t *)):
+			em_malloc(64 * sizeof(em_node_t *));
+
+		if (!nodes || !grow((void **)&code->insts, &code->capinsts, code->ninsts, sizeof(em_reg_inst_t))) {
+
+			if (nodes) code->nodes = nodes;
+			c->ok = EM_FALSE;
+			return 0;
+		}
+		code->nodes = nodes;
+	}
+	code->insts[code->ninsts] = (em_reg_inst_t){
+		.op = (uint8_t)op,
+		.flags = flags,
+		.a = a, .b = b, .c = cc,
+		.x = x,
+	};
+	code->nodes[code->ninsts] = node;
+	return code->ninsts++;
+}
+
+/* add jump to chain of jumps with the same target */
+static void emit_jump(compiler_t *c, em_node_t *node, em_reg_op_t op, uint16_t a, uint16_t b, uint16_t cc, size_t *chain) {
+
+	size_t at = emit(c, node, op, 0, a, b, cc, (uint32_t)*chain);
+	if (c->ok) *chain = at + 1;
+}
+
+/* point chain of jumps at target */
+static void resolve(compiler_t *c, size_t chain, size_t target) {
+
+	while (chain && c->ok) {
+
+		em_reg_inst_t *inst = &c->code->insts[chain-1];
+		chain = inst->x;
+		inst->x = (uint32_t)target;
+	}
+}
+
+/* allocate register */
+static uint16_t alloc_reg(compiler_t *c) {
+
+	if (c->top >= EM_REG_MAX) {
+
+		c->ok = EM_FALSE;
+		return 0;
+	}
+	if (++c->top > c->code->nregs) c->code->nregs = c->top;
+	return (uint16_t)(c->top-1);
+}
+
+/* add constant */
+static uint32_t add_const(compiler_t *c, em_value_t value) {
+
+	em_reg_code_t *code = c->code;
+	if (!c->ok || !grow((void **)&code->consts, &code->capconsts, code->nconsts, sizeof(em_value_t))) {
+
+		c->ok = EM_FALSE;
+		return 0;
+	}
+	code->consts[code->nconsts] = value;
+	return (uint32_t)code->nconsts++;
+}
+
+/* add name or string */
+static uint32_t add_name(compiler_t *c, em_node_token_t *token, em_hash_t hash) {
+
+	em_reg_code_t *code = c->code;
+	if (!c->ok || !grow((void **)&code->names, &code->capnames, code->nnames, sizeof(em_reg_name_t))) {
+
+		c->ok = EM_FALSE;
+		return 0;
+	}
+	code->names[code->nnames] = (em_reg_name_t){
+		.hash = hash,
+		.string = token->value,
+		.length = token->length,
+	};
+	return (uint32_t)code->nnames++;
+}
+
+/* get constant value of node, if it has one */
+static em_bool_t get_const(em_node_t *node, em_value_t *value) {
+
+	em_node_token_t *token;
+
+	if (node->type == EM_NODE_TYPE_INT) {
+
+		token = em_node_get_token(node, 0);
+		em_inttype_t it_value = 0;
+
+		const char *string = token->value;
+		for (; *string >= '0' && *string <= '9'; string++)
+			it_value = (it_value * 10) + (em_inttype_t)(*string - '0');
+
+		*value = EM_VALUE_INT(it_value);
+		return EM_TRUE;
+	}
+	if (node->type == EM_NODE_TYPE_FLOAT) {
+
+		em_floattype_t ft_value = 0;
+#ifndef _ECLAIR
+		token = em_node_get_token(node, 0);
+		sscanf(token->value, EM_FLOATTYPE_FORMAT, &ft_value);
+#endif
+		*value = EM_VALUE_FLOAT(ft_value);
+		return EM_TRUE;
+	}
+	return EM_FALSE;
+}
+
+/* compile node as operand, using a constant if possible */
+static uint16_t operand(compiler_t *c, em_node_t *node, uint16_t reg) {
+
+	em_value_t value;
+	if (get_const(node, &value) && c->code->nconsts < EM_REG_CONST)
+		return (uint16_t)(EM_REG_CONST | add_const(c, value));
+
+	compile(c, node, reg, EM_TRUE);
+	return reg;
+}
+
+/* get first register of a run of registers starting at dest if possible */
+static uint16_t begin_run(compiler_t *c, uint16_t dest) {
+
+	if ((size_t)dest+1 == c->top) return dest;
+	return alloc_reg(c);
+}
+
+/* compile condition, jumping to chain if not true */
+static void compile_cond(compiler_t *c, em_node_t *node, size_t *chain) {
+
+	size_t top = c->top;
+	em_reg_op_t op = 0;
+
+	if (node->type == EM_NODE_TYPE_BINARY_OPERATION) {
+
+		switch (node->op) {
+			case EM_NODE_OP_EQUAL: op = EM_REG_OP_JNEQ; break;
+			case EM_NODE_OP_NOT_EQUAL: op = EM_REG_OP_JNNEQ; break;
+			case EM_NODE_OP_LESS_THAN: op = EM_REG_OP_JNLT; break;
+			case EM_NODE_OP_GREATER_THAN: op = EM_REG_OP_JNGT; break;
+			case EM_NODE_OP_LESS_THAN_EQUAL: op = EM_REG_OP_JNLE; break;
+			case EM_NODE_OP_GREATER_THAN_EQUAL: op = EM_REG_OP_JNGE; break;
+			default: break;
+		}
+	}
+
+	/* compare and jump */
+	if (op) {
+
+		uint16_t b = operand(c, node->children[0], alloc_reg(c));
+		uint16_t cc = operand(c, node->children[1], alloc_reg(c));
+		emit_jump(c, node, op, 0, b, cc, chain);
+	}
+
+	/* jump on truthiness */
+	else {
+		uint16_t a = alloc_reg(c);
+		compile(c, node, a, EM_TRUE);
+		emit_jump(c, node, EM_REG_OP_JF, a, 0, 0, chain);
+	}
+	c->top = top;
+}
+
+/* add jumps taken when a break or continue escapes from a call or node */
+static void emit_exits(compiler_t *c, em_node_t *node) {
+
+	if (!c->loop) return;
+
+	emit_jump(c, node, EM_REG_OP_JMP, 0, 0, 0, &c->loop->brk);
+	emit_jump(c, node, EM_REG_OP_JMP, 0, 0, 0, &c->loop->cont);
+}
+
+/* run node on tree-walker */
+static void compile_visit(compiler_t *c, em_node_t *node, uint16_t dest, em_bool_t want) {
+
+	emit(c, node, EM_REG_OP_VISIT, c->loop? FLAG_IN_LOOP: 0, dest, 0, 0, 0);
+	emit_exits(c, node);
+	if (!want) emit(c, node, EM_REG_OP_DEL, 0, dest, 0, 0, 0);
+}
+
+/* load object that holds the last name of a let statement */
+static void compile_path(compiler_t *c, em_node_t *node, size_t count, uint16_t dest) {
+
+	for (size_t i = 0; i < count; i++) {
+
+		em_node_token_t *token = em_node_get_token(node, i);
+		em_hash_t hash = em_node_get_value(node, i).v.te_hash;
+
+		emit(c, node, i? EM_REG_OP_GETNM: EM_REG_OP_LOAD, 0, dest, dest, 0, add_name(c, token, hash));
+	}
+}
+
+/* write break and continue stubs of loop */
+static void end_loop(compiler_t *c, em_node_t *node, loop_t *loop, size_t cont_target, size_t *done) {
+
+	em_reg_code_t *code = c->code;
+	uint32_t none = add_const(c, em_none);
+
+	/* skip stubs when the loop ends normally */
+	if ((loop->cont || loop->brk) && c->ok && code->insts[code->ninsts-1].op != EM_REG_OP_JMP)
+		emit_jump(c, node, EM_REG_OP_JMP, 0, 0, 0, done);
+
+	if (loop->cont) {
+
+		resolve(c, loop->cont, code->ninsts);
+		emit(c, node, EM_REG_OP_LOADK, 0, loop->dest, 0, 0, none);
+		emit(c, node, EM_REG_OP_JMP, 0, 0, 0, 0, (uint32_t)cont_target);
+	}
+	if (loop->brk) {
+
+		resolve(c, loop->brk, code->ninsts);
+		emit(c, node, EM_REG_OP_LOADK, 0, loop->dest, 0, 0, none);
+	}
+	c->loop = loop->prev;
+}
+
+/* compile node into register */
+static void compile(compiler_t *c, em_node_t *node, uint16_t dest, em_bool_t want) {
+
+	size_t top = c->top;
+	em_node_token_t *token;
+	em_hash_t hash;
+	em_value_t value;
+	em_reg_op_t op = 0;
+	uint16_t base, t, t2;
+	size_t count = 0;
+	size_t chain = 0, end = 0;
+	loop_t loop;
+
+	if (!c->ok) return;
+
+	switch (node->type) {
+
+		/* block */
+		case EM_NODE_TYPE_BLOCK:
+			for (uint32_t i = 0; i < node->nchildren; i++)
+				compile(c, node->children[i], dest, want && i+1 == node->nchildren);
+			if (!node->nchildren && want)
+				emit(c, node, EM_REG_OP_LOADK, 0, dest, 0, 0, add_const(c, em_none));
+			return;
+
+		/* constants */
+		case EM_NODE_TYPE_INT:
+		case EM_NODE_TYPE_FLOAT:
+			if (!want) return;
+			(void)get_const(node, &value);
+			emit(c, node, EM_REG_OP_LOADK, 0, dest, 0, 0, add_const(c, value));
+			return;
+		case EM_NODE_TYPE_STRING:
+			if (!want) return;
+			token = em_node_get_token(node, 0);
+			emit(c, node, EM_REG_OP_KSTR, 0, dest, 0, 0, add_name(c, token, 0));
+			return;
+
+		/* load variable */
+		case EM_NODE_TYPE_IDENTIFIER:
+			token = em_node_get_token(node, 0);
+			hash = em_node_get_value(node, 0).v.te_hash;
+			emit(c, node, EM_REG_OP_LOAD, 0, dest, 0, 0, add_name(c, token, hash));
+			break;
+
+		/* construct list or map, print values or call value */
+		case EM_NODE_TYPE_LIST:
+		case EM_NODE_TYPE_MAP:
+		case EM_NODE_TYPE_PUTS:
+		case EM_NODE_TYPE_CALL:
+			if (node->type == EM_NODE_TYPE_PUTS && !node->nchildren) {
+
+				compile_visit(c, node, dest, want);
+				return;
+			}
+			base = begin_run(c, dest);
+			for (uint32_t i = 0; i < node->nchildren; i++)
+				compile(c, node->children[i], count++? alloc_reg(c): base, EM_TRUE);
+
+			switch (node->type) {
+				case EM_NODE_TYPE_LIST:
+					emit(c, node, EM_REG_OP_LIST, 0, dest, base, (uint16_t)count, 0);
+					break;
+				case EM_NODE_TYPE_MAP:
+					emit(c, node, EM_REG_OP_MAP, 0, dest, base, (uint16_t)(count >> 1), 0);
+					break;
+				case EM_NODE_TYPE_PUTS:
+					emit(c, node, EM_REG_OP_PUTS, 0, base, (uint16_t)count, 0, 0);
+					if (base != dest) emit(c, node, EM_REG_OP_MOVE, 0, dest, base, 0, 0);
+					break;
+				default:
+					emit(c, node, EM_REG_OP_CALL, c->loop? FLAG_IN_LOOP: 0, base, (uint16_t)count, 0, 0);
+					emit_exits(c, node);
+					if (base != dest) emit(c, node, EM_REG_OP_MOVE, 0, dest, base, 0, 0);
+					break;
+			}
+			break;
+
+		/* unary operation */
+		case EM_NODE_TYPE_UNARY_OPERATION:
+			compile(c, node->children[0], dest, EM_TRUE);
+
+			if (node->op == EM_NODE_OP_POSITIVE) break;
+			else if (node->op == EM_NODE_OP_NEGATIVE) op = EM_REG_OP_NEG;
+			else if (node->op == EM_NODE_OP_BITWISE_NOT) op = EM_REG_OP_BNOT;
+			else op = EM_REG_OP_NOT;
+
+			emit(c, node, op, 0, dest, dest, 0, 0);
+			break;
+
+		/* binary operation */
+		case EM_NODE_TYPE_BINARY_OPERATION:
+			/* short-circuited operations result in a boolean, like in the tree-walker */
+			if (node->op == EM_NODE_OP_AND || node->op == EM_NODE_OP_OR) {
+
+				op = node->op == EM_NODE_OP_AND? EM_REG_OP_JF: EM_REG_OP_JT;
+
+				compile(c, node->children[0], dest, EM_TRUE);
+				emit_jump(c, node, op, dest, 0, 0, &chain);
+				compile(c, node->children[1], dest, EM_TRUE);
+				emit(c, node, EM_REG_OP_BOOL, 0, dest, dest, 0, 0);
+				emit_jump(c, node, EM_REG_OP_JMP, 0, 0, 0, &end);
+
+				resolve(c, chain, c->code->ninsts);
+				value = op == EM_REG_OP_JF? EM_VALUE_FALSE: EM_VALUE_TRUE;
+				emit(c, node, EM_REG_OP_LOADK, 0, dest, 0, 0, add_const(c, value));
+				resolve(c, end, c->code->ninsts);
+				break;
+			}
+
+			switch (node->op) {
+				case EM_NODE_OP_ADD: op = EM_REG_OP_ADD; break;
+				case EM_NODE_OP_SUBTRACT: op = EM_REG_OP_SUB; break;
+				case EM_NODE_OP_MULTIPLY: op = EM_REG_OP_MUL; break;
+				case EM_NODE_OP_DIVIDE: op = EM_REG_OP_DIV; break;
+				case EM_NODE_OP_MODULO: op = EM_REG_OP_MOD; break;
+				case EM_NODE_OP_BITWISE_OR: op = EM_REG_OP_BOR; break;
+				case EM_NODE_OP_BITWISE_XOR: op = EM_REG_OP_BXOR; break;
+				case EM_NODE_OP_BITWISE_AND: op = EM_REG_OP_BAND; break;
+				case EM_NODE_OP_SHIFT_LEFT: op = EM_REG_OP_BLSH; break;
+				case EM_NODE_OP_SHIFT_RIGHT: op = EM_REG_OP_BRSH; break;
+				case EM_NODE_OP_EQUAL: op = EM_REG_OP_EQ; break;
+				case EM_NODE_OP_NOT_EQUAL: op = EM_REG_OP_NEQ; break;
+				case EM_NODE_OP_LESS_THAN: op = EM_REG_OP_LT; break;
+				case EM_NODE_OP_GREATER_THAN: op = EM_REG_OP_GT; break;
+				case EM_NODE_OP_LESS_THAN_EQUAL: op = EM_REG_OP_LE; break;
+				case EM_NODE_OP_GREATER_THAN_EQUAL: op = EM_REG_OP_GE; break;
+				default: break;
+			}
+			t = operand(c, node->children[0], dest);
+			t2 = operand(c, node->children[1], alloc_reg(c));
+			emit(c, node, op, 0, dest, t, t2, 0);
+			break;
+
+		/* member access */
+		case EM_NODE_TYPE_ACCESS:
+			compile(c, node->children[0], dest, EM_TRUE);
+			if (node->nchildren > 1) { /* indexed */
+
+				t = operand(c, node->children[1], alloc_reg(c));
+				emit(c, node, EM_REG_OP_GETIDX, 0, dest, dest, t, 0);
+			}
+			else { /* named */
+				token = em_node_get_token(node, 0);
+				hash = em_node_get_value(node, 0).v.te_hash;
+				emit(c, node, EM_REG_OP_GETNM, 0, dest, dest, 0, add_name(c, token, hash));
+			}
+			break;
+
+		/* loop exits jump straight to the end of the loop */
+		case EM_NODE_TYPE_CONTINUE:
+		case EM_NODE_TYPE_BREAK:
+			if (c->loop) {
+
+				emit_jump(c, node, EM_REG_OP_JMP, 0, 0, 0,
+					  node->type == EM_NODE_TYPE_BREAK? &c->loop->brk: &c->loop->cont);
+				return;
+			}
+			emit(c, node, EM_REG_OP_RAISE,
+			     node->type == EM_NODE_TYPE_BREAK? RAISE_BREAK: RAISE_CONTINUE, 0, 0, 0, 0);
+			return;
+
+		/* return */
+		case EM_NODE_TYPE_RETURN:
+			compile(c, node->children[0], dest, EM_TRUE);
+			emit(c, node, EM_REG_OP_RAISE, RAISE_RETURN, dest, 0, 0, 0);
+			return;
+
+		/* include */
+		case EM_NODE_TYPE_INCLUDE:
+			compile(c, node->children[0], dest, EM_TRUE);
+			emit(c, node->children[0], EM_REG_OP_INCLUDE, 0, dest, dest, 0, 0);
+			break;
+
+		/* let statement */
+		case EM_NODE_TYPE_LET:
+			count = node->ntokens;
+			if (node->nchildren > 1) { /* indexed */
+
+				compile_path(c, node, count, dest);
+				t = operand(c, node->children[0], alloc_reg(c));
+				t2 = alloc_reg(c);
+				compile(c, node->children[1], t2, EM_TRUE);
+				emit(c, node, EM_REG_OP_SETIDX, 0, dest, t, t2, 0);
+			}
+			else if (count > 1) { /* named member */
+
+				compile_path(c, node, count-1, dest);
+				t2 = alloc_reg(c);
+				compile(c, node->children[0], t2, EM_TRUE);
+
+				token = em_node_get_token(node, count-1);
+				hash = em_node_get_value(node, count-1).v.te_hash;
+				emit(c, node, EM_REG_OP_SETNM, 0, dest, t2, 0, add_name(c, token, hash));
+			}
+			else { /* variable */
+				compile(c, node->children[0], dest, EM_TRUE);
+
+				token = em_node_get_token(node, 0);
+				hash = em_node_get_value(node, 0).v.te_hash;
+				emit(c, node, EM_REG_OP_STOR, want? 0: FLAG_DISCARD, dest, 0, 0, add_name(c, token, hash));
+				return;
+			}
+
+			/* value is left in last register */
+			if (want) emit(c, node, EM_REG_OP_MOVE, 0, dest, t2, 0, 0);
+			else emit(c, node, EM_REG_OP_DEL, 0, t2, 0, 0, 0);
+			c->top = top;
+			return;
+
+		/* if statement */
+		case EM_NODE_TYPE_IF:
+			for (uint32_t i = 0; i < node->nchildren; i += 2) {
+
+				em_node_t *condition_node = node->children[i];
+				em_node_t *body_node = i+1 < node->nchildren? node->children[i+1]: NULL;
+				em_bool_t more = i+2 < node->nchildren;
+
+				if (!body_node) {
+
+					body_node = condition_node;
+					condition_node = NULL;
+				}
+
+				chain = 0;
+				if (condition_node) compile_cond(c, condition_node, &chain);
+				compile(c, body_node, dest, want);
+
+				/* without an else arm, the statement results in none */
+				if (more || (want && condition_node))
+					emit_jump(c, node, EM_REG_OP_JMP, 0, 0, 0, &end);
+				resolve(c, chain, c->code->ninsts);
+
+				if (!more && condition_node && want)
+					emit(c, node, EM_REG_OP_LOADK, 0, dest, 0, 0, add_const(c, em_none));
+			}
+			resolve(c, end, c->code->ninsts);
+			return;
+
+		/* for statement */
+		case EM_NODE_TYPE_FOR:
+			token = em_node_get_token(node, 0);
+			hash = em_utf8_strhash(token->value);
+			if (c->code->nnames > UINT16_MAX) {
+
+				compile_visit(c, node, dest, want);
+				return;
+			}
+			uint16_t name = (uint16_t)add_name(c, token, hash);
+
+			/* iterator and end value */
+			t = alloc_reg(c);
+			t2 = alloc_reg(c);
+			compile(c, node->children[0], t, EM_TRUE);
+			compile(c, node->children[1], t2, EM_TRUE);
+
+			emit_jump(c, node, EM_REG_OP_FORPREP, t, dest, name, &end);
+			c->code->insts[c->code->ninsts-1].flags = (uint8_t)node->flags;
+			size_t body = c->code->ninsts;
+
+			loop = (loop_t){c->loop, dest, 0, 0};
+			c->loop = &loop;
+			compile(c, node->children[2], dest, EM_TRUE);
+
+			size_t next = c->code->ninsts;
+			emit(c, node, EM_REG_OP_FORLOOP, (uint8_t)node->flags, t, dest, name, (uint32_t)body);
+			end_loop(c, node, &loop, next, &end);
+			resolve(c, end, c->code->ninsts);
+			break;
+
+		/* while statement */
+		case EM_NODE_TYPE_WHILE:
+			emit(c, node, EM_REG_OP_LOADK, 0, dest, 0, 0, add_const(c, em_none));
+			size_t start = c->code->ninsts;
+			compile_cond(c, node->children[0], &end);
+			emit(c, node, EM_REG_OP_DEL, 0, dest, 0, 0, 0);
+
+			loop = (loop_t){c->loop, dest, 0, 0};
+			c->loop = &loop;
+			compile(c, node->children[1], dest, EM_TRUE);
+			emit(c, node, EM_REG_OP_JMP, 0, 0, 0, 0, (uint32_t)start);
+
+			end_loop(c, node, &loop, start, &end);
+			resolve(c, end, c->code->ninsts);
+			break;
+
+		/* everything else */
+		default:
+			compile_visit(c, node, dest, want);
+			return;
+	}
+
+	c->top = top;
+	if (!want) emit(c, node, EM_REG_OP_DEL, 0, dest, 0, 0, 0);
+}
+
+/* compile node to register code */
+EM_API em_result_t em_reg_compile(em_reg_code_t *code, em_node_t *node) {
+
+	*code = (em_reg_code_t){0};
+
+	compiler_t c = {
+		.code = code,
+		.ok = EM_TRUE,
+	};
+	compile(&c, node, alloc_reg(&c), EM_TRUE);
+
+	if (!c.ok) {
+
+		em_reg_free(code);
+		return EM_RESULT_FAILURE;
+	}
+	return EM_RESULT_SUCCESS;
+}
+
+/*
+ * Run register code. Registers are addressed through the context, since
+ * the value stack may move when anything called from here grows it.
+ */
+#define R(p_reg) (context->stack[base + (p_reg)])
+#define RK(p_op) ((p_op) & EM_REG_CONST? consts[(p_op) & EM_REG_MAX]: R(p_op))
+#define NAME (&code->names[inst->x])
+#define POS EM_NODE_POS(code->nodes[pc-1])
+
+#define FAIL goto fail
+
+#define RUNTIME_ERROR(...) ({\
+	if (!em_log_catch(NULL) && !context->signal)\
+		em_log_runtime_error(POS, __VA_ARGS__);\
+	goto fail;\
+})
+
+#define BOTH_INTS (a.type == EM_VALUE_TYPE_INT && b.type == EM_VALUE_TYPE_INT)
+
+#define UNARY_OPERATION(p_expr, ...) ({\
+	a = R(inst->b);\
+	b = p_expr;\
+	em_value_delete(a);\
+	if (!EM_VALUE_OK(b)) FAIL;\
+	__VA_ARGS__;\
+	R(inst->a) = b;\
+})
+
+#define BINARY_OPERATION(p_name, ...) ({\
+	a = RK(inst->b);\
+	b = RK(inst->c);\
+	c = em_value_##p_name(a, b, POS);\
+	em_value_delete(a);\
+	em_value_delete(b);\
+	if (!EM_VALUE_OK(c)) FAIL;\
+	__VA_ARGS__;\
+	R(inst->a) = c;\
+})
+
+#define INT_OPERATION(p_name, p_expr, ...) ({\
+	a = RK(inst->b);\
+	b = RK(inst->c);\
+	if (BOTH_INTS) {\
+		R(inst->a) = EM_VALUE_INT(p_expr);\
+		break;\
+	}\
+	c = em_value_##p_name(a, b, POS);\
+	em_value_delete(a);\
+	em_value_delete(b);\
+	if (!EM_VALUE_OK(c)) FAIL;\
+	__VA_ARGS__;\
+	R(inst->a) = c;\
+})
+
+#define COMPARE_JUMP(p_name, p_expr, ...) ({\
+	a = RK(inst->b);\
+	b = RK(inst->c);\
+	if (BOTH_INTS) {\
+		if (!(p_expr)) pc = inst->x;\
+		break;\
+	}\
+	c = em_value_##p_name(a, b, POS);\
+	em_value_delete(a);\
+	em_value_delete(b);\
+	if (!EM_VALUE_OK(c)) FAIL;\
+	__VA_ARGS__;\
+	if (!em_value_is_true(c, POS).value.te_inttype)\
+		pc = inst->x;\
+	em_value_delete(c);\
+})
+
+EM_API em_value_t em_reg_run(em_context_t *context, em_reg_code_t *code) {
+
+	const em_reg_inst_t *insts = code->insts;
+	const em_value_t *consts = code->consts;
+	size_t pc = 0;
+	em_value_t a, b, c;
+	em_result_t result;
+	em_reg_name_t *name;
+	size_t count;
+
+	/* registers are a window on the value stack */
+	size_t base = context->sp;
+	size_t reserved = context->stack_reserved;
+	if (em_context_reserve_stack(context, code->nregs) != EM_RESULT_SUCCESS) {
+
+		em_log_runtime_error(EM_NODE_POS(code->nodes[0]), "Stack overflow");
+		return EM_VALUE_FAIL;
+	}
+	context->sp += code->nregs;
+
+	while (pc < code->ninsts) {
+
+		const em_reg_inst_t *inst = &insts[pc++];
+		switch (inst->op) {
+
+			/* constants and moves */
+			case EM_REG_OP_LOADK:
+				R(inst->a) = consts[inst->x];
+				break;
+			case EM_REG_OP_KSTR:
+				name = NAME;
+				R(inst->a) = em_string_new_from_utf8(name->string, em_utf8_strlen(name->string));
+				break;
+			case EM_REG_OP_MOVE:
+				R(inst->a) = R(inst->b);
+				break;
+			case EM_REG_OP_DEL:
+				em_value_delete(R(inst->a));
+				break;
+
+			/* variables */
+			case EM_REG_OP_LOAD:
+				a = em_context_get_value(context, NAME->hash);
+				if (!EM_VALUE_OK(a))
+					RUNTIME_ERROR("Variable '%s' not defined", NAME->string);
+				R(inst->a) = a;
+				break;
+			case EM_REG_OP_STOR:
+				a = R(inst->a);
+				em_context_set_value(context, NAME->hash, a);
+				if (inst->flags & FLAG_DISCARD) em_value_delete(a);
+				break;
+
+			/* members */
+			case EM_REG_OP_GETNM:
+				a = R(inst->b);
+				b = em_value_get_by_hash(a, NAME->hash, POS);
+				em_value_delete(a);
+
+				if (!EM_VALUE_OK(b))
+					RUNTIME_ERROR("Attribute '%s' not defined", NAME->string);
+				R(inst->a) = b;
+				break;
+			case EM_REG_OP_SETNM:
+				a = R(inst->a);
+				result = em_value_set_by_hash(a, NAME->hash, R(inst->b), POS);
+				em_value_delete(a);
+
+				if (result != EM_RESULT_SUCCESS)
+					RUNTIME_ERROR("Attribute '%s' not defined", NAME->string);
+				break;
+			case EM_REG_OP_GETIDX:
+				a = R(inst->b);
+				b = RK(inst->c);
+				c = em_value_get_by_index(a, b, POS);
+				em_value_delete(a);
+				em_value_delete(b);
+
+				if (!EM_VALUE_OK(c))
+					RUNTIME_ERROR("Invalid index");
+				R(inst->a) = c;
+				break;
+			case EM_REG_OP_SETIDX:
+				a = R(inst->a);
+				b = RK(inst->b);
+				result = em_value_set_by_index(a, b, R(inst->c), POS);
+				em_value_delete(a);
+				em_value_delete(b);
+
+				if (result != EM_RESULT_SUCCESS)
+					RUNTIME_ERROR("Invalid index");
+				break;
+
+			/* constructors */
+			case EM_REG_OP_LIST:
+				a = em_list_new((size_t)inst->c);
+				for (size_t i = 0; i < inst->c; i++) {
+
+					em_list_append(a, R(inst->b+i));
+					em_value_delete(R(inst->b+i));
+				}
+				R(inst->a) = a;
+				break;
+			case EM_REG_OP_MAP:
+				a = em_map_new();
+				for (size_t i = 0; i < (size_t)inst->c * 2; i += 2) {
+
+					b = R(inst->b+i);
+					c = R(inst->b+i+1);
+					em_map_set_key(a, b, em_value_hash(b, POS), c);
+					em_value_delete(b);
+					em_value_delete(c);
+				}
+				R(inst->a) = a;
+				break;
+
+			/* unary operations */
+			case EM_REG_OP_NEG:
+				UNARY_OPERATION(em_value_multiply(a, EM_VALUE_INT(-1), POS));
+				break;
+			case EM_REG_OP_NOT:
+				UNARY_OPERATION(em_value_is_true(a, POS), b = EM_VALUE_INT_INV(b));
+				break;
+			case EM_REG_OP_BNOT:
+				UNARY_OPERATION(em_value_not(a, POS));
+				break;
+			case EM_REG_OP_BOOL:
+				UNARY_OPERATION(em_value_is_true(a, POS));
+				break;
+
+			/* binary operations */
+			case EM_REG_OP_ADD:
+				INT_OPERATION(add, EM_INTTYPE_ADD(a.value.te_inttype, b.value.te_inttype));
+				break;
+			case EM_REG_OP_SUB:
+				INT_OPERATION(subtract, EM_INTTYPE_SUB(a.value.te_inttype, b.value.te_inttype));
+				break;
+			case EM_REG_OP_MUL:
+				INT_OPERATION(multiply, EM_INTTYPE_MUL(a.value.te_inttype, b.value.te_inttype));
+				break;
+			case EM_REG_OP_DIV:
+				BINARY_OPERATION(divide);
+				break;
+			case EM_REG_OP_MOD:
+				BINARY_OPERATION(modulo);
+				break;
+			case EM_REG_OP_BOR:
+				BINARY_OPERATION(or);
+				break;
+			case EM_REG_OP_BXOR:
+				BINARY_OPERATION(xor);
+				break;
+			case EM_REG_OP_BAND:
+				BINARY_OPERATION(and);
+				break;
+			case EM_REG_OP_BLSH:
+				BINARY_OPERATION(shift_left);
+				break;
+			case EM_REG_OP_BRSH:
+				BINARY_OPERATION(shift_right);
+				break;
+			case EM_REG_OP_EQ:
+				INT_OPERATION(compare_equal, a.value.te_inttype == b.value.te_inttype);
+				break;
+			case EM_REG_OP_NEQ:
+				INT_OPERATION(compare_equal, a.value.te_inttype != b.value.te_inttype, c = EM_VALUE_INT_INV(c));
+				break;
+			case EM_REG_OP_LT:
+				INT_OPERATION(compare_less_than, a.value.te_inttype < b.value.te_inttype);
+				break;
+			case EM_REG_OP_GT:
+				INT_OPERATION(compare_greater_than, a.value.te_inttype > b.value.te_inttype);
+				break;
+			case EM_REG_OP_LE:
+				INT_OPERATION(compare_greater_than, a.value.te_inttype <= b.value.te_inttype, c = EM_VALUE_INT_INV(c));
+				break;
+			case EM_REG_OP_GE:
+				INT_OPERATION(compare_less_than, a.value.te_inttype >= b.value.te_inttype, c = EM_VALUE_INT_INV(c));
+				break;
+
+			/* jumps */
+			case EM_REG_OP_JMP:
+				pc = inst->x;
+				break;
+			case EM_REG_OP_JT:
+			case EM_REG_OP_JF:
+				a = R(inst->a);
+				if (a.type == EM_VALUE_TYPE_INT) count = a.value.te_inttype != 0;
+				else {
+					count = (size_t)em_value_is_true(a, POS).value.te_inttype;
+					em_value_delete(a);
+				}
+				if (count == (inst->op == EM_REG_OP_JT)) pc = inst->x;
+				break;
+			case EM_REG_OP_JNEQ:
+				COMPARE_JUMP(compare_equal, a.value.te_inttype == b.value.te_inttype);
+				break;
+			case EM_REG_OP_JNNEQ:
+				COMPARE_JUMP(compare_equal, a.value.te_inttype != b.value.te_inttype, c = EM_VALUE_INT_INV(c));
+				break;
+			case EM_REG_OP_JNLT:
+				COMPARE_JUMP(compare_less_than, a.value.te_inttype < b.value.te_inttype);
+				break;
+			case EM_REG_OP_JNGT:
+				COMPARE_JUMP(compare_greater_than, a.value.te_inttype > b.value.te_inttype);
+				break;
+			case EM_REG_OP_JNLE:
+				COMPARE_JUMP(compare_greater_than, a.value.te_inttype <= b.value.te_inttype, c = EM_VALUE_INT_INV(c));
+				break;
+			case EM_REG_OP_JNGE:
+				COMPARE_JUMP(compare_less_than, a.value.te_inttype >= b.value.te_inttype, c = EM_VALUE_INT_INV(c));
+				break;
+
+			/*
+			 * Counted loops keep the iterator in register a and the end
+			 * value in the one after it. The variable is only stored when
+			 * the body could see it and loaded back when the body could
+			 * redefine it, as in the stack interpreter.
+			 */
+			case EM_REG_OP_FORPREP:
+				a = R(inst->a);
+				b = R(inst->a+1);
+				name = &code->names[inst->c];
+
+				if (!BOTH_INTS) {
+
+					em_value_delete(a);
+					em_value_delete(b);
+					RUNTIME_ERROR("Expected integers for start and end values");
+				}
+				if (a.value.te_inttype >= b.value.te_inttype) {
+
+					R(inst->b) = em_none;
+					pc = inst->x;
+					break;
+				}
+				if (inst->flags & (EM_NODE_NAME_READ | EM_NODE_NAME_WRITTEN))
+					em_context_set_value(context, name->hash, a);
+				break;
+			case EM_REG_OP_FORLOOP:
+				a = R(inst->a);
+				b = R(inst->a+1);
+				name = &code->names[inst->c];
+
+				if (inst->flags & EM_NODE_NAME_WRITTEN) {
+
+					a = em_context_get_value(context, name->hash);
+					if (a.type != EM_VALUE_TYPE_INT) {
+
+						em_value_delete(R(inst->b));
+						RUNTIME_ERROR("Expected integer for iterator");
+					}
+				}
+
+				/* next iteration */
+				if (a.value.te_inttype + 1 < b.value.te_inttype) {
+
+					a.value.te_inttype++;
+					R(inst->a) = a;
+
+					if (inst->flags & (EM_NODE_NAME_READ | EM_NODE_NAME_WRITTEN))
+						em_context_set_value(context, name->hash, a);
+					em_value_delete(R(inst->b));
+					pc = inst->x;
+					break;
+				}
+
+				/* done; leave value of body */
+				if (!(inst->flags & (EM_NODE_NAME_READ | EM_NODE_NAME_WRITTEN)))
+					em_context_set_value(context, name->hash, a);
+				break;
+
+			/* call value */
+			case EM_REG_OP_CALL:
+				count = (size_t)inst->b - 1;
+				a = R(inst->a);
+
+				for (size_t i = 0; i < count; i++)
+					em_value_incref(R(inst->a+1+i));
+
+				em_value_t buf[EM_FUNCTION_MAX_ARGUMENTS];
+				em_value_t *args = buf;
+				if (count > EM_FUNCTION_MAX_ARGUMENTS && !(args = em_malloc(sizeof(em_value_t) * count))) {
+
+					for (size_t i = 0; i < count; i++)
+						em_value_decref(R(inst->a+1+i));
+					FAIL;
+				}
+				memcpy(args, &R(inst->a+1), sizeof(em_value_t) * count);
+
+				c = em_value_call(context, a, args, count, POS);
+				if (args != buf) em_free(args);
+
+				for (size_t i = 0; i < count; i++) {
+
+					b = R(inst->a+1+i);
+					if (em_value_is(c, b))
+						em_value_decref_no_free(b);
+					else em_value_decref(b);
+				}
+				em_value_delete(a);
+
+				if (!EM_VALUE_OK(c)) {
+
+					/* loop exits in called functions apply here, like in the tree-walker */
+					if (!(inst->flags & FLAG_IN_LOOP)) FAIL;
+					if (em_context_catch_signal(context, EM_SIGNAL_CONTINUE)) pc++;
+					else if (!em_context_catch_signal(context, EM_SIGNAL_BREAK)) FAIL;
+					break;
+				}
+				R(inst->a) = c;
+				if (inst->flags & FLAG_IN_LOOP) pc += 2;
+				break;
+
+			/* print values */
+			case EM_REG_OP_PUTS:
+				count = (size_t)inst->b;
+				for (size_t i = 0; i < count; i++) {
+
+					if (i) fputc(' ', stdout);
+
+					a = R(inst->a+i);
+					b = em_value_to_string(a, POS);
+
+					if (!EM_VALUE_OK(b)) FAIL;
+					em_string_t *strobject = EM_STRING(EM_OBJECT_FROM_VALUE(b));
+					em_wchar_write(stdout, strobject->data, strobject->length);
+
+					if (!em_value_is(a, b))
+						em_value_delete(b);
+				}
+				for (size_t i = 0; i < count-1; i++)
+					em_value_delete(R(inst->a+i));
+				R(inst->a) = R(inst->a+count-1);
+				fputc('\n', stdout);
+				break;
+
+			/* include file */
+			case EM_REG_OP_INCLUDE:
+				a = R(inst->b);
+				if (!em_is_string(a)) {
+
+					em_value_delete(a);
+					RUNTIME_ERROR("Expected string for path");
+				}
+				em_wpath_fix(pathbuf, PATHBUFSZ, EM_STRING(EM_OBJECT_FROM_VALUE(a))->data);
+
+				b = em_context_run_file(context, POS, pathbuf);
+				em_value_delete(a);
+
+				if (!EM_VALUE_OK(b)) FAIL;
+				R(inst->a) = b;
+				break;
+
+			/* return, break or continue outside of anything that handles it here */
+			case EM_REG_OP_RAISE:
+				switch (inst->flags) {
+					case RAISE_RETURN:
+						context->pass = R(inst->a);
+						em_context_signal(context, EM_SIGNAL_RETURN, POS);
+						break;
+					case RAISE_BREAK:
+						em_context_signal(context, EM_SIGNAL_BREAK, POS);
+						break;
+					default:
+						em_context_signal(context, EM_SIGNAL_CONTINUE, POS);
+						break;
+				}
+				FAIL;
+
+			/* run node on tree-walker */
+			case EM_REG_OP_VISIT:
+				a = em_context_visit(context, code->nodes[pc-1]);
+				if (!EM_VALUE_OK(a)) {
+
+					/* loop exits in the node continue at the jumps that follow */
+					if (!(inst->flags & FLAG_IN_LOOP)) FAIL;
+					if (em_context_catch_signal(context, EM_SIGNAL_CONTINUE)) pc++;
+					else if (!em_context_catch_signal(context, EM_SIGNAL_BREAK)) FAIL;
+					break;
+				}
+				R(inst->a) = a;
+				if (inst->flags & FLAG_IN_LOOP) pc += 2;
+				break;
+		}
+	}
+	context->sp = base;
+	a = R(0);
+	em_context_trim_stack(context, reserved);
+	return a;
+
+fail:
+	context->sp = base;
+	em_context_trim_stack(context, reserved);
+	return EM_VALUE_FAIL;
+}
+
+/* print operand */
+static void print_operand(em_reg_code_t *code, uint16_t op, FILE *fp) {
+
+	if (!(op & EM_REG_CONST)) {
+
+		fprintf(fp, " r%hu", op);
+		return;
+	}
+	em_value_t value = code->consts[op & EM_REG_MAX];
+	if (value.type == EM_VALUE_TYPE_INT)
+		fprintf(fp, " " EM_INTTYPE_FORMAT, value.value.te_inttype);
+	else if (value.type == EM_VALUE_TYPE_FLOAT)
+		fprintf(fp, " " EM_FLOATTYPE_FORMAT, value.value.te_floattype);
+	else fputs(" none", fp);
+}
+
+/* disassemble register code */
+EM_API void em_reg_disassemble(em_reg_code_t *code, FILE *fp) {
+
+	for (size_t i = 0; i < code->ninsts; i++) {
+
+		em_reg_inst_t *inst = &code->insts[i];
+		fprintf(fp, "%08zx  %s", i, op_names[inst->op]);
+
+		switch (inst->op) {
+
+			/* registers and names */
+			case EM_REG_OP_KSTR:
+			case EM_REG_OP_LOAD:
+			case EM_REG_OP_STOR:
+				fprintf(fp, " r%hu \"%s\"", inst->a, code->names[inst->x].string);
+				break;
+			case EM_REG_OP_GETNM:
+			case EM_REG_OP_SETNM:
+				fprintf(fp, " r%hu r%hu \"%s\"", inst->a, inst->b, code->names[inst->x].string);
+				break;
+
+			/* register and constant */
+			case EM_REG_OP_LOADK:
+				fprintf(fp, " r%hu", inst->a);
+				print_operand(code, (uint16_t)(EM_REG_CONST | inst->x), fp);
+				break;
+
+			/* three operands */
+			case EM_REG_OP_GETIDX:
+			case EM_REG_OP_SETIDX:
+			case EM_REG_OP_ADD:
+			case EM_REG_OP_SUB:
+			case EM_REG_OP_MUL:
+			case EM_REG_OP_DIV:
+			case EM_REG_OP_MOD:
+			case EM_REG_OP_BOR:
+			case EM_REG_OP_BXOR:
+			case EM_REG_OP_BAND:
+			case EM_REG_OP_BLSH:
+			case EM_REG_OP_BRSH:
+			case EM_REG_OP_EQ:
+			case EM_REG_OP_NEQ:
+			case EM_REG_OP_LT:
+			case EM_REG_OP_GT:
+			case EM_REG_OP_LE:
+			case EM_REG_OP_GE:
+				fprintf(fp, " r%hu", inst->a);
+				print_operand(code, inst->b, fp);
+				print_operand(code, inst->c, fp);
+				break;
+
+			/* jumps */
+			case EM_REG_OP_JMP:
+				fprintf(fp, " @%x", inst->x);
+				break;
+			case EM_REG_OP_JT:
+			case EM_REG_OP_JF:
+				fprintf(fp, " r%hu @%x", inst->a, inst->x);
+				break;
+			case EM_REG_OP_JNEQ:
+			case EM_REG_OP_JNNEQ:
+			case EM_REG_OP_JNLT:
+			case EM_REG_OP_JNGT:
+			case EM_REG_OP_JNLE:
+			case EM_REG_OP_JNGE:
+				print_operand(code, inst->b, fp);
+				print_operand(code, inst->c, fp);
+				fprintf(fp, " @%x", inst->x);
+				break;
+			case EM_REG_OP_FORPREP:
+			case EM_REG_OP_FORLOOP:
+				fprintf(fp, " r%hu r%hu \"%s\" @%x", inst->a, inst->b,
+					code->names[inst->c].string, inst->x);
+				break;
+
+			/* one register */
+			case EM_REG_OP_DEL:
+			case EM_REG_OP_RAISE:
+			case EM_REG_OP_VISIT:
+				fprintf(fp, " r%hu", inst->a);
+				break;
+
+			/* registers */
+			default:
+				fprintf(fp, " r%hu r%hu %hu", inst->a, inst->b, inst->c);
+				break;
+		}
+		fputc('\n', fp);
+	}
+}
+
+/* free register code */
+EM_API void em_reg_free(em_reg_code_t *code) {
+
+	em_free(code->insts);
+	em_free(code->nodes);
+	em_free(code->consts);
+	em_free(code->names);
+	*code = (em_reg_code_t){0};
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emerald/core.h>
+#include <emerald/memory.h>
+#include <emerald/log.h>
+#include <emerald/map.h>
+#include <emerald/fold.h>
+#include <emerald/closure.h>
+#include <emerald/jit.h>
+#include <emerald/script.h>
+
+/* compile text for mode of context */
+EM_API em_script_t *em_script_new(em_context_t *context, const char *path, const char *text, em_ssize_t len) {
+
+	if (!context || !context->init) return NULL;
+
+	size_t pathlen = strlen(path);
+
+	em_script_t *script = em_malloc(sizeof(em_script_t)+pathlen+1);
+	if (!script) return NULL;
+
+	memset(script, 0, sizeof(em_script_t));
+	memcpy(script->path, path, pathlen);
+	script->path[pathlen] = 0;
+	script->mode = context->mode;
+
+	/* positions refer to the copy of the path */
+	if (em_lexer_reset(&context->lexer, script->path, text, len) != EM_RESULT_SUCCESS) {
+
+		em_free(script);
+		return NULL;
+	}
+	context->lexer.source->context = context;
+
+	em_parser_reset(&context->parser, &context->lexer);
+	if (em_parser_parse(&context->parser) != EM_RESULT_SUCCESS) {
+
+		em_free(script);
+		return NULL;
+	}
+
+	em_node_t *node = context->parser.node;
+	EM_TREE_INCREF(node->tree);
+	script->node = node;
+
+	if (context->fold) em_node_fold(node);
+
+	switch (script->mode) {
+		case EM_CODE_TYPE_TREE:
+			em_closure_compile(node);
+			script->code = em_code_new_node(node, script->path);
+			if (script->code) return script;
+			break;
+		case EM_CODE_TYPE_REGISTER:
+			if (em_reg_compile(&script->reg, node) == EM_RESULT_SUCCESS)
+				return script;
+			em_log_runtime_error(EM_NODE_POS(node), "Failed to compile register code");
+			break;
+		default:
+			if (em_code_compile(&script->slice, node) == EM_RESULT_SUCCESS)
+				return script;
+			break;
+	}
+	EM_TREE_DECREF(node->tree);
+	em_free(script);
+	return NULL;
+}
+
+/* run script in scope map, or in empty scope if scope is fail */
+EM_API em_value_t em_script_run(em_script_t *script, em_context_t *context, em_value_t scope) {
+
+	if (!script || !context || !context->init) return EM_VALUE_FAIL;
+
+	if (EM_VALUE_OK(scope) && !em_is_map(scope)) {
+
+		em_log_runtime_error(EM_NODE_POS(script->node), "Expected map for scope of script");
+		return EM_VALUE_FAIL;
+	}
+
+	/* the supplied map takes the place of the one kept for reuse */
+	size_t index = context->nscopestack;
+	if (em_context_push_scope(context) != EM_RESULT_SUCCESS)
+		return EM_VALUE_FAIL;
+
+	em_value_t kept = context->scopestack[index];
+	if (EM_VALUE_OK(scope)) {
+
+		em_value_incref(scope);
+		context->scopestack[index] = scope;
+	}
+
+	em_value_t result = EM_VALUE_FAIL;
+	switch (script->mode) {
+		case EM_CODE_TYPE_TREE:
+			context->file_level++;
+			result = em_code_run(script->code, context);
+			em_context_leave_file(context);
+			break;
+		case EM_CODE_TYPE_REGISTER:
+			context->file_level++;
+			result = em_reg_run(context, &script->reg);
+			em_context_leave_file(context);
+			break;
+		default:
+			result = em_context_run_slice(context, script->path, &script->slice);
+			break;
+	}
+
+	/* result may only be held by the scope */
+	em_value_incref(result);
+
+	if (EM_VALUE_OK(scope)) {
+
+		context->scopestack[index] = kept;
+		context->nscopestack--;
+		em_value_decref(scope);
+	}
+	else em_context_pop_scope(context);
+
+	em_value_decref_no_free(result);
+	return result;
+}
+
+/* free script */
+EM_API void em_script_free(em_script_t *script) {
+
+	if (!script) return;
+
+	switch (script->mode) {
+		case EM_CODE_TYPE_TREE:
+			EM_CODE_DECREF(script->code);
+			break;
+		case EM_CODE_TYPE_REGISTER:
+			em_reg_free(&script->reg);
+			break;
+		default:
+			em_jit_free(&script->slice);
+			em_free(script->slice.data);
+			break;
+	}
+	EM_TREE_DECREF(script->node->tree);
+	em_free(script);
+}
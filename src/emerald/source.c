@@ -0,0 +1,112 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emerald/core.h>
+#include <emerald/memory.h>
+#include <emerald/source.h>
+
+#define LINES_INIT 64
+
+/* create source with copy of text */
+EM_API em_source_t *em_source_new(const char *path, const char *text, em_ssize_t len) {
+
+	em_source_t *source = em_malloc(sizeof(em_source_t));
+	if (!source) return NULL;
+
+	source->text = em_malloc((size_t)len+1);
+	if (!source->text) {
+
+		em_free(source);
+		return NULL;
+	}
+	memcpy(source->text, text, (size_t)len);
+	source->text[len] = 0;
+
+	source->refcnt = 1;
+	source->path = path;
+	source->len = len;
+	source->lines = NULL;
+	source->nlines = 0;
+	source->maxlines = 0;
+	source->context = NULL;
+	return source;
+}
+
+/* increase reference count */
+EM_API em_source_t *em_source_incref(em_source_t *source) {
+
+	if (source) source->refcnt++;
+	return source;
+}
+
+/* decrease reference count */
+EM_API void em_source_decref(em_source_t *source) {
+
+	if (!source || --source->refcnt) return;
+
+	em_free(source->text);
+	em_free(source->lines);
+	em_free(source);
+}
+
+/* add start of next line */
+EM_API em_result_t em_source_add_line(em_source_t *source, em_ssize_t index) {
+
+	if (source->nlines >= source->maxlines) {
+
+		uint32_t maxlines = source->maxlines? source->maxlines * 2: LINES_INIT;
+		uint32_t *lines = source->lines?
+			em_realloc(source->lines, maxlines * sizeof(uint32_t)):
+			em_malloc(maxlines * sizeof(uint32_t));
+		if (!lines) return EM_RESULT_FAILURE;
+
+		source->lines = lines;
+		source->maxlines = maxlines;
+	}
+	source->lines[source->nlines++] = (uint32_t)index;
+	return EM_RESULT_SUCCESS;
+}
+
+/* get text of line */
+EM_API em_ssize_t em_source_get_line(em_source_t *source, uint32_t line, const char **start) {
+
+	if (!source || !source->text || !line || line > source->nlines)
+		return -1;
+
+	em_ssize_t i = (em_ssize_t)source->lines[line-1], end = i;
+	while (end < source->len && source->text[end] != '\n')
+		end++;
+
+	*start = source->text+i;
+	return end-i;
+}
+
+/* find line and column of offset into text */
+EM_API void em_source_find(em_source_t *source, uint32_t offset, uint32_t *line, uint32_t *column) {
+
+	*line = 0;
+	*column = 1;
+	if (!source || !source->nlines) return;
+
+	/* last line starting at or before offset */
+	uint32_t lo = 0, hi = source->nlines;
+	while (hi - lo > 1) {
+
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (source->lines[mid] <= offset) lo = mid;
+		else hi = mid;
+	}
+	*line = lo+1;
+
+	/* count characters, skipping continuation bytes */
+	for (uint32_t i = source->lines[lo]; i < offset && i < (uint32_t)source->len; i++) {
+
+		if (((unsigned char)source->text[i] & 0xc0) != 0x80)
+			(*column)++;
+	}
+}
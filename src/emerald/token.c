@@ -8,6 +8,7 @@
 #include <string.h>
 #include <emerald/core.h>
 #include <emerald/refobj.h>
+#include <emerald/source.h>
 #include <emerald/token.h>
 
 /* token type names */
@@ -48,6 +49,12 @@ static const char *typenames[EM_TOKEN_TYPE_COUNT] = {
 	"EOF",
 };
 
+/* free callback */
+static void token_free(void *p) {
+
+	em_source_decref(EM_TOKEN(p)->pos.source);
+}
+
 /* get name of token type */
 EM_API const char *em_get_token_type_name(em_token_type_t type) {
 
@@ -62,8 +69,11 @@ EM_API em_token_t *em_token_new(em_token_type_t type, em_pos_t *pos, const char
 	em_token_t *token = EM_TOKEN(em_refobj_new(&em_reflist_token, sizeof(em_token_t)+len+1, EM_CLEANUP_MODE_IMMEDIATE));
 	if (!token) return NULL;
 
+	EM_REFOBJ(token)->free = token_free;
+
 	token->type = type;
 	memcpy(&token->pos, pos, sizeof(token->pos));
+	em_source_incref(token->pos.source);
 	if (value) memcpy(token->value, value, len);
 	else memset(token->value, 0, len);
 	token->value[len] = 0;
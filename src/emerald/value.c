@@ -147,7 +147,7 @@ static em_value_t add_int(em_value_t a, em_value_t b, em_pos_t *pos) {
 
 	switch (b.type) {
 		case EM_VALUE_TYPE_INT:
-			return EM_VALUE_INT(a.value.te_inttype + b.value.te_inttype);
+			return EM_VALUE_INT(EM_INTTYPE_ADD(a.value.te_inttype, b.value.te_inttype));
 		case EM_VALUE_TYPE_FLOAT:
 			return EM_VALUE_FLOAT((em_floattype_t)a.value.te_inttype + b.value.te_floattype);
 		default:
@@ -160,7 +160,7 @@ static em_value_t subtract_int(em_value_t a, em_value_t b, em_pos_t *pos) {
 
 	switch (b.type) {
 		case EM_VALUE_TYPE_INT:
-			return EM_VALUE_INT(a.value.te_inttype - b.value.te_inttype);
+			return EM_VALUE_INT(EM_INTTYPE_SUB(a.value.te_inttype, b.value.te_inttype));
 		case EM_VALUE_TYPE_FLOAT:
 			return EM_VALUE_FLOAT((em_floattype_t)a.value.te_inttype - b.value.te_floattype);
 		default:
@@ -173,7 +173,7 @@ static em_value_t multiply_int(em_value_t a, em_value_t b, em_pos_t *pos) {
 
 	switch (b.type) {
 		case EM_VALUE_TYPE_INT:
-			return EM_VALUE_INT(a.value.te_inttype * b.value.te_inttype);
+			return EM_VALUE_INT(EM_INTTYPE_MUL(a.value.te_inttype, b.value.te_inttype));
 		case EM_VALUE_TYPE_FLOAT:
 			return EM_VALUE_FLOAT((em_floattype_t)a.value.te_inttype * b.value.te_floattype);
 		default:
@@ -668,7 +668,7 @@ EM_API void em_value_log(em_value_t v) {
 
 	em_value_t string = em_value_to_string(v, NULL); /* TODO: Figure out what to do about NULL position */
 
-	static char stringbuf[1024];
+	static EM_THREAD_LOCAL char stringbuf[1024];
 	em_wchar_to_utf8(stringbuf, 1024, EM_STRING(EM_OBJECT_FROM_VALUE(string))->data);
 	em_log_info("%s", stringbuf);
 
@@ -0,0 +1,383 @@
+/*
+ * Copyright 2025-2026, Elliot Kohlmyer
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emerald/core.h>
+#include <emerald/memory.h>
+#include <emerald/bytecode.h>
+#include <emerald/verify.h>
+
+/*
+ * The interpreter reads operands and moves values on the stack without
+ * bounds checks, so every slice goes through here first. A slice passes if
+ *
+ *   - every instruction is complete and has a known operation,
+ *   - every jump lands on an instruction or the end of the slice,
+ *   - each instruction is reached with the same stack depth on every path,
+ *     never pops more values than it has and the slice ends with one value,
+ *   - every handler covers whole instructions, is reached with one value
+ *     above the depth its range starts at, and nothing in its range pops
+ *     below that depth.
+ *
+ * Handlers are followed from the start of their ranges. Newly compiled
+ * slices get the depths of their handlers filled in here; others have to
+ * match them.
+ *
+ * Operations that the interpreter doesn't implement yet raise an error when
+ * run, so nothing after them is reached through them.
+ */
+
+#define NOT_INST (-2)
+#define NOT_SEEN (-1)
+#define NO_EDGE INT32_MIN
+
+/* stack use of instruction */
+typedef struct effect {
+	int32_t need; /* values popped or read */
+	int32_t next; /* change in depth for next instruction, or NO_EDGE */
+	int32_t jump; /* change in depth at target, or NO_EDGE */
+} effect_t;
+
+/* get stack use of instruction at position */
+static em_bool_t get_effect(const uint8_t *data, size_t pos, effect_t *effect) {
+
+	em_code_op_t op = (em_code_op_t)data[pos];
+	uint16_t count;
+
+	effect->need = 0;
+	effect->next = 0;
+	effect->jump = NO_EDGE;
+
+	switch (op) {
+
+		/* pushes */
+		case EM_CODE_OP_PCINT:
+		case EM_CODE_OP_PCFLT:
+		case EM_CODE_OP_PCSTR:
+		case EM_CODE_OP_PTRUE:
+		case EM_CODE_OP_PFLSE:
+		case EM_CODE_OP_PNONE:
+		case EM_CODE_OP_LOAD:
+		case EM_CODE_OP_LADDI:
+		case EM_CODE_OP_LADDII:
+			effect->next = 1;
+			break;
+
+		/* pops */
+		case EM_CODE_OP_POP:
+		case EM_CODE_OP_STORP:
+			effect->need = 1;
+			effect->next = -1;
+			break;
+
+		/* replace top value */
+		case EM_CODE_OP_UNEG:
+		case EM_CODE_OP_UNOT:
+		case EM_CODE_OP_UBNOT:
+		case EM_CODE_OP_UINC:
+		case EM_CODE_OP_UDEC:
+		case EM_CODE_OP_LDNM:
+		case EM_CODE_OP_STOR:
+		case EM_CODE_OP_INCLUDE:
+			effect->need = 1;
+			break;
+
+		/* replace top two values */
+		case EM_CODE_OP_BADD:
+		case EM_CODE_OP_BSUB:
+		case EM_CODE_OP_BMUL:
+		case EM_CODE_OP_BDIV:
+		case EM_CODE_OP_BMOD:
+		case EM_CODE_OP_BBOR:
+		case EM_CODE_OP_BBXOR:
+		case EM_CODE_OP_BBAND:
+		case EM_CODE_OP_BBLSH:
+		case EM_CODE_OP_BBRSH:
+		case EM_CODE_OP_BEQ:
+		case EM_CODE_OP_BNEQ:
+		case EM_CODE_OP_BLT:
+		case EM_CODE_OP_BGT:
+		case EM_CODE_OP_BADDII:
+		case EM_CODE_OP_BSUBII:
+		case EM_CODE_OP_BMULII:
+		case EM_CODE_OP_BEQII:
+		case EM_CODE_OP_BNEQII:
+		case EM_CODE_OP_BLTII:
+		case EM_CODE_OP_BGTII:
+		case EM_CODE_OP_LDIDX:
+		case EM_CODE_OP_STNM:
+			effect->need = 2;
+			effect->next = -1;
+			break;
+		case EM_CODE_OP_STIDX:
+			effect->need = 3;
+			effect->next = -2;
+			break;
+
+		/* replace counted values */
+		case EM_CODE_OP_CLIST:
+		case EM_CODE_OP_CMAP:
+		case EM_CODE_OP_CALL:
+		case EM_CODE_OP_PUTS:
+			memcpy(&count, data + pos + 1, 2);
+			if (op == EM_CODE_OP_CMAP) effect->need = (int32_t)count * 2;
+			else effect->need = (int32_t)count;
+
+			/* calls need the function and prints a value to leave behind */
+			if ((op == EM_CODE_OP_CALL || op == EM_CODE_OP_PUTS) && !count)
+				return EM_FALSE;
+			effect->next = 1 - effect->need;
+			break;
+
+		/* jumps */
+		case EM_CODE_OP_JMP:
+			effect->next = NO_EDGE;
+			effect->jump = 0;
+			break;
+		case EM_CODE_OP_JTR:
+		case EM_CODE_OP_JNTR:
+			effect->need = 1;
+			effect->next = -1;
+			effect->jump = -1;
+			break;
+		case EM_CODE_OP_JPNTR:
+			effect->need = 1;
+			effect->next = -1;
+			effect->jump = 0;
+			break;
+		case EM_CODE_OP_JNLT:
+		case EM_CODE_OP_JNGT:
+		case EM_CODE_OP_JNEQ:
+		case EM_CODE_OP_JNNEQ:
+		case EM_CODE_OP_JNLTII:
+		case EM_CODE_OP_JNGTII:
+		case EM_CODE_OP_JNEQII:
+		case EM_CODE_OP_JNNEQII:
+			effect->need = 2;
+			effect->next = -2;
+			effect->jump = -2;
+			break;
+
+		/* counted loops (see interpreter) */
+		case EM_CODE_OP_FORPREP:
+			effect->need = 2;
+			effect->jump = -1;
+			break;
+		case EM_CODE_OP_FORLOOP:
+			effect->need = 3;
+			effect->next = -2;
+			effect->jump = -1;
+			break;
+
+		/* unwinding pops the value that it passes to the handler */
+		case EM_CODE_OP_RSTR2:
+		case EM_CODE_OP_RSTR3:
+			effect->need = 1;
+			effect->next = NO_EDGE;
+			break;
+		case EM_CODE_OP_TCALL:
+			memcpy(&count, data + pos + 1, 2);
+			if (!count) return EM_FALSE;
+			effect->need = (int32_t)count;
+			effect->next = NO_EDGE;
+			break;
+
+		/* no stack use */
+		case EM_CODE_OP_HTAB:
+		case EM_CODE_OP_ESETL:
+		case EM_CODE_OP_ESETC:
+		case EM_CODE_OP_ESETLC:
+			break;
+
+		/* not implemented by the interpreter */
+		default:
+			effect->next = NO_EDGE;
+			break;
+	}
+	return EM_TRUE;
+}
+
+/* get jump target of instruction */
+static em_bool_t get_target(const uint8_t *data, size_t pos, size_t size, size_t length, size_t *target) {
+
+	int32_t rel;
+	memcpy(&rel, data + pos + size - 4, 4);
+
+	int64_t end = (int64_t)(pos + size) + rel;
+	if (end < 0 || end > (int64_t)length)
+		return EM_FALSE;
+
+	*target = (size_t)end;
+	return EM_TRUE;
+}
+
+/* check that handler covers whole instructions */
+static em_bool_t check_handler(const em_code_handler_t *handler, const int32_t *depth, size_t length) {
+
+	if (handler->level != 1 && handler->level != 3)
+		return EM_FALSE;
+	if (handler->start > handler->end || handler->end > length || handler->handler >= length)
+		return EM_FALSE;
+
+	return depth[handler->start] != NOT_INST &&
+	       depth[handler->end] != NOT_INST &&
+	       depth[handler->handler] != NOT_INST;
+}
+
+/* reach position with depth, queueing it on first visit */
+static em_bool_t follow(int32_t *depth, size_t *work, size_t *nwork, int32_t *max, size_t to, int32_t nd) {
+
+	if (depth[to] == NOT_INST) return EM_FALSE;
+	if (nd > *max) *max = nd;
+
+	/* first visit */
+	if (depth[to] == NOT_SEEN) {
+
+		depth[to] = nd;
+		work[(*nwork)++] = to;
+		return EM_TRUE;
+	}
+	return depth[to] == nd;
+}
+
+/* verify slice, filling in or checking depths of handlers */
+static em_result_t verify(em_code_slice_t *slice, em_bool_t fill) {
+
+	const uint8_t *data = (const uint8_t *)slice->data;
+	size_t length = slice->length;
+
+	if (!data || !length || length > (size_t)INT32_MAX)
+		return EM_RESULT_FAILURE;
+
+	size_t nhandlers = em_code_get_handler_count(slice);
+	int32_t *depth = em_malloc(sizeof(int32_t) * (length+1));
+	size_t *work = em_malloc(sizeof(size_t) * (length+1));
+	uint8_t *starts = em_malloc(length+1);
+	em_code_handler_t *handlers = em_malloc(sizeof(em_code_handler_t) * (nhandlers? nhandlers: 1));
+	em_result_t result = EM_RESULT_FAILURE;
+	size_t nwork = 0;
+	int32_t max = 1;
+
+	if (!depth || !work || !starts || !handlers) goto done;
+
+	/* find instructions */
+	for (size_t i = 0; i <= length; i++)
+		depth[i] = NOT_INST;
+	memset(starts, 0, length+1);
+
+	for (size_t pos = 0; pos < length;) {
+
+		size_t size = em_code_get_inst_size(slice, pos);
+		if (!size) goto done;
+
+		depth[pos] = NOT_SEEN;
+		pos += size;
+	}
+	depth[length] = NOT_SEEN;
+
+	/* find handlers (unused ones are left zeroed) */
+	for (size_t i = 0; i < nhandlers; i++) {
+
+		em_code_get_handler(slice, i, &handlers[i]);
+		if (!handlers[i].level) continue;
+
+		if (!check_handler(&handlers[i], depth, length))
+			goto done;
+		starts[handlers[i].start] = 1;
+	}
+
+	/* follow every path from the start */
+	depth[0] = 0;
+	work[nwork++] = 0;
+
+	while (nwork) {
+
+		size_t pos = work[--nwork];
+		int32_t d = depth[pos];
+		if (pos == length) continue;
+
+		size_t size = em_code_get_inst_size(slice, pos);
+		effect_t effect;
+
+		if (!get_effect(data, pos, &effect) || d < effect.need)
+			goto done;
+
+		for (size_t i = 0; i < 2; i++) {
+
+			int32_t change = i? effect.jump: effect.next;
+			size_t to = pos + size;
+
+			if (change == NO_EDGE) continue;
+			if (i && !get_target(data, pos, size, length, &to))
+				goto done;
+
+			if (!follow(depth, work, &nwork, &max, to, d + change))
+				goto done;
+		}
+
+		/* handlers are entered with the unwinding value on top of the depth at their start */
+		for (size_t i = 0; starts[pos] && i < nhandlers; i++) {
+
+			em_code_handler_t *handler = &handlers[i];
+			if (!handler->level || handler->start != pos) continue;
+
+			if (d > UINT16_MAX) goto done;
+			if (fill) handler->depth = (uint16_t)d;
+			else if (handler->depth != d) goto done;
+
+			if (!follow(depth, work, &nwork, &max, handler->handler, d + 1))
+				goto done;
+		}
+	}
+
+	/* the result is popped at the end */
+	if (depth[length] != NOT_SEEN && depth[length] != 1)
+		goto done;
+
+	/* ranges are only run from their start, and unwinding never has to put values back */
+	for (size_t i = 0; i < nhandlers; i++) {
+
+		em_code_handler_t *handler = &handlers[i];
+		if (!handler->level) continue;
+
+		for (size_t pos = handler->start; pos < handler->end; pos++) {
+
+			if (depth[pos] < 0) continue;
+
+			effect_t effect;
+			if (depth[handler->start] < 0 || !get_effect(data, pos, &effect) ||
+			    depth[pos] - effect.need < (int32_t)handler->depth)
+				goto done;
+		}
+	}
+
+	if (fill) {
+
+		for (size_t i = 0; i < nhandlers; i++)
+			if (handlers[i].level) em_code_set_handler(slice, i, &handlers[i]);
+	}
+	slice->max_stack = (size_t)max;
+	result = EM_RESULT_SUCCESS;
+done:
+	em_free(depth);
+	em_free(work);
+	em_free(starts);
+	em_free(handlers);
+	return result;
+}
+
+/* verify slice */
+EM_API em_result_t em_code_verify(em_code_slice_t *slice) {
+
+	return verify(slice, EM_FALSE);
+}
+
+/* fill in depths of handlers of newly compiled slice, then verify it */
+EM_API em_result_t em_code_verify_compiled(em_code_slice_t *slice) {
+
+	return verify(slice, EM_TRUE);
+}
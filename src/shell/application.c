@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <emerald.h>
+#include <emerald/profile.h>
 #include <shell/application.h>
 
 #define SHBUFSZ 1024
@@ -26,6 +27,12 @@ enum {
 	OPT_LOG_WARNING,
 	OPT_LOG_FATAL,
 	OPT_USE_BYTECODE,
+	OPT_NO_CACHE,
+	OPT_NO_FOLD,
+	OPT_NO_JIT,
+	OPT_NO_TIER,
+	OPT_USE_REGISTERS,
+	OPT_PROFILE,
 
 	OPT_NO_EXIT_FREE,
 	OPT_NO_PRINT_ALLOCS,
@@ -37,6 +44,12 @@ enum {
 	OPT_LOG_WARNING_BIT = 0x4,
 	OPT_LOG_FATAL_BIT = 0x8,
 	OPT_USE_BYTECODE_BIT = 0x10,
+	OPT_NO_CACHE_BIT = 0x20,
+	OPT_NO_FOLD_BIT = 0x40,
+	OPT_NO_JIT_BIT = 0x80,
+	OPT_NO_TIER_BIT = 0x100,
+	OPT_USE_REGISTERS_BIT = 0x200,
+	OPT_PROFILE_BIT = 0x400,
 
 	OPT_NO_EXIT_FREE_BIT = 0x10000,
 	OPT_NO_PRINT_ALLOCS_BIT = 0x20000,
@@ -77,6 +90,30 @@ static em_result_t parse_args(int argc, const char **argv) {
 			else if (!strcmp(arg, "-b") || !strcmp(arg, "--use-bytecode"))
 				opt_flags |= OPT_USE_BYTECODE_BIT;
 
+			/* use register-based bytecode interpreter */
+			else if (!strcmp(arg, "-r") || !strcmp(arg, "--use-registers"))
+				opt_flags |= OPT_USE_REGISTERS_BIT;
+
+			/* don't load or write bytecode cache files */
+			else if (!strcmp(arg, "--no-cache"))
+				opt_flags |= OPT_NO_CACHE_BIT;
+
+			/* don't fold constants or prune dead branches */
+			else if (!strcmp(arg, "--no-fold"))
+				opt_flags |= OPT_NO_FOLD_BIT;
+
+			/* don't compile bytecode to native code */
+			else if (!strcmp(arg, "--no-jit"))
+				opt_flags |= OPT_NO_JIT_BIT;
+
+			/* don't compile hot tree-walked code to bytecode */
+			else if (!strcmp(arg, "--no-tier"))
+				opt_flags |= OPT_NO_TIER_BIT;
+
+			/* print bytecode execution profile */
+			else if (!strcmp(arg, "--profile"))
+				opt_flags |= OPT_PROFILE_BIT;
+
 			/* don't free objects after program execution */
 			else if (!strcmp(arg, "--no-exit-free"))
 				opt_flags |= OPT_NO_EXIT_FREE_BIT;
@@ -121,6 +158,12 @@ static void print_help(const char *progname) {
 	       "    -lw|--log-warning  Log warning and fatal messages\n"
 	       "    -lf|--log-fatal    Log fatal messages\n"
 	       "    -b|--use-bytecode  Use bytecode interpreter (experimental)\n"
+	       "    -r|--use-registers Use register-based bytecode interpreter (experimental)\n"
+	       "    --no-cache         Don't load or write bytecode cache (.emc) files\n"
+	       "    --no-fold          Don't fold constant expressions (for debugging)\n"
+	       "    --no-jit           Don't compile hot bytecode to native code\n"
+	       "    --no-tier          Don't compile hot functions and loops to bytecode\n"
+	       "    --profile          Print bytecode execution profile (needs --enable-profile build)\n"
 	       "\nArguments:\n"
 	       "    filename           The name of the file to run\n",
 	       progname);
@@ -157,18 +200,15 @@ static void repl(void) {
 		}
 
 		/* print value */
+		em_source_t source = {
+			.path = "<stdin>",
+			.context = &context,
+		};
 		em_pos_t pos = {
 			.path = "<stdin>",
-			.text = NULL,
-			.len = 0,
-			.index = 0,
-			.lastchsz = 0,
+			.source = &source,
 			.line = 1,
 			.column = 1,
-			.lstart = 0,
-			.lend = 0,
-			.cc = 0,
-			.context = &context,
 		};
 		if (EM_VALUE_OK(res)) em_value_print(res, &pos);
 		em_value_delete(res);
@@ -213,10 +253,29 @@ EM_API em_result_t shell_application_run(int argc, const char **argv) {
 	if (em_module_init_all(&context) != EM_RESULT_SUCCESS)
 		return EM_RESULT_FAILURE;
 
+	if (opt_flags & OPT_NO_FOLD_BIT) {
+
+		context.fold = EM_FALSE;
+		context.use_cache = EM_FALSE;
+	}
+	if (opt_flags & OPT_NO_TIER_BIT)
+		context.tier = EM_FALSE;
+
+	/* native code isn't counted, so it is disabled while profiling */
+	if (opt_flags & OPT_PROFILE_BIT) {
+#ifdef EM_PROFILE
+		context.profile = EM_TRUE;
+		context.use_jit = EM_FALSE;
+#else
+		em_log_fatal("Can't profile without profiler (build with --enable-profile)");
+		return EM_RESULT_FAILURE;
+#endif
+	}
+
 	/* interpret file or stdin */
 	if (!arg_filename) {
 
-		if (opt_flags & OPT_USE_BYTECODE_BIT) {
+		if (opt_flags & (OPT_USE_BYTECODE_BIT | OPT_USE_REGISTERS_BIT)) {
 
 			em_log_fatal("Can't use bytecode mode in interactive shell");
 			return EM_RESULT_FAILURE;
@@ -226,8 +285,20 @@ EM_API em_result_t shell_application_run(int argc, const char **argv) {
 	else {
 		if (opt_flags & OPT_USE_BYTECODE_BIT)
 			context.mode = EM_CODE_TYPE_BINARY;
+		if (opt_flags & OPT_USE_REGISTERS_BIT)
+			context.mode = EM_CODE_TYPE_REGISTER;
+		if (opt_flags & OPT_NO_CACHE_BIT)
+			context.use_cache = EM_FALSE;
+		if (opt_flags & OPT_NO_JIT_BIT)
+			context.use_jit = EM_FALSE;
 		em_value_t res = em_context_run_file(&context, NULL, arg_filename);
 
+		if (context.profile) {
+
+			em_profile_report(stderr);
+			em_profile_reset();
+		}
+
 		if (em_log_catch(&em_class_system_exit))
 			result = EM_RESULT_FROM_CODE(context.pass.value.te_inttype);
 
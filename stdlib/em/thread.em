@@ -0,0 +1,8 @@
+#
+# Copyright 2025-2026, Elliot Kohlmyer
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Thread module stub
+#
+let thread = __module_thread
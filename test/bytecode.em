@@ -6,3 +6,11 @@
 #
 let l = [0, 1, 2]
 puts let l[0] = 'Hello, world!'
+
+# int arithmetic wraps around, including in quickened operations
+let big = 4611686018427387904
+let i = 0
+while i < 3 then
+	puts big + big, big * 4, -big - big - big
+	let i = i + 1
+end
@@ -0,0 +1,29 @@
+#!/bin/sh
+#
+# Purpose: Check that a cached file is recompiled after it is edited
+#
+# Usage: test/cache-stale.sh [emerald binary]
+#
+EMERALD=$(realpath "${1:-bin/emerald}")
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+check() {
+	out=$(cd "$DIR" && "$EMERALD" -b main.em)
+	if [ "$out" != "$1" ]; then
+		echo "expected '$1', got '$out'"
+		exit 1
+	fi
+}
+
+# same size and (usually) same second, so only the contents differ
+echo "puts 'first'" > "$DIR/main.em"
+check first
+[ -f "$DIR/main.emc" ] || { echo "cache file not written"; exit 1; }
+check first
+
+echo "puts 'again'" > "$DIR/main.em"
+check again
+check again
+
+echo "passed"
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Purpose: Compare cold and warm startup time of the bytecode cache
+#
+# Usage: test/cache-timing.sh [emerald binary] [number of runs]
+#
+EMERALD=$(realpath "${1:-bin/emerald}")
+RUNS=${2:-20}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# generate a large include file so the front end dominates startup
+i=0
+while [ $i -lt 5000 ]; do
+	echo "let v$i = [$i, $i * 2 + 1, 'value $i']"
+	i=$((i+1))
+done > "$DIR/lib.em"
+printf 'include "lib.em"\nputs v4999[2]\n' > "$DIR/main.em"
+
+run() {
+	start=$(date +%s%N)
+	n=0
+	while [ $n -lt $RUNS ]; do
+		[ "$1" = cold ] && rm -f "$DIR"/*.emc
+		(cd "$DIR" && "$EMERALD" -b main.em) > /dev/null || exit 1
+		n=$((n+1))
+	done
+	end=$(date +%s%N)
+	echo "$1: $(( (end - start) / RUNS / 1000 )) us/run"
+}
+
+run cold
+run warm
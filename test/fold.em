@@ -0,0 +1,40 @@
+#!/usr/bin/env emerald
+#
+# Author: Elliot Kohlmyer
+# Date: October 18th, 2026
+# Purpose: Test constant folding (compare output with --no-fold)
+#
+let day = 60 * 60 * 24
+puts day
+puts 'ab' * 3
+puts -5 + 2, 7 / 2, 7 % 3, 1.5 * 4
+puts 1 << 4, 255 & 15, 6 ^ 3
+puts true and 0, false or 3, not true
+puts 1 < 2, 3 >= 4, 'x' == 'x'
+
+if false then
+	puts 'never'
+elif 1 == 1 then
+	puts 'taken'
+else then
+	puts 'never'
+end
+
+while false then
+	puts 'never'
+end
+
+let n = 0
+while n < 3 then
+	let n = n + 1
+end
+puts n
+
+# true and false are variables and may be redefined
+let true = 0
+if true then
+	puts 'never'
+else then
+	puts 'redefined true'
+end
+let true = 1
@@ -0,0 +1,27 @@
+#!/usr/bin/env emerald
+#
+# Author: Elliot Kohlmyer
+# Date: October 18th, 2026
+# Purpose: Test keywords against identifiers that look like them
+#
+let iff = 1
+let ends = 2
+let forx = 3
+let i = 4
+let thenelse = 5
+puts iff, ends, forx, i, thenelse
+
+# names after a dot are never keywords
+let a = {"if": 1, "end": 2, "include": 3, "continue": 4}
+puts a.if, a.end, a.include, a.continue
+
+# keywords in strings and comments stay as they are (if end then)
+puts 'if', "end", 'not continue'
+
+let n = 0
+for x = 0 to 3 then
+	if not x == 1 and x != 2 or x == 2 then
+		let n = n + x
+	end
+end
+puts n
@@ -0,0 +1,104 @@
+#!/usr/bin/env emerald
+#
+# Author: Elliot Kohlmyer
+# Date: October 18th, 2026
+# Purpose: Test peephole rewrites (compare output of -b and -r with the tree walker)
+#
+
+# loop counter (LADDI), store and pop (STORP) and compare and jump (JNLT)
+let i = 0
+let total = 0
+while i < 10 then
+	let total = total + i
+	let i = i + 1
+end
+puts i, total
+
+# other compares, with ints and other types (JNGT, JNNEQ, JNEQ)
+let n = 0
+let seen = ''
+for j = 0 to 8 then
+	if j > 5 then
+		let seen = seen + 'g'
+	end
+	if j == 3 then
+		let seen = seen + 'e'
+	end
+	if j != 4 then
+		let n = n + 2
+	end
+end
+puts n, seen
+
+let down = 5
+while down > 0 then
+	let down = down - 1
+end
+let step = 0
+while step != 4 then
+	let step = step + 1
+end
+let flag = 1
+while flag == 1 then
+	let flag = 0
+end
+puts down, step, flag
+
+# the same with floats and strings, which take the generic paths
+let f = 0.5
+while f < 3 then
+	let f = f + 1
+end
+let s = 'a'
+while s != 'aaaa' then
+	let s = s + 'a'
+end
+puts f, s
+
+# nested ifs and elif chains leave jumps to jumps behind (jump threading)
+let counts = [0, 0, 0, 0]
+for j = 0 to 20 then
+	if j % 2 == 0 then
+		if j % 4 == 0 then
+			let counts[0] = counts[0] + 1
+		else then
+			let counts[1] = counts[1] + 1
+		end
+	elif j % 3 == 0 then
+		let counts[2] = counts[2] + 1
+	else then
+		let counts[3] = counts[3] + 1
+	end
+end
+puts counts[0], counts[1], counts[2], counts[3]
+
+# loop heads, continue and break jump to the start of fused sequences, and
+# ifs without else jump between STOR and POP, so those are left unfused
+let k = 0
+let odd = 0
+while k < 20 then
+	let k = k + 1
+	if k % 2 == 0 then
+		continue
+	end
+	if k > 15 then
+		break
+	end
+	let odd = odd + k
+end
+puts k, odd
+
+let m = 0
+while m < 3 then
+	let m = m + 1
+end
+let m = m + 1
+puts m
+
+# position updates spread over several lines
+let value = [
+	1,
+	2 +
+	3,
+]
+puts value[0], value[1]
@@ -0,0 +1,25 @@
+#!/usr/bin/env emerald
+#
+# Author: Elliot Kohlmyer
+# Date: October 18th, 2026
+# Purpose: Test recursion deeper than the initial scope and value stacks
+#
+func depth(n) then
+	if n == 0 then return 0 end
+	return depth(n - 1) + 1
+end
+
+# stacks grow for the deep calls and shrink again after them
+for i = 0 to 3 then
+	puts depth(1000), depth(10)
+end
+
+func sum(items, index) then
+	if index == lengthOf(items) then return 0 end
+	return items[index] + sum(items, index + 1)
+end
+let items = []
+for i = 0 to 500 then
+	append(items, i)
+end
+puts sum(items, 0)
@@ -0,0 +1,124 @@
+#!/bin/sh
+#
+# Purpose: Compare running text with running a script compiled once
+#
+# Usage: test/script-timing.sh [library directory] [number of runs]
+#
+LIB=$(realpath "${1:-lib}")
+RUNS=${2:-20000}
+ROOT=$(dirname "$(realpath "$0")")/..
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# rule evaluated with different inputs each time
+cat > "$DIR/bench.c" <<'EOF'
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <emerald.h>
+
+static const char *rule =
+	"let score = (price * quantity + bonus) % 1000\n"
+	"if score > limit then\n"
+	"	let result = score - limit\n"
+	"else then\n"
+	"	let result = 0\n"
+	"end\n";
+
+static em_context_t context;
+
+static double now(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void check(em_value_t result) {
+
+	if (EM_VALUE_OK(result)) {
+
+		em_value_delete(result);
+		return;
+	}
+	em_log_flush();
+	exit(1);
+}
+
+static void set_inputs(em_value_t map, long i) {
+
+	em_util_set_value(map, "price", EM_VALUE_INT(i % 97));
+	em_util_set_value(map, "quantity", EM_VALUE_INT(i % 13 + 1));
+	em_util_set_value(map, "bonus", EM_VALUE_INT(i % 5));
+	em_util_set_value(map, "limit", EM_VALUE_INT(500));
+}
+
+/* lex, parse and compile on every run */
+static void run_text(long runs) {
+
+	em_value_t global = context.scopestack[0];
+	em_inttype_t sum = 0;
+	size_t len = strlen(rule);
+
+	double start = now();
+	for (long i = 0; i < runs; i++) {
+
+		set_inputs(global, i);
+		check(em_context_run_text(&context, "<rule>", rule, (em_ssize_t)len));
+		sum += em_util_get_value(global, "result").value.te_inttype;
+	}
+	double end = now();
+
+	printf("%-6s %-4s %8.0f ns/run  (%lld)\n", "text", "tree", (end - start) / runs, (long long)sum);
+}
+
+/* compile once, run with a supplied scope */
+static void run_script(long runs, em_code_type_t mode, const char *name) {
+
+	context.mode = mode;
+	em_script_t *script = em_script_new(&context, "<rule>", rule, (em_ssize_t)strlen(rule));
+	if (!script) check(EM_VALUE_FAIL);
+
+	em_value_t scope = em_map_new();
+	em_value_incref(scope);
+	em_inttype_t sum = 0;
+
+	double start = now();
+	for (long i = 0; i < runs; i++) {
+
+		set_inputs(scope, i);
+		check(em_script_run(script, &context, scope));
+		sum += em_util_get_value(scope, "result").value.te_inttype;
+	}
+	double end = now();
+
+	printf("%-6s %-4s %8.0f ns/run  (%lld)\n", "script", name, (end - start) / runs, (long long)sum);
+
+	em_value_decref(scope);
+	em_script_free(script);
+}
+
+int main(int argc, const char **argv) {
+
+	long runs = argc > 1? atol(argv[1]): 20000;
+
+	em_track_allocations = EM_FALSE;
+	if (em_init(EM_INIT_FLAG_NO_PRINT_ALLOCS) != EM_RESULT_SUCCESS ||
+	    em_context_init(&context, NULL) != EM_RESULT_SUCCESS)
+		return 1;
+
+	run_text(runs);
+	run_script(runs, EM_CODE_TYPE_TREE, "tree");
+	run_script(runs, EM_CODE_TYPE_BINARY, "-b");
+	run_script(runs, EM_CODE_TYPE_REGISTER, "-r");
+
+	em_context_destroy(&context);
+	em_quit();
+	return 0;
+}
+EOF
+
+cc -std=c99 -O2 -D_POSIX_C_SOURCE=199309L -I"$ROOT/include" "$DIR/bench.c" -o "$DIR/bench" \
+	-L"$LIB" -lemerald -lm -Wl,-rpath,"$LIB" || exit 1
+"$DIR/bench" "$RUNS"
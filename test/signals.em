@@ -0,0 +1,36 @@
+#!/usr/bin/env emerald
+#
+# Author: Elliot Kohlmyer
+# Date: October 18th, 2026
+# Purpose: Test break, continue and return crossing loops and calls
+#
+func stop() then
+	break
+end
+func skip() then
+	continue
+end
+let total = 0
+for i = 0 to 10 then
+	if i == 2 then skip() end
+	if i == 7 then stop() end
+	for j = 0 to 3 then
+		if j == 1 then continue end
+		let total = total + j
+	end
+	let total = total + i
+end
+puts total
+
+# returns leave every loop they're in
+func find(limit) then
+	let x = 0
+	while true then
+		for i = 0 to 2 then
+			let x = x + 1
+			if x == limit then return x * 2 end
+		end
+	end
+end
+puts find(6)
+
@@ -0,0 +1,55 @@
+#!/usr/bin/env emerald
+#
+# Author: Elliot Kohlmyer
+# Date: October 18th, 2026
+# Purpose: Test calls in tail position (deeper than the scope limit)
+#
+func count(n, total) then
+	if n == 0 then
+		return total
+	end
+	return count(n - 1, total + n)
+end
+puts count(100000, 0)
+
+func is_even(n) then
+	if n == 0 then return true end
+	return is_odd(n - 1)
+end
+func is_odd(n) then
+	if n == 0 then return false end
+	return is_even(n - 1)
+end
+puts is_even(50001), is_odd(50001)
+
+# calls that aren't emerald functions return normally
+func length(value) then
+	return lengthOf(value)
+end
+puts length([1, 2, 3])
+
+# calls inside of try blocks return to be caught
+func checked(n) then
+	try then
+		return fail(n)
+	catch e = Error then
+		return 'caught'
+	end
+end
+func fail(n) then
+	raise Error('failed')
+end
+puts checked(1)
+
+# arguments are checked against the function being called
+func one(a) then
+	return a
+end
+func two() then
+	return one(1, 2)
+end
+try then
+	two()
+catch e = Error then
+	puts 'wrong arguments'
+end
@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Purpose: Time the same amount of work split over more and more threads
+#
+# Usage: test/thread-timing.sh [emerald binary] [maximum number of threads]
+#
+EMERALD=$(realpath "${1:-bin/emerald}")
+MAX=${2:-$(nproc)}
+ROOT=$(dirname "$(realpath "$0")")/..
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# arithmetic-heavy share of the work
+cat > "$DIR/worker.em" <<'EOF2'
+func main(first, last) then
+	let total = 0
+	let i = first
+	while i < last then
+		let total = (total + i * 3 - (i % 7)) % 1000003
+		let i = i + 1
+	end
+	return total
+end
+EOF2
+
+# split work evenly and add up the results
+cat > "$DIR/split.em" <<'EOF2'
+include 'em/thread.em'
+
+let count = toInteger(argv[1])
+let size = 4000000 / count
+let threads = []
+for i = 0 to count then
+	append(threads, thread.spawn('worker.em', i * size, (i + 1) * size))
+end
+let total = 0
+foreach t in threads then
+	let total = total + thread.join(t)
+end
+puts total
+EOF2
+
+n=1
+while [ $n -le "$MAX" ]; do
+	start=$(date +%s%N)
+	(cd "$DIR" && EM_PATH="$ROOT/stdlib" "$EMERALD" --no-alloc-tracking split.em $n) > /dev/null || exit 1
+	end=$(date +%s%N)
+	ms=$(( (end - start) / 1000000 ))
+	[ $n -eq 1 ] && base=$ms
+	printf '%3d threads %8d ms  %5s speedup\n' $n $ms $(awk "BEGIN { printf \"%.2f\", $base / $ms }")
+	n=$(( n * 2 ))
+done
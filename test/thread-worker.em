@@ -0,0 +1,34 @@
+#!/usr/bin/env emerald
+#
+# Author: Elliot Kohlmyer
+# Date: October 18th, 2026
+# Purpose: Worker spawned by test/thread.em
+#
+include 'em/thread.em'
+
+func main(kind, a, b) then
+
+	# sum of a range
+	if kind == 'sum' then
+		let total = 0
+		for i = a to b then
+			let total = total + i
+		end
+		return total
+
+	# copy of argument
+	elif kind == 'echo' then
+		return a
+
+	# squares of jobs until channel is closed
+	elif kind == 'square' then
+		let job = thread.receive(a)
+		while job != none then
+			thread.send(b, job * job)
+			let job = thread.receive(a)
+		end
+
+	elif kind == 'fail' then
+		raise Error('Failed in worker')
+	end
+end
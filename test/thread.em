@@ -0,0 +1,65 @@
+#!/usr/bin/env emerald
+#
+# Author: Elliot Kohlmyer
+# Date: October 18th, 2026
+# Purpose: Test threads and channels in Emerald
+#
+include 'em/thread.em'
+
+# results come back when threads are joined
+let workers = []
+for i = 0 to 4 then
+	append(workers, thread.spawn('thread-worker.em', 'sum', i * 1000, (i + 1) * 1000))
+end
+let total = 0
+foreach worker in workers then
+	let total = total + thread.join(worker)
+end
+puts total
+
+# values are copied rather than shared
+let data = {'name': 'data', 'items': [1, 2.5, 'three', none]}
+let copy = thread.join(thread.spawn('thread-worker.em', 'echo', data, none))
+let copy['name'] = 'copy'
+puts data['name'], copy['name'], copy['items'][1], copy['items'][2]
+
+# jobs are shared out over one channel and results gathered on another
+let jobs = thread.Channel(4)
+let results = thread.Channel()
+let workers = []
+for i = 0 to 3 then
+	append(workers, thread.spawn('thread-worker.em', 'square', jobs, results))
+end
+for i = 1 to 11 then
+	thread.send(jobs, i)
+end
+thread.close(jobs)
+let sum = 0
+for i = 1 to 11 then
+	let sum = sum + thread.receive(results)
+end
+foreach worker in workers then
+	thread.join(worker)
+end
+puts sum
+
+# errors in a thread are raised again when it is joined
+try then
+	thread.join(thread.spawn('thread-worker.em', 'fail', none, none))
+catch e = Error then
+	puts 'caught'
+end
+
+# channels may be sent through each other and through themselves, and are
+# freed once only their own queues refer to them
+let a = thread.Channel()
+let b = thread.Channel()
+thread.send(a, a)
+thread.send(a, b)
+thread.send(b, a)
+thread.send(b, 'queued')
+let c = thread.receive(a)
+thread.receive(thread.receive(c))
+puts thread.receive(b)
+thread.send(b, a)
+thread.send(a, b)
@@ -0,0 +1,135 @@
+#!/bin/sh
+#
+# Purpose: Run a separate context on each of several threads at once
+#
+# Usage: test/threads-stress.sh [library directory] [number of threads]
+#
+LIB=$(realpath "${1:-lib}")
+THREADS=${2:-8}
+ROOT=$(dirname "$(realpath "$0")")/..
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+cat > "$DIR/stress.c" <<'EOF'
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <emerald.h>
+
+#define RUNS 50
+
+/* recursion, strings, lists, maps, classes and errors */
+static const char *text =
+	"class Counter then\n"
+	"	func _initialize(this, start) then\n"
+	"		let this.count = start\n"
+	"	end\n"
+	"	func add(this, n) then\n"
+	"		let this.count = this.count + n\n"
+	"	end\n"
+	"end\n"
+	"func fib(n) then\n"
+	"	if n < 2 then return n end\n"
+	"	return fib(n - 1) + fib(n - 2)\n"
+	"end\n"
+	"let counter = Counter(seed)\n"
+	"let items = []\n"
+	"let names = {}\n"
+	"for i = 0 to 200 then\n"
+	"	append(items, i * seed)\n"
+	"	let names['n' + toString(i)] = i\n"
+	"	counter.add(i)\n"
+	"end\n"
+	"let caught = 0\n"
+	"foreach item in items then\n"
+	"	try then\n"
+	"		if item % 7 == 0 then raise Error('seven') end\n"
+	"	catch e = Error then\n"
+	"		let caught = caught + 1\n"
+	"	end\n"
+	"end\n"
+	"let result = fib(15) + counter.count + names['n199'] + caught\n";
+
+static em_inttype_t expected(em_inttype_t seed) {
+
+	em_inttype_t count = seed, caught = 0;
+	for (em_inttype_t i = 0; i < 200; i++) {
+
+		count += i;
+		if ((i * seed) % 7 == 0) caught++;
+	}
+	return 610 + count + 199 + caught;
+}
+
+static void *run(void *arg) {
+
+	em_inttype_t seed = (em_inttype_t)(size_t)arg;
+	em_context_t context = {0};
+	long failed = 0;
+
+	if (em_thread_init() != EM_RESULT_SUCCESS ||
+	    em_context_init(&context, NULL) != EM_RESULT_SUCCESS ||
+	    em_module_init_all(&context) != EM_RESULT_SUCCESS)
+		return (void *)1;
+
+	em_script_t *script = em_script_new(&context, "<stress>", text, (em_ssize_t)strlen(text));
+	if (!script) failed++;
+
+	for (int i = 0; script && i < RUNS; i++) {
+
+		em_value_t scope = em_map_new();
+		em_value_incref(scope);
+		em_util_set_value(scope, "seed", EM_VALUE_INT(seed));
+
+		em_value_t value = em_script_run(script, &context, scope);
+		if (!EM_VALUE_OK(value)) {
+
+			em_log_flush();
+			failed++;
+		}
+		else if (em_util_get_value(scope, "result").value.te_inttype != expected(seed))
+			failed++;
+
+		em_value_decref(scope);
+	}
+
+	em_script_free(script);
+	em_module_destroy_all(&context);
+	em_context_destroy(&context);
+	em_thread_quit();
+	return (void *)failed;
+}
+
+int main(int argc, const char **argv) {
+
+	int nthreads = argc > 1? atoi(argv[1]): 8;
+	pthread_t *threads = malloc(sizeof(pthread_t) * (size_t)nthreads);
+	if (!threads) return 1;
+
+	em_track_allocations = EM_FALSE;
+	if (em_init(EM_INIT_FLAG_NO_PRINT_ALLOCS) != EM_RESULT_SUCCESS)
+		return 1;
+
+	for (int i = 0; i < nthreads; i++)
+		pthread_create(&threads[i], NULL, run, (void *)(size_t)(i + 1));
+
+	long failed = 0;
+	for (int i = 0; i < nthreads; i++) {
+
+		void *result;
+		pthread_join(threads[i], &result);
+		failed += (long)result;
+	}
+
+	em_quit();
+	free(threads);
+
+	printf("%d threads, %d runs each, %ld failed\n", nthreads, RUNS, failed);
+	return failed != 0;
+}
+EOF
+
+cc -std=c99 -O2 -D_POSIX_C_SOURCE=199309L -I"$ROOT/include" "$DIR/stress.c" -o "$DIR/stress" \
+	-L"$LIB" -lemerald -lm -lpthread -Wl,-rpath,"$LIB" || exit 1
+"$DIR/stress" "$THREADS"
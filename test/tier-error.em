@@ -0,0 +1,15 @@
+#!/usr/bin/env emerald
+#
+# Author: Elliot Kohlmyer
+# Date: October 18th, 2026
+# Purpose: Test that errors in promoted code show the source line (compare output with --no-tier)
+#
+func check(n) then
+	if n > 1200 then
+		return n + 'calls'
+	end
+	return n
+end
+for i = 0 to 1300 then
+	check(i)
+end
@@ -0,0 +1,49 @@
+#!/usr/bin/env emerald
+#
+# Author: Elliot Kohlmyer
+# Date: October 18th, 2026
+# Purpose: Test hot functions and loops switching to bytecode (compare output with --no-tier)
+#
+func collatz(n) then
+	let steps = 0
+	while n != 1 then
+		if n % 2 == 0 then
+			let n = n / 2
+		else then
+			let n = n * 3 + 1
+		end
+		let steps = steps + 1
+	end
+	return steps
+end
+
+func longest(limit) then
+	let best = 0
+	let arg = 0
+	for i = 1 to limit then
+		let steps = collatz(i)
+		if steps > best then
+			let best = steps
+			let arg = i
+		end
+	end
+	return {'n': arg, 'steps': best}
+end
+
+let result = longest(3000)
+puts result['n'], result['steps']
+
+# loop switches over at its header #
+let total = 0
+let i = 0
+while i < 5000 then
+	let i = i + 1
+	if i % 7 == 0 then
+		continue
+	end
+	if i > 4500 then
+		break
+	end
+	let total = total + i
+end
+puts total, i
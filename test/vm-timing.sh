@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Purpose: Compare the tree-walker, stack bytecode and register bytecode
+#
+# Usage: test/vm-timing.sh [emerald binary]
+#
+EMERALD=$(realpath "${1:-bin/emerald}")
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# arithmetic-heavy kernel
+cat > "$DIR/arith.em" <<'EOF'
+let total = 0
+let i = 0
+while i < 2000000 then
+	let total = (total + i * 3 - (i % 7)) % 1000003
+	let i = i + 1
+end
+puts total
+EOF
+
+# member-access-heavy kernel
+cat > "$DIR/member.em" <<'EOF'
+let point = {'x': 0, 'y': 0}
+let items = [1, 2, 3, 4, 5, 6, 7, 8]
+for i = 0 to 500000 then
+	let point['x'] = point['x'] + items[i % 8]
+	let point['y'] = point['y'] + point['x'] % 3
+end
+puts point['x'], point['y']
+EOF
+
+run() {
+	start=$(date +%s%N)
+	(cd "$DIR" && "$EMERALD" $2 --no-cache "$1") > /dev/null || exit 1
+	end=$(date +%s%N)
+	printf '%-10s %-4s %8d ms\n' "$1" "${2:-tree}" $(( (end - start) / 1000000 ))
+}
+
+for kernel in arith.em member.em; do
+	run $kernel
+	run $kernel -b
+	run $kernel -r
+done
+
+# test scripts that the stack interpreter can run
+for mode in "" -b -r; do
+	start=$(date +%s%N)
+	for f in bytecode fold variable-timing; do
+		"$EMERALD" $mode --no-cache "test/$f.em" > /dev/null || exit 1
+	done
+	end=$(date +%s%N)
+	printf '%-10s %-4s %8d ms\n' suite "${mode:-tree}" $(( (end - start) / 1000000 ))
+done